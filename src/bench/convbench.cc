@@ -0,0 +1,218 @@
+/*
+ *	PearPC
+ *	convbench.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ *	Pixel conversion benchmark (ppc-bench-convert).
+ *
+ *	Runs every kernel of system/pixconv.cc the host supports
+ *	on a full frame of random guest pixels and reports frames
+ *	per second and the speedup over the scalar kernel. Before
+ *	that, the output of each kernel is compared to the scalar
+ *	one, including a line length which leaves a tail. The
+ *	palette lookups of the 8 bit indexed modes come last.
+ */
+
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "tools/snprintf.h"
+#include "system/pixconv.h"
+#include "system/sysclk.h"
+
+static int gWidth = 1920;
+static int gHeight = 1200;
+static double gSeconds = 1.0;
+
+static const int gSrcBpp[PIXCONV_SRC_FORMATS] = {2, 4};
+static const int gDestBpp[PIXCONV_DEST_FORMATS] = {2, 2, 3, 4};
+static uint32 gLUT[256];
+
+// either a line or a palette lookup kernel
+struct BenchKernel {
+	PixConvLine line;
+	PixConvLUTLine lut;
+
+	BenchKernel(PixConvLine l): line(l), lut(NULL) {}
+	BenchKernel(PixConvLUTLine l): line(NULL), lut(l) {}
+
+	bool operator ==(const BenchKernel &k) const
+	{
+		return line == k.line && lut == k.lut;
+	}
+
+	void operator ()(uint32 pixel, const byte *src, byte *dest) const
+	{
+		if (line) {
+			line(pixel, src, dest);
+		} else {
+			lut(pixel, src, dest, gLUT);
+		}
+	}
+};
+
+static bool benchVerify(const BenchKernel &k, const BenchKernel &ref, int sbpp, int dbpp,
+	const byte *src, byte *out, byte *refOut)
+{
+	// the odd count leaves work for every tail
+	uint32 pixel[2] = {(uint32)gWidth * gHeight, (uint32)gWidth - 3};
+	for (int i=0; i<2; i++) {
+		memset(out, 0xaa, gWidth * gHeight * dbpp + 64);
+		memset(refOut, 0xaa, gWidth * gHeight * dbpp + 64);
+		k(pixel[i], src + sbpp, out + dbpp);
+		ref(pixel[i], src + sbpp, refOut + dbpp);
+		if (memcmp(out, refOut, gWidth * gHeight * dbpp + 64) != 0) return false;
+	}
+	return true;
+}
+
+static double benchRun(const BenchKernel &k, const byte *src, byte *dest)
+{
+	uint32 pixel = gWidth * gHeight;
+	uint64 freq = sys_get_hiresclk_ticks_per_second();
+	uint64 limit = (uint64)(gSeconds * freq);
+	uint64 start = sys_get_hiresclk_ticks();
+	uint64 elapsed;
+	int frames = 0;
+	do {
+		k(pixel, src, dest);
+		frames++;
+		elapsed = sys_get_hiresclk_ticks() - start;
+	} while (elapsed < limit);
+	return frames * (double)freq / elapsed;
+}
+
+static void benchReport(const char *from, const char *to, const char *name, double fps, double base)
+{
+	char f[20], mp[20], sp[20];
+	ht_snprintf(f, sizeof f, "%.1f", fps);
+	ht_snprintf(mp, sizeof mp, "%.0f", fps * gWidth * gHeight / 1e6);
+	ht_snprintf(sp, sizeof sp, "%.2fx", fps / base);
+	ht_printf("%-8s %-8s %-8s %10s %10s %8s\n", from, to, name, f, mp, sp);
+}
+
+static void usage()
+{
+	ht_printf("usage: ppc-bench-convert [-t seconds] [-s width height]\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	setvbuf(stdout, 0, _IONBF, 0);
+
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-t") == 0) {
+			if (++i == argc) usage();
+			gSeconds = atof(argv[i]);
+			if (gSeconds <= 0) usage();
+		} else if (strcmp(argv[i], "-s") == 0) {
+			if (i+2 >= argc) usage();
+			gWidth = atoi(argv[++i]);
+			gHeight = atoi(argv[++i]);
+			if (gWidth < 8 || gHeight < 1) usage();
+		} else {
+			usage();
+		}
+	}
+
+	PixConvLevel host = pixconv_host_level();
+	ht_printf("%dx%d, host level: %s\n\n", gWidth, gHeight, pixconv_level_name(host));
+	ht_printf("%-8s %-8s %-8s %10s %10s %8s\n", "from", "to", "kernel", "frames/s", "Mpixel/s", "speedup");
+
+	uint32 size = gWidth * gHeight * 4 + 64;
+	byte *src = (byte*)malloc(size);
+	byte *dest = (byte*)malloc(size);
+	byte *refDest = (byte*)malloc(size);
+	if (!src || !dest || !refDest) {
+		ht_printf("out of memory.\n");
+		return 1;
+	}
+	srand(0x1234);
+	for (uint32 i=0; i < size; i++) src[i] = rand();
+
+	int failed = 0;
+	for (int s=0; s < PIXCONV_SRC_FORMATS; s++) {
+		for (int d=0; d < PIXCONV_DEST_FORMATS; d++) {
+			BenchKernel ref = pixconv_get_kernel(PIXCONV_SCALAR, (PixConvSrcFormat)s, (PixConvDestFormat)d);
+			double base = 0;
+			for (int l=PIXCONV_SCALAR; l <= host; l++) {
+				BenchKernel k = pixconv_get_kernel((PixConvLevel)l, (PixConvSrcFormat)s, (PixConvDestFormat)d);
+				// levels without an own kernel use the one below
+				if (l > PIXCONV_SCALAR && k == BenchKernel(pixconv_get_kernel((PixConvLevel)(l-1), (PixConvSrcFormat)s, (PixConvDestFormat)d))) continue;
+				const char *from = pixconv_src_name((PixConvSrcFormat)s);
+				const char *to = pixconv_dest_name((PixConvDestFormat)d);
+				const char *name = pixconv_level_name((PixConvLevel)l);
+				if (!benchVerify(k, ref, gSrcBpp[s], gDestBpp[d], src, dest, refDest)) {
+					ht_printf("%-8s %-8s %-8s MISMATCH\n", from, to, name);
+					failed++;
+					continue;
+				}
+				double fps = benchRun(k, src, dest);
+				if (l == PIXCONV_SCALAR) base = fps;
+				benchReport(from, to, name, fps, base);
+			}
+		}
+	}
+
+	// a random palette, as pixels of the usual host formats
+	RGB palette[256];
+	for (int i=0; i < 256; i++) palette[i] = MK_RGB(rand() & 0xff, rand() & 0xff, rand() & 0xff);
+	static const char *lutNames[5] = {NULL, "332", "565", "888/24", "888/32"};
+	static const int lutFormats[5][6] = {
+		{0, 0, 0, 0, 0, 0},
+		{5, 3, 2, 3, 0, 2},
+		{11, 5, 5, 6, 0, 5},
+		{16, 8, 8, 8, 0, 8},
+		{16, 8, 8, 8, 0, 8},
+	};
+	for (int b=1; b <= 4; b++) {
+		DisplayCharacteristics dc;
+		dc.bytesPerPixel = b;
+		dc.redShift = lutFormats[b][0];
+		dc.redSize = lutFormats[b][1];
+		dc.greenShift = lutFormats[b][2];
+		dc.greenSize = lutFormats[b][3];
+		dc.blueShift = lutFormats[b][4];
+		dc.blueSize = lutFormats[b][5];
+		pixconv_build_lut(dc, palette, gLUT);
+		BenchKernel ref = pixconv_get_lut_kernel(PIXCONV_SCALAR, b);
+		double base = 0;
+		for (int l=PIXCONV_SCALAR; l <= host; l++) {
+			BenchKernel k = pixconv_get_lut_kernel((PixConvLevel)l, b);
+			if (l > PIXCONV_SCALAR && k == BenchKernel(pixconv_get_lut_kernel((PixConvLevel)(l-1), b))) continue;
+			const char *name = pixconv_level_name((PixConvLevel)l);
+			if (!benchVerify(k, ref, 1, b, src, dest, refDest)) {
+				ht_printf("%-8s %-8s %-8s MISMATCH\n", "8 idx", lutNames[b], name);
+				failed++;
+				continue;
+			}
+			double fps = benchRun(k, src, dest);
+			if (l == PIXCONV_SCALAR) base = fps;
+			benchReport("8 idx", lutNames[b], name, fps, base);
+		}
+	}
+	free(src);
+	free(dest);
+	free(refDest);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,513 @@
+/*
+ *	PearPC
+ *	cpubench.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ *	Headless cpu benchmark, linked against one of the cpu cores
+ *	(ppc-bench-jitc, ppc-bench-generic).
+ *
+ *	Every kernel is a small endless loop which is written directly
+ *	into guest RAM and run for a fixed time, no firmware and no
+ *	devices involved. Each iteration increments r31 and executes a
+ *	known number of guest instructions, which gives guest MIPS and
+ *	host cycles per guest instruction. Time spent translating guest
+ *	code is reported separately.
+ */
+
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "cpu/cpu.h"
+#include "cpu/common.h"
+#include "cpu/mem.h"
+#include "tools/atom.h"
+#include "tools/data.h"
+#include "tools/except.h"
+#include "tools/snprintf.h"
+#include "system/arch/sysendian.h"
+#include "system/sys.h"
+#include "system/sysclk.h"
+#include "system/systimer.h"
+#include "configparser.h"
+
+#define BENCH_MEMORY_SIZE	(64*1024*1024)
+
+#define BENCH_TRAMPOLINE	0x00003000
+#define BENCH_CODE		0x00100000	// one 64k slot per kernel
+#define BENCH_DATA		0x00200000
+#define BENCH_PAGE_TABLE	0x00300000
+#define BENCH_PAGE_TABLE_SIZE	(256*1024)
+#define BENCH_STREAM		0x00400000	// 1 MiB
+#define BENCH_TLB_EA		0x10000000
+#define BENCH_TLB_PA		0x00800000
+#define BENCH_TLB_PAGES		1024
+#define BENCH_TLB_VSID		0x123
+
+#define BENCH_MAX_CODE		64
+
+/*
+ *	Host cycle counter, compatible to the one the jitc uses
+ *	for its translation time.
+ */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#	define HAVE_BENCH_CYCLES
+static inline uint64 benchGetCycles()
+{
+	uint32 lo, hi;
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64)hi << 32) | lo;
+}
+#else
+static inline uint64 benchGetCycles()
+{
+	return 0;
+}
+#endif
+
+/*
+ *	Instruction encoding
+ */
+static uint32 opD(int op, int d, int a, int imm)
+{
+	return (op<<26) | (d<<21) | (a<<16) | (imm & 0xffff);
+}
+
+static uint32 opX(int op, int d, int a, int b, int xo)
+{
+	return (op<<26) | (d<<21) | (a<<16) | (b<<11) | (xo<<1);
+}
+
+static uint32 opA(int op, int d, int a, int b, int c, int xo)
+{
+	return (op<<26) | (d<<21) | (a<<16) | (b<<11) | (c<<6) | (xo<<1);
+}
+
+static uint32 opVX(int d, int a, int b, int xo)
+{
+	return (4<<26) | (d<<21) | (a<<16) | (b<<11) | xo;
+}
+
+static uint32 opSPR(int xo, int r, int spr)
+{
+	return (31<<26) | (r<<21) | ((spr & 0x1f)<<16) | ((spr>>5)<<11) | (xo<<1);
+}
+
+#define ADDI(d, a, i)		opD(14, d, a, i)
+#define ADDIS(d, a, i)		opD(15, d, a, i)
+#define ORI(a, s, i)		opD(24, s, a, i)
+#define ANDI_(a, s, i)		opD(28, s, a, i)
+#define LWZ(d, o, a)		opD(32, d, a, o)
+#define STW(s, o, a)		opD(36, s, a, o)
+#define LFD(d, o, a)		opD(50, d, a, o)
+#define ADD(d, a, b)		opX(31, d, a, b, 266)
+#define SUBF(d, a, b)		opX(31, d, a, b, 40)
+#define XOR(a, s, b)		opX(31, s, a, b, 316)
+#define AND(a, s, b)		opX(31, s, a, b, 28)
+#define LVX(d, a, b)		opX(31, d, a, b, 103)
+#define TRAP			opX(31, 31, 0, 0, 4)
+#define RLWINM(a, s, sh, mb, me) ((21<<26) | ((s)<<21) | ((a)<<16) | ((sh)<<11) | ((mb)<<6) | ((me)<<1))
+#define MFSPR(d, spr)		opSPR(339, d, spr)
+#define MTSPR(spr, s)		opSPR(467, s, spr)
+#define MTSR(sr, s)		opX(31, s, sr, 0, 210)
+#define FMADD(d, a, c, b)	opA(63, d, a, b, c, 29)
+#define FMUL(d, a, c)		opA(63, d, a, 0, c, 25)
+#define FADD(d, a, b)		opA(63, d, a, b, 0, 21)
+#define VADDFP(d, a, b)		opVX(d, a, b, 10)
+#define VAND(d, a, b)		opVX(d, a, b, 1028)
+#define VMADDFP(d, a, c, b)	((4<<26) | ((d)<<21) | ((a)<<16) | ((b)<<11) | ((c)<<6) | 46)
+#define SC			0x44000002
+#define RFI			0x4c000064
+
+#define SPR_SDR1	25
+#define SPR_SRR0	26
+#define SPR_SRR1	27
+
+class BenchCode {
+public:
+	uint32	code[BENCH_MAX_CODE];
+	int	n;
+
+	BenchCode(): n(0) {}
+
+	int here()
+	{
+		return n;
+	}
+
+	void emit(uint32 opc)
+	{
+		if (n == BENCH_MAX_CODE) throw MsgException("benchmark kernel too large");
+		code[n++] = opc;
+	}
+
+	// b to instruction index
+	void b(int target)
+	{
+		emit((18<<26) | (((target - n) * 4) & 0x03fffffc));
+	}
+
+	// beq cr0 to instruction index
+	void beq(int target)
+	{
+		emit((16<<26) | (12<<21) | (2<<16) | (((target - n) * 4) & 0xfffc));
+	}
+
+	void loop(int head)
+	{
+		emit(ADDI(31, 31, 1));
+		b(head);
+	}
+
+	void write(uint32 pa) const
+	{
+		uint32 buf[BENCH_MAX_CODE];
+		for (int i=0; i<n; i++) buf[i] = ppc_word_to_BE(code[i]);
+		ppc_dma_write(pa, buf, n*4);
+	}
+};
+
+/*
+ *	Kernels. r31 counts iterations, r20/r21 belong to the trampoline.
+ */
+static void kernelInt(BenchCode &c)
+{
+	int l = c.here();
+	c.emit(ADDI(3, 3, 1));
+	c.emit(ADD(4, 4, 3));
+	c.emit(XOR(5, 5, 4));
+	c.emit(RLWINM(6, 5, 3, 0, 28));
+	c.emit(SUBF(7, 6, 4));
+	c.loop(l);
+}
+
+static void kernelBranch(BenchCode &c)
+{
+	int l = c.here();
+	c.emit(ANDI_(4, 3, 1));
+	c.beq(c.here()+2);
+	c.emit(ADDI(5, 5, 1));
+	c.emit(ANDI_(4, 3, 2));
+	c.beq(c.here()+2);
+	c.emit(ADDI(6, 6, 1));
+	c.emit(ADDI(3, 3, 1));
+	c.loop(l);
+}
+
+static void kernelStream(BenchCode &c)
+{
+	c.emit(ADDIS(3, 0, BENCH_STREAM >> 16));
+	c.emit(ADDIS(30, 0, (BENCH_STREAM + 0xfffff) >> 16));
+	c.emit(ORI(30, 30, 0xfffc));
+	int l = c.here();
+	c.emit(LWZ(4, 0, 3));
+	c.emit(ADDI(4, 4, 1));
+	c.emit(STW(4, 0, 3));
+	c.emit(ADDI(3, 3, 4));
+	c.emit(AND(3, 3, 30));
+	c.loop(l);
+}
+
+static void kernelFPU(BenchCode &c)
+{
+	c.emit(ADDIS(29, 0, BENCH_DATA >> 16));
+	c.emit(LFD(1, 0, 29));
+	c.emit(LFD(2, 8, 29));
+	c.emit(LFD(3, 16, 29));
+	int l = c.here();
+	c.emit(FMADD(1, 1, 2, 3));	// converges to 2.0
+	c.emit(FMUL(4, 1, 2));
+	c.emit(FADD(5, 4, 3));
+	c.loop(l);
+}
+
+static void kernelAltiVec(BenchCode &c)
+{
+	c.emit(ADDIS(29, 0, BENCH_DATA >> 16));
+	c.emit(ADDI(28, 0, 32));
+	c.emit(LVX(1, 29, 28));
+	c.emit(LVX(3, 29, 28));
+	c.emit(ADDI(28, 0, 48));
+	c.emit(LVX(2, 29, 28));
+	int l = c.here();
+	c.emit(VMADDFP(3, 3, 1, 2));	// converges to 1.0
+	c.emit(VADDFP(4, 3, 2));
+	c.emit(VAND(5, 4, 3));
+	c.loop(l);
+}
+
+static void kernelSyscall(BenchCode &c)
+{
+	int l = c.here();
+	c.emit(SC);
+	c.loop(l);
+}
+
+static void kernelTrap(BenchCode &c)
+{
+	int l = c.here();
+	c.emit(TRAP);
+	c.loop(l);
+}
+
+static void kernelTLB(BenchCode &c)
+{
+	c.emit(ADDIS(3, 0, BENCH_TLB_EA >> 16));
+	c.emit(ADDIS(30, 0, (BENCH_TLB_EA + (BENCH_TLB_PAGES-1)*4096) >> 16));
+	c.emit(ORI(30, 30, ((BENCH_TLB_PAGES-1)*4096) & 0xf000));
+	int l = c.here();
+	c.emit(LWZ(4, 0, 3));
+	c.emit(ADDI(3, 3, 4096));
+	c.emit(AND(3, 3, 30));
+	c.loop(l);
+}
+
+struct BenchKernel {
+	const char *name;
+	const char *desc;
+	uint32 msr;
+	int insns;		// guest instructions per iteration (incl. handlers)
+	void (*build)(BenchCode &c);
+};
+
+static const BenchKernel gKernels[] = {
+	{"int",		"integer alu",			0,		7, kernelInt},
+	{"branch",	"conditional branches",		0,		8, kernelBranch},
+	{"stream",	"load/store stream, 1 MiB",	0,		7, kernelStream},
+	{"fpu",		"fmadd/fmul/fadd",		MSR_FP,		5, kernelFPU},
+	{"altivec",	"vmaddfp/vaddfp/vand",		MSR_VEC,	5, kernelAltiVec},
+	{"syscall",	"sc/rfi round trip",		0,		4, kernelSyscall},
+	{"trap",	"program exception round trip",	0,		7, kernelTrap},
+	{"tlb",		"page per load, 1024 pages",	MSR_DR,		5, kernelTLB},
+};
+
+#define BENCH_KERNELS	(sizeof gKernels / sizeof gKernels[0])
+
+static void writeWord(uint32 pa, uint32 w)
+{
+	w = ppc_word_to_BE(w);
+	ppc_dma_write(pa, &w, 4);
+}
+
+static uint32 readWord(uint32 pa)
+{
+	uint32 w;
+	ppc_dma_read(&w, pa, 4);
+	return ppc_word_from_BE(w);
+}
+
+/*
+ *	Enters a page into the hashed page table like a guest
+ *	kernel would, the segment register of ea has to hold
+ *	BENCH_TLB_VSID.
+ */
+static void benchMapPage(uint32 ea, uint32 pa)
+{
+	uint32 page_index = (ea >> 12) & 0xffff;
+	uint32 hash = BENCH_TLB_VSID ^ page_index;
+	uint32 hashmask = (BENCH_PAGE_TABLE_SIZE >> 6) - 1;
+	for (uint32 h=0; h<2; h++) {
+		uint32 pteg = BENCH_PAGE_TABLE | ((hash & hashmask) << 6);
+		for (int i=0; i<8; i++, pteg += 8) {
+			if (readWord(pteg) & 0x80000000) continue;
+			// V | VSID | H | API, then RPN with pp = 0
+			writeWord(pteg, 0x80000000 | (BENCH_TLB_VSID << 7) | (h << 6) | (page_index >> 10));
+			writeWord(pteg + 4, pa & 0xfffff000);
+			return;
+		}
+		hash = ~hash;
+	}
+	throw MsgException("can't create page table entries");
+}
+
+static void benchSetupMachine()
+{
+	ppc_dma_set(0, 0, BENCH_TLB_PA);
+
+	// unexpected exceptions spin in their vector (b .)
+	for (uint32 v = 0x100; v < 0x3000; v += 0x100) writeWord(v, 0x48000000);
+
+	BenchCode sc;
+	sc.emit(RFI);
+	sc.write(0xc00);
+
+	BenchCode program;
+	program.emit(MFSPR(10, SPR_SRR0));
+	program.emit(ADDI(10, 10, 4));
+	program.emit(MTSPR(SPR_SRR0, 10));
+	program.emit(RFI);
+	program.write(0x700);
+
+	// enters a kernel (r20) with its msr (r21), the tlb kernel needs the page table
+	BenchCode tramp;
+	tramp.emit(ADDIS(22, 0, BENCH_PAGE_TABLE >> 16));
+	tramp.emit(ORI(22, 22, (BENCH_PAGE_TABLE_SIZE >> 16) - 1));
+	tramp.emit(MTSPR(SPR_SDR1, 22));
+	tramp.emit(ADDI(22, 0, BENCH_TLB_VSID));
+	tramp.emit(MTSR(BENCH_TLB_EA >> 28, 22));
+	tramp.emit(MTSPR(SPR_SRR0, 20));
+	tramp.emit(MTSPR(SPR_SRR1, 21));
+	tramp.emit(RFI);
+	tramp.write(BENCH_TRAMPOLINE);
+
+	uint64 d[3];
+	double v[3] = {1.0, 0.5, 1.0};
+	memcpy(d, v, sizeof d);
+	for (int i=0; i<3; i++) d[i] = ppc_dword_to_BE(d[i]);
+	ppc_dma_write(BENCH_DATA, d, sizeof d);
+	for (int i=0; i<8; i++) writeWord(BENCH_DATA + 32 + i*4, 0x3f000000);	// 0.5f
+
+	for (int i=0; i<(int)BENCH_KERNELS; i++) {
+		BenchCode c;
+		gKernels[i].build(c);
+		c.write(BENCH_CODE + i*0x10000);
+	}
+
+	// 256 Kbytes Pagetable, only used by the tlb kernel
+	ppc_dma_set(BENCH_PAGE_TABLE, 0, BENCH_PAGE_TABLE_SIZE);
+	for (uint32 i=0; i<BENCH_TLB_PAGES; i++) {
+		benchMapPage(BENCH_TLB_EA + i*4096, BENCH_TLB_PA + i*4096);
+	}
+}
+
+static void benchTimeout(sys_timer t)
+{
+	ppc_cpu_stop();
+}
+
+static void benchRun(int k, sys_timer timer, int seconds)
+{
+	const BenchKernel &bk = gKernels[k];
+	for (int i=0; i<32; i++) ppc_cpu_set_gpr(0, i, 0);
+	ppc_cpu_set_gpr(0, 20, BENCH_CODE + k*0x10000);
+	ppc_cpu_set_gpr(0, 21, bk.msr);
+	ppc_cpu_set_msr(0, 0);
+	ppc_cpu_set_pc(0, BENCH_TRAMPOLINE);
+
+	uint64 trans = ppc_cpu_get_translation_cycles();
+	uint64 clk = sys_get_hiresclk_ticks();
+	uint64 cycles = benchGetCycles();
+	sys_set_timer(timer, seconds, 0, false);
+	ppc_cpu_run();
+	cycles = benchGetCycles() - cycles;
+	clk = sys_get_hiresclk_ticks() - clk;
+	trans = ppc_cpu_get_translation_cycles() - trans;
+
+	uint32 pc = ppc_cpu_get_pc(0);
+	uint32 opc = 0;
+	ppc_dma_read(&opc, pc, 4);
+	if (pc < BENCH_TRAMPOLINE && ppc_word_from_BE(opc) == 0x48000000) {
+		ht_printf("%-8s  unexpected exception %04x\n", bk.name, pc & ~0xff);
+		return;
+	}
+
+	double secs = (double)clk / sys_get_hiresclk_ticks_per_second();
+	double insns = (double)ppc_cpu_get_gpr(0, 31) * bk.insns;
+	if (insns == 0 || secs == 0) {
+		ht_printf("%-8s  no progress\n", bk.name);
+		return;
+	}
+	char mips[20], cpi[20], ms[20];
+	ht_snprintf(mips, sizeof mips, "%.1f", insns / secs / 1e6);
+#ifdef HAVE_BENCH_CYCLES
+	ht_snprintf(cpi, sizeof cpi, "%.2f", cycles / insns);
+	ht_snprintf(ms, sizeof ms, "%.2f", trans * secs * 1000.0 / cycles);
+#else
+	strcpy(cpi, "-");
+	strcpy(ms, "-");
+#endif
+	ht_printf("%-8s  %10s  %12s  %10s  %s\n", bk.name, mips, cpi, ms, bk.desc);
+}
+
+static void usage()
+{
+	ht_printf("usage: ppc-bench [-t seconds] [kernel...]\n");
+	ht_printf("kernels:");
+	for (int i=0; i<(int)BENCH_KERNELS; i++) ht_printf(" %s", gKernels[i].name);
+	ht_printf("\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	setvbuf(stdout, 0, _IONBF, 0);
+
+	int seconds = 2;
+	bool selected[BENCH_KERNELS];
+	bool any = false;
+	memset(selected, 0, sizeof selected);
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-t") == 0) {
+			if (++i == argc) usage();
+			seconds = atoi(argv[i]);
+			if (seconds < 1) usage();
+			continue;
+		}
+		int k;
+		for (k=0; k<(int)BENCH_KERNELS; k++) {
+			if (strcmp(argv[i], gKernels[k].name) == 0) break;
+		}
+		if (k == (int)BENCH_KERNELS) usage();
+		selected[k] = any = true;
+	}
+
+#if defined(WIN32) || defined(__WIN32__)
+#else
+	ht_snprintf(gAppFilename, sizeof gAppFilename, "%s", argv[0]);
+#endif
+
+	if (!initAtom()) return 3;
+	if (!initData()) return 4;
+	if (!initOSAPI()) return 5;
+	try {
+		gConfig = new ConfigParser();
+		ppc_cpu_init_config();
+
+		if (!ppc_init_physical_memory(BENCH_MEMORY_SIZE, 0)) {
+			ht_printf("cannot initialize memory.\n");
+			exit(1);
+		}
+		if (!ppc_cpu_init()) {
+			ht_printf("cpu_init failed! Out of memory?\n");
+			exit(1);
+		}
+		benchSetupMachine();
+
+		sys_timer timer;
+		if (!sys_create_timer(&timer, benchTimeout)) {
+			ht_printf("cannot create timer.\n");
+			exit(1);
+		}
+
+		ht_printf("PVR=%08x, %d second(s) per kernel\n\n", ppc_cpu_get_pvr(0), seconds);
+		ht_printf("%-8s  %10s  %12s  %10s\n", "kernel", "guest MIPS", "cycles/insn", "transl. ms");
+		for (int k=0; k<(int)BENCH_KERNELS; k++) {
+			if (!any || selected[k]) benchRun(k, timer, seconds);
+		}
+		sys_delete_timer(timer);
+	} catch (const Exception &e) {
+		String res;
+		e.reason(res);
+		ht_printf("exception: %y\n", &res);
+		return 1;
+	}
+	return 0;
+}
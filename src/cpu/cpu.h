@@ -23,31 +23,61 @@
 
 #include "system/types.h"
 
+#define PPC_MAX_CPUS	4
+
 uint64	ppc_get_clock_frequency(int cpu);
 uint64	ppc_get_bus_frequency(int cpu);
 uint64	ppc_get_timebase_frequency(int cpu);
 
 bool	ppc_cpu_init();
 void	ppc_cpu_init_config();
+int	ppc_cpu_count();
 
 void	ppc_cpu_stop();
 void	ppc_cpu_wakeup();
 
+/*
+ *	Save/restore the state of a stopped cpu (for snapshots).
+ *	The format depends on the cpu core and the host.
+ *	Throw an exception on error.
+ */
+class Stream;
+void	ppc_cpu_save_state(Stream &st);
+void	ppc_cpu_load_state(Stream &st);
+
 void	ppc_machine_check_exception();
 
-void	ppc_cpu_raise_ext_exception();
-void	ppc_cpu_cancel_ext_exception();
+void	ppc_cpu_raise_ext_exception(int cpu);
+void	ppc_cpu_cancel_ext_exception(int cpu);
 
 /*
  * May only be called from within a CPU thread.
  */
 
 void	ppc_cpu_run();
+int	ppc_cpu_current();
+// starts a stopped secondary cpu at pc with arg in r3, on its own thread
+bool	ppc_cpu_start(int cpu, uint32 pc, uint32 arg);
 uint32	ppc_cpu_get_gpr(int cpu, int i);
 void	ppc_cpu_set_gpr(int cpu, int i, uint32 newvalue);
 void	ppc_cpu_set_msr(int cpu, uint32 newvalue);
+uint32	ppc_cpu_get_msr(int cpu);
 void	ppc_cpu_set_pc(int cpu, uint32 newvalue);
 uint32	ppc_cpu_get_pc(int cpu);
 uint32	ppc_cpu_get_pvr(int cpu);
 
+/*
+ *	Called after the dirty framebuffer pages have been collected,
+ *	cores which cache writable framebuffer pages have to drop them
+ *	so that the next store marks its page again (system/display.h).
+ *	May be called from any thread.
+ */
+void	ppc_cpu_protect_framebuffer();
+
+/*
+ *	Host cycles spent translating guest code so far,
+ *	always 0 for cores which don't translate.
+ */
+uint64	ppc_cpu_get_translation_cycles();
+
 #endif
@@ -26,11 +26,15 @@
 
 #include <crisscross/stopwatch.h>
 
+#include "system/sysclk.h"
 #include "system/systhread.h"
 #include "system/arch/sysendian.h"
+#include "tools/except.h"
 #include "tools/snprintf.h"
+#include "tools/stream.h"
 #include "debug/tracers.h"
 #include "cpu/cpu.h"
+#include "cpu/cputrace.h"
 #include "cpu/debug.h"
 #include "info.h"
 #include "io/pic/pic.h"
@@ -45,9 +49,27 @@
 
 //#include "io/graphic/gcard.h"
 
+#undef gCPU
 PPC_CPU_State gCPU;
+static PPC_CPU_State gSecondaryCPU[PPC_MAX_CPUS-1];
+static PPC_CPU_State *gCPUs[PPC_MAX_CPUS];
+SYS_THREAD_LOCAL PPC_CPU_State *gCurrentCPU = &gCPU;
+
+static void ppc_cpu_init_states()
+{
+	gCPUs[0] = &gCPU;
+	for (int i=1; i<PPC_MAX_CPUS; i++) {
+		gCPUs[i] = &gSecondaryCPU[i-1];
+	}
+}
+#define gCPU (*gCurrentCPU)
+
 Debugger *gDebugger;
 
+static int gCPUCount = 1;
+static sys_thread gCPUThread[PPC_MAX_CPUS];
+static bool gCPUStarted[PPC_MAX_CPUS];
+
 static uint32 IPS = 0;
 static uint32 lastClock = 0;
 static CrissCross::System::Stopwatch clockIPS;
@@ -80,20 +102,30 @@ static void ppc_debug_hook()
 }
 
 sys_mutex exception_mutex;
+static sys_mutex io_mutex;
 
-void ppc_cpu_atomic_raise_ext_exception()
+/*
+ *	Must be called with exception_mutex held.
+ */
+static inline void ppc_cpu_update_pending(PPC_CPU_State &cpu)
+{
+	cpu.exception_pending = cpu.ext_exception || cpu.dec_exception
+		|| cpu.stop_exception || cpu.tlb_invalidate;
+}
+
+void ppc_cpu_atomic_raise_ext_exception(int cpu)
 {
 	sys_lock_mutex(exception_mutex);
-	gCPU.ext_exception = true;
-	gCPU.exception_pending = true;
+	gCPUs[cpu]->ext_exception = true;
+	gCPUs[cpu]->exception_pending = true;
 	sys_unlock_mutex(exception_mutex);
 }
 
-void ppc_cpu_atomic_cancel_ext_exception()
+void ppc_cpu_atomic_cancel_ext_exception(int cpu)
 {
 	sys_lock_mutex(exception_mutex);
-	gCPU.ext_exception = false;
-	if (!gCPU.dec_exception) gCPU.exception_pending = false;
+	gCPUs[cpu]->ext_exception = false;
+	ppc_cpu_update_pending(*gCPUs[cpu]);
 	sys_unlock_mutex(exception_mutex);
 }
 
@@ -105,17 +137,65 @@ void ppc_cpu_atomic_raise_dec_exception()
 	sys_unlock_mutex(exception_mutex);
 }
 
+void ppc_cpu_tlb_invalidate_others()
+{
+	if (gCPUCount == 1) return;
+	sys_lock_mutex(exception_mutex);
+	for (int i=0; i<gCPUCount; i++) {
+		if (gCPUs[i] != gCurrentCPU && gCPUStarted[i]) {
+			gCPUs[i]->tlb_invalidate = true;
+			gCPUs[i]->exception_pending = true;
+		}
+	}
+	sys_unlock_mutex(exception_mutex);
+}
+
+/*
+ *	Shared timebase of more than one cpu:
+ *	ptb = gPTBBase + host clock since gPTBClock.
+ */
+static uint64 gPTBBase;
+static uint64 gPTBClock;
+
+uint64 ppc_cpu_get_ptb()
+{
+	if (gCPUCount == 1) return gCPU.ptb;
+	uint64 freq = sys_get_hiresclk_ticks_per_second();
+	uint64 d = sys_get_hiresclk_ticks() - gPTBClock;
+	// split, so the product can't overflow
+	return gPTBBase + d / freq * PPC_CLOCK_FREQUENCY
+		+ d % freq * PPC_CLOCK_FREQUENCY / freq;
+}
+
+static void ppc_cpu_set_ptb(uint64 ptb)
+{
+	gPTBBase = ptb;
+	gPTBClock = sys_get_hiresclk_ticks();
+}
+
+void ppc_cpu_lock_io()
+{
+	if (gCPUCount > 1) sys_lock_mutex(io_mutex);
+}
+
+void ppc_cpu_unlock_io()
+{
+	if (gCPUCount > 1) sys_unlock_mutex(io_mutex);
+}
+
 void ppc_cpu_wakeup()
 {
 }
 
-void ppc_cpu_run()
+/*
+ *	Runs the cpu of the current thread until it is stopped.
+ */
+static void ppc_cpu_loop()
 {
-	gDebugger = new Debugger();
-	gDebugger->mAlwaysShowRegs = true;
-	PPC_CPU_TRACE("execution started at %08x\n", gCPU.pc);
+	PPC_CPU_TRACE("cpu %d: execution started at %08x\n", gCPU.pir, gCPU.pc);
 	uint ops=0;
-	gCPU.effective_code_page = 0xffffffff;
+	ppc_mmu_tlb_invalidate();
+	ppc_mmu_tlb_update_mode();
 //	ppc_fpu_test();
 //	return;
 	while (true) {
@@ -123,6 +203,7 @@ void ppc_cpu_run()
 		if ((gCPU.pc & ~0xfff) == gCPU.effective_code_page) {
 			gCPU.current_opc = ppc_word_from_BE(*((uint32*)(&gCPU.physical_code_page[gCPU.pc & 0xfff])));
 			ppc_debug_hook();
+			if (gPPCTrace) ppc_trace_insn(gCPU.pc, gCPU.current_opc);
 		} else {
 			int ret;
 			if ((ret = ppc_direct_effective_memory_handle_code(gCPU.pc & ~0xfff, gCPU.physical_code_page))) {
@@ -151,7 +232,7 @@ void ppc_cpu_run()
 				gCPU.exception_pending = true;
 				gCPU.ext_exception = true;
 			}*/
-			if ((ops & 0x0fffff)==0) {
+			if ((ops & 0x0fffff)==0 && !gCPU.pir) {
 //				uint32 j=0;
 //				ppc_read_effective_word(0xc046b2f8, j);
 
@@ -190,17 +271,28 @@ void ppc_cpu_run()
 		
 		if (gCPU.exception_pending) {
 			if (gCPU.stop_exception) {
+				sys_lock_mutex(exception_mutex);
 				gCPU.stop_exception = false;
-				if (!gCPU.dec_exception && !gCPU.ext_exception) gCPU.exception_pending = false;
+				ppc_cpu_update_pending(gCPU);
+				sys_unlock_mutex(exception_mutex);
 				break;
 			}
-			if (gCPU.msr & MSR_EE) {
+			if (gCPU.tlb_invalidate) {
+				sys_lock_mutex(exception_mutex);
+				gCPU.tlb_invalidate = false;
+				ppc_cpu_update_pending(gCPU);
+				sys_unlock_mutex(exception_mutex);
+				ppc_mmu_tlb_invalidate();
+				// the msr may have been changed for us, see ppc_cpu_set_msr()
+				ppc_mmu_tlb_update_mode();
+			}
+			if (gCPU.exception_pending && (gCPU.msr & MSR_EE)) {
 				sys_lock_mutex(exception_mutex);
 				if (gCPU.ext_exception) {
 					ppc_exception(PPC_EXC_EXT_INT);
 					gCPU.ext_exception = false;
 					gCPU.pc = gCPU.npc;
-					if (!gCPU.dec_exception) gCPU.exception_pending = false;
+					ppc_cpu_update_pending(gCPU);
 					sys_unlock_mutex(exception_mutex);
 					continue;
 				}
@@ -208,7 +300,7 @@ void ppc_cpu_run()
 					ppc_exception(PPC_EXC_DEC);
 					gCPU.dec_exception = false;
 					gCPU.pc = gCPU.npc;
-					gCPU.exception_pending = false;
+					ppc_cpu_update_pending(gCPU);
 					sys_unlock_mutex(exception_mutex);
 					continue;
 				}
@@ -230,14 +322,116 @@ void ppc_cpu_run()
 	}
 }
 
+static void *ppc_cpu_thread(void *arg)
+{
+	gCurrentCPU = (PPC_CPU_State *)arg;
+	ppc_cpu_loop();
+	return NULL;
+}
+
+void ppc_cpu_run()
+{
+	if (!gDebugger) {
+		gDebugger = new Debugger();
+		gDebugger->mAlwaysShowRegs = true;
+	}
+	ppc_cpu_loop();
+	for (int i=1; i<gCPUCount; i++) {
+		if (gCPUStarted[i]) {
+			sys_join_thread(gCPUThread[i]);
+			gCPUStarted[i] = false;
+		}
+	}
+}
+
+bool ppc_cpu_start(int cpu, uint32 pc, uint32 arg)
+{
+	if (cpu < 1 || cpu >= gCPUCount || gCPUStarted[cpu]) {
+		return false;
+	}
+	PPC_CPU_State &s = *gCPUs[cpu];
+	// same memory management setup and timebase as the calling cpu
+	s = gCPU;
+	s.pir = cpu;
+	s.pc = pc;
+	s.gpr[3] = arg;
+	s.exception_pending = false;
+	s.dec_exception = false;
+	s.ext_exception = false;
+	s.stop_exception = false;
+	s.tlb_invalidate = false;
+	s.have_reservation = false;
+	s.effective_code_page = 0xffffffff;
+	gCPUStarted[cpu] = true;
+	if (sys_create_thread(&gCPUThread[cpu], 0, ppc_cpu_thread, &s)) {
+		gCPUStarted[cpu] = false;
+		return false;
+	}
+	return true;
+}
+
 void ppc_cpu_stop()
 {
 	sys_lock_mutex(exception_mutex);
-	gCPU.stop_exception = true;
-	gCPU.exception_pending = true;
+	for (int i=0; i<gCPUCount; i++) {
+		gCPUs[i]->stop_exception = true;
+		gCPUs[i]->exception_pending = true;
+	}
 	sys_unlock_mutex(exception_mutex);
 }
 
+void ppc_cpu_trace_state(PPCTraceState &s)
+{
+	s.pc = gCPU.pc;
+	s.msr = gCPU.msr;
+	s.cr = gCPU.cr;
+	s.xer = gCPU.xer;
+	s.lr = gCPU.lr;
+	s.ctr = gCPU.ctr;
+	s.fpscr = gCPU.fpscr;
+	s.srr0 = gCPU.srr[0];
+	s.srr1 = gCPU.srr[1];
+	memcpy(s.gpr, gCPU.gpr, sizeof s.gpr);
+	memcpy(s.fpr, gCPU.fpr, sizeof s.fpr);
+}
+
+/*
+ *	Only the boot cpu is saved, secondary cpus have to be
+ *	stopped (or never started) by the client.
+ */
+void ppc_cpu_save_state(Stream &st)
+{
+	for (int i=1; i<gCPUCount; i++) {
+		if (gCPUStarted[i]) throw MsgException("can't save the state of secondary cpus");
+	}
+	gCPUs[0]->ptb = ppc_cpu_get_ptb();
+	st.writex(gCPUs[0], sizeof *gCPUs[0]);
+}
+
+void ppc_cpu_load_state(Stream &st)
+{
+	PPC_CPU_State &s = *gCPUs[0];
+	st.readx(&s, sizeof s);
+	s.stop_exception = false;
+	s.tlb_invalidate = false;
+	s.effective_code_page = 0xffffffff;
+	s.physical_code_page = NULL;
+	ppc_cpu_set_ptb(s.ptb);
+	sys_lock_mutex(exception_mutex);
+	ppc_cpu_update_pending(s);
+	sys_unlock_mutex(exception_mutex);
+}
+
+int ppc_cpu_count()
+{
+	return gCPUCount;
+}
+
+int ppc_cpu_current()
+{
+	return gCPU.pir;
+}
+
 uint64	ppc_get_clock_frequency(int cpu)
 {
 	return PPC_CLOCK_FREQUENCY;
@@ -261,32 +455,52 @@ void ppc_machine_check_exception()
 
 uint32	ppc_cpu_get_gpr(int cpu, int i)
 {
-	return gCPU.gpr[i];
+	return gCPUs[cpu]->gpr[i];
 }
 
 void	ppc_cpu_set_gpr(int cpu, int i, uint32 newvalue)
 {
-	gCPU.gpr[i] = newvalue;
+	gCPUs[cpu]->gpr[i] = newvalue;
 }
 
 void	ppc_cpu_set_msr(int cpu, uint32 newvalue)
 {
-	gCPU.msr = newvalue;
+	gCPUs[cpu]->msr = newvalue;
+	if (gCPUs[cpu] == gCurrentCPU) {
+		ppc_mmu_tlb_invalidate();
+		ppc_mmu_tlb_update_mode();
+	} else {
+		// the tlb belongs to the other cpu's thread
+		sys_lock_mutex(exception_mutex);
+		gCPUs[cpu]->tlb_invalidate = true;
+		gCPUs[cpu]->exception_pending = true;
+		sys_unlock_mutex(exception_mutex);
+	}
+}
+
+uint32	ppc_cpu_get_msr(int cpu)
+{
+	return gCPUs[cpu]->msr;
 }
 
 void	ppc_cpu_set_pc(int cpu, uint32 newvalue)
 {
-	gCPU.pc = newvalue;
+	gCPUs[cpu]->pc = newvalue;
 }
 
 uint32	ppc_cpu_get_pc(int cpu)
 {
-	return gCPU.pc;
+	return gCPUs[cpu]->pc;
 }
 
 uint32	ppc_cpu_get_pvr(int cpu)
 {
-	return gCPU.pvr;
+	return gCPUs[cpu]->pvr;
+}
+
+uint64	ppc_cpu_get_translation_cycles()
+{
+	return 0;
 }
 
 void ppc_cpu_map_framebuffer(uint32 pa, uint32 ea)
@@ -295,6 +509,23 @@ void ppc_cpu_map_framebuffer(uint32 pa, uint32 ea)
 	gCPU.dbatu[0] = ea|(7<<2)|0x3;
 	gCPU.dbat_bl17[0] = ~(BATU_BL(gCPU.dbatu[0])<<17);
 	gCPU.dbatl[0] = pa;
+	ppc_mmu_tlb_invalidate();
+}
+
+/*
+ *	Framebuffer pages only get into the write TLB when they're
+ *	marked dirty, see ppc_tlb_data_fill_write()
+ */
+void ppc_cpu_protect_framebuffer()
+{
+	sys_lock_mutex(exception_mutex);
+	for (int i=0; i<gCPUCount; i++) {
+		if (gCPUStarted[i]) {
+			gCPUs[i]->tlb_invalidate = true;
+			gCPUs[i]->exception_pending = true;
+		}
+	}
+	sys_unlock_mutex(exception_mutex);
 }
 
 void ppc_set_singlestep_v(bool v, const char *file, int line, const char *format, ...)
@@ -314,20 +545,35 @@ void ppc_set_singlestep_nonverbose(bool v)
 }
 
 #define CPU_KEY_PVR	"cpu_pvr"
+#define CPU_KEY_COUNT	"cpu_count"
 
 #include "configparser.h"
 
 bool ppc_cpu_init()
 {
-	memset(&gCPU, 0, sizeof gCPU);
-	gCPU.pvr = gConfig->getConfigInt(CPU_KEY_PVR);
+	ppc_cpu_init_states();
+	gCPUCount = gConfig->getConfigInt(CPU_KEY_COUNT);
+	if (gCPUCount < 1 || gCPUCount > PPC_MAX_CPUS) {
+		PPC_CPU_WARN("%s must be between 1 and %d\n", CPU_KEY_COUNT, PPC_MAX_CPUS);
+		gCPUCount = 1;
+	}
+	for (int cpu=0; cpu<gCPUCount; cpu++) {
+		PPC_CPU_State &s = *gCPUs[cpu];
+		memset(&s, 0, sizeof s);
+		s.pvr = gConfig->getConfigInt(CPU_KEY_PVR);
+		s.pir = cpu;
+		// initialize srs (mostly for prom)
+		for (int i=0; i<16; i++) {
+			s.sr[i] = 0x2aa*i;
+		}
+		ppc_tlb_contexts_reset(s.tlb_contexts);
+	}
+	ppc_mmu_tlb_invalidate();
+	ppc_cpu_set_ptb(0);
 	
 	ppc_dec_init();
-	// initialize srs (mostly for prom)
-	for (int i=0; i<16; i++) {
-		gCPU.sr[i] = 0x2aa*i;
-	}
 	sys_create_mutex(&exception_mutex);
+	sys_create_mutex(&io_mutex);
 
 	PPC_CPU_WARN("You are using the generic CPU!\n");
 	PPC_CPU_WARN("This is much slower than the just-in-time compiler and\n");
@@ -339,5 +585,6 @@ bool ppc_cpu_init()
 
 void ppc_cpu_init_config()
 {
-	gConfig->acceptConfigEntryIntDef("cpu_pvr", 0x000c0201);
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_PVR, 0x000c0201);
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_COUNT, 1);
 }
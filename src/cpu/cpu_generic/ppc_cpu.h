@@ -23,7 +23,9 @@
 
 #include <stddef.h>
 #include "system/types.h"
+#include "system/sysatomic.h"
 #include "cpu/common.h"
+#include "cpu/tlbcontext.h"
 
 #define PPC_MHz(v) ((v)*1000*1000)
 
@@ -35,6 +37,8 @@
 #define PPC_BUS_FREQUENCY PPC_MHz(10)
 #define PPC_TIMEBASE_FREQUENCY (PPC_CLOCK_FREQUENCY / TB_TO_PTB_FACTOR)
 
+#define PPC_TLB_ENTRIES 256
+
 struct PPC_CPU_State {	
 	// * uisa
 	uint32 gpr[32];
@@ -90,10 +94,17 @@ struct PPC_CPU_State {
 	int    pagetable_hashmask;
 	uint32 reserve;
 	bool   have_reservation;
+	bool   tlb_invalidate;	// tlbie on another cpu
 	
 	// for generic cpu core
 	uint32 effective_code_page;
 	byte  *physical_code_page;
+	uint32 tlb_data_read_eff[PPC_TLB_ENTRIES];
+	uint32 tlb_data_write_eff[PPC_TLB_ENTRIES];
+	byte  *tlb_data_read_host[PPC_TLB_ENTRIES];	// host pointer to page
+	byte  *tlb_data_write_host[PPC_TLB_ENTRIES];
+	uint32 tlb_context[16];		// or'ed into the tags, see cpu/tlbcontext.h
+	PPC_TLBContexts tlb_contexts;
 	uint64 pdec;	// more precise version of dec
 	uint64 ptb;	// more precise version of tb
 
@@ -106,8 +117,35 @@ struct PPC_CPU_State {
 
 extern PPC_CPU_State gCPU;
 
-void ppc_cpu_atomic_raise_ext_exception();
-void ppc_cpu_atomic_cancel_ext_exception();
+#ifdef PPC_CPU_GENERIC_CORE
+/*
+ *	Within the cpu core gCPU is the cpu running on the current
+ *	thread. The rest of the emulator (prom, debugger) only
+ *	ever sees the boot cpu.
+ */
+extern SYS_THREAD_LOCAL PPC_CPU_State *gCurrentCPU;
+#define gCPU (*gCurrentCPU)
+#endif
+
+void ppc_cpu_atomic_raise_ext_exception(int cpu);
+void ppc_cpu_atomic_cancel_ext_exception(int cpu);
+void ppc_cpu_tlb_invalidate_others();
+
+/*
+ *	The timebase in PTB units (TB_TO_PTB_FACTOR per tick).
+ *	A single cpu counts its instructions, so its timebase is
+ *	deterministic. With more cpus they all read one timebase,
+ *	derived from the host clock like the common timebase input
+ *	of an SMP board.
+ */
+uint64 ppc_cpu_get_ptb();
+
+/*
+ *	Device emulation isn't reentrant, so device accesses
+ *	are serialized as soon as there's more than one cpu.
+ */
+void ppc_cpu_lock_io();
+void ppc_cpu_unlock_io();
 
 extern uint32 gBreakpoint;
 extern uint32 gBreakpoint2;
@@ -0,0 +1,62 @@
+/*
+ *	PearPC
+ *	ppc_esc.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include "system/types.h"
+#include "debug/tracers.h"
+#include "ppc_cpu.h"
+#include "ppc_esc.h"
+#include "ppc_exc.h"
+#include "ppc_mmu.h"
+
+/*
+ *	The generic core raises the DSI right away from
+ *	ppc_effective_to_physical(), so there is nothing
+ *	left to do when ppc_escape() reports a fault.
+ */
+byte *ppc_escape_memory_handle(uint32 ea, bool write)
+{
+	uint32 pa;
+	byte *ptr = NULL;
+	if (!ppc_effective_to_physical(ea, write ? PPC_MMU_WRITE : PPC_MMU_READ, pa)) {
+		if (ppc_direct_physical_memory_handle(pa, ptr)) {
+			// mapped, but not to RAM
+			ppc_exception(PPC_EXC_DSI, write ? (PPC_EXC_DSISR_PAGE | PPC_EXC_DSISR_STORE) : PPC_EXC_DSISR_PAGE, ea);
+			ptr = NULL;
+		}
+	}
+	return ptr;
+}
+
+byte *ppc_escape_memory_handle_phys(uint32 pa)
+{
+	byte *ptr = NULL;
+	ppc_direct_physical_memory_handle(pa, ptr);
+	return ptr;
+}
+
+void ppc_escape_vm(uint32 func)
+{
+	uint32 ea;
+	if (!ppc_escape(func, ea)) {
+		PPC_ESC_TRACE(" dsi at %08x\n", ea);
+	}
+}
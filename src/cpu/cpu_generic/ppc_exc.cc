@@ -113,18 +113,21 @@ bool FASTCALL ppc_exception(uint32 type, uint32 flags, uint32 a)
 		PPC_EXC_ERR("unknown\n");
 		return false;
 	}
-	ppc_mmu_tlb_invalidate();
+	uint32 oldmsr = gCPU.msr;
 	gCPU.msr = 0;
+	if (oldmsr & (MSR_PR | MSR_IR | MSR_DR)) {
+		ppc_mmu_tlb_update_mode();
+	}
 	gCPU.npc = type;
 	return true;
 }
 
-void ppc_cpu_raise_ext_exception()
+void ppc_cpu_raise_ext_exception(int cpu)
 {
-	ppc_cpu_atomic_raise_ext_exception();
+	ppc_cpu_atomic_raise_ext_exception(cpu);
 }
 
-void ppc_cpu_cancel_ext_exception()
+void ppc_cpu_cancel_ext_exception(int cpu)
 {
-	ppc_cpu_atomic_cancel_ext_exception();
+	ppc_cpu_atomic_cancel_ext_exception(cpu);
 }
@@ -67,8 +67,8 @@
 #define PPC_EXC_PROGRAM_NEXT  (1<<16)
 
 bool FASTCALL ppc_exception(uint32 type=0, uint32 flags=0, uint32 a=0);
-void ppc_cpu_raise_ext_exception();
-void ppc_cpu_cancel_ext_exception();
+void ppc_cpu_raise_ext_exception(int cpu);
+void ppc_cpu_cancel_ext_exception(int cpu);
 
 #endif
 
@@ -30,6 +30,8 @@
 #include <cstdlib>
 #include <cstring>
 #include "system/arch/sysendian.h"
+#include "system/sys.h"
+#include "system/sysatomic.h"
 #include "tools/snprintf.h"
 #include "debug/tracers.h"
 #include "io/prom/prom.h"
@@ -320,6 +322,95 @@ int FASTCALL ppc_effective_to_physical(uint32 addr, int flags, uint32 &result)
 void ppc_mmu_tlb_invalidate()
 {
 	gCPU.effective_code_page = 0xffffffff;
+	memset(gCPU.tlb_data_read_eff, 0xff, sizeof gCPU.tlb_data_read_eff);
+	memset(gCPU.tlb_data_write_eff, 0xff, sizeof gCPU.tlb_data_write_eff);
+}
+
+void ppc_mmu_tlb_update_segment(int sr)
+{
+	int id = ppc_tlb_context_lookup(gCPU.tlb_contexts, gCPU.sr[sr], gCPU.msr);
+	if (id < 0) {
+		// out of ids, start over
+		ppc_tlb_contexts_reset(gCPU.tlb_contexts);
+		ppc_mmu_tlb_invalidate();
+		ppc_mmu_tlb_update_mode();
+		return;
+	}
+	gCPU.tlb_context[sr] = id;
+	if ((gCPU.effective_code_page >> 28) == (uint32)sr) {
+		gCPU.effective_code_page = 0xffffffff;
+	}
+}
+
+void ppc_mmu_tlb_update_mode()
+{
+	for (int i=0; i<16; i++) {
+		ppc_mmu_tlb_update_segment(i);
+	}
+	gCPU.effective_code_page = 0xffffffff;
+}
+
+/*
+ *	Data TLB
+ *
+ *	Direct mapped, indexed by the effective page number. Only pages
+ *	backed by RAM or the framebuffer are cached, so a hit is always a
+ *	plain host access. Framebuffer pages are marked dirty when they
+ *	enter the write TLB and are dropped again by
+ *	ppc_cpu_protect_framebuffer().
+ *	The tag is compared against the page of the last byte accessed,
+ *	which makes accesses crossing a page boundary miss automatically.
+ *	Tags carry the context id of their segment (cpu/tlbcontext.h).
+ */
+#define PPC_TLB_INDEX(ea)	(((ea)>>12) & (PPC_TLB_ENTRIES-1))
+#define PPC_TLB_TAG(ea)		(((ea) & ~0xfff) | gCPU.tlb_context[(ea) >> 28])
+
+static inline byte *ppc_tlb_data_read(uint32 addr, int size)
+{
+	uint32 idx = PPC_TLB_INDEX(addr);
+	if (gCPU.tlb_data_read_eff[idx] == PPC_TLB_TAG(addr+size-1)) {
+		return gCPU.tlb_data_read_host[idx] + EA_Offset(addr);
+	}
+	return NULL;
+}
+
+static inline byte *ppc_tlb_data_write(uint32 addr, int size)
+{
+	uint32 idx = PPC_TLB_INDEX(addr);
+	if (gCPU.tlb_data_write_eff[idx] == PPC_TLB_TAG(addr+size-1)) {
+		return gCPU.tlb_data_write_host[idx] + EA_Offset(addr);
+	}
+	return NULL;
+}
+
+static inline bool ppc_tlb_is_framebuffer(uint32 pa)
+{
+	return pa - IO_GCARD_FRAMEBUFFER_PA_START < FRAMEBUFFER_MAX_SIZE && gFrameBuffer;
+}
+
+static inline void ppc_tlb_data_fill_read(uint32 addr, uint32 pa)
+{
+	uint32 idx = PPC_TLB_INDEX(addr);
+	if ((pa | 0xfff) < gMemorySize) {
+		gCPU.tlb_data_read_eff[idx] = PPC_TLB_TAG(addr);
+		gCPU.tlb_data_read_host[idx] = gMemory + (pa & ~0xfff);
+	} else if (ppc_tlb_is_framebuffer(pa)) {
+		gCPU.tlb_data_read_eff[idx] = PPC_TLB_TAG(addr);
+		gCPU.tlb_data_read_host[idx] = gFrameBuffer + ((pa - IO_GCARD_FRAMEBUFFER_PA_START) & ~0xfff);
+	}
+}
+
+static inline void ppc_tlb_data_fill_write(uint32 addr, uint32 pa)
+{
+	uint32 idx = PPC_TLB_INDEX(addr);
+	if ((pa | 0xfff) < gMemorySize) {
+		gCPU.tlb_data_write_eff[idx] = PPC_TLB_TAG(addr);
+		gCPU.tlb_data_write_host[idx] = gMemory + (pa & ~0xfff);
+	} else if (ppc_tlb_is_framebuffer(pa)) {
+		damageFrameBufferPage(pa - IO_GCARD_FRAMEBUFFER_PA_START);
+		gCPU.tlb_data_write_eff[idx] = PPC_TLB_TAG(addr);
+		gCPU.tlb_data_write_host[idx] = gFrameBuffer + ((pa - IO_GCARD_FRAMEBUFFER_PA_START) & ~0xfff);
+	}
 }
 
 /*
@@ -357,6 +448,7 @@ bool FASTCALL ppc_mmu_set_sdr1(uint32 newval, bool quiesce)
 	gCPU.pagetable_base = htaborg<<16;
 	gCPU.sdr1 = newval;
 	gCPU.pagetable_hashmask = ((xx<<10)|0x3ff);
+	ppc_mmu_tlb_invalidate();
 	PPC_MMU_TRACE("new pagetable: sdr1 accepted\n");
 	PPC_MMU_TRACE("number of pages: 2^%d pagetable_start: 0x%08x size: 2^%d\n", n+13, gCPU.pagetable_base, n+16);
 	if (quiesce) {
@@ -443,7 +535,10 @@ int FASTCALL ppc_read_physical_qword(uint32 addr, Vector_t &result)
 		VECT_D(result,1) = ppc_dword_from_BE(*((uint64*)(gMemory+addr+8)));
 		return PPC_MMU_OK;
 	}
-	return io_mem_read128(addr, (uint128 *)&result);
+	ppc_cpu_lock_io();
+	int ret = io_mem_read128(addr, (uint128 *)&result);
+	ppc_cpu_unlock_io();
+	return ret;
 }
 
 int FASTCALL ppc_read_physical_dword(uint32 addr, uint64 &result)
@@ -453,7 +548,9 @@ int FASTCALL ppc_read_physical_dword(uint32 addr, uint64 &result)
 		result = ppc_dword_from_BE(*((uint64*)(gMemory+addr)));
 		return PPC_MMU_OK;
 	}
+	ppc_cpu_lock_io();
 	int ret = io_mem_read64(addr, result);
+	ppc_cpu_unlock_io();
 	result = ppc_bswap_dword(result);
 	return ret;
 }
@@ -465,7 +562,9 @@ int FASTCALL ppc_read_physical_word(uint32 addr, uint32 &result)
 		result = ppc_word_from_BE(*((uint32*)(gMemory+addr)));
 		return PPC_MMU_OK;
 	}
+	ppc_cpu_lock_io();
 	int ret = io_mem_read(addr, result, 4);
+	ppc_cpu_unlock_io();
 	result = ppc_bswap_word(result);
 	return ret;
 }
@@ -478,7 +577,9 @@ int FASTCALL ppc_read_physical_half(uint32 addr, uint16 &result)
 		return PPC_MMU_OK;
 	}
 	uint32 r;
+	ppc_cpu_lock_io();
 	int ret = io_mem_read(addr, r, 2);
+	ppc_cpu_unlock_io();
 	result = ppc_bswap_half(r);
 	return ret;
 }
@@ -491,7 +592,9 @@ int FASTCALL ppc_read_physical_byte(uint32 addr, uint8 &result)
 		return PPC_MMU_OK;
 	}
 	uint32 r;
+	ppc_cpu_lock_io();
 	int ret = io_mem_read(addr, r, 1);
+	ppc_cpu_unlock_io();
 	result = r;
 	return ret;
 }
@@ -517,7 +620,14 @@ int FASTCALL ppc_read_effective_qword(uint32 addr, Vector_t &result)
 
 	addr &= ~0x0f;
 
+	byte *h = ppc_tlb_data_read(addr, 16);
+	if (h) {
+		VECT_D(result,0) = ppc_dword_from_BE(*((uint64*)h));
+		VECT_D(result,1) = ppc_dword_from_BE(*((uint64*)(h+8)));
+		return PPC_MMU_OK;
+	}
 	if (!(r = ppc_effective_to_physical(addr, PPC_MMU_READ, p))) {
+		ppc_tlb_data_fill_read(addr, p);
 		return ppc_read_physical_qword(p, result);
 	}
 
@@ -528,7 +638,13 @@ int FASTCALL ppc_read_effective_dword(uint32 addr, uint64 &result)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_read(addr, 8);
+	if (h) {
+		result = ppc_dword_from_BE(*((uint64*)h));
+		return PPC_MMU_OK;
+	}
 	if (!(r = ppc_effective_to_physical(addr, PPC_MMU_READ, p))) {
+		ppc_tlb_data_fill_read(addr, p);
 		if (EA_Offset(addr) > 4088) {
 			// read overlaps two pages.. tricky
 			byte *r1, *r2;
@@ -553,7 +669,13 @@ int FASTCALL ppc_read_effective_word(uint32 addr, uint32 &result)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_read(addr, 4);
+	if (h) {
+		result = ppc_word_from_BE(*((uint32*)h));
+		return PPC_MMU_OK;
+	}
 	if (!(r = ppc_effective_to_physical(addr, PPC_MMU_READ, p))) {
+		ppc_tlb_data_fill_read(addr, p);
 		if (EA_Offset(addr) > 4092) {
 			// read overlaps two pages.. tricky
 			byte *r1, *r2;
@@ -578,7 +700,13 @@ int FASTCALL ppc_read_effective_half(uint32 addr, uint16 &result)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_read(addr, 2);
+	if (h) {
+		result = ppc_half_from_BE(*((uint16*)h));
+		return PPC_MMU_OK;
+	}
 	if (!((r = ppc_effective_to_physical(addr, PPC_MMU_READ, p)))) {
+		ppc_tlb_data_fill_read(addr, p);
 		if (EA_Offset(addr) > 4094) {
 			// read overlaps two pages.. tricky
 			byte b1, b2;
@@ -599,7 +727,13 @@ int FASTCALL ppc_read_effective_byte(uint32 addr, uint8 &result)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_read(addr, 1);
+	if (h) {
+		result = *h;
+		return PPC_MMU_OK;
+	}
 	if (!((r = ppc_effective_to_physical(addr, PPC_MMU_READ, p)))) {
+		ppc_tlb_data_fill_read(addr, p);
 		return ppc_read_physical_byte(p, result);
 	}
 	return r;
@@ -613,7 +747,10 @@ int FASTCALL ppc_write_physical_qword(uint32 addr, Vector_t data)
 		*((uint64*)(gMemory+addr+8)) = ppc_dword_to_BE(VECT_D(data,1));
 		return PPC_MMU_OK;
 	}
-	if (io_mem_write128(addr, (uint128 *)&data) == IO_MEM_ACCESS_OK) {
+	ppc_cpu_lock_io();
+	int ret = io_mem_write128(addr, (uint128 *)&data);
+	ppc_cpu_unlock_io();
+	if (ret == IO_MEM_ACCESS_OK) {
 		return PPC_MMU_OK;
 	} else {
 		return PPC_MMU_FATAL;
@@ -627,7 +764,10 @@ int FASTCALL ppc_write_physical_dword(uint32 addr, uint64 data)
 		*((uint64*)(gMemory+addr)) = ppc_dword_to_BE(data);
 		return PPC_MMU_OK;
 	}
-	if (io_mem_write64(addr, ppc_bswap_dword(data)) == IO_MEM_ACCESS_OK) {
+	ppc_cpu_lock_io();
+	int ret = io_mem_write64(addr, ppc_bswap_dword(data));
+	ppc_cpu_unlock_io();
+	if (ret == IO_MEM_ACCESS_OK) {
 		return PPC_MMU_OK;
 	} else {
 		return PPC_MMU_FATAL;
@@ -641,7 +781,10 @@ int FASTCALL ppc_write_physical_word(uint32 addr, uint32 data)
 		*((uint32*)(gMemory+addr)) = ppc_word_to_BE(data);
 		return PPC_MMU_OK;
 	}
-	return io_mem_write(addr, ppc_bswap_word(data), 4);
+	ppc_cpu_lock_io();
+	int ret = io_mem_write(addr, ppc_bswap_word(data), 4);
+	ppc_cpu_unlock_io();
+	return ret;
 }
 
 int FASTCALL ppc_write_physical_half(uint32 addr, uint16 data)
@@ -651,7 +794,10 @@ int FASTCALL ppc_write_physical_half(uint32 addr, uint16 data)
 		*((uint16*)(gMemory+addr)) = ppc_half_to_BE(data);
 		return PPC_MMU_OK;
 	}
-	return io_mem_write(addr, ppc_bswap_half(data), 2);
+	ppc_cpu_lock_io();
+	int ret = io_mem_write(addr, ppc_bswap_half(data), 2);
+	ppc_cpu_unlock_io();
+	return ret;
 }
 
 int FASTCALL ppc_write_physical_byte(uint32 addr, uint8 data)
@@ -661,7 +807,10 @@ int FASTCALL ppc_write_physical_byte(uint32 addr, uint8 data)
 		gMemory[addr] = data;
 		return PPC_MMU_OK;
 	}
-	return io_mem_write(addr, data, 1);
+	ppc_cpu_lock_io();
+	int ret = io_mem_write(addr, data, 1);
+	ppc_cpu_unlock_io();
+	return ret;
 }
 
 int FASTCALL ppc_write_effective_qword(uint32 addr, Vector_t data)
@@ -671,7 +820,14 @@ int FASTCALL ppc_write_effective_qword(uint32 addr, Vector_t data)
 
 	addr &= ~0x0f;
 
+	byte *h = ppc_tlb_data_write(addr, 16);
+	if (h) {
+		*((uint64*)h) = ppc_dword_to_BE(VECT_D(data,0));
+		*((uint64*)(h+8)) = ppc_dword_to_BE(VECT_D(data,1));
+		return PPC_MMU_OK;
+	}
 	if (!((r=ppc_effective_to_physical(addr, PPC_MMU_WRITE, p)))) {
+		ppc_tlb_data_fill_write(addr, p);
 		return ppc_write_physical_qword(p, data);
 	}
 	return r;
@@ -681,7 +837,13 @@ int FASTCALL ppc_write_effective_dword(uint32 addr, uint64 data)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_write(addr, 8);
+	if (h) {
+		*((uint64*)h) = ppc_dword_to_BE(data);
+		return PPC_MMU_OK;
+	}
 	if (!((r=ppc_effective_to_physical(addr, PPC_MMU_WRITE, p)))) {
+		ppc_tlb_data_fill_write(addr, p);
 		if (EA_Offset(addr) > 4088) {
 			// write overlaps two pages.. tricky
 			byte *r1, *r2;
@@ -708,7 +870,13 @@ int FASTCALL ppc_write_effective_word(uint32 addr, uint32 data)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_write(addr, 4);
+	if (h) {
+		*((uint32*)h) = ppc_word_to_BE(data);
+		return PPC_MMU_OK;
+	}
 	if (!((r=ppc_effective_to_physical(addr, PPC_MMU_WRITE, p)))) {
+		ppc_tlb_data_fill_write(addr, p);
 		if (EA_Offset(addr) > 4092) {
 			// write overlaps two pages.. tricky
 			byte *r1, *r2;
@@ -735,7 +903,13 @@ int FASTCALL ppc_write_effective_half(uint32 addr, uint16 data)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_write(addr, 2);
+	if (h) {
+		*((uint16*)h) = ppc_half_to_BE(data);
+		return PPC_MMU_OK;
+	}
 	if (!((r=ppc_effective_to_physical(addr, PPC_MMU_WRITE, p)))) {
+		ppc_tlb_data_fill_write(addr, p);
 		if (EA_Offset(addr) > 4094) {
 			// write overlaps two pages.. tricky
 			ppc_effective_to_physical((addr & ~0xfff)+4095, PPC_MMU_WRITE, p);
@@ -754,18 +928,25 @@ int FASTCALL ppc_write_effective_byte(uint32 addr, uint8 data)
 {
 	uint32 p;
 	int r;
+	byte *h = ppc_tlb_data_write(addr, 1);
+	if (h) {
+		*h = data;
+		return PPC_MMU_OK;
+	}
 	if (!((r=ppc_effective_to_physical(addr, PPC_MMU_WRITE, p)))) {
+		ppc_tlb_data_fill_write(addr, p);
 		return ppc_write_physical_byte(p, data);
 	}
 	return r;
 }
 
-bool FASTCALL ppc_init_physical_memory(uint size)
+bool FASTCALL ppc_init_physical_memory(uint size, int flags)
 {
 	if (size < 64*1024*1024) {
 		PPC_MMU_ERR("Main memory size must >= 64MB!\n");
 	}
-	gMemory = (byte*)malloc(size);
+	// page aligned
+	gMemory = (byte*)sys_alloc_memory(size, flags);
 	gMemorySize = size;
 	return gMemory != NULL;
 }
@@ -775,6 +956,15 @@ uint32  ppc_get_memory_size()
 	return gMemorySize;
 }
 
+bool ppc_map_physical_memory(const char *filename, FileOfs ofs)
+{
+	byte *p = (byte*)sys_map_file_memory(filename, ofs, gMemorySize);
+	if (!p) return false;
+	sys_free_memory(gMemory, gMemorySize);
+	gMemory = p;
+	return true;
+}
+
 /***************************************************************************
  *	DMA Interface
  */
@@ -883,8 +1073,8 @@ void ppc_opc_dcbz()
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rD, rA, rB);
 	// assert rD=0
-	uint32 a = (rA?gCPU.gpr[rA]:0)+gCPU.gpr[rB];
-	// BAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA
+	// clears the whole cache line containing the address
+	uint32 a = ((rA?gCPU.gpr[rA]:0)+gCPU.gpr[rB]) & ~31;
 	ppc_write_effective_dword(a, 0)
 	|| ppc_write_effective_dword(a+8, 0)
 	|| ppc_write_effective_dword(a+16, 0)
@@ -2008,15 +2198,36 @@ void ppc_opc_stwcx_()
 	gCPU.cr &= 0x0fffffff;
 	if (gCPU.have_reservation) {
 		gCPU.have_reservation = false;
-		uint32 v;
-		if (ppc_read_effective_word((rA?gCPU.gpr[rA]:0)+gCPU.gpr[rB], v)) {
-			return;
+		uint32 ea = (rA?gCPU.gpr[rA]:0)+gCPU.gpr[rB];
+		byte *h = ppc_tlb_data_write(ea, 4);
+		if (!h) {
+			uint32 pa;
+			if (ppc_effective_to_physical(ea, PPC_MMU_WRITE, pa)) {
+				return;
+			}
+			ppc_tlb_data_fill_write(ea, pa);
+			if (pa < gMemorySize) h = gMemory + pa;
 		}
-		if (v==gCPU.reserve) {
-			if (ppc_write_effective_word((rA?gCPU.gpr[rA]:0)+gCPU.gpr[rB], gCPU.gpr[rS])) {
+		if (h && !(ea & 3)) {
+			/*
+			 *	Other cpus may store to this word at any time,
+			 *	so comparing with the reserved value and storing
+			 *	has to be one atomic operation.
+			 */
+			if (sys_atomic_cas((uint32*)h, ppc_word_to_BE(gCPU.reserve), ppc_word_to_BE(gCPU.gpr[rS]))) {
+				gCPU.cr |= CR_CR0_EQ;
+			}
+		} else {
+			uint32 v;
+			if (ppc_read_effective_word(ea, v)) {
 				return;
 			}
-			gCPU.cr |= CR_CR0_EQ;
+			if (v==gCPU.reserve) {
+				if (ppc_write_effective_word(ea, gCPU.gpr[rS])) {
+					return;
+				}
+				gCPU.cr |= CR_CR0_EQ;
+			}
 		}
 		if (gCPU.xer & XER_SO) {
 			gCPU.cr |= CR_CR0_SO;
@@ -40,7 +40,7 @@ void ppc_set_msr(uint32 newmsr)
 			gCPU.ext_exception = true;
 		}
 	}*/
-	ppc_mmu_tlb_invalidate();
+	uint32 changed = newmsr ^ gCPU.msr;
 #ifndef PPC_CPU_ENABLE_SINGLESTEP
 	if (newmsr & MSR_SE) {
 		SINGLESTEP("");
@@ -57,7 +57,9 @@ void ppc_set_msr(uint32 newmsr)
 		newmsr &= ~MSR_POW;
 	}
 	gCPU.msr = newmsr;
-	
+	if (changed & (MSR_PR | MSR_IR | MSR_DR)) {
+		ppc_mmu_tlb_update_mode();
+	}
 }
 
 /*
@@ -361,12 +363,12 @@ void ppc_opc_mfspr()
 	case 8:
 		switch (spr1) {
 		case 12: {
-			gCPU.tb = gCPU.ptb / TB_TO_PTB_FACTOR;
+			gCPU.tb = ppc_cpu_get_ptb() / TB_TO_PTB_FACTOR;
 			gCPU.gpr[rD] = gCPU.tb;
 			return;
 		}
 		case 13: {
-			gCPU.tb = gCPU.ptb / TB_TO_PTB_FACTOR;
+			gCPU.tb = ppc_cpu_get_ptb() / TB_TO_PTB_FACTOR;
 			gCPU.gpr[rD] = gCPU.tb >> 32;
 			return;
 		}
@@ -471,8 +473,8 @@ void ppc_opc_mfspr()
 			gCPU.gpr[rD] = 0;
 			return;
 		case 31:
-//			PPC_OPC_WARN("read from spr %d:%d (???) not supported!\n", spr1, spr2);
-			gCPU.gpr[rD] = 0;
+			// PIR
+			gCPU.gpr[rD] = gCPU.pir;
 			return;
 		}
 	}
@@ -523,12 +525,12 @@ void ppc_opc_mftb()
 	case 8:
 		switch (spr1) {
 		case 12: {
-			gCPU.tb = gCPU.ptb / TB_TO_PTB_FACTOR;
+			gCPU.tb = ppc_cpu_get_ptb() / TB_TO_PTB_FACTOR;
 			gCPU.gpr[rD] = gCPU.tb;
 			return;
 		}
 		case 13: {
-			gCPU.tb = gCPU.ptb / TB_TO_PTB_FACTOR;
+			gCPU.tb = ppc_cpu_get_ptb() / TB_TO_PTB_FACTOR;
 			gCPU.gpr[rD] = gCPU.tb >> 32;
 			return;
 		}
@@ -690,6 +692,8 @@ void ppc_opc_mtspr()
 		}
 		break;
 	case 16:
+		// BATs changed, cached translations may be stale
+		ppc_mmu_tlb_invalidate();
 		switch (spr1) {
 		case 16:
 			gCPU.ibatu[0] = gCPU.gpr[rS];
@@ -813,6 +817,7 @@ void ppc_opc_mtsr()
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rS, SR, rB);
 	// FIXME: check insn
 	gCPU.sr[SR & 0xf] = gCPU.gpr[rS];
+	ppc_mmu_tlb_update_segment(SR & 0xf);
 }
 /*
  *	mtsrin		Move to Segment Register Indirect
@@ -828,6 +833,7 @@ void ppc_opc_mtsrin()
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rS, rA, rB);
 	// FIXME: check insn
 	gCPU.sr[gCPU.gpr[rB] >> 28] = gCPU.gpr[rS];
+	ppc_mmu_tlb_update_segment(gCPU.gpr[rB] >> 28);
 }
 
 /*
@@ -881,6 +887,7 @@ void ppc_opc_tlbia()
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rS, rA, rB);
 	// FIXME: check rS.. for 0
 	ppc_mmu_tlb_invalidate();
+	ppc_cpu_tlb_invalidate_others();
 }
 
 /*
@@ -897,6 +904,7 @@ void ppc_opc_tlbie()
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rS, rA, rB);
 	// FIXME: check rS.. for 0     
 	ppc_mmu_tlb_invalidate();
+	ppc_cpu_tlb_invalidate_others();
 }
 
 /*
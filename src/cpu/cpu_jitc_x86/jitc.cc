@@ -25,16 +25,24 @@
 
 #include "system/sys.h"
 #include "tools/snprintf.h"
+#include "cpu/cputrace.h"
 
 #include "jitc.h"
 #include "jitc_debug.h"
 #include "jitc_asm.h"
 
 #include "ppc_dec.h"
+#include "ppc_idiom.h"
 #include "ppc_mmu.h"
 #include "ppc_tools.h"
 
 JITC gJITC;
+NativeAddress gJITCExceptionEntry[JITC_EXC_VECTORS];
+ClientPage *gJITCExceptionPage;
+
+static const uint32 gJITCExceptionVector[JITC_EXC_VECTORS] = {
+	0x300, 0x400, 0x700, 0x900, 0xc00,
+};
 
 static TranslationCacheFragment *jitcAllocFragment();
 
@@ -126,30 +134,40 @@ void FASTCALL jitcEmitAlign(int align)
 }
 /**
  *	Intern.
- *	Maps ClientPage to base address
+ *	The msr mode new translations are made for
  */
-static void inline jitcMapClientPage(uint32 baseaddr, ClientPage *cp)
+static inline uint32 jitcMSRMode()
 {
-	gJITC.clientPages[baseaddr >> 12] = cp;
-	cp->baseaddress = baseaddr;
+	return gCPU.msr & JITC_MSR_MODE_MASK;
 }
 
 /**
  *	Intern.
- *	Unmaps ClientPage at base address
+ *	Maps ClientPage to base address and msr mode
  */
-static void inline jitcUnmapClientPage(uint32 baseaddr)
+static void inline jitcMapClientPage(uint32 baseaddr, uint32 mode, ClientPage *cp)
 {
-	gJITC.clientPages[baseaddr >> 12] = NULL;
+	cp->nextMode = gJITC.clientPages[baseaddr >> 12];
+	gJITC.clientPages[baseaddr >> 12] = cp;
+	cp->baseaddress = baseaddr;
+	cp->msrMode = mode;
 }
 
 /**
  *	Intern.
- *	Unmaps ClientPage
+ *	Unmaps ClientPage (if it's still mapped)
  */
 static void inline jitcUnmapClientPage(ClientPage *cp)
 {
-	jitcUnmapClientPage(cp->baseaddress);
+	ClientPage **p = &gJITC.clientPages[cp->baseaddress >> 12];
+	while (*p) {
+		if (*p == cp) {
+			*p = cp->nextMode;
+			break;
+		}
+		p = &(*p)->nextMode;
+	}
+	cp->nextMode = NULL;
 }
 
 /**
@@ -195,6 +213,94 @@ void FASTCALL jitcDestroyFragments(TranslationCacheFragment *tcf)
 	}
 }
 
+/**
+ *	Intern.
+ *	Returns size bytes of JIT metadata.
+ *	There's no way to free it except jitc_done().
+ */
+static void *jitcArenaAlloc(uint size)
+{
+	size = (size + 15) & ~15;
+	if (gJITC.arenaLeft < size) {
+		byte *chunk = (byte *)malloc(JITC_ARENA_CHUNK_SIZE);
+		if (!chunk) {
+			ht_printf("JITC: out of memory\n");
+			exit(1);
+		}
+		*(byte **)chunk = gJITC.arenaChunks;
+		gJITC.arenaChunks = chunk;
+		gJITC.arenaCurrent = chunk + 16;
+		gJITC.arenaLeft = JITC_ARENA_CHUNK_SIZE - 16;
+	}
+	void *r = gJITC.arenaCurrent;
+	gJITC.arenaCurrent += size;
+	gJITC.arenaLeft -= size;
+	return r;
+}
+
+/**
+ *	Intern.
+ *	Returns an empty entrypoint map with 1<<bits slots
+ */
+static JitcEntrypoint *jitcAllocEntrypoints(int bits)
+{
+	uint size = sizeof (JitcEntrypoint) << bits;
+	JitcEntrypoint *e = gJITC.freeEntrypoints[bits];
+	if (e) {
+		gJITC.freeEntrypoints[bits] = *(JitcEntrypoint **)e;
+	} else {
+		e = (JitcEntrypoint *)jitcArenaAlloc(size);
+	}
+	memset(e, 0, size);
+	return e;
+}
+
+/**
+ *	Intern.
+ *	Puts entrypoint map with mask+1 slots into its free list
+ */
+static void jitcFreeEntrypoints(JitcEntrypoint *e, uint32 mask)
+{
+	int bits = JITC_ENTRYPOINTS_MIN_BITS;
+	while ((1U << bits) <= mask) bits++;
+	*(JitcEntrypoint **)e = gJITC.freeEntrypoints[bits];
+	gJITC.freeEntrypoints[bits] = e;
+}
+
+/**
+ *	Intern.
+ *	Returns the slot of ofs in the entrypoint map of cp
+ *	or the empty slot where it has to be inserted.
+ *	The map must not be full if ofs isn't in it.
+ */
+static inline JitcEntrypoint *jitcEntrypointSlot(ClientPage *cp, uint32 ofs)
+{
+	uint32 i = ((ofs >> 2) * 0x9e3779b1) >> 22;
+	while (1) {
+		JitcEntrypoint *e = &cp->entrypoints[i & cp->entrypointsMask];
+		if (!e->native || e->ofs == ofs) return e;
+		i++;
+	}
+}
+
+/**
+ *	Intern.
+ *	Doubles the size of the entrypoint map of cp
+ */
+static void jitcGrowEntrypoints(ClientPage *cp)
+{
+	JitcEntrypoint *old = cp->entrypoints;
+	uint32 oldMask = cp->entrypointsMask;
+	int bits = JITC_ENTRYPOINTS_MIN_BITS;
+	while ((1U << bits) <= oldMask) bits++;
+	cp->entrypoints = jitcAllocEntrypoints(bits+1);
+	cp->entrypointsMask = (1 << (bits+1)) - 1;
+	for (uint32 i=0; i <= oldMask; i++) {
+		if (old[i].native) *jitcEntrypointSlot(cp, old[i].ofs) = old[i];
+	}
+	jitcFreeEntrypoints(old, oldMask);
+}
+
 /**
  *	Unmaps ClientPage and destroys fragments
  */
@@ -202,9 +308,16 @@ static void FASTCALL jitcDestroyClientPage(ClientPage *cp)
 {
 	// assert(cp->tcf_current)
 	jitcDestroyFragments(cp->tcf_current);
-	memset(cp->entrypoints, 0, sizeof cp->entrypoints);
+	if (cp->entrypoints) {
+		jitcFreeEntrypoints(cp->entrypoints, cp->entrypointsMask);
+		cp->entrypoints = NULL;
+	}
 	cp->tcf_current = NULL;
 	jitcUnmapClientPage(cp);
+	if (cp == gJITCExceptionPage) {
+		memset(gJITCExceptionEntry, 0, sizeof gJITCExceptionEntry);
+		gJITCExceptionPage = NULL;
+	}
 }
 
 /**
@@ -247,13 +360,25 @@ static void FASTCALL jitcFreeClientPage(ClientPage *cp)
 /**
  *	Destroys and frees ClientPage
  */
-extern "C" void FASTCALL jitcDestroyAndFreeClientPage(ClientPage *cp)
+static void FASTCALL jitcDestroyAndFreeSingleClientPage(ClientPage *cp)
 {
 	gJITC.destroy_write++;
 	jitcDestroyClientPage(cp);
 	jitcFreeClientPage(cp);
 }
 
+/**
+ *	Destroys and frees ClientPage and the translations
+ *	of the same physical page for all other msr modes
+ */
+extern "C" void FASTCALL jitcDestroyAndFreeClientPage(ClientPage *cp)
+{
+	ClientPage **head = &gJITC.clientPages[cp->baseaddress >> 12];
+	while (*head) {
+		jitcDestroyAndFreeSingleClientPage(*head);
+	}
+}
+
 /**
  *	Destroys and touches ClientPage
  */
@@ -288,14 +413,15 @@ static TranslationCacheFragment *jitcAllocFragment()
 		 */
 		gJITC.destroy_write--;	// destroy and free will increase this
 		gJITC.destroy_ootc++;
-		jitcDestroyAndFreeClientPage(gJITC.LRUpage);
+		jitcDestroyAndFreeSingleClientPage(gJITC.LRUpage);
 	}
 	return jitcGetFragment();
 }
 
 /**
  *	Moves page from freeClientPages at the end of the LRU list if there's
- *	a free page or destroys the LRU page and touches it
+ *	a free page or destroys the LRU page and touches it.
+ *	The page is mapped for the current msr mode.
  */
 extern "C" ClientPage *jitcCreateClientPage(uint32 baseaddr)
 {
@@ -323,32 +449,46 @@ extern "C" ClientPage *jitcCreateClientPage(uint32 baseaddr)
 		if (gJITC.LRUpage) jitcDestroyAndTouchClientPage(gJITC.LRUpage);
 		if (gJITC.LRUpage) jitcDestroyAndTouchClientPage(gJITC.LRUpage);
 	}
-	jitcMapClientPage(baseaddr, cp);
+	jitcMapClientPage(baseaddr, jitcMSRMode(), cp);
 	return cp;
 }
 
 /**
- *	Returns the ClientPage which maps to baseaddr or
- *	creates a new page that maps to baseaddr
+ *	Returns the ClientPage which maps to baseaddr in the
+ *	current msr mode or creates a new page that maps to it
  */
 ClientPage *jitcGetOrCreateClientPage(uint32 baseaddr)
 {
+	uint32 mode = jitcMSRMode();
 	ClientPage *cp = gJITC.clientPages[baseaddr >> 12];
-	if (cp) {
-		return cp;
-	} else {
-		return jitcCreateClientPage(baseaddr);
+	while (cp) {
+		if (cp->msrMode == mode) return cp;
+		cp = cp->nextMode;
 	}
+	return jitcCreateClientPage(baseaddr);
 }
 
 static void jitcCreateEntrypoint(ClientPage *cp, uint32 ofs)
 {
-	cp->entrypoints[ofs >> 2] = cp->tcp;
+	if (!cp->entrypoints) {
+		cp->entrypoints = jitcAllocEntrypoints(JITC_ENTRYPOINTS_MIN_BITS);
+		cp->entrypointsMask = (1 << JITC_ENTRYPOINTS_MIN_BITS) - 1;
+		cp->entrypointsCount = 0;
+	} else if (cp->entrypointsCount*4 >= (cp->entrypointsMask+1)*3
+	 && cp->entrypointsMask < (1 << JITC_ENTRYPOINTS_MAX_BITS) - 1) {
+		// keep the load factor below 3/4
+		jitcGrowEntrypoints(cp);
+	}
+	JitcEntrypoint *e = jitcEntrypointSlot(cp, ofs);
+	if (!e->native) cp->entrypointsCount++;
+	e->ofs = ofs;
+	e->native = cp->tcp;
 }
 
 static NativeAddress jitcGetEntrypoint(ClientPage *cp, uint32 ofs)
 {
-	return cp->entrypoints[ofs >> 2];
+	if (!cp->entrypoints) return NULL;
+	return jitcEntrypointSlot(cp, ofs)->native;
 }
 
 extern uint64 gJITCCompileTicks;
@@ -359,8 +499,8 @@ extern "C" NativeAddress FASTCALL jitcNewEntrypoint(ClientPage *cp, uint32 basea
 {
 /*
 	gJITCRunTicks += jitcDebugGetTicks() - gJITCRunTicksStart;
-	uint64 jitcCompileStartTicks = jitcDebugGetTicks();
 */
+	uint64 jitcCompileStartTicks = jitcDebugGetTicks();
 	jitcDebugLogAdd("=== jitcNewEntrypoint: %08x Beginning jitc ===\n", baseaddr+ofs);
 	gJITC.currentPage = cp;
 	
@@ -374,24 +514,46 @@ extern "C" NativeAddress FASTCALL jitcNewEntrypoint(ClientPage *cp, uint32 basea
 
 	gJITC.pc = ofs;
         jitcInvalidateAll();
-	gJITC.checkedPriviledge = false;
-	gJITC.checkedFloat = false;
-	gJITC.checkedVector = false;
 	
 	// now we've setup gJITC and can start the real compilation
 
+	// exit jump of a recognized loop, see ppc_idiom.h
+	NativeAddress idiomExit = NULL;
+	uint32 idiomExitOfs = 0;
+
 	while (1) {
 		gJITC.current_opc = ppc_word_from_BE(*(uint32 *)(&physpage[ofs]));
 		jitcDebugLogNewInstruction();
-		JITCFlow flow = ppc_gen_opc();
+		JITCFlow flow;
+		int fused = 0;
+		if (gPPCTrace) {
+			/*
+			 *	Trace every single instruction,
+			 *	so no idioms and no fusing.
+			 */
+			jitcClobberAll();
+			asmMOVRegDMem(EAX, (uint32)&gCPU.current_code_base);
+			asmALURegImm(X86_ADD, EAX, ofs);
+			asmALURegImm(X86_MOV, EDX, gJITC.current_opc);
+			asmCALL((NativeAddress)&ppc_trace_insn);
+		} else {
+			if (!idiomExit) {
+				idiomExit = ppc_gen_idiom(physpage, ofs, idiomExitOfs);
+			}
+			fused = ppc_gen_fused(physpage, ofs);
+		}
+		if (fused) {
+			ofs += 4*(fused-1);
+			gJITC.pc += 4*(fused-1);
+			flow = flowContinue;
+		} else {
+			flow = ppc_gen_opc();
+		}
 		if (flow == flowContinue) {
 			/* nothing to do */
 		} else if (flow == flowEndBlock) {
 			jitcClobberAll();
 
-			gJITC.checkedPriviledge = false;
-			gJITC.checkedFloat = false;
-			gJITC.checkedVector = false;
 			if (ofs+4 < 4096) {
 				jitcCreateEntrypoint(cp, ofs+4);
 			}
@@ -400,6 +562,15 @@ extern "C" NativeAddress FASTCALL jitcNewEntrypoint(ClientPage *cp, uint32 basea
 			break;
 		}
 		ofs += 4;
+		if (idiomExit && ofs == idiomExitOfs) {
+			/*
+			 *	The loop ends with a branch (flowEndBlock),
+			 *	so all registers are clobbered here, just
+			 *	like after the helper call.
+			 */
+			asmResolveFixup(idiomExit);
+			idiomExit = NULL;
+		}
 		if (ofs == 4096) {
 			/*
 			 *	End of page.
@@ -413,9 +584,13 @@ extern "C" NativeAddress FASTCALL jitcNewEntrypoint(ClientPage *cp, uint32 basea
 		}
 		gJITC.pc += 4;
 	}
+	/*
+	 *	Every way out of the loop above ends here,
+	 *	ppc_cpu_get_translation_cycles() reports this.
+	 */
+	gJITCCompileTicks += jitcDebugGetTicks() - jitcCompileStartTicks;
 /*
 	gJITCRunTicksStart = jitcDebugGetTicks();
-	gJITCCompileTicks += jitcDebugGetTicks() - jitcCompileStartTicks;	
 */
 	return entry;
 }
@@ -454,6 +629,21 @@ extern "C" NativeAddress FASTCALL jitcNewPC(uint32 entry)
 	}
 }
 
+/**
+ *	Like jitcNewPC() for one of the exception vectors,
+ *	but remembers the result (see JitcExceptionVector).
+ *	Must be called with msr = 0.
+ */
+extern "C" NativeAddress FASTCALL jitcNewExceptionPC(int vector)
+{
+	NativeAddress entry = jitcNewPC(gJITCExceptionVector[vector]);
+	ClientPage *cp = gJITC.clientPages[0];
+	while (cp->msrMode != 0) cp = cp->nextMode;
+	gJITCExceptionPage = cp;
+	gJITCExceptionEntry[vector] = entry;
+	return entry;
+}
+
 extern "C" void FASTCALL jitc_error_msr_unsupported_bits(uint32 a)
 {
 	ht_printf("JITC msr Error: %08x\n", a);
@@ -491,43 +681,39 @@ bool jitc_init(int maxClientPages, uint32 tcSize)
 	memset(gJITC.clientPages, 0, maxPages * sizeof (ClientPage *));
 
 	// allocate fragments
-	TranslationCacheFragment *tcf = (TranslationCacheFragment *)malloc(sizeof (TranslationCacheFragment));
-	gJITC.freeFragmentsList = tcf;
-	tcf->base = gJITC.translationCache;
-	for (uint32 addr=FRAGMENT_SIZE; addr < tcSize; addr += FRAGMENT_SIZE) {
-		tcf->prev = (TranslationCacheFragment *)malloc(sizeof (TranslationCacheFragment));
-		tcf = tcf->prev;
-		tcf->base = gJITC.translationCache + addr;
+	int maxFragments = tcSize / FRAGMENT_SIZE;
+	gJITC.fragments = (TranslationCacheFragment *)malloc(maxFragments * sizeof (TranslationCacheFragment));
+	if (!gJITC.fragments) return false;
+	for (int i=0; i < maxFragments; i++) {
+		gJITC.fragments[i].base = gJITC.translationCache + i*FRAGMENT_SIZE;
+		gJITC.fragments[i].prev = (i+1 < maxFragments) ? &gJITC.fragments[i+1] : NULL;
 	}
-	tcf->prev = NULL;
+	gJITC.freeFragmentsList = gJITC.fragments;
 	
-	// allocate client pages
-	ClientPage *cp = (ClientPage *)malloc(sizeof (ClientPage));
-	memset(cp->entrypoints, 0, sizeof cp->entrypoints);
-	cp->tcf_current = NULL; // not translated yet
-	cp->lessRU = NULL;
-	gJITC.LRUpage = NULL;
-	gJITC.freeClientPages = cp;
-	for (int i=1; i < maxClientPages; i++) {
-		cp->moreRU = (ClientPage *)malloc(sizeof (ClientPage));
-		cp->moreRU->lessRU = cp;
-		cp = cp->moreRU;
-		
-		memset(cp->entrypoints, 0, sizeof cp->entrypoints);
-		cp->tcf_current = NULL; // not translated yet
+	// allocate client pages (not translated yet)
+	gJITC.pages = (ClientPage *)malloc(maxClientPages * sizeof (ClientPage));
+	if (!gJITC.pages) return false;
+	memset(gJITC.pages, 0, maxClientPages * sizeof (ClientPage));
+	for (int i=0; i < maxClientPages; i++) {
+		ClientPage *cp = &gJITC.pages[i];
+		cp->lessRU = i ? &gJITC.pages[i-1] : NULL;
+		cp->moreRU = (i+1 < maxClientPages) ? &gJITC.pages[i+1] : NULL;
 	}
-	cp->moreRU = NULL;
+	gJITC.LRUpage = NULL;
 	gJITC.MRUpage = NULL;
+	gJITC.freeClientPages = gJITC.pages;
 	
 	// initialize native registers
-	NativeRegType *nr = (NativeRegType *)malloc(sizeof (NativeRegType));
+	gJITC.regs = (NativeRegType *)malloc(8 * sizeof (NativeRegType));
+	if (!gJITC.regs) return false;
+	NativeRegType *nr = &gJITC.regs[EAX];
 	nr->reg = EAX;
 	nr->lessRU = NULL;
 	gJITC.LRUreg = nr;
 	gJITC.nativeRegsList[EAX] = nr;
 	for (NativeReg reg = ECX; reg <= EDI; reg=(NativeReg)(reg+1)) {
 		if (reg != ESP) {
-			nr->moreRU = (NativeRegType *)malloc(sizeof (NativeRegType));
+			nr->moreRU = &gJITC.regs[reg];
 			nr->moreRU->lessRU = nr;
 			nr = nr->moreRU;
 			nr->reg = reg;
@@ -601,6 +787,7 @@ bool jitc_init(int maxClientPages, uint32 tcSize)
 	memset(gJITC.tlb_code_eff, 0xff, sizeof gJITC.tlb_code_eff);
 	memset(gJITC.tlb_data_read_eff, 0xff, sizeof gJITC.tlb_data_read_eff);
 	memset(gJITC.tlb_data_write_eff, 0xff, sizeof gJITC.tlb_data_write_eff);
+	ppc_tlb_contexts_reset(gJITC.tlbContexts);
 	gJITC.tlb_code_hits = 0;
 	gJITC.tlb_data_read_hits = 0;
 	gJITC.tlb_data_write_hits = 0;
@@ -613,4 +800,13 @@ bool jitc_init(int maxClientPages, uint32 tcSize)
 void jitc_done()
 {
 	if (gJITC.translationCache) sys_free_read_write_execute(gJITC.translationCache);
+	free(gJITC.fragments);
+	free(gJITC.pages);
+	free(gJITC.regs);
+	free(gJITC.clientPages);
+	while (gJITC.arenaChunks) {
+		byte *next = *(byte **)gJITC.arenaChunks;
+		free(gJITC.arenaChunks);
+		gJITC.arenaChunks = next;
+	}
 }
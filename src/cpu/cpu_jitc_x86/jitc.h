@@ -21,6 +21,7 @@
 #ifndef __JITC_H__
 #define __JITC_H__
 
+#include "cpu/tlbcontext.h"
 #include "jitc_types.h"
 #include "x86asm.h"
 
@@ -51,19 +52,44 @@ struct TranslationCacheFragment {
 	TranslationCacheFragment *prev; 
 };
 
+/**
+ *	One slot of the entrypoint map of a client page.
+ *	The slot is empty if native == NULL.
+ */
+struct JitcEntrypoint {
+	NativeAddress native;
+	uint32 ofs;
+};
+
+/**
+ *	Entrypoint maps have 8, 16, ..., 1024 slots
+ *	(there are only 1024 possible entries per page).
+ */
+#define JITC_ENTRYPOINTS_MIN_BITS	3
+#define JITC_ENTRYPOINTS_MAX_BITS	10
+
+/**
+ *	Size of the chunks the JIT metadata is allocated from
+ */
+#define JITC_ARENA_CHUNK_SIZE	(64*1024)
+
 /**
  *	Used to describe a (not neccessarily translated) client page
  */
 struct ClientPage {
 	/**
 	 *	This is used to translate client page addresses 
-	 *	into host addresses. Address isn't (yet) an entrypoint 
-	 *	or not yet translated if entrypoints[page_offset] == 0
+	 *	into host addresses. It's an open addressed hash
+	 *	table of entrypointsMask+1 slots, which is grown
+	 *	as entrypoints are created.
+	 *	Address isn't (yet) an entrypoint or not yet translated
+	 *	if it isn't found in the table.
 	 *
-	 *	Note that a client page has 4096 bytes, but there are only
-	 *	1024 possible entries per page.
+	 *	entrypoints == NULL if page isn't translated yet
 	 */
-	NativeAddress entrypoints[1024];
+	JitcEntrypoint *entrypoints;
+	uint32 entrypointsMask;
+	uint32 entrypointsCount;
 	uint32 baseaddress;
 
 	/**
@@ -77,6 +103,13 @@ struct ClientPage {
 
 	ClientPage *moreRU;	//* points to a page which was used more recently
 	ClientPage *lessRU;	//* points to a page which was used less recently
+
+	/**
+	 *	The translation is only valid for (msr & JITC_MSR_MODE_MASK) == msrMode
+	 *	All translations of one physical page are chained by nextMode.
+	 */
+	uint32 msrMode;
+	ClientPage *nextMode;
 };
 
 struct NativeRegType {
@@ -99,11 +132,36 @@ enum RegisterState {
 
 #define TLB_ENTRIES 32
 
+/**
+ *	Translations are specialized on these MSR bits, so the
+ *	generated code doesn't have to check them at run time.
+ *	The msr can only change when leaving a translation
+ *	(mtmsr, rfi and exceptions all go through jitcNewPC()).
+ */
+#define JITC_MSR_MODE_MASK	(MSR_PR | MSR_FP | MSR_VEC)
+
+/**
+ *	Exceptions always enter with msr = 0, ie. in real mode and in
+ *	msr mode 0. So the native entry points of the busiest vectors
+ *	are resolved once and jumped to directly by the exception
+ *	helpers in jitc_tools.S (which hardcode these indices) until
+ *	the translation of physical page 0 is destroyed.
+ */
+enum JitcExceptionVector {
+	JITC_EXC_DSI = 0,	// 0x300
+	JITC_EXC_ISI = 1,	// 0x400
+	JITC_EXC_PROGRAM = 2,	// 0x700
+	JITC_EXC_DEC = 3,	// 0x900
+	JITC_EXC_SC = 4,	// 0xc00
+	JITC_EXC_VECTORS
+};
+
 struct JITC {	
 	/**
 	 *	This is the array of all (physical) pages of the client.
 	 *	The entries might be NULL indicating the this base address
-	 *	isn't translated yet.
+	 *	isn't translated yet. Otherwise they point to a chain
+	 *	of translations (one per msr mode, see ClientPage::nextMode).
 	 */
 	ClientPage **clientPages;
 
@@ -116,6 +174,13 @@ struct JITC {
 	uint32 tlb_code_phys[TLB_ENTRIES];
 	uint32 tlb_data_read_phys[TLB_ENTRIES];
 	uint32 tlb_data_write_phys[TLB_ENTRIES];
+
+	/**
+	 *	Context id of each segment (see cpu/tlbcontext.h),
+	 *	it's or'ed into the tags above
+	 */
+	uint32 tlb_context[16];
+
 	uint64 tlb_code_hits;
 	uint64 tlb_data_read_hits;
 	uint64 tlb_data_write_hits;
@@ -150,6 +215,7 @@ struct JITC {
 	 *
 	 */
 	PPC_CRx nativeFlags;
+	NativeFlagsKind nativeFlagsKind;
 	RegisterState nativeFlagsState;
 	RegisterState nativeCarryState;
 	
@@ -173,13 +239,6 @@ struct JITC {
 	JitcFloatReg floatRegPerm[9];
 	JitcFloatReg floatRegPermInverse[9];
 
-	/**
-	 *	Do this only once per basic block
-	 */
-	bool checkedPriviledge;
-	bool checkedFloat;
-	bool checkedVector; 
-	 
 	/**
 	 *	The FPU can be in 53 bit or in 64 bit mode
 	 */	
@@ -220,6 +279,29 @@ struct JITC {
 	 *
 	 */
 	byte *translationCache;
+
+	/**
+	 *	The fragment, client page and register descriptors
+	 *	(allocated once in jitc_init)
+	 */
+	TranslationCacheFragment *fragments;
+	ClientPage *pages;
+	NativeRegType *regs;
+
+	/**
+	 *	Unused entrypoint maps, one list per size
+	 *	(linked through the first slot)
+	 */
+	JitcEntrypoint *freeEntrypoints[JITC_ENTRYPOINTS_MAX_BITS+1];
+
+	/**
+	 *	Entrypoint maps are carved from these chunks.
+	 *	They are chained through their first word and
+	 *	only freed in jitc_done().
+	 */
+	byte *arenaChunks;
+	byte *arenaCurrent;
+	uint arenaLeft;
 	
 	/**
 	 *	Only valid while compiling
@@ -251,6 +333,11 @@ struct JITC {
 	NativeVectorReg LRUvregs[9];
 	NativeVectorReg MRUvregs[9];
 	int nativeVectorReg;
+
+	/**
+	 *	Allocates the ids in tlb_context
+	 */
+	PPC_TLBContexts tlbContexts;
 };
 extern JITC gJITC;
 
@@ -261,6 +348,14 @@ bool FASTCALL jitcEmitAssure(int size);
 
 extern "C" void FASTCALL jitcDestroyAndFreeClientPage(ClientPage *cp);
 extern "C" NativeAddress FASTCALL jitcNewPC(uint32 entry);
+extern "C" NativeAddress FASTCALL jitcNewExceptionPC(int vector);
+
+/**
+ *	Cached entry points (NULL if not resolved yet) and the
+ *	ClientPage they belong to, see JitcExceptionVector
+ */
+extern "C" NativeAddress gJITCExceptionEntry[JITC_EXC_VECTORS];
+extern "C" ClientPage *gJITCExceptionPage;
 
 bool jitc_init(int maxClientPages, uint32 tcSize);
 void jitc_done();
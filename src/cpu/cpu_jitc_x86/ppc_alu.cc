@@ -739,6 +739,11 @@ JITCFlow ppc_opc_gen_cmp()
 	NativeReg a = jitcGetClientRegister(PPC_GPR(rA));
 	NativeReg b = jitcGetClientRegister(PPC_GPR(rB));
 	asmALURegReg(X86_CMP, a, b);
+	if (cr == 0) {
+		// keep cr0 in the x86 flags, so a following bc can use them directly
+		jitcMapFlagsDirty(PPC_CR0, fkCMP);
+		return flowContinue;
+	}
 #if 0
 	if (cr == 0) {
 		asmCALL((NativeAddress)ppc_flush_flags_signed_0_asm);
@@ -792,6 +797,11 @@ JITCFlow ppc_opc_gen_cmpi()
 	jitcClobberCarryAndFlags();
 	NativeReg a = jitcGetClientRegister(PPC_GPR(rA));
 	asmALURegImm(X86_CMP, a, imm);
+	if (cr == 0) {
+		// keep cr0 in the x86 flags, so a following bc can use them directly
+		jitcMapFlagsDirty(PPC_CR0, fkCMP);
+		return flowContinue;
+	}
 #if 0
 	if (cr == 0) {
 		asmCALL((NativeAddress)ppc_flush_flags_signed_0_asm);
@@ -844,6 +854,11 @@ JITCFlow ppc_opc_gen_cmpl()
 	NativeReg a = jitcGetClientRegister(PPC_GPR(rA));
 	NativeReg b = jitcGetClientRegister(PPC_GPR(rB));
 	asmALURegReg(X86_CMP, a, b);
+	if (cr == 0) {
+		// keep cr0 in the x86 flags, so a following bc can use them directly
+		jitcMapFlagsDirty(PPC_CR0, fkCMPL);
+		return flowContinue;
+	}
 #if 0
 	if (cr == 0) {
 		asmCALL((NativeAddress)ppc_flush_flags_unsigned_0_asm);
@@ -897,6 +912,11 @@ JITCFlow ppc_opc_gen_cmpli()
 	jitcClobberCarryAndFlags();
 	NativeReg a = jitcGetClientRegister(PPC_GPR(rA));
 	asmALURegImm(X86_CMP, a, imm);
+	if (cr == 0) {
+		// keep cr0 in the x86 flags, so a following bc can use them directly
+		jitcMapFlagsDirty(PPC_CR0, fkCMPL);
+		return flowContinue;
+	}
 #if 0
 	if (cr == 0) {
 		asmCALL((NativeAddress)ppc_flush_flags_unsigned_0_asm);
@@ -2024,6 +2044,36 @@ static void ppc_opc_gen_rotl_and(NativeReg r, int SH, uint32 mask)
 		}
 	}	
 }
+/*
+ *	r := rotl(s, SH), possibly only partially like
+ *	ppc_opc_gen_rotl_and(). r must not be s.
+ */
+static void ppc_opc_gen_mov_rotl_and(NativeReg r, NativeReg s, int SH, uint32 mask)
+{
+	SH &= 0x1f;
+	uint32 low = (1<<SH)-1;
+	if (SH && gJITC.hostCPUCaps.bmi2 && (mask & low) && (mask & ~low)) {
+		// a real rotate, rorx saves us the mov
+		asmRORXRegRegImm(r, s, 32-SH);
+	} else {
+		asmALURegReg(X86_MOV, r, s);
+		ppc_opc_gen_rotl_and(r, SH, mask);
+	}
+}
+/*
+ *	Returns true if the result of ppc_opc_gen_rotl_and() already
+ *	is masked by mask (i.e. the shift did all the work)
+ */
+static bool ppc_opc_rotl_and_is_masked(int SH, uint32 mask)
+{
+	SH &= 0x1f;
+	if (mask == 0xffffffff) return true;
+	if (!SH) return false;
+	uint32 low = (1<<SH)-1;
+	if (!(mask & low)) return mask == ~low;
+	if (!(mask & ~low)) return mask == low;
+	return false;
+}
 JITCFlow ppc_opc_gen_rlwimix()
 {
 	int rS, rA, SH, MB, ME;
@@ -2037,8 +2087,7 @@ JITCFlow ppc_opc_gen_rlwimix()
 	NativeReg s = jitcGetClientRegister(PPC_GPR(rS));
 	NativeReg a = jitcGetClientRegisterDirty(PPC_GPR(rA));
 	NativeReg tmp = jitcAllocRegister();
-	asmALURegReg(X86_MOV, tmp, s);
-	ppc_opc_gen_rotl_and(tmp, SH, mask);
+	ppc_opc_gen_mov_rotl_and(tmp, s, SH, mask);
 	asmALURegImm(X86_AND, a, ~mask);
 	asmALURegImm(X86_AND, tmp, mask);
 	asmALURegReg(X86_OR, a, tmp);
@@ -2075,16 +2124,18 @@ JITCFlow ppc_opc_gen_rlwinmx()
 		jitcClobberCarryAndFlags();
 	}
 	NativeReg a;
+	uint32 mask = ppc_mask(MB, ME);
 	if (rS == rA) {
 		a = jitcGetClientRegisterDirty(PPC_GPR(rA));
+		ppc_opc_gen_rotl_and(a, SH, mask);
 	} else {
 		NativeReg s = jitcGetClientRegister(PPC_GPR(rS));
 		a = jitcMapClientRegisterDirty(PPC_GPR(rA));
-		asmALURegReg(X86_MOV, a, s);
+		ppc_opc_gen_mov_rotl_and(a, s, SH, mask);
+	}
+	if ((gJITC.current_opc & PPC_OPC_Rc) || !ppc_opc_rotl_and_is_masked(SH, mask)) {
+		asmALURegImm(X86_AND, a, mask);
 	}
-	uint32 mask = ppc_mask(MB, ME);
-	ppc_opc_gen_rotl_and(a, SH, mask);
-	asmALURegImm(X86_AND, a, mask);
 	if (gJITC.current_opc & PPC_OPC_Rc) {
 		/*
 		 *	Important side-node:
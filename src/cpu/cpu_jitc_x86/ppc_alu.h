@@ -171,4 +171,6 @@ JITCFlow ppc_opc_gen_xorx();
 JITCFlow ppc_opc_gen_xori();
 JITCFlow ppc_opc_gen_xoris();
 
+JITCFlow ppc_opc_gen_addi_addis(int rD, int rA, uint32 imm);
+
 #endif
@@ -28,9 +28,12 @@
 #include "system/sysclk.h"
 #include "system/systhread.h"
 #include "system/systimer.h"
+#include "tools/stream.h"
+#include "cpu/cputrace.h"
 #include "ppc_cpu.h"
 #include "ppc_dec.h"
 #include "ppc_mmu.h"
+#include "ppc_opc.h"
 #include "jitc.h"
 #include "jitc_asm.h"
 #include "jitc_debug.h"
@@ -103,14 +106,25 @@ static void decTimerCB(sys_timer t)
 //	cpu_wakeup();
 }
 
+static bool gCPUHasRun = false;
+
 void ppc_cpu_run()
 {
 //	ppc_fpu_test();
 //	return;
+	gCPU.stop_exception = false;
+	gCPU.exception_pending = gCPU.dec_exception || gCPU.ext_exception;
+	PPC_CPU_TRACE("execution started at %08x\n", gCPU.pc);
+	if (gCPUHasRun) {
+		// resumed after ppc_cpu_stop()
+		ppc_start_jitc_asm(gCPU.pc);
+		return;
+	}
+	gCPUHasRun = true;
+	ppc_mmu_tlb_update_mode();
 	gJITCRunTicks = 0;
 	gJITCCompileTicks = 0;
 	gJITCRunTicksStart = jitcDebugGetTicks();
-	PPC_CPU_TRACE("execution started at %08x\n", gCPU.pc);
 	jitcDebugInit();
 /*
 	PPC_CPU_WARN("clock ticks / second = %08qx\n", q);
@@ -121,10 +135,6 @@ void ppc_cpu_run()
 	q = sys_get_cpu_ticks();
 	PPC_CPU_WARN("ticks = %08qx\n", q);*/
 
-	if (!sys_create_timer(&gDECtimer, decTimerCB)) {
-		ht_printf("Unable to create timer\n");
-		exit(1);
-	}
 	ppc_start_jitc_asm(gCPU.pc);
 }
 
@@ -141,6 +151,14 @@ void ppc_cpu_map_framebuffer(uint32 pa, uint32 ea)
 	gCPU.dbat_brpn[0] = gCPU.dbatl[0] & gCPU.dbat_bl[0];
 }
 
+/*
+ *	The jitc only caches physical addresses, framebuffer
+ *	stores mark their page every time (see fb_host in jitc_mmu.S).
+ */
+void ppc_cpu_protect_framebuffer()
+{
+}
+
 
 void ppc_cpu_stop()
 {
@@ -148,6 +166,58 @@ void ppc_cpu_stop()
 	gCPU.stop_exception = true;
 }
 
+void ppc_cpu_trace_state(PPCTraceState &s)
+{
+	s.pc = gCPU.pc;
+	s.msr = gCPU.msr;
+	s.cr = gCPU.cr;
+	s.xer = gCPU.xer | (gCPU.xer_ca ? XER_CA : 0);
+	s.lr = gCPU.lr;
+	s.ctr = gCPU.ctr;
+	s.fpscr = gCPU.fpscr;
+	s.srr0 = gCPU.srr[0];
+	s.srr1 = gCPU.srr[1];
+	memcpy(s.gpr, gCPU.gpr, sizeof s.gpr);
+	memcpy(s.fpr, gCPU.fpr, sizeof s.fpr);
+}
+
+void ppc_cpu_save_state(Stream &st)
+{
+	ppc_get_cpu_timebase();
+	ppc_opc_read_dec();
+	st.writex(&gCPU, sizeof gCPU);
+}
+
+void ppc_cpu_load_state(Stream &st)
+{
+	st.readx(&gCPU, sizeof gCPU);
+	gCPU.stop_exception = false;
+	gCPU.exception_pending = gCPU.dec_exception || gCPU.ext_exception;
+	gTBreadITB = sys_get_hiresclk_ticks();
+	ppc_opc_restart_dec();
+	ppc_mmu_tlb_invalidate();
+	ppc_mmu_tlb_update_mode();
+}
+
+/*
+ *	The translated code addresses gCPU and gJITC directly,
+ *	so there is only one cpu.
+ */
+int ppc_cpu_count()
+{
+	return 1;
+}
+
+int ppc_cpu_current()
+{
+	return 0;
+}
+
+bool ppc_cpu_start(int cpu, uint32 pc, uint32 arg)
+{
+	return false;
+}
+
 uint64	ppc_get_clock_frequency(int cpu)
 {
 	return gClientClockFrequency;
@@ -182,6 +252,12 @@ void	ppc_cpu_set_gpr(int cpu, int i, uint32 newvalue)
 void	ppc_cpu_set_msr(int cpu, uint32 newvalue)
 {
 	gCPU.msr = newvalue;
+	ppc_mmu_tlb_update_mode();
+}
+
+uint32	ppc_cpu_get_msr(int cpu)
+{
+	return gCPU.msr;
 }
 
 void	ppc_cpu_set_pc(int cpu, uint32 newvalue)
@@ -199,6 +275,11 @@ uint32	ppc_cpu_get_pvr(int cpu)
 	return gCPU.pvr;
 }
 
+uint64	ppc_cpu_get_translation_cycles()
+{
+	return gJITCCompileTicks;
+}
+
 
 void ppc_set_singlestep_v(bool v, const char *file, int line, const char *format, ...)
 {
@@ -217,6 +298,7 @@ void ppc_set_singlestep_nonverbose(bool v)
 }
 
 #define CPU_KEY_PVR	"cpu_pvr"
+#define CPU_KEY_COUNT	"cpu_count"
 
 #include "configparser.h"
 
@@ -224,6 +306,9 @@ bool ppc_cpu_init()
 {
 	memset(&gCPU, 0, sizeof gCPU);
 	gCPU.pvr = gConfig->getConfigInt(CPU_KEY_PVR);
+	if (gConfig->getConfigInt(CPU_KEY_COUNT) != 1) {
+		PPC_CPU_WARN("the just-in-time compiler only supports one cpu, %s ignored\n", CPU_KEY_COUNT);
+	}
 	
 	ppc_dec_init();
 	// initialize srs (mostly for prom)
@@ -235,6 +320,11 @@ bool ppc_cpu_init()
 
 	sys_create_semaphore(&gCPUDozeSem);
 
+	if (!sys_create_timer(&gDECtimer, decTimerCB)) {
+		ht_printf("Unable to create timer\n");
+		exit(1);
+	}
+
 	gStartHostCLKTicks = sys_get_hiresclk_ticks();
 	uint64 q = sys_get_hiresclk_ticks_per_second();
 	gHostClockScale = 0;
@@ -250,10 +340,11 @@ bool ppc_cpu_init()
 	gClientBusFrequency = gClientTimeBaseFrequency * 4;
 	gClientClockFrequency = gClientBusFrequency * 5;
 
-	return jitc_init(4096, 32*1024*1024);
+	return jitc_init(16384, 32*1024*1024);
 }
 
 void ppc_cpu_init_config()
 {
-	gConfig->acceptConfigEntryIntDef("cpu_pvr", 0x000c0201);
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_PVR, 0x000c0201);
+	gConfig->acceptConfigEntryIntDef(CPU_KEY_COUNT, 1);
 }
@@ -62,51 +62,6 @@ static void ppc_opc_special()
 		call_prom_osi();
 		return;
 	}
-	if (gCPU.current_opc == 0x00333301) {
-		// memset(r3, r4, r5)
-		uint32 dest = gCPU.gpr[3];
-		uint32 c = gCPU.gpr[4];
-		uint32 size = gCPU.gpr[5];
-		if (dest & 0xfff) {
-			byte *dst;
-			ppc_direct_effective_memory_handle(dest, dst);
-			uint32 a = 4096 - (dest & 0xfff);
-			memset(dst, c, a);
-			size -= a;
-			dest += a;
-		}
-		while (size >= 4096) {
-			byte *dst;
-			ppc_direct_effective_memory_handle(dest, dst);
-			memset(dst, c, 4096);
-			dest += 4096;
-			size -= 4096;
-		}
-		if (size) {
-			byte *dst;
-			ppc_direct_effective_memory_handle(dest, dst);
-			memset(dst, c, size);
-		}
-		gCPU.pc = gCPU.npc;
-		return;
-	}
-	if (gCPU.current_opc == 0x00333302) {
-		// memcpy
-		uint32 dest = gCPU.gpr[3];
-		uint32 src = gCPU.gpr[4];
-		uint32 size = gCPU.gpr[5];
-		byte *d, *s;
-		ppc_direct_effective_memory_handle(dest, d);
-		ppc_direct_effective_memory_handle(src, s);
-		while (size--) {
-			if (!(dest & 0xfff)) ppc_direct_effective_memory_handle(dest, d);
-			if (!(src & 0xfff)) ppc_direct_effective_memory_handle(src, s);
-			*d = *s;
-			src++; dest++; d++; s++;
-		}
-		gCPU.pc = gCPU.npc;
-		return;
-	}
 	ppc_opc_invalid();
 }
 
@@ -1,6 +1,6 @@
 /*
  *	PearPC
- *	ppc_dec.h
+ *	ppc_esc.h
  *
  *	Copyright (C) 2003, 2004 Sebastian Biallas (sb@biallas.net)
  *
@@ -22,23 +22,7 @@
 #define __PPC_ESC_H__
 
 #include "system/types.h"
-
-#define PPC_OPC_ESCAPE_VM 0x0069BABE
-
-#define PPC_ESCAPE_IF_VERSION		0
-
-// values for r3
-#define PPC_INTERN_VERSION		0
-
-#define PPC_INTERN_MEMSET		1
-#define PPC_INTERN_MEMCPY		2
-#define PPC_INTERN_BZERO		3
-#define PPC_INTERN_BZERO_PHYS		4
-#define PPC_INTERN_BCOPY		5
-#define PPC_INTERN_BCOPY_PHYS		6
-#define PPC_INTERN_BCOPY_PHYSVIR	7
-#define PPC_INTERN_COPY_PAGE		8
-
+#include "cpu/esc.h"
 
 void FASTCALL ppc_escape_vm(uint32 func, uint32 *esp, uint32 client_pc);
 
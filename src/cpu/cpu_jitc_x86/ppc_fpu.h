@@ -641,23 +641,19 @@ double ppc_fpu_get_double(ppc_double &d);
 #include "x86asm.h"
 #include "ppc_exc.h"
 
+/*
+ *	Translations are specialized on MSR_FP, see ppc_opc_gen_check_privilege()
+ */
 static UNUSED void ppc_opc_gen_check_fpu()
 {
-	if (!gJITC.checkedFloat) {
+	if (!(gJITC.currentPage->msrMode & MSR_FP)) {
 		jitcFloatRegisterClobberAll();
 		jitcFlushVectorRegister();
 		jitcClobberCarryAndFlags();
 
-		NativeReg r1 = jitcGetClientRegister(PPC_MSR);
-		asmALU(X86_TEST, r1, MSR_FP);
-		NativeAddress fixup = asmJxxFixup(X86_NZ);
-
 		jitcFlushRegisterDirty();
 		asmALU(X86_MOV, ESI, gJITC.pc);
 		asmJMP((NativeAddress)ppc_no_fpu_exception_asm);
-
-		asmResolveFixup(fixup);
-		gJITC.checkedFloat = true;
 	}
 }
 
@@ -0,0 +1,343 @@
+/*
+ *	PearPC
+ *	ppc_idiom.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <cstring>
+
+#include "system/types.h"
+#include "debug/tracers.h"
+#include "jitc.h"
+#include "jitc_asm.h"
+#include "jitc_debug.h"
+#include "ppc_alu.h"
+#include "ppc_cpu.h"
+#include "ppc_dec.h"
+#include "ppc_exc.h"
+#include "ppc_idiom.h"
+#include "ppc_mmu.h"
+#include "ppc_tools.h"
+#include "x86asm.h"
+
+/*
+ *	The helpers below run the loops they replace with exactly
+ *	the semantics of the original instructions, including the
+ *	final values of ctr and of all registers involved. They work
+ *	one page-chunk at a time, so every chunk needs one
+ *	translation per operand.
+ *
+ *	A helper just returns with ctr != 0 if it can't handle the
+ *	next iteration (e.g. an unaligned word crossing a page
+ *	boundary). The translated loop body then executes this
+ *	iteration and branches back to the loop head, which calls
+ *	the helper again.
+ *
+ *	All helpers are called like this:
+ *	EAX: register numbers, EDX: ESP before the call,
+ *	ECX: page offset of the loop head
+ */
+
+static inline bool idiom_translate(uint32 ea, int flags, uint32 &pa)
+{
+	return (ppc_effective_to_physical_vm(ea, flags, pa) & flags) == flags;
+}
+
+/*
+ *	Limits a chunk of n iterations to the loop counter.
+ *	Note that ctr == 0 means 2^32 iterations.
+ */
+static inline uint32 idiom_chunk(uint32 ctr, uint32 n)
+{
+	return (ctr && ctr < n) ? ctr : n;
+}
+
+static void idiom_dsi(uint32 ea, uint32 *stack, uint32 client_pc)
+{
+	// see return_to_dsi_exception_handler() in ppc_esc.cc
+	stack[-1] = (uint32)&ppc_dsi_exception_special_asm;
+	gCPU.pc_ofs = client_pc;
+	gCPU.dar = ea;
+}
+
+/*
+ *	loop:	lwzu	rT, 4(rS)
+ *		stwu	rT, 4(rD)
+ *		bdnz	loop
+ */
+static void FASTCALL ppc_idiom_copy_words(uint32 regs, uint32 *stack, uint32 client_pc)
+{
+	int rT = regs & 0xff;
+	int rS = (regs >> 8) & 0xff;
+	int rD = regs >> 16;
+	uint32 src = gCPU.gpr[rS];
+	uint32 dst = gCPU.gpr[rD];
+	uint32 val = gCPU.gpr[rT];
+	uint32 ctr = gCPU.ctr;
+	do {
+		uint32 ea_s = src + 4;
+		uint32 ea_d = dst + 4;
+		if ((ea_s & 0xfff) > 0xffc || (ea_d & 0xfff) > 0xffc) {
+			// word crosses a page boundary
+			break;
+		}
+		uint32 pa_s, pa_d;
+		if (!idiom_translate(ea_s, PPC_MMU_READ, pa_s)) {
+			idiom_dsi(ea_s, stack, client_pc);
+			break;
+		}
+		if (pa_s >= gMemorySize) {
+			if (ppc_read_physical_word(pa_s, val)) break;
+			src = ea_s;
+			if (!idiom_translate(ea_d, PPC_MMU_READ | PPC_MMU_WRITE, pa_d)) {
+				idiom_dsi(ea_d, stack, client_pc+4);
+				break;
+			}
+			if (ppc_write_physical_word(pa_d, val)) break;
+			dst = ea_d;
+			ctr--;
+			continue;
+		}
+		if (!idiom_translate(ea_d, PPC_MMU_READ | PPC_MMU_WRITE, pa_d)) {
+			val = ppc_word_from_BE(*(uint32*)(gMemory+pa_s));
+			src = ea_s;
+			idiom_dsi(ea_d, stack, client_pc+4);
+			break;
+		}
+		if (pa_d >= gMemorySize) {
+			val = ppc_word_from_BE(*(uint32*)(gMemory+pa_s));
+			src = ea_s;
+			if (ppc_write_physical_word(pa_d, val)) break;
+			dst = ea_d;
+			ctr--;
+			continue;
+		}
+		uint32 n = MIN((4096 - (ea_s & 0xfff)) / 4, (4096 - (ea_d & 0xfff)) / 4);
+		n = idiom_chunk(ctr, n);
+		byte *s = gMemory+pa_s;
+		byte *d = gMemory+pa_d;
+		if (d > s && d < s + 4*n) {
+			/*
+			 *	the loop replicates the words between
+			 *	source and destination, memmove would not
+			 */
+			for (uint32 i=0; i < n; i++) {
+				*(uint32*)(d+4*i) = *(uint32*)(s+4*i);
+			}
+			val = ppc_word_from_BE(*(uint32*)(d+4*(n-1)));
+		} else {
+			val = ppc_word_from_BE(*(uint32*)(s+4*(n-1)));
+			memmove(d, s, 4*n);
+		}
+		src += 4*n;
+		dst += 4*n;
+		ctr -= n;
+	} while (ctr);
+	gCPU.gpr[rT] = val;
+	gCPU.gpr[rS] = src;
+	gCPU.gpr[rD] = dst;
+	gCPU.ctr = ctr;
+}
+
+/*
+ *	loop:	stwu	rS, 4(rD)
+ *		bdnz	loop
+ */
+static void FASTCALL ppc_idiom_fill_words(uint32 regs, uint32 *stack, uint32 client_pc)
+{
+	int rS = regs & 0xff;
+	int rD = (regs >> 8) & 0xff;
+	uint32 val = gCPU.gpr[rS];
+	uint32 dst = gCPU.gpr[rD];
+	uint32 ctr = gCPU.ctr;
+	uint32 be_val = ppc_word_to_BE(val);
+	do {
+		uint32 ea = dst + 4;
+		if ((ea & 0xfff) > 0xffc) break;
+		uint32 pa;
+		if (!idiom_translate(ea, PPC_MMU_READ | PPC_MMU_WRITE, pa)) {
+			idiom_dsi(ea, stack, client_pc);
+			break;
+		}
+		if (pa >= gMemorySize) {
+			if (ppc_write_physical_word(pa, val)) break;
+			dst = ea;
+			ctr--;
+			continue;
+		}
+		uint32 n = idiom_chunk(ctr, (4096 - (ea & 0xfff)) / 4);
+		byte *d = gMemory+pa;
+		if ((val & 0xff) * 0x01010101 == val) {
+			memset(d, val, 4*n);
+		} else {
+			for (uint32 i=0; i < n; i++) {
+				*(uint32*)(d+4*i) = be_val;
+			}
+		}
+		dst += 4*n;
+		ctr -= n;
+	} while (ctr);
+	gCPU.gpr[rD] = dst;
+	gCPU.ctr = ctr;
+}
+
+/*
+ *	loop:	dcbz	rA, rB
+ *		addi	rB, rB, 32
+ *		bdnz	loop
+ */
+static void FASTCALL ppc_idiom_clear_lines(uint32 regs, uint32 *stack, uint32 client_pc)
+{
+	int rA = regs & 0xff;
+	int rB = (regs >> 8) & 0xff;
+	uint32 base = rA ? gCPU.gpr[rA] : 0;
+	uint32 b = gCPU.gpr[rB];
+	uint32 ctr = gCPU.ctr;
+	do {
+		// the aligned line, like dcbz
+		uint32 ea = (base + b) & ~31;
+		uint32 pa;
+		if (!idiom_translate(ea, PPC_MMU_READ | PPC_MMU_WRITE, pa)) {
+			idiom_dsi(ea, stack, client_pc);
+			break;
+		}
+		if (pa >= gMemorySize) break;
+		uint32 n = idiom_chunk(ctr, (4096 - (ea & 0xfff)) / 32);
+		memset(gMemory+pa, 0, 32*n);
+		b += 32*n;
+		ctr -= n;
+	} while (ctr);
+	gCPU.gpr[rB] = b;
+	gCPU.ctr = ctr;
+}
+
+static inline uint32 idiom_opc(byte *physpage, uint32 ofs)
+{
+	return ppc_word_from_BE(*(uint32 *)(&physpage[ofs]));
+}
+
+/*
+ *	Is opc a "bdnz" (with any hint) to target?
+ */
+static bool idiom_is_bdnz(uint32 opc, uint32 ofs, uint32 target)
+{
+	if (PPC_OPC_MAIN(opc) != 16 || (opc & 3)) return false;
+	uint32 BO, BI, BD;
+	PPC_OPC_TEMPL_B(opc, BO, BI, BD);
+	return (BO & 0x16) == 0x10 && ofs + BD == target;
+}
+
+NativeAddress ppc_gen_idiom(byte *physpage, uint32 ofs, uint32 &exit_ofs)
+{
+	if (ofs + 8 > 4096) return NULL;
+	uint32 opc0 = idiom_opc(physpage, ofs);
+	uint32 opc1 = idiom_opc(physpage, ofs+4);
+	NativeAddress helper = NULL;
+	uint32 regs = 0;
+	uint32 len = 0;
+	int r0, r1, r2;
+	uint32 imm;
+	switch (PPC_OPC_MAIN(opc0)) {
+	case 33: {
+		// lwzu rT, 4(rS)
+		if (ofs + 12 > 4096) return NULL;
+		uint32 opc2 = idiom_opc(physpage, ofs+8);
+		int rT, rS;
+		PPC_OPC_TEMPL_D_SImm(opc0, rT, rS, imm);
+		if (imm != 4 || !rS || rT == rS) return NULL;
+		// stwu rT, 4(rD)
+		if (PPC_OPC_MAIN(opc1) != 37) return NULL;
+		PPC_OPC_TEMPL_D_SImm(opc1, r0, r1, imm);
+		if (imm != 4 || r0 != rT || !r1 || r1 == rT || r1 == rS) return NULL;
+		if (!idiom_is_bdnz(opc2, ofs+8, ofs)) return NULL;
+		helper = (NativeAddress)ppc_idiom_copy_words;
+		regs = rT | (rS << 8) | (r1 << 16);
+		len = 12;
+		break;
+	}
+	case 37:
+		// stwu rS, 4(rD)
+		PPC_OPC_TEMPL_D_SImm(opc0, r0, r1, imm);
+		if (imm != 4 || !r1 || r0 == r1) return NULL;
+		if (!idiom_is_bdnz(opc1, ofs+4, ofs)) return NULL;
+		helper = (NativeAddress)ppc_idiom_fill_words;
+		regs = r0 | (r1 << 8);
+		len = 8;
+		break;
+	case 31: {
+		// dcbz rA, rB
+		if (PPC_OPC_EXT(opc0) != 1014) return NULL;
+		if (ofs + 12 > 4096) return NULL;
+		uint32 opc2 = idiom_opc(physpage, ofs+8);
+		int rA, rB;
+		PPC_OPC_TEMPL_X(opc0, r0, rA, rB);
+		if (rA == rB) return NULL;
+		// addi rB, rB, 32
+		if (PPC_OPC_MAIN(opc1) != 14) return NULL;
+		PPC_OPC_TEMPL_D_SImm(opc1, r1, r2, imm);
+		if (imm != 32 || r1 != rB || r2 != rB || !rB) return NULL;
+		if (!idiom_is_bdnz(opc2, ofs+8, ofs)) return NULL;
+		helper = (NativeAddress)ppc_idiom_clear_lines;
+		regs = rA | (rB << 8);
+		len = 12;
+		break;
+	}
+	default:
+		return NULL;
+	}
+	jitcDebugLogAdd("=== idiom %08x at %03x ===\n", opc0, ofs);
+	jitcClobberAll();
+	asmALURegImm(X86_MOV, EAX, regs);
+	asmALURegReg(X86_MOV, EDX, ESP);
+	asmALURegImm(X86_MOV, ECX, gJITC.pc);
+	asmCALL(helper);
+	asmTESTDMemImm((uint32)&gCPU.ctr, 0xffffffff);
+	exit_ofs = ofs + len;
+	return asmJxxFixup(X86_Z);
+}
+
+int ppc_gen_fused(byte *physpage, uint32 ofs)
+{
+	if (ofs + 8 > 4096) return 0;
+	uint32 opc0 = idiom_opc(physpage, ofs);
+	// lis rD, hi
+	if (PPC_OPC_MAIN(opc0) != 15) return 0;
+	int rD, rA;
+	uint32 hi;
+	PPC_OPC_TEMPL_D_Shift16(opc0, rD, rA, hi);
+	if (rA || !rD) return 0;
+	uint32 opc1 = idiom_opc(physpage, ofs+4);
+	int r0, r1;
+	uint32 lo;
+	switch (PPC_OPC_MAIN(opc1)) {
+	case 14:
+		// addi rD, rD, lo
+		PPC_OPC_TEMPL_D_SImm(opc1, r0, r1, lo);
+		if (r0 != rD || r1 != rD) return 0;
+		ppc_opc_gen_addi_addis(rD, 0, hi + lo);
+		return 2;
+	case 24:
+		// ori rD, rD, lo
+		PPC_OPC_TEMPL_D_UImm(opc1, r0, r1, lo);
+		if (r0 != rD || r1 != rD) return 0;
+		ppc_opc_gen_addi_addis(rD, 0, hi | lo);
+		return 2;
+	}
+	return 0;
+}
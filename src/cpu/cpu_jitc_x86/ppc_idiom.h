@@ -0,0 +1,49 @@
+/*
+ *	PearPC
+ *	ppc_idiom.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __PPC_IDIOM_H__
+#define __PPC_IDIOM_H__
+
+#include "system/types.h"
+#include "jitc_types.h"
+
+/*
+ *	Checks if the code at physpage[ofs] is the head of a
+ *	well-known copy/fill loop. If so, a call to a host helper
+ *	which runs the whole loop is emitted and the address of a
+ *	forward jump (taken when the loop has completed) is returned.
+ *	The caller has to resolve it to the translation of exit_ofs.
+ *	The loop itself is translated as usual afterwards, it's only
+ *	executed for iterations the helper can't handle.
+ *
+ *	Returns NULL if nothing has been emitted.
+ */
+NativeAddress ppc_gen_idiom(byte *physpage, uint32 ofs, uint32 &exit_ofs);
+
+/*
+ *	Translates a short sequence of instructions at physpage[ofs]
+ *	as a whole if it's a known pattern (e.g. building a
+ *	constant with lis/ori). None of them may raise an exception.
+ *
+ *	Returns the number of instructions translated or 0.
+ */
+int ppc_gen_fused(byte *physpage, uint32 ofs);
+
+#endif
@@ -23,6 +23,7 @@
 
 #include <cstdlib>
 #include <cstring>
+#include "system/sys.h"
 #include "tools/snprintf.h"
 #include "debug/tracers.h"
 #include "io/prom/prom.h"
@@ -34,8 +35,9 @@
 #include "ppc_exc.h"
 #include "ppc_tools.h"
 
-#include "x86asm.h"
+#include "jitc.h"
 #include "jitc_asm.h"
+#include "x86asm.h"
 
 byte *gMemory = NULL;
 uint32 gMemorySize;
@@ -319,7 +321,7 @@ int FASTCALL ppc_effective_to_physical_vm(uint32 addr, int flags, uint32 &result
 				addr |= gCPU.dbat_brpn[i];
 				result = addr;
 				// FIXME: check access rights
-				return PPC_MMU_OK;
+				return PPC_MMU_READ | PPC_MMU_WRITE;
 			}
 		}
 	}
@@ -466,6 +468,26 @@ void ppc_mmu_tlb_invalidate()
 	ppc_mmu_tlb_invalidate_all_asm();
 }
 
+extern "C" void FASTCALL ppc_mmu_tlb_update_segment(int sr)
+{
+	int id = ppc_tlb_context_lookup(gJITC.tlbContexts, gCPU.sr[sr], gCPU.msr);
+	if (id < 0) {
+		// out of ids, start over
+		ppc_tlb_contexts_reset(gJITC.tlbContexts);
+		ppc_mmu_tlb_invalidate();
+		ppc_mmu_tlb_update_mode();
+		return;
+	}
+	gJITC.tlb_context[sr] = id;
+}
+
+extern "C" void FASTCALL ppc_mmu_tlb_update_mode()
+{
+	for (int i=0; i<16; i++) {
+		ppc_mmu_tlb_update_segment(i);
+	}
+}
+
 /**
 pagetable:
 min. 2^10 (64k) PTEGs
@@ -868,15 +890,13 @@ int FASTCALL ppc_write_effective_byte(uint32 addr, uint8 data)
 	return r;
 }
 
-bool FASTCALL ppc_init_physical_memory(uint size)
+bool FASTCALL ppc_init_physical_memory(uint size, int flags)
 {
 	if (size < 64*1024*1024) {
 		PPC_MMU_ERR("Main memory size must >= 64MB!\n");
 	}
-	gMemory = (byte*)malloc(size+16);
-	if ((uint32)gMemory & 0x0f) {
-		gMemory += 16 - ((uint32)gMemory & 0x0f);
-	}
+	// page aligned
+	gMemory = (byte*)sys_alloc_memory(size, flags);
 	gMemorySize = size;
 	return gMemory != NULL;
 }
@@ -886,6 +906,15 @@ uint32  ppc_get_memory_size()
 	return gMemorySize;
 }
 
+bool ppc_map_physical_memory(const char *filename, FileOfs ofs)
+{
+	byte *p = (byte*)sys_map_file_memory(filename, ofs, gMemorySize);
+	if (!p) return false;
+	sys_free_memory(gMemory, gMemorySize);
+	gMemory = p;
+	return true;
+}
+
 /***************************************************************************
  *	DMA Interface
  */
@@ -1336,6 +1365,204 @@ uint32 FASTCALL ppc_opc_double_to_single(uint64 r)
 }
 
 
+/*
+ *	Multi-word accesses
+ *
+ *	dcbz, lmw/stmw and lswi/stswi translate the effective address
+ *	once per page they touch and access every page with a single
+ *	host operation. All pages are translated before anything is
+ *	accessed, so a DSI leaves memory and registers untouched.
+ *
+ *	The helpers are called like this:
+ *	EAX: see below, EDX: ESP before the call,
+ *	ECX: current client pc offset
+ */
+
+#define PPC_BULK_MAX	128
+
+struct ppc_bulk_chunk {
+	uint32 ea;
+	uint32 pa;
+	uint32 size;
+	byte *ptr;		// NULL if not backed by RAM
+};
+
+/*
+ *	Same as ppc_effective_to_physical_data_read/write in
+ *	jitc_mmu.S, including the TLB refill.
+ */
+static bool ppc_bulk_translate(uint32 ea, bool write, uint32 &pa)
+{
+	uint32 page = (ea & 0xfffff000) | gJITC.tlb_context[ea >> 28];
+	uint32 idx = (ea >> 12) & (TLB_ENTRIES-1);
+	uint32 *eff = write ? gJITC.tlb_data_write_eff : gJITC.tlb_data_read_eff;
+	uint32 *phys = write ? gJITC.tlb_data_write_phys : gJITC.tlb_data_read_phys;
+	if (eff[idx] == page) {
+		pa = phys[idx] | (ea & 0xfff);
+		return true;
+	}
+	int flags = write ? (PPC_MMU_READ | PPC_MMU_WRITE) : PPC_MMU_READ;
+	if ((ppc_effective_to_physical_vm(ea, flags, pa) & flags) != flags) {
+		return false;
+	}
+	eff[idx] = page;
+	phys[idx] = pa & 0xfffff000;
+	return true;
+}
+
+/*
+ *	Splits [ea, ea+size) at the page boundary and translates
+ *	both parts. Returns the number of chunks, or 0 if the DSI
+ *	handler has been set up as return address.
+ */
+static int ppc_bulk_map(uint32 ea, uint32 size, bool write, ppc_bulk_chunk *c, uint32 *stack, uint32 client_pc)
+{
+	uint32 first = 4096 - (ea & 0xfff);
+	int n = (size > first) ? 2 : 1;
+	c[0].ea = ea;
+	c[0].size = (n == 2) ? first : size;
+	c[1].ea = ea + first;
+	c[1].size = size - c[0].size;
+	for (int i=0; i<n; i++) {
+		if (!ppc_bulk_translate(c[i].ea, write, c[i].pa)) {
+			// see return_to_dsi_exception_handler() in ppc_esc.cc
+			stack[-1] = (uint32)&ppc_dsi_exception_special_asm;
+			gCPU.pc_ofs = client_pc;
+			gCPU.dar = c[i].ea;
+			return 0;
+		}
+		if (ppc_direct_physical_memory_handle(c[i].pa, c[i].ptr)) {
+			c[i].ptr = NULL;
+		}
+	}
+	return n;
+}
+
+static void ppc_bulk_read(const ppc_bulk_chunk *c, int n, byte *buf)
+{
+	for (int i=0; i<n; i++) {
+		if (c[i].ptr) {
+			memcpy(buf, c[i].ptr, c[i].size);
+			buf += c[i].size;
+			continue;
+		}
+		// device memory: don't split aligned words
+		uint32 pa = c[i].pa;
+		uint32 s = c[i].size;
+		while (s) {
+			if (!(pa & 3) && s >= 4) {
+				uint32 w;
+				ppc_read_physical_word(pa, w);
+				*(uint32*)buf = ppc_word_to_BE(w);
+				buf += 4;
+				pa += 4;
+				s -= 4;
+			} else {
+				ppc_read_physical_byte(pa++, *buf++);
+				s--;
+			}
+		}
+	}
+}
+
+static void ppc_bulk_write(const ppc_bulk_chunk *c, int n, const byte *buf)
+{
+	for (int i=0; i<n; i++) {
+		if (c[i].ptr) {
+			memcpy(c[i].ptr, buf, c[i].size);
+			buf += c[i].size;
+			continue;
+		}
+		uint32 pa = c[i].pa;
+		uint32 s = c[i].size;
+		while (s) {
+			if (!(pa & 3) && s >= 4) {
+				ppc_write_physical_word(pa, ppc_word_from_BE(*(uint32*)buf));
+				buf += 4;
+				pa += 4;
+				s -= 4;
+			} else {
+				ppc_write_physical_byte(pa++, *buf++);
+				s--;
+			}
+		}
+	}
+}
+
+/*
+ *	EAX: effective address
+ */
+static void FASTCALL ppc_opc_dcbz_bulk(uint32 ea, uint32 *stack, uint32 client_pc)
+{
+	ppc_bulk_chunk c[2];
+	// a cache line never crosses a page
+	if (!ppc_bulk_map(ea & ~31, 32, true, c, stack, client_pc)) return;
+	if (c[0].ptr) {
+		memset(c[0].ptr, 0, 32);
+	} else {
+		for (int i=0; i<32; i+=8) {
+			ppc_write_physical_dword(c[0].pa + i, 0);
+		}
+	}
+}
+
+/*
+ *	lmw is lswi with 4*(32-rD) bytes.
+ *
+ *	EAX: first register | (number of bytes << 8),
+ *	gCPU.temp: effective address
+ */
+static void FASTCALL ppc_opc_load_string_bulk(uint32 arg, uint32 *stack, uint32 client_pc)
+{
+	uint32 reg = arg & 0x1f;
+	uint32 nb = arg >> 8;
+	ppc_bulk_chunk c[2];
+	int n = ppc_bulk_map(gCPU.temp, nb, false, c, stack, client_pc);
+	if (!n) return;
+	byte buf[PPC_BULK_MAX];
+	ppc_bulk_read(c, n, buf);
+	// the last register is padded with zeros
+	memset(buf + nb, 0, sizeof buf - nb);
+	for (uint32 i=0; i < nb; i += 4) {
+		gCPU.gpr[reg] = ppc_word_from_BE(*(uint32*)(buf + i));
+		reg = (reg + 1) & 0x1f;
+	}
+}
+
+/*
+ *	stmw is stswi with 4*(32-rS) bytes.
+ *
+ *	EAX: first register | (number of bytes << 8),
+ *	gCPU.temp: effective address
+ */
+static void FASTCALL ppc_opc_store_string_bulk(uint32 arg, uint32 *stack, uint32 client_pc)
+{
+	uint32 reg = arg & 0x1f;
+	uint32 nb = arg >> 8;
+	ppc_bulk_chunk c[2];
+	int n = ppc_bulk_map(gCPU.temp, nb, true, c, stack, client_pc);
+	if (!n) return;
+	byte buf[PPC_BULK_MAX];
+	for (uint32 i=0; i < nb; i += 4) {
+		*(uint32*)(buf + i) = ppc_word_to_BE(gCPU.gpr[reg]);
+		reg = (reg + 1) & 0x1f;
+	}
+	ppc_bulk_write(c, n, buf);
+}
+
+/*
+ *	Expects the effective address in EAX, all client
+ *	registers have to be clobbered.
+ */
+static void ppc_opc_gen_string_bulk(NativeAddress helper, int reg, int nb)
+{
+	asmMOVDMemReg((uint32)&gCPU.temp, EAX);
+	asmALURegImm(X86_MOV, EAX, reg | (nb << 8));
+	asmALURegReg(X86_MOV, EDX, ESP);
+	asmALURegImm(X86_MOV, ECX, gJITC.pc);
+	asmCALL(helper);
+}
+
 /**
  *	dcbz		Data Cache Clear to Zero
  *	.464
@@ -1346,8 +1573,8 @@ void ppc_opc_dcbz()
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rD, rA, rB);
 	// assert rD=0
-	uint32 a = (rA?gCPU.gpr[rA]:0)+gCPU.gpr[rB];
-	// BAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA
+	// clears the whole cache line containing the address
+	uint32 a = ((rA?gCPU.gpr[rA]:0)+gCPU.gpr[rB]) & ~31;
 	ppc_write_effective_dword(a, 0)
 	|| ppc_write_effective_dword(a+8, 0)
 	|| ppc_write_effective_dword(a+16, 0)
@@ -1360,30 +1587,10 @@ JITCFlow ppc_opc_gen_dcbz()
 	jitcClobberCarryAndFlags();
 	jitcFlushRegister();
 	getEAX_0_Rsum(PPC_GPR(rA), PPC_GPR(rB));
-	jitcClobberRegister();
-	asmALURegImm(X86_MOV, ECX, 0);
-	asmMOVDMemReg((uint32)&gCPU.temp, EAX);
-	asmALURegImm(X86_MOV, EDX, 0);
-	asmALURegImm(X86_MOV, ESI, gJITC.pc);
-	asmCALL((NativeAddress)ppc_write_effective_dword_asm);
-	asmALURegImm(X86_MOV, ECX, 0);
-	asmMOVRegDMem(EAX, (uint32)&gCPU.temp);
-	asmALURegImm(X86_MOV, EDX, 0);
-	asmALURegImm(X86_ADD, EAX, 8);
-	asmALURegImm(X86_MOV, ESI, gJITC.pc);
-	asmCALL((NativeAddress)ppc_write_effective_dword_asm);
-	asmALURegImm(X86_MOV, ECX, 0);
-	asmMOVRegDMem(EAX, (uint32)&gCPU.temp);
-	asmALURegImm(X86_MOV, EDX, 0);
-	asmALURegImm(X86_ADD, EAX, 16);
-	asmALURegImm(X86_MOV, ESI, gJITC.pc);
-	asmCALL((NativeAddress)ppc_write_effective_dword_asm);
-	asmALURegImm(X86_MOV, ECX, 0);
-	asmMOVRegDMem(EAX, (uint32)&gCPU.temp);
-	asmALURegImm(X86_MOV, EDX, 0);
-	asmALURegImm(X86_ADD, EAX, 24);
-	asmALURegImm(X86_MOV, ESI, gJITC.pc);
-	asmCALL((NativeAddress)ppc_write_effective_dword_asm);
+	jitcClobberAll();
+	asmALURegReg(X86_MOV, EDX, ESP);
+	asmALURegImm(X86_MOV, ECX, gJITC.pc);
+	asmCALL((NativeAddress)ppc_opc_dcbz_bulk);
 	return flowEndBlock;
 }
 
@@ -2072,19 +2279,11 @@ JITCFlow ppc_opc_gen_lmw()
 	int rD, rA;
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(gJITC.current_opc, rD, rA, imm);
-	while (rD <= 30) {
-		ppc_opc_gen_helper_l(PPC_GPR(rA), imm);
-		asmCALL((NativeAddress)ppc_read_effective_dword_asm);
-		jitcMapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | ECX);
-		jitcMapClientRegisterDirty(PPC_GPR(rD+1), NATIVE_REG | EDX);
-		rD += 2;
-		imm += 8;
-         }
-	if (rD == 31) {
-		ppc_opc_gen_helper_l(PPC_GPR(rA), imm);
-		asmCALL((NativeAddress)ppc_read_effective_word_asm);
-		jitcMapClientRegisterDirty(PPC_GPR(rD), NATIVE_REG | EDX);
-	}
+	jitcClobberCarryAndFlags();
+	jitcFlushRegister();
+	getEAX_0_Isum(PPC_GPR(rA), imm);
+	jitcClobberAll();
+	ppc_opc_gen_string_bulk((NativeAddress)ppc_opc_load_string_bulk, rD, 4*(32-rD));
 	return flowContinue;
 }
 /**
@@ -2132,12 +2331,9 @@ JITCFlow ppc_opc_gen_lswi()
 	} else {
 		asmALURegImm(X86_MOV, EAX, 0);
 	}
-	asmALURegImm(X86_MOV, ECX, NB);
-	asmALURegImm(X86_MOV, EBX, rD);
-	asmALURegImm(X86_MOV, ESI, gJITC.pc);
 	jitcClobberAll();
-	asmCALL((NativeAddress)ppc_opc_lswi_asm);
-	return flowEndBlock;
+	ppc_opc_gen_string_bulk((NativeAddress)ppc_opc_load_string_bulk, rD, NB);
+	return flowContinue;
 }
 /**
  *	lswx		Load String Word Indexed
@@ -3525,17 +3721,11 @@ JITCFlow ppc_opc_gen_stmw()
 	int rS, rA;
 	uint32 imm;
 	PPC_OPC_TEMPL_D_SImm(gJITC.current_opc, rS, rA, imm);
-        while (rS <= 30) {
-                ppc_opc_gen_helper_st(PPC_GPR(rA), imm, PPC_GPR(rS+1));
-                jitcGetClientRegister(PPC_GPR(rS), NATIVE_REG | ECX);
-                asmCALL((NativeAddress)ppc_write_effective_dword_asm);
-                rS += 2;
-                imm += 8;
-        } 
-	if (rS == 31) {
-		ppc_opc_gen_helper_st(PPC_GPR(rA), imm, PPC_GPR(rS));
-		asmCALL((NativeAddress)ppc_write_effective_word_asm);
-	}
+	jitcClobberCarryAndFlags();
+	jitcFlushRegister();
+	getEAX_0_Isum(PPC_GPR(rA), imm);
+	jitcClobberAll();
+	ppc_opc_gen_string_bulk((NativeAddress)ppc_opc_store_string_bulk, rS, 4*(32-rS));
 	return flowEndBlock;
 }
 /**
@@ -3579,11 +3769,8 @@ JITCFlow ppc_opc_gen_stswi()
 	} else {
 		asmALURegImm(X86_MOV, EAX, 0);
 	}
-	asmALURegImm(X86_MOV, ECX, NB);
-	asmALURegImm(X86_MOV, EBX, rS);
-	asmALURegImm(X86_MOV, ESI, gJITC.pc);
 	jitcClobberAll();
-	asmCALL((NativeAddress)ppc_opc_stswi_asm);
+	ppc_opc_gen_string_bulk((NativeAddress)ppc_opc_store_string_bulk, rS, NB);
 	return flowEndBlock;
 }
 /**
@@ -41,6 +41,13 @@ int FASTCALL ppc_effective_to_physical_vm(uint32 addr, int flags, uint32 &result
 bool FASTCALL ppc_mmu_set_sdr1(uint32 newval, bool quiesce);
 void ppc_mmu_tlb_invalidate();
 
+/*
+ *	Have to be called whenever a segment register or
+ *	MSR[PR,IR,DR] changes, see cpu/tlbcontext.h
+ */
+extern "C" void FASTCALL ppc_mmu_tlb_update_segment(int sr);
+extern "C" void FASTCALL ppc_mmu_tlb_update_mode();
+
 int FASTCALL ppc_read_physical_dword(uint32 addr, uint64 &result);
 int FASTCALL ppc_read_physical_word(uint32 addr, uint32 &result);
 int FASTCALL ppc_read_physical_half(uint32 addr, uint16 &result);
@@ -67,7 +74,7 @@ int FASTCALL ppc_direct_effective_memory_handle(uint32 addr, byte *&ptr);
 int FASTCALL ppc_direct_effective_memory_handle_code(uint32 addr, byte *&ptr);
 bool FASTCALL ppc_mmu_page_create(uint32 ea, uint32 pa);
 bool FASTCALL ppc_mmu_page_free(uint32 ea);
-bool FASTCALL ppc_init_physical_memory(uint size);
+bool FASTCALL ppc_init_physical_memory(uint size, int flags);
 
 /**
 pte: (page table entry)
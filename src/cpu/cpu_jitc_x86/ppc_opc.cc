@@ -73,6 +73,16 @@ static void FASTCALL writeDEC(uint32 newdec)
 	gDECwriteITB = ppc_get_cpu_ideal_timebase();
 }
 
+void ppc_opc_read_dec()
+{
+	readDEC();
+}
+
+void ppc_opc_restart_dec()
+{
+	writeDEC(gCPU.dec);
+}
+
 static void FASTCALL writeTBL(uint32 newtbl)
 {
 	uint64 tbBase = ppc_get_cpu_timebase();
@@ -93,7 +103,7 @@ void ppc_set_msr(uint32 newmsr)
 			gCPU.ext_exception = true;
 		}
 	}*/
-	ppc_mmu_tlb_invalidate();
+	uint32 changed = newmsr ^ gCPU.msr;
 #ifndef PPC_CPU_ENABLE_SINGLESTEP
 	if (newmsr & MSR_SE) {
 		SINGLESTEP("");
@@ -110,29 +120,28 @@ void ppc_set_msr(uint32 newmsr)
 		newmsr &= ~MSR_POW;
 	}
 	gCPU.msr = newmsr;
-	
+	// the tlb context only depends on the privilege level and on translation
+	if (changed & (MSR_PR | MSR_IR | MSR_DR)) {
+		ppc_mmu_tlb_update_mode();
+	}
 }
 
+/*
+ *	Translations are specialized on MSR_PR (see JITC_MSR_MODE_MASK),
+ *	so either we don't need a check at all or the instruction
+ *	always raises the exception.
+ */
 void ppc_opc_gen_check_privilege()
 {
-	if (!gJITC.checkedPriviledge) {
+	if (gJITC.currentPage->msrMode & MSR_PR) {
 		jitcClobberCarryAndFlags();
 		jitcFloatRegisterClobberAll();
 		jitcFlushVectorRegister();
-		NativeReg msr = jitcGetClientRegisterMapping(PPC_MSR);
-		if (msr == REG_NO) {
-			asmTESTDMemImm((uint32)&gCPU.msr, MSR_PR);
-		} else {
-			asmALURegImm(X86_TEST, msr, MSR_PR);
-		}
-		NativeAddress fixup = asmJxxFixup(X86_Z);
 		jitcFlushRegisterDirty();
 		asmALURegImm(X86_MOV, ECX, PPC_EXC_PROGRAM_PRIV);
 		asmALURegImm(X86_MOV, EDX, gJITC.current_opc);
 		asmALURegImm(X86_MOV, ESI, gJITC.pc);
 		asmJMP((NativeAddress)ppc_program_exception_asm);
-		asmResolveFixup(fixup, asmHERE());
-		gJITC.checkedPriviledge = true;
 	}
 }
 
@@ -234,15 +243,26 @@ JITCFlow ppc_opc_gen_bcx()
 				// x86 flags map to correct crX register
 				// and not SO flag (which isnt mapped)
 				NativeAddress fixup2=NULL;
+				NativeFlagsKind kind = jitcGetFlagsKind();
 				switch (BI%4) {
 				case 0:
 					// less than
-					fixup = asmJxxFixup((BO & 8) ? X86_NS : X86_S);
+					if (kind == fkCMP) {
+						fixup = asmJxxFixup((BO & 8) ? X86_GE : X86_L);
+					} else if (kind == fkCMPL) {
+						fixup = asmJxxFixup((BO & 8) ? X86_AE : X86_B);
+					} else {
+						fixup = asmJxxFixup((BO & 8) ? X86_NS : X86_S);
+					}
 					break;
 				case 1:
 					// greater than
-					// there seems to be no equivalent instruction on the x86
-					if (BO & 8) {
+					if (kind == fkCMP) {
+						fixup = asmJxxFixup((BO & 8) ? X86_LE : X86_G);
+					} else if (kind == fkCMPL) {
+						fixup = asmJxxFixup((BO & 8) ? X86_BE : X86_A);
+					} else if (BO & 8) {
+						// there seems to be no equivalent instruction on the x86
 						fixup = asmJxxFixup(X86_S);
 						fixup2 = asmJxxFixup(X86_Z);
 					} else {
@@ -263,7 +283,17 @@ JITCFlow ppc_opc_gen_bcx()
 					byte modrm[6];
 					asmSETMem(X86_C, modrm, x86_mem(modrm, REG_NO, (uint32)&gCPU.xer_ca));					
 				}
-				asmCALL((NativeAddress)ppc_flush_flags_asm);
+				switch (kind) {
+				case fkCMP:
+					asmCALL((NativeAddress)ppc_flush_flags_signed_0_asm);
+					break;
+				case fkCMPL:
+					asmCALL((NativeAddress)ppc_flush_flags_unsigned_0_asm);
+					break;
+				default:
+					asmCALL((NativeAddress)ppc_flush_flags_asm);
+					break;
+				}
 				jitcFlushRegisterDirty();
 				if (gJITC.current_opc & PPC_OPC_LK) {
 					asmMOVRegDMem(EAX, (uint32)&gCPU.current_code_base);
@@ -1819,6 +1849,7 @@ void ppc_opc_mtsr()
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rS, SR, rB);
 	// FIXME: check insn
 	gCPU.sr[SR & 0xf] = gCPU.gpr[rS];
+	ppc_mmu_tlb_update_segment(SR & 0xf);
 }
 JITCFlow ppc_opc_gen_mtsr()
 {
@@ -1829,7 +1860,8 @@ JITCFlow ppc_opc_gen_mtsr()
 	// FIXME: check insn
 	move_reg(PPC_SR(SR & 0xf), PPC_GPR(rS));
 	jitcClobberAll();
-	asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_asm);
+	asmALURegImm(X86_MOV, EAX, SR & 0xf);
+	asmCALL((NativeAddress)ppc_mmu_tlb_update_segment);
 	// sync
 //	asmALURegImm(X86_MOV, EAX, gJITC.pc+4);
 //	asmJMP((NativeAddress)ppc_new_pc_rel_asm);
@@ -1850,6 +1882,7 @@ void ppc_opc_mtsrin()
 	PPC_OPC_TEMPL_X(gCPU.current_opc, rS, rA, rB);
 	// FIXME: check insn
 	gCPU.sr[gCPU.gpr[rB] >> 28] = gCPU.gpr[rS];
+	ppc_mmu_tlb_update_segment(gCPU.gpr[rB] >> 28);
 }
 JITCFlow ppc_opc_gen_mtsrin()
 {
@@ -1869,7 +1902,8 @@ JITCFlow ppc_opc_gen_mtsrin()
 	// mov [4*b+sr], s
 	byte modrm[6];
 	asmALUMemReg(X86_MOV, modrm, x86_mem_sib(modrm, REG_NO, 4, b, (uint32)(&gCPU.sr[0])), s);
-	asmCALL((NativeAddress)ppc_mmu_tlb_invalidate_all_asm);
+	if (b != EAX) asmALURegReg(X86_MOV, EAX, b);
+	asmCALL((NativeAddress)ppc_mmu_tlb_update_segment);
 	// sync
 //	asmALURegImm(X86_MOV, EAX, gJITC.pc+4);
 //	asmJMP((NativeAddress)ppc_new_pc_rel_asm);
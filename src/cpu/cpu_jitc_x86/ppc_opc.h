@@ -133,6 +133,12 @@ JITCFlow ppc_opc_gen_tlbsync();
 JITCFlow ppc_opc_gen_tw();
 JITCFlow ppc_opc_gen_twi();
 
+/*
+ *	Used for snapshots: brings gCPU.dec up to date,
+ *	restarts the decrementer timer from gCPU.dec
+ */
+void ppc_opc_read_dec();
+void ppc_opc_restart_dec();
 
 #endif
 
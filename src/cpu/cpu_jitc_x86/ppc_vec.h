@@ -88,21 +88,15 @@
 static UNUSED void ppc_opc_gen_check_vec()
 {
 #ifndef __VEC_EXC_OFF__
-	if (!gJITC.checkedVector) {
+	// translations are specialized on MSR_VEC, see ppc_opc_gen_check_privilege()
+	if (!(gJITC.currentPage->msrMode & MSR_VEC)) {
 		jitcFloatRegisterClobberAll();
 		jitcFlushVectorRegister();
 		jitcClobberCarryAndFlags();
 
-		NativeReg r1 = jitcGetClientRegister(PPC_MSR);
-		asmALU(X86_TEST, r1, MSR_VEC);
-		NativeAddress fixup = asmJxxFixup(X86_NZ);
-
 		jitcFlushRegisterDirty();
 		asmALU(X86_MOV, ESI, gJITC.pc);
 		asmJMP((NativeAddress)ppc_no_vec_exception_asm);
-
-		asmResolveFixup(fixup);
-		gJITC.checkedVector = true;
 	}
 #endif
 }
@@ -65,6 +65,15 @@ void x86GetCaps(X86CPUCaps &caps)
 	caps.sse = id2.features & (1<<25);
 	caps.sse2 = id2.features & (1<<26);
 	caps.sse3 = id2.features2 & (1<<0);
+
+	if (id.level >= 7) {
+		// structured extended features, subleaf 0
+		struct {
+			uint32 level, c, d, b;
+		} id7;
+		ppc_cpuid_asm(7, &id7);
+		caps.bmi2 = id7.b & (1<<8);
+	}
 	
 	ppc_cpuid_asm(0x80000000, &id);
 	if (id.level >= 0x80000001) {
@@ -76,14 +85,15 @@ void x86GetCaps(X86CPUCaps &caps)
 		caps._3dnow2 = id2.features & (1<<30);
 	}
 	
-	ht_printf("%s%s%s%s%s%s%s\n",
+	ht_printf("%s%s%s%s%s%s%s%s\n",
 		caps.cmov?" CMOV":"",
 		caps.mmx?" MMX":"",
 		caps._3dnow?" 3DNOW":"",
 		caps._3dnow2?" 3DNOW+":"",
 		caps.sse?" SSE":"",
 		caps.sse2?" SSE2":"",
-		caps.sse3?" SSE3":"");
+		caps.sse3?" SSE3":"",
+		caps.bmi2?" BMI2":"");
 }
 
 /*
@@ -562,9 +572,13 @@ void FASTCALL jitcGetClientCarry()
 	}
 }
 
-void FASTCALL jitcMapFlagsDirty(PPC_CRx cr)
+/*
+ *	Only PPC_CR0 can be flushed by jitcClobberFlags()
+ */
+void FASTCALL jitcMapFlagsDirty(PPC_CRx cr, NativeFlagsKind kind)
 {
 	gJITC.nativeFlags = cr;
+	gJITC.nativeFlagsKind = kind;
 	gJITC.nativeFlagsState = rsDirty;
 }
 
@@ -573,6 +587,11 @@ PPC_CRx FASTCALL jitcGetFlagsMapping()
 	return gJITC.nativeFlags;
 }
 
+NativeFlagsKind FASTCALL jitcGetFlagsKind()
+{
+	return gJITC.nativeFlagsKind;
+}
+
 bool FASTCALL jitcFlagsMapped()
 {
 	return gJITC.nativeFlagsState != rsUnused;
@@ -598,7 +617,17 @@ static void FASTCALL jitcFlushCarry()
 
 static void FASTCALL jitcFlushFlags()
 {
-	asmCALL((NativeAddress)ppc_flush_flags_asm);
+	switch (gJITC.nativeFlagsKind) {
+	case fkResult:
+		asmCALL((NativeAddress)ppc_flush_flags_asm);
+		break;
+	case fkCMP:
+		asmCALL((NativeAddress)ppc_flush_flags_signed_0_asm);
+		break;
+	case fkCMPL:
+		asmCALL((NativeAddress)ppc_flush_flags_unsigned_0_asm);
+		break;
+	}
 }
 
 #else
@@ -608,8 +637,21 @@ uint8 jitcFlagsMapping2[256];
 uint8 jitcFlagsMappingCMP_U[257];
 uint8 jitcFlagsMappingCMP_L[257];
 
+static void jitcFlushFlagsAfterCMP(X86FlagTest t1, X86FlagTest t2, byte mask, int disp, uint32 map);
+
 static void FASTCALL jitcFlushFlags()
 {
+	// compares mapped to cr0 (see ppc_opc_gen_cmp())
+	switch (gJITC.nativeFlagsKind) {
+	case fkCMP:
+		jitcFlushFlagsAfterCMP(X86_G, X86_L, 0x0f, 3, (uint32)&jitcFlagsMappingCMP_U);
+		return;
+	case fkCMPL:
+		jitcFlushFlagsAfterCMP(X86_A, X86_B, 0x0f, 3, (uint32)&jitcFlagsMappingCMP_U);
+		return;
+	default:
+		break;
+	}
 #if 1
 	byte modrm[6];
 	NativeReg r = jitcAllocRegister(NATIVE_REG_8);
@@ -2205,6 +2247,21 @@ void FASTCALL asmBSxRegReg(X86BitSearch opc, NativeReg reg1, NativeReg reg2)
 	asmBSx(opc, reg1, reg2);
 }
 
+/*
+ *	rorx reg1, reg2, imm (needs BMI2)
+ *	Doesn't touch the flags
+ */
+void FASTCALL asmRORX(NativeReg reg1, NativeReg reg2, uint32 imm)
+{
+	// VEX.LZ.F2.0F3A.W0 F0 /r ib
+	byte instr[6] = {0xc4, 0xe3, 0x7b, 0xf0, 0xc0+(reg1<<3)+reg2, imm};
+	jitcEmit(instr, sizeof(instr));
+}
+void FASTCALL asmRORXRegRegImm(NativeReg reg1, NativeReg reg2, uint32 imm)
+{
+	asmRORX(reg1, reg2, imm);
+}
+
 void FASTCALL asmBSWAP(NativeReg reg)
 {
 	byte instr[2];
@@ -75,6 +75,16 @@ enum NativeReg8 {
 
 #define NATIVE_REGS_ALL 0
 
+/*
+ *	Tells how the x86 flags have to be interpreted
+ *	when they are mapped to a crX
+ */
+enum NativeFlagsKind {
+	fkResult = 0,	// S: lt, Z: eq, else gt (ALU result compared with 0)
+	fkCMP = 1,	// result of a signed cmp
+	fkCMPL = 2,	// result of an unsigned cmp
+};
+
 struct X86CPUCaps {
 	char vendor[13];
 	bool rdtsc;
@@ -87,6 +97,7 @@ struct X86CPUCaps {
 	bool sse3;
 	bool ssse3;
 	bool sse4;
+	bool bmi2;
 	int  loop_align;
 };
 
@@ -107,7 +118,7 @@ void FASTCALL jitcFlushRegister(int options = NATIVE_REGS_ALL);
 void FASTCALL jitcFlushRegisterDirty(int options = NATIVE_REGS_ALL);
 void FASTCALL jitcClobberRegister(int options = NATIVE_REGS_ALL);
 void FASTCALL jitcGetClientCarry();
-void FASTCALL jitcMapFlagsDirty(PPC_CRx cr = PPC_CR0);
+void FASTCALL jitcMapFlagsDirty(PPC_CRx cr = PPC_CR0, NativeFlagsKind kind = fkResult);
 void FASTCALL jitcMapCarryDirty();
 void FASTCALL jitcClobberFlags();
 void FASTCALL jitcClobberCarry();
@@ -115,6 +126,7 @@ void FASTCALL jitcClobberCarryAndFlags();
 void FASTCALL jitcFlushCarryAndFlagsDirty(); // ONLY FOR DEBUG! DON'T CALL!
 
 PPC_CRx FASTCALL jitcGetFlagsMapping();
+NativeFlagsKind FASTCALL jitcGetFlagsKind();
 
 bool FASTCALL jitcFlagsMapped();
 bool FASTCALL jitcCarryMapped();
@@ -325,6 +337,7 @@ void FASTCALL asmLEA(NativeReg reg1, byte *modrm, int len);
 void FASTCALL asmBTxRegImm(X86BitTest opc, NativeReg reg1, int value);
 void FASTCALL asmBTxMemImm(X86BitTest opc, byte *modrm, int len, int value);
 void FASTCALL asmBSxRegReg(X86BitSearch opc, NativeReg reg1, NativeReg reg2);
+void FASTCALL asmRORXRegRegImm(NativeReg reg1, NativeReg reg2, uint32 imm);	// BMI2
 /* End: X86Asm v1.0 */
 #endif // X86ASM_V2_ONLY
 
@@ -345,6 +358,7 @@ void FASTCALL asmLEA(NativeReg reg1, modrm_p modrm);
 void FASTCALL asmBTx(X86BitTest opc, NativeReg reg1, int value);
 void FASTCALL asmBTx(X86BitTest opc, modrm_p modrm, int value);
 void FASTCALL asmBSx(X86BitSearch opc, NativeReg reg1, NativeReg reg2);
+void FASTCALL asmRORX(NativeReg reg1, NativeReg reg2, uint32 imm);	// BMI2
 /* End: X86Asm v2.0 */
 
 void FASTCALL asmBSWAP(NativeReg reg);
@@ -0,0 +1,97 @@
+/*
+ *	PearPC
+ *	cputrace.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "configparser.h"
+#include "tools/except.h"
+#include "tools/str.h"
+#include "cpu.h"
+#include "cputrace.h"
+
+#define CPU_TRACE_KEY_FILE	"cpu_trace_file"
+#define CPU_TRACE_KEY_LIMIT	"cpu_trace_limit"
+
+bool gPPCTrace = false;
+
+static FILE *gTraceFile;
+static uint32 gTraceLimit;
+static uint32 gTraceRecords;
+static PPCTraceRecord gTraceRecord;
+static uint32 gTraceNextPC;
+
+void ppc_trace_init_config()
+{
+	gConfig->acceptConfigEntryStringDef(CPU_TRACE_KEY_FILE, "");
+	gConfig->acceptConfigEntryIntDef(CPU_TRACE_KEY_LIMIT, 0);
+}
+
+void ppc_trace_init()
+{
+	String filename;
+	gConfig->getConfigString(CPU_TRACE_KEY_FILE, filename);
+	if (filename.isEmpty()) return;
+	gTraceFile = fopen(filename.contentChar(), "wb");
+	if (!gTraceFile) throw MsgfException("can't create trace file '%s'", filename.contentChar());
+	PPCTraceHeader h;
+	h.magic = PPC_TRACE_MAGIC;
+	h.version = PPC_TRACE_VERSION;
+	h.record_size = sizeof (PPCTraceRecord);
+	h.pvr = ppc_cpu_get_pvr(0);
+	fwrite(&h, sizeof h, 1, gTraceFile);
+	gTraceLimit = gConfig->getConfigInt(CPU_TRACE_KEY_LIMIT);
+	gTraceRecords = 0;
+	memset(&gTraceRecord, 0, sizeof gTraceRecord);
+	gTraceNextPC = 0xffffffff;
+	gPPCTrace = true;
+}
+
+void ppc_trace_done()
+{
+	if (!gTraceFile) return;
+	gPPCTrace = false;
+	fclose(gTraceFile);
+	gTraceFile = NULL;
+}
+
+extern "C" void FASTCALL ppc_trace_insn(uint32 pc, uint32 opc)
+{
+	if (!gTraceFile || ppc_cpu_current() != 0) return;
+	PPCTraceRecord &r = gTraceRecord;
+	if (pc != gTraceNextPC && r.block_len) {
+		ppc_cpu_trace_state(r.state);
+		r.state.pc = pc;
+		fwrite(&r, sizeof r, 1, gTraceFile);
+		if (gTraceLimit && ++gTraceRecords == gTraceLimit) {
+			ppc_trace_done();
+			ppc_cpu_stop();
+			return;
+		}
+		r.block_len = 0;
+	}
+	if (!r.block_len) r.block_pc = pc;
+	if (r.block_len < PPC_TRACE_BLOCK_OPCS) r.opc[r.block_len] = opc;
+	r.block_len++;
+	r.insn++;
+	gTraceNextPC = pc + 4;
+}
@@ -0,0 +1,89 @@
+/*
+ *	PearPC
+ *	cputrace.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __CPU_CPUTRACE_H__
+#define __CPU_CPUTRACE_H__
+
+#include "system/types.h"
+
+/*
+ *	Block trace of the boot cpu, written by both cpu cores in the
+ *	same format, so their traces can be compared (see tracediff).
+ *
+ *	A block ends whenever an instruction isn't followed by the next
+ *	one in memory (taken branch, exception, rfi). For each block a
+ *	record with its instructions and the register state at the start
+ *	of the following block is written.
+ */
+
+#define PPC_TRACE_MAGIC		0x43525450
+#define PPC_TRACE_VERSION	1
+// instructions stored per record, longer blocks are truncated
+#define PPC_TRACE_BLOCK_OPCS	32
+
+struct PPCTraceHeader {
+	uint32	magic;
+	uint32	version;
+	uint32	record_size;
+	uint32	pvr;
+};
+
+struct PPCTraceState {
+	uint32	pc;
+	uint32	msr;
+	uint32	cr;
+	uint32	xer;		// including CA
+	uint32	lr;
+	uint32	ctr;
+	uint32	fpscr;
+	uint32	srr0;
+	uint32	srr1;
+	uint32	reserved;
+	uint32	gpr[32];
+	uint64	fpr[32];
+};
+
+struct PPCTraceRecord {
+	uint64	insn;		// instructions executed before state.pc
+	uint32	block_pc;
+	uint32	block_len;
+	uint32	opc[PPC_TRACE_BLOCK_OPCS];
+	PPCTraceState state;
+};
+
+extern bool gPPCTrace;
+
+void	ppc_trace_init_config();
+// opens cpu_trace_file if configured
+void	ppc_trace_init();
+void	ppc_trace_done();
+
+/*
+ *	Called by the cpu core before every instruction when gPPCTrace
+ *	is set, with all registers written back to gCPU.
+ */
+extern "C" void FASTCALL ppc_trace_insn(uint32 pc, uint32 opc);
+
+/*
+ *	Have to be provided by the cpu core.
+ */
+void	ppc_cpu_trace_state(PPCTraceState &s);
+
+#endif
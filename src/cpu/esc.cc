@@ -0,0 +1,407 @@
+/*
+ *	PearPC
+ *	esc.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <cstring>
+
+#include "system/types.h"
+#include "debug/tracers.h"
+#include "cpu/common.h"
+#include "cpu/cpu.h"
+#include "esc.h"
+
+/*
+ *	All functions here work on host memory one page-chunk at a
+ *	time: a chunk never crosses a page boundary of any of its
+ *	operands, so each chunk needs exactly one translation per
+ *	operand and can be handed to the (vectorized) host memcpy,
+ *	memmove, memset and memchr as a whole.
+ */
+
+typedef bool (*ppc_escape_function)(uint32 &fault_ea);
+
+static inline uint32 arg(int i)
+{
+	return ppc_cpu_get_gpr(ppc_cpu_current(), i);
+}
+
+static inline void set_arg(int i, uint32 v)
+{
+	ppc_cpu_set_gpr(ppc_cpu_current(), i, v);
+}
+
+static inline uint32 page_rest(uint32 a)
+{
+	return 4096 - (a & 0xfff);
+}
+
+/*
+ *	Host pointer to the physical range [pa, pa+size) if it lies in
+ *	RAM as a whole, NULL otherwise. The phys escapes hand the range
+ *	to the host in one call, so it may neither wrap around nor reach
+ *	past the end of RAM (into the framebuffer, for example).
+ */
+static byte *esc_phys_range(uint32 pa, uint32 size)
+{
+	if (pa + size < pa || pa + size > gMemorySize) return NULL;
+	return ppc_escape_memory_handle_phys(pa);
+}
+
+static bool esc_fill(uint32 &dest, int c, uint32 &size, uint32 &fault_ea)
+{
+	while (size) {
+		byte *dst = ppc_escape_memory_handle(dest, true);
+		if (!dst) {
+			fault_ea = dest;
+			return false;
+		}
+		uint32 s = MIN(page_rest(dest), size);
+		memset(dst, c, s);
+		dest += s;
+		size -= s;
+	}
+	return true;
+}
+
+static bool esc_move_forward(uint32 &dest, uint32 &source, uint32 &size, uint32 &fault_ea)
+{
+	while (size) {
+		byte *dst = ppc_escape_memory_handle(dest, true);
+		if (!dst) {
+			fault_ea = dest;
+			return false;
+		}
+		byte *src = ppc_escape_memory_handle(source, false);
+		if (!src) {
+			fault_ea = source;
+			return false;
+		}
+		uint32 s = MIN(page_rest(dest), page_rest(source));
+		s = MIN(s, size);
+		memmove(dst, src, s);
+		dest += s;
+		source += s;
+		size -= s;
+	}
+	return true;
+}
+
+/*
+ *	Copies from the end, so only size shrinks. When restarted
+ *	after a fault the remaining ranges may no longer overlap
+ *	and esc_move() will pick the forward direction, which is
+ *	fine then.
+ */
+static bool esc_move_backward(uint32 dest, uint32 source, uint32 &size, uint32 &fault_ea)
+{
+	while (size) {
+		uint32 dlast = dest + size - 1;
+		uint32 slast = source + size - 1;
+		uint32 s = MIN((dlast & 0xfff) + 1, (slast & 0xfff) + 1);
+		s = MIN(s, size);
+		byte *dst = ppc_escape_memory_handle(dest + size - s, true);
+		if (!dst) {
+			fault_ea = dest + size - s;
+			return false;
+		}
+		byte *src = ppc_escape_memory_handle(source + size - s, false);
+		if (!src) {
+			fault_ea = source + size - s;
+			return false;
+		}
+		memmove(dst, src, s);
+		size -= s;
+	}
+	return true;
+}
+
+static bool esc_move(uint32 &dest, uint32 &source, uint32 &size, uint32 &fault_ea)
+{
+	if (dest == source || !size) return true;
+	if (dest > source && dest - source < size) {
+		return esc_move_backward(dest, source, size, fault_ea);
+	}
+	return esc_move_forward(dest, source, size, fault_ea);
+}
+
+static bool escape_version(uint32 &fault_ea)
+{
+	set_arg(4, PPC_ESCAPE_IF_VERSION);
+	return true;
+}
+
+static bool escape_memset(uint32 &fault_ea)
+{
+	// memset(dest [r4], c [r5], size [r6])
+	uint32 dest = arg(4);
+	uint32 c = arg(5);
+	uint32 size = arg(6);
+	PPC_ESC_TRACE("memset(%08x, %02x, %d)\n", dest, c, size);
+	if (esc_fill(dest, c, size, fault_ea)) return true;
+	set_arg(4, dest);
+	set_arg(6, size);
+	return false;
+}
+
+static bool escape_memcpy(uint32 &fault_ea)
+{
+	// memcpy(dest [r4], src [r5], size [r6])
+	uint32 dest = arg(4);
+	uint32 source = arg(5);
+	uint32 size = arg(6);
+	PPC_ESC_TRACE("memcpy(%08x, %08x, %d)\n", dest, source, size);
+	if (esc_move(dest, source, size, fault_ea)) return true;
+	set_arg(4, dest);
+	set_arg(5, source);
+	set_arg(6, size);
+	return false;
+}
+
+static bool escape_bzero(uint32 &fault_ea)
+{
+	// bzero(dest [r4], size [r5])
+	uint32 dest = arg(4);
+	uint32 size = arg(5);
+	PPC_ESC_TRACE("bzero(%08x, %08x)\n", dest, size);
+	if (esc_fill(dest, 0, size, fault_ea)) return true;
+	set_arg(4, dest);
+	set_arg(5, size);
+	return false;
+}
+
+static bool escape_bzero_phys(uint32 &fault_ea)
+{
+	// bzero_phys(dest [r4], size [r5])
+	uint32 dest = arg(4);
+	uint32 size = arg(5);
+	PPC_ESC_TRACE("bzero_phys(%08x, %08x)\n", dest, size);
+	if (ppc_cpu_get_msr(ppc_cpu_current()) & MSR_PR) return true;
+	if (!size) return true;
+	byte *dst = esc_phys_range(dest, size);
+	if (!dst) return true;
+	memset(dst, 0, size);
+	return true;
+}
+
+static bool escape_bcopy(uint32 &fault_ea)
+{
+	// bcopy(src [r4], dest [r5], size [r6])
+	// r7 (reverse flag) is obsolete and ignored
+	uint32 source = arg(4);
+	uint32 dest = arg(5);
+	uint32 size = arg(6);
+	PPC_ESC_TRACE("bcopy(%08x, %08x, %d)\n", source, dest, size);
+	if (esc_move(dest, source, size, fault_ea)) return true;
+	set_arg(4, source);
+	set_arg(5, dest);
+	set_arg(6, size);
+	set_arg(7, 0);
+	return false;
+}
+
+static bool escape_bcopy_phys(uint32 &fault_ea)
+{
+	// bcopy_phys(src [r4], dest [r5], size [r6])
+	// bcopy_physvirt(src [r4], dest [r5], size [r6])
+	uint32 source = arg(4);
+	uint32 dest = arg(5);
+	uint32 size = arg(6);
+	PPC_ESC_TRACE("bcopy_phys(%08x, %08x, %d)\n", source, dest, size);
+	if (ppc_cpu_get_msr(ppc_cpu_current()) & MSR_PR) return true;
+	if (!size) return true;
+	byte *dst = esc_phys_range(dest, size);
+	if (!dst) return true;
+	byte *src = esc_phys_range(source, size);
+	if (!src) return true;
+	memmove(dst, src, size);
+	return true;
+}
+
+static bool escape_copy_page(uint32 &fault_ea)
+{
+	// copy_page(src [r4], dest [r5])
+	uint32 source = arg(4);
+	uint32 dest = arg(5);
+	PPC_ESC_TRACE("copy_page(%05x, %05x)\n", source, dest);
+	if (ppc_cpu_get_msr(ppc_cpu_current()) & MSR_PR) return true;
+	byte *dst = esc_phys_range(dest << 12, 4096);
+	if (!dst) return true;
+	byte *src = esc_phys_range(source << 12, 4096);
+	if (!src) return true;
+	memcpy(dst, src, 4096);
+	return true;
+}
+
+static bool escape_zero_page(uint32 &fault_ea)
+{
+	// zero_page(page [r4])
+	uint32 dest = arg(4);
+	PPC_ESC_TRACE("zero_page(%05x)\n", dest);
+	if (ppc_cpu_get_msr(ppc_cpu_current()) & MSR_PR) return true;
+	byte *dst = esc_phys_range(dest << 12, 4096);
+	if (!dst) return true;
+	memset(dst, 0, 4096);
+	return true;
+}
+
+static inline uint32 csum_fold32(uint64 sum)
+{
+	while (sum >> 32) {
+		sum = (sum & 0xffffffff) + (sum >> 32);
+	}
+	return sum;
+}
+
+static bool escape_csum_partial(uint32 &fault_ea)
+{
+	/*
+	 *	csum_partial(buf [r4], len [r5], sum [r6])
+	 *	returns the 32 bit (unfolded) ones' complement sum
+	 *	of the big-endian halfwords of buf plus sum in r4
+	 */
+	uint32 buf = arg(4);
+	uint32 len = arg(5);
+	uint64 sum = arg(6);
+	PPC_ESC_TRACE("csum_partial(%08x, %d, %08x)\n", buf, len, (uint32)sum);
+	// high byte of a halfword split by a page boundary
+	int pending = -1;
+	while (len) {
+		byte *p = ppc_escape_memory_handle(buf, false);
+		if (!p) {
+			fault_ea = buf;
+			// don't count the pending byte, we have to restart on an even offset
+			if (pending >= 0) {
+				buf--;
+				len++;
+			}
+			set_arg(4, buf);
+			set_arg(5, len);
+			set_arg(6, csum_fold32(sum));
+			return false;
+		}
+		uint32 s = MIN(page_rest(buf), len);
+		uint32 i = 0;
+		if (pending >= 0) {
+			sum += (pending << 8) | p[0];
+			pending = -1;
+			i = 1;
+		}
+		for (; i+1 < s; i += 2) {
+			sum += (p[i] << 8) | p[i+1];
+		}
+		if (i < s) {
+			if (s == len) {
+				sum += p[i] << 8;
+			} else {
+				pending = p[i];
+			}
+		}
+		buf += s;
+		len -= s;
+	}
+	set_arg(4, csum_fold32(sum));
+	return true;
+}
+
+static bool escape_strlen(uint32 &fault_ea)
+{
+	// strlen(s [r4], 0 [r5])
+	// r5 carries the length counted so far when restarted after a fault
+	uint32 s = arg(4);
+	uint32 len = arg(5);
+	PPC_ESC_TRACE("strlen(%08x)\n", s);
+	while (true) {
+		byte *p = ppc_escape_memory_handle(s, false);
+		if (!p) {
+			fault_ea = s;
+			set_arg(4, s);
+			set_arg(5, len);
+			return false;
+		}
+		uint32 n = page_rest(s);
+		byte *z = (byte*)memchr(p, 0, n);
+		if (z) {
+			set_arg(4, len + (z - p));
+			return true;
+		}
+		s += n;
+		len += n;
+	}
+}
+
+static bool escape_strcmp(uint32 &fault_ea)
+{
+	// strcmp(s1 [r4], s2 [r5])
+	uint32 s1 = arg(4);
+	uint32 s2 = arg(5);
+	PPC_ESC_TRACE("strcmp(%08x, %08x)\n", s1, s2);
+	while (true) {
+		byte *p1 = ppc_escape_memory_handle(s1, false);
+		if (!p1) {
+			fault_ea = s1;
+			break;
+		}
+		byte *p2 = ppc_escape_memory_handle(s2, false);
+		if (!p2) {
+			fault_ea = s2;
+			break;
+		}
+		uint32 n = MIN(page_rest(s1), page_rest(s2));
+		for (uint32 i=0; i < n; i++) {
+			if (p1[i] != p2[i] || !p1[i]) {
+				set_arg(4, (sint32)p1[i] - (sint32)p2[i]);
+				return true;
+			}
+		}
+		s1 += n;
+		s2 += n;
+	}
+	set_arg(4, s1);
+	set_arg(5, s2);
+	return false;
+}
+
+static ppc_escape_function escape_functions[] = {
+	escape_version,
+
+	escape_memset,
+	escape_memcpy,
+	escape_bzero,
+	escape_bzero_phys,
+	escape_bcopy,
+	escape_bcopy_phys,
+	escape_bcopy_phys,
+	escape_copy_page,
+
+	escape_zero_page,
+	escape_csum_partial,
+	escape_strlen,
+	escape_strcmp,
+};
+
+bool ppc_escape(uint32 func, uint32 &fault_ea)
+{
+	if (func >= (sizeof escape_functions / sizeof escape_functions[0])) {
+		PPC_ESC_WARN("unimplemented escape function %d\n", func);
+		return true;
+	}
+	return escape_functions[func](fault_ea);
+}
@@ -0,0 +1,67 @@
+/*
+ *	PearPC
+ *	esc.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __CPU_ESC_H__
+#define __CPU_ESC_H__
+
+#include "system/types.h"
+
+#define PPC_OPC_ESCAPE_VM 0x0069BABE
+
+#define PPC_ESCAPE_IF_VERSION		1
+
+// values for r3
+#define PPC_INTERN_VERSION		0
+
+#define PPC_INTERN_MEMSET		1
+#define PPC_INTERN_MEMCPY		2
+#define PPC_INTERN_BZERO		3
+#define PPC_INTERN_BZERO_PHYS		4
+#define PPC_INTERN_BCOPY		5
+#define PPC_INTERN_BCOPY_PHYS		6
+#define PPC_INTERN_BCOPY_PHYSVIR	7
+#define PPC_INTERN_COPY_PAGE		8
+// since version 1
+#define PPC_INTERN_ZERO_PAGE		9
+#define PPC_INTERN_CSUM_PARTIAL		10
+#define PPC_INTERN_STRLEN		11
+#define PPC_INTERN_STRCMP		12
+
+/*
+ *	Runs escape function func (arguments in r4...).
+ *	Returns false if a data access fault occured at fault_ea.
+ *	The argument registers are updated in that case, so the
+ *	escape can be restarted after the DSI handler has run.
+ */
+bool	ppc_escape(uint32 func, uint32 &fault_ea);
+
+/*
+ *	Have to be provided by the cpu core.
+ *	Return a host pointer to the given address or NULL if the
+ *	address isn't accessible or isn't backed by RAM. In that
+ *	case ppc_escape_memory_handle() has to record (or raise)
+ *	the DSI, ppc_escape() just passes the faulting address up.
+ */
+byte *	ppc_escape_memory_handle(uint32 ea, bool write);
+byte *	ppc_escape_memory_handle_phys(uint32 pa);
+// size of guest RAM, starting at physical address 0
+extern uint32 gMemorySize;
+
+#endif
@@ -22,11 +22,19 @@
 #define __MEM_H__
 
 #include "system/types.h"
+#include "system/fileofs.h"
 
-bool	FASTCALL ppc_init_physical_memory(uint size);
+// flags are SYS_ALLOC_* (system/sys.h)
+bool	FASTCALL ppc_init_physical_memory(uint size, int flags);
 
 uint32  ppc_get_memory_size();
 
+/*
+ *	Replaces guest RAM by a copy-on-write mapping of filename at ofs.
+ *	Returns false if the host can't map files, RAM is unchanged then.
+ */
+bool	ppc_map_physical_memory(const char *filename, FileOfs ofs);
+
 bool	ppc_dma_write(uint32 dest, const void *src, uint32 size);
 bool	ppc_dma_read(void *dest, uint32 src, uint32 size);
 bool	ppc_dma_set(uint32 dest, int c, uint32 size);
@@ -0,0 +1,61 @@
+/*
+ *	PearPC
+ *	tlbcontext.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <cstring>
+
+#include "system/types.h"
+#include "cpu/common.h"
+#include "tlbcontext.h"
+
+#define PPC_TLB_CONTEXT_EMPTY	0xffffffff
+// keep the open addressing short
+#define PPC_TLB_CONTEXTS_MAX	(PPC_TLB_CONTEXTS*3/4)
+
+void ppc_tlb_contexts_reset(PPC_TLBContexts &c)
+{
+	memset(c.key, 0xff, sizeof c.key);
+	c.used = 0;
+}
+
+int ppc_tlb_context_lookup(PPC_TLBContexts &c, uint32 sr, uint32 msr)
+{
+	uint32 key;
+	if (msr & (MSR_IR | MSR_DR)) {
+		// the mode goes into the reserved bits 4-6 of sr
+		key = sr & 0xf0ffffff;
+		if (msr & MSR_PR) key |= 1<<24;
+		if (msr & MSR_IR) key |= 1<<25;
+		if (msr & MSR_DR) key |= 1<<26;
+	} else {
+		// untranslated, segments and protection don't matter
+		key = 0;
+	}
+	uint32 h = (key ^ (key >> 8) ^ (key >> 16) ^ (key >> 24)) & (PPC_TLB_CONTEXTS-1);
+	while (c.key[h] != PPC_TLB_CONTEXT_EMPTY) {
+		if (c.key[h] == key) return h;
+		h = (h+1) & (PPC_TLB_CONTEXTS-1);
+	}
+	if (c.used == PPC_TLB_CONTEXTS_MAX) return -1;
+	c.used++;
+	c.key[h] = key;
+	return h;
+}
@@ -0,0 +1,53 @@
+/*
+ *	PearPC
+ *	tlbcontext.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __CPU_TLBCONTEXT_H__
+#define __CPU_TLBCONTEXT_H__
+
+#include "system/types.h"
+
+/*
+ *	Both cores tag their TLB entries with a context id, stored in
+ *	the (otherwise zero) lower 12 bits of the effective page. A
+ *	context is a segment register value together with the msr bits
+ *	a translation depends on (PR, IR, DR). So a mode switch or a
+ *	segment register reload only has to look up new ids instead
+ *	of flushing the TLB.
+ *
+ *	Ids are never reused until the table runs full. The core then
+ *	has to flush its TLB and reset the table. Ids are always less
+ *	than 0xfff, so an invalidated entry (all bits set) can't match.
+ */
+#define PPC_TLB_CONTEXTS	256
+
+struct PPC_TLBContexts {
+	uint32	key[PPC_TLB_CONTEXTS];
+	uint	used;
+};
+
+void	ppc_tlb_contexts_reset(PPC_TLBContexts &c);
+
+/*
+ *	Returns the id of segment register value sr in msr mode
+ *	or -1 if the table is full.
+ */
+int	ppc_tlb_context_lookup(PPC_TLBContexts &c, uint32 sr, uint32 msr);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ *	PearPC
+ *	tracediff.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/*
+ *	Compares two cpu traces (see cpu/cputrace.h), usually one of
+ *	ppc-generic and one of ppc-jitc booted with the same configuration,
+ *	and reports the first divergence.
+ *
+ *	Records are read alternately from both files, so the traces
+ *	can be named pipes with both emulators running in lock-step.
+ */
+
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "cpu/cputrace.h"
+#include "debug/ppcdis.h"
+#include "tools/snprintf.h"
+
+#define TRACEDIFF_HISTORY	8
+
+static const char *gRegNames[] = {
+	"pc", "msr", "cr", "xer", "lr", "ctr", "fpscr", "srr0", "srr1",
+};
+
+static void usage()
+{
+	ht_printf("usage: ppc-tracediff trace1 trace2\n");
+	exit(2);
+}
+
+static FILE *openTrace(const char *filename)
+{
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		ht_printf("%s: can't open\n", filename);
+		exit(2);
+	}
+	PPCTraceHeader h;
+	if (fread(&h, sizeof h, 1, f) != 1 || h.magic != PPC_TRACE_MAGIC) {
+		ht_printf("%s: not a cpu trace\n", filename);
+		exit(2);
+	}
+	if (h.version != PPC_TRACE_VERSION || h.record_size != sizeof (PPCTraceRecord)) {
+		ht_printf("%s: unsupported trace version\n", filename);
+		exit(2);
+	}
+	return f;
+}
+
+static void disasmBlock(const char *prefix, const PPCTraceRecord &r)
+{
+	PPCDisassembler dis;
+	uint n = MIN(r.block_len, PPC_TRACE_BLOCK_OPCS);
+	for (uint i=0; i < n; i++) {
+		CPU_ADDR addr;
+		uint32 pc = r.block_pc + i*4;
+		addr.addr32.offset = pc;
+		uint32 code = r.opc[i];
+		ht_printf("%s%08x  %08x  %s\n", prefix, pc, code, dis.str(dis.decode((byte*)&code, 4, addr), 0));
+	}
+	if (r.block_len > n) ht_printf("%s...       (%d more)\n", prefix, r.block_len - n);
+}
+
+static bool sameBlock(const PPCTraceRecord &a, const PPCTraceRecord &b)
+{
+	if (a.insn != b.insn || a.block_pc != b.block_pc || a.block_len != b.block_len) return false;
+	uint n = MIN(a.block_len, PPC_TRACE_BLOCK_OPCS);
+	return memcmp(a.opc, b.opc, n * sizeof a.opc[0]) == 0;
+}
+
+static void diffState(const PPCTraceState &a, const PPCTraceState &b)
+{
+	const uint32 *ra = &a.pc, *rb = &b.pc;
+	for (uint i=0; i < sizeof gRegNames / sizeof gRegNames[0]; i++) {
+		if (ra[i] != rb[i]) ht_printf("  %-6s %08x  %08x\n", gRegNames[i], ra[i], rb[i]);
+	}
+	for (int i=0; i < 32; i++) {
+		if (a.gpr[i] != b.gpr[i]) ht_printf("  r%-5d %08x  %08x\n", i, a.gpr[i], b.gpr[i]);
+	}
+	for (int i=0; i < 32; i++) {
+		if (a.fpr[i] != b.fpr[i]) ht_printf("  f%-5d %016qx  %016qx\n", i, a.fpr[i], b.fpr[i]);
+	}
+}
+
+/*
+ *	External and decrementer interrupts are asynchronous, both
+ *	cores don't necessarily take them at the same instruction.
+ */
+static bool isAsyncVector(uint32 pc)
+{
+	uint32 v = pc & 0x000fffff;
+	return (v == 0x500 || v == 0x900) && ((pc & 0xfff00000) == 0 || (pc & 0xfff00000) == 0xfff00000);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3) usage();
+	FILE *f[2];
+	f[0] = openTrace(argv[1]);
+	f[1] = openTrace(argv[2]);
+
+	PPCTraceRecord history[TRACEDIFF_HISTORY];
+	PPCTraceRecord r[2];
+	uint64 n = 0;
+	while (true) {
+		bool ok0 = fread(&r[0], sizeof r[0], 1, f[0]) == 1;
+		bool ok1 = fread(&r[1], sizeof r[1], 1, f[1]) == 1;
+		if (!ok0 || !ok1) {
+			if (ok0 != ok1) {
+				ht_printf("%s ends after %qd blocks.\n", argv[ok0 ? 2 : 1], n);
+			}
+			ht_printf("no divergence in %qd blocks.\n", n);
+			return 0;
+		}
+		if (sameBlock(r[0], r[1]) && memcmp(&r[0].state, &r[1].state, sizeof r[0].state) == 0) {
+			history[n % TRACEDIFF_HISTORY] = r[0];
+			n++;
+			continue;
+		}
+		break;
+	}
+
+	ht_printf("divergence in block %qd:\n\n", n);
+	uint64 first = (n > TRACEDIFF_HISTORY) ? n - TRACEDIFF_HISTORY : 0;
+	for (uint64 i = first; i < n; i++) {
+		const PPCTraceRecord &h = history[i % TRACEDIFF_HISTORY];
+		ht_printf("block %qd (insn %qd):\n", i, h.insn - h.block_len);
+		disasmBlock("  ", h);
+	}
+	for (int i=0; i < 2; i++) {
+		ht_printf("\n%s, block %qd (insn %qd):\n", argv[i+1], n, r[i].insn - r[i].block_len);
+		disasmBlock("  ", r[i]);
+		ht_printf("  -> %08x\n", r[i].state.pc);
+	}
+	ht_printf("\nregisters at the end of the block (%s, %s):\n", argv[1], argv[2]);
+	diffState(r[0].state, r[1].state);
+	if (isAsyncVector(r[0].state.pc) || isAsyncVector(r[1].state.pc)) {
+		ht_printf("\nan asynchronous interrupt was taken at a different point, this is "
+			"probably a timing difference rather than a translation bug.\n");
+	}
+	return 1;
+}
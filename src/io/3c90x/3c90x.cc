@@ -1751,6 +1751,56 @@ void writeConfig(uint reg, int offset, int size)
 	sys_unlock_mutex(mLock);
 }
 
+void saveState(Stream &st)
+{
+	sys_lock_mutex(mLock);
+	PCI_Device::saveState(st);
+	st.writex(mEEPROM, sizeof mEEPROM);
+	st.writex(&mEEPROMWritable, sizeof mEEPROMWritable);
+	st.writex(&mRegisters, sizeof mRegisters);
+	st.writex(mWindows, sizeof mWindows);
+	st.writex(&mIntStatus, sizeof mIntStatus);
+	st.writex(&mRxEnabled, sizeof mRxEnabled);
+	st.writex(&mTxEnabled, sizeof mTxEnabled);
+	st.writex(&mUpStalled, sizeof mUpStalled);
+	st.writex(&mDnStalled, sizeof mDnStalled);
+	st.writex(&mRxPacketSize, sizeof mRxPacketSize);
+	st.writex(mRxPacket, mRxPacketSize);
+	st.writex(&mMIIRegs, sizeof mMIIRegs);
+	st.writex(&mMIIReadWord, sizeof mMIIReadWord);
+	st.writex(&mMIIWriteWord, sizeof mMIIWriteWord);
+	st.writex(&mMIIWrittenBits, sizeof mMIIWrittenBits);
+	st.writex(&mLastHiClkPhysMgmt, sizeof mLastHiClkPhysMgmt);
+	sys_unlock_mutex(mLock);
+}
+
+void loadState(Stream &st)
+{
+	sys_lock_mutex(mLock);
+	PCI_Device::loadState(st);
+	st.readx(mEEPROM, sizeof mEEPROM);
+	st.readx(&mEEPROMWritable, sizeof mEEPROMWritable);
+	st.readx(&mRegisters, sizeof mRegisters);
+	st.readx(mWindows, sizeof mWindows);
+	st.readx(&mIntStatus, sizeof mIntStatus);
+	st.readx(&mRxEnabled, sizeof mRxEnabled);
+	st.readx(&mTxEnabled, sizeof mTxEnabled);
+	st.readx(&mUpStalled, sizeof mUpStalled);
+	st.readx(&mDnStalled, sizeof mDnStalled);
+	st.readx(&mRxPacketSize, sizeof mRxPacketSize);
+	if (mRxPacketSize > sizeof mRxPacket) {
+		sys_unlock_mutex(mLock);
+		throw MsgException("3c90x: invalid snapshot");
+	}
+	st.readx(mRxPacket, mRxPacketSize);
+	st.readx(&mMIIRegs, sizeof mMIIRegs);
+	st.readx(&mMIIReadWord, sizeof mMIIReadWord);
+	st.readx(&mMIIWriteWord, sizeof mMIIWriteWord);
+	st.readx(&mMIIWrittenBits, sizeof mMIIWrittenBits);
+	st.readx(&mLastHiClkPhysMgmt, sizeof mLastHiClkPhysMgmt);
+	sys_unlock_mutex(mLock);
+}
+
 bool readDeviceIO(uint r, uint32 port, uint32 &data, uint size)
 {
 	if (r != 0) return false;
@@ -40,6 +40,7 @@
 
 #include "cpu/cpu.h"
 #include "tools/snprintf.h"
+#include "tools/stream.h"
 #include "debug/tracers.h"
 #include "io/pic/pic.h"
 #include "system/keyboard.h"
@@ -998,6 +999,32 @@ void cuda_done()
 	sys_destroy_semaphore(gCUDA.idle_sem);
 }
 
+/*
+ *	T1_end is saved relative to the host clock,
+ *	the semaphore isn't saved at all.
+ */
+void cuda_save_state(Stream &st)
+{
+	sys_lock_mutex(gCUDAMutex);
+	cuda_control c = gCUDA;
+	sys_unlock_mutex(gCUDAMutex);
+	uint64 clk = sys_get_hiresclk_ticks();
+	c.T1_end = (c.T1_end > clk) ? c.T1_end - clk : 0;
+	memset(&c.idle_sem, 0, sizeof c.idle_sem);
+	st.writex(&c, sizeof c);
+}
+
+void cuda_load_state(Stream &st)
+{
+	cuda_control c;
+	st.readx(&c, sizeof c);
+	sys_lock_mutex(gCUDAMutex);
+	c.idle_sem = gCUDA.idle_sem;
+	c.T1_end += sys_get_hiresclk_ticks();
+	gCUDA = c;
+	sys_unlock_mutex(gCUDAMutex);
+}
+
 void cuda_init_config()
 {
 }
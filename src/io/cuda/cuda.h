@@ -34,6 +34,10 @@ void cuda_init();
 void cuda_done();
 void cuda_init_config();
 
+class Stream;
+void cuda_save_state(Stream &st);
+void cuda_load_state(Stream &st);
+
 bool cuda_prom_get_key(uint32 &key);
 
 #endif
@@ -26,6 +26,7 @@
 #include "debug/tracers.h"
 #include "system/display.h"
 #include "system/arch/sysendian.h"
+#include "tools/except.h"
 #include "tools/snprintf.h"
 #include "cpu/cpu.h"
 #include "io/pic/pic.h"
@@ -36,28 +37,40 @@ struct VMode {
 };
 
 static VMode stdVModes[] = {
+	{640, 480, 1},
 	{640, 480, 2},
 	{640, 480, 4},
+	{800, 600, 1},
 	{800, 600, 2},
 	{800, 600, 4},
+	{1024, 768, 1},
 	{1024, 768, 2},
 	{1024, 768, 4},
+	{1152, 864, 1},
 	{1152, 864, 2},
 	{1152, 864, 4},
+	{1280, 720, 1},
 	{1280, 720, 2},
 	{1280, 720, 4},
+	{1280, 768, 1},
 	{1280, 768, 2},
 	{1280, 768, 4},
+	{1280, 960, 1},
 	{1280, 960, 2},
 	{1280, 960, 4},
+	{1280, 1024, 1},
 	{1280, 1024, 2},
 	{1280, 1024, 4},
+	{1360, 768, 1},
 	{1360, 768, 2},
 	{1360, 768, 4},
+	{1600, 900, 1},
 	{1600, 900, 2},
 	{1600, 900, 4},
+	{1600, 1024, 1},
 	{1600, 1024, 2},
 	{1600, 1024, 4},
+	{1600, 1200, 1},
 	{1600, 1200, 2},
 	{1600, 1200, 4}
 };
@@ -228,6 +241,110 @@ void gcard_raise_interrupt()
 	if (gVBLon) pic_raise_interrupt(IO_PIC_IRQ_GCARD);
 }
 
+static bool gcard_on_screen(const DisplayCharacteristics &chr, uint32 pos, uint32 size)
+{
+	uint x = pos >> 16, y = pos & 0xffff;
+	uint w = size >> 16, h = size & 0xffff;
+	return x + w <= (uint)chr.width && y + h <= (uint)chr.height;
+}
+
+static inline void gcard_put_pixel(byte *p, uint32 pixel, int bytesPerPixel)
+{
+	switch (bytesPerPixel) {
+	case 1:
+		p[0] = pixel;
+		break;
+	case 2:
+		p[0] = pixel >> 8;
+		p[1] = pixel;
+		break;
+	case 4:
+		p[0] = pixel >> 24;
+		p[1] = pixel >> 16;
+		p[2] = pixel >> 8;
+		p[3] = pixel;
+		break;
+	}
+}
+
+/*
+ *	Copies the first min(h, rows) lines of the rectangle
+ *	down to the rest of it.
+ */
+static void gcard_repeat_lines(const DisplayCharacteristics &chr, byte *p, uint w, uint h, uint rows)
+{
+	uint len = w * chr.bytesPerPixel;
+	for (uint y=rows; y < h; y++) {
+		memcpy(p + y * chr.scanLineLength, p + (y-rows) * chr.scanLineLength, len);
+	}
+}
+
+/*
+ *	Source and destination may overlap (that's what scrolling
+ *	is), so overlapping lines are copied bottom up when moving
+ *	down and memmove() handles the columns.
+ */
+static void gcard_blit(const DisplayCharacteristics &chr, uint32 src, uint32 dest, uint32 size)
+{
+	uint w = size >> 16, h = size & 0xffff;
+	if (!w || !h) return;
+	uint len = w * chr.bytesPerPixel;
+	byte *s = gFrameBuffer + (src & 0xffff) * chr.scanLineLength + (src >> 16) * chr.bytesPerPixel;
+	byte *d = gFrameBuffer + (dest & 0xffff) * chr.scanLineLength + (dest >> 16) * chr.bytesPerPixel;
+	if (d > s) {
+		for (int y=h-1; y >= 0; y--) {
+			memmove(d + y * chr.scanLineLength, s + y * chr.scanLineLength, len);
+		}
+	} else {
+		for (uint y=0; y < h; y++) {
+			memmove(d + y * chr.scanLineLength, s + y * chr.scanLineLength, len);
+		}
+	}
+	damageFrameBufferRect(dest >> 16, dest & 0xffff, w, h);
+}
+
+static void gcard_fill(const DisplayCharacteristics &chr, uint32 pos, uint32 size, uint32 pixel)
+{
+	uint w = size >> 16, h = size & 0xffff;
+	if (!w || !h) return;
+	byte *p = gFrameBuffer + (pos & 0xffff) * chr.scanLineLength + (pos >> 16) * chr.bytesPerPixel;
+	// one pixel, then double it
+	uint len = w * chr.bytesPerPixel;
+	gcard_put_pixel(p, pixel, chr.bytesPerPixel);
+	for (uint l = chr.bytesPerPixel; l < len; l *= 2) {
+		memcpy(p + l, p, MIN(l, len - l));
+	}
+	gcard_repeat_lines(chr, p, w, h, 1);
+	damageFrameBufferRect(pos >> 16, pos & 0xffff, w, h);
+}
+
+static void gcard_pattern_fill(const DisplayCharacteristics &chr, uint32 pos, uint32 size,
+	uint32 fg, uint32 bg, uint32 pat0, uint32 pat1)
+{
+	uint x0 = pos >> 16, y0 = pos & 0xffff;
+	uint w = size >> 16, h = size & 0xffff;
+	if (!w || !h) return;
+	byte *p = gFrameBuffer + y0 * chr.scanLineLength + x0 * chr.bytesPerPixel;
+	uint rows = MIN(h, 8);
+	for (uint y=0; y < rows; y++) {
+		uint py = (y0 + y) & 7;
+		uint row = ((py < 4 ? pat0 : pat1) >> (24 - (py & 3) * 8)) & 0xff;
+		byte *l = p + y * chr.scanLineLength;
+		// eight pixels, then repeat them
+		uint n = MIN(w, 8);
+		for (uint x=0; x < n; x++) {
+			uint px = (x0 + x) & 7;
+			gcard_put_pixel(l + x * chr.bytesPerPixel, (row & (0x80 >> px)) ? fg : bg, chr.bytesPerPixel);
+		}
+		uint len = w * chr.bytesPerPixel;
+		for (uint c = n * chr.bytesPerPixel; c < len; c *= 2) {
+			memcpy(l + c, l, MIN(c, len - c));
+		}
+	}
+	gcard_repeat_lines(chr, p, w, h, rows);
+	damageFrameBufferRect(x0, y0, w, h);
+}
+
 void gcard_osi(int cpu)
 {
 	IO_GRAPHIC_TRACE("osi: %d\n", ppc_cpu_get_gpr(cpu, 5));
@@ -329,13 +446,51 @@ typedef struct osi_get_vmode_info {
 		IO_GRAPHIC_TRACE("hw cursor!! %d, %d, %d\n", ppc_cpu_get_gpr(cpu, 6), ppc_cpu_get_gpr(cpu, 7), ppc_cpu_get_gpr(cpu, 8));
 		gDisplay->setHWCursor(ppc_cpu_get_gpr(cpu, 6), ppc_cpu_get_gpr(cpu, 7), ppc_cpu_get_gpr(cpu, 8), NULL);
 		return;
+	case OSI_GCARD_BLIT: {
+		const DisplayCharacteristics &chr = gDisplay->mClientChar;
+		uint32 src = ppc_cpu_get_gpr(cpu, 6);
+		uint32 dest = ppc_cpu_get_gpr(cpu, 7);
+		uint32 size = ppc_cpu_get_gpr(cpu, 8);
+		if (!gcard_on_screen(chr, src, size) || !gcard_on_screen(chr, dest, size)) {
+			ppc_cpu_set_gpr(cpu, 3, 1);
+			return;
+		}
+		gcard_blit(chr, src, dest, size);
+		ppc_cpu_set_gpr(cpu, 3, 0);
+		return;
+	}
+	case OSI_GCARD_FILL: {
+		const DisplayCharacteristics &chr = gDisplay->mClientChar;
+		uint32 pos = ppc_cpu_get_gpr(cpu, 6);
+		uint32 size = ppc_cpu_get_gpr(cpu, 7);
+		if (!gcard_on_screen(chr, pos, size)) {
+			ppc_cpu_set_gpr(cpu, 3, 1);
+			return;
+		}
+		gcard_fill(chr, pos, size, ppc_cpu_get_gpr(cpu, 8));
+		ppc_cpu_set_gpr(cpu, 3, 0);
+		return;
+	}
+	case OSI_GCARD_PATTERN_FILL: {
+		const DisplayCharacteristics &chr = gDisplay->mClientChar;
+		uint32 pos = ppc_cpu_get_gpr(cpu, 6);
+		uint32 size = ppc_cpu_get_gpr(cpu, 7);
+		if (!gcard_on_screen(chr, pos, size)) {
+			ppc_cpu_set_gpr(cpu, 3, 1);
+			return;
+		}
+		gcard_pattern_fill(chr, pos, size, ppc_cpu_get_gpr(cpu, 8), ppc_cpu_get_gpr(cpu, 9),
+			ppc_cpu_get_gpr(cpu, 10), ppc_cpu_get_gpr(cpu, 11));
+		ppc_cpu_set_gpr(cpu, 3, 0);
+		return;
+	}
 	}
 	IO_GRAPHIC_ERR("unknown osi function\n");
 }
 
 /*
  * displayCharacteristicsFromString tries to create a(n unfinished) characteristic
- * from a String of the form [0-9]+x[0-9]+x(15|32)(@[0-9]+)?
+ * from a String of the form [0-9]+x[0-9]+x(8|15|32)(@[0-9]+)?
  */
  
 bool displayCharacteristicsFromString(DisplayCharacteristics &aChar, const String &s)
@@ -387,6 +542,15 @@ bool gcard_finish_characteristic(DisplayCharacteristics &aChar)
 	if (aChar.vsyncFrequency == -1) aChar.vsyncFrequency = 60;
 	if (aChar.scanLineLength == -1) aChar.scanLineLength = aChar.width * aChar.bytesPerPixel;
 	switch (aChar.bytesPerPixel) {
+	case 1:
+		// indexed, the colors come from the palette
+		if (aChar.redShift == -1) aChar.redShift = 0;
+		if (aChar.redSize == -1) aChar.redSize = 8;
+		if (aChar.greenShift == -1) aChar.greenShift = 0;
+		if (aChar.greenSize == -1) aChar.greenSize = 8;
+		if (aChar.blueShift == -1) aChar.blueShift = 0;
+		if (aChar.blueSize == -1) aChar.blueSize = 8;
+		break;
 	case 2:
 		
 		if (aChar.redShift == -1) aChar.redShift = 10;
@@ -421,6 +585,59 @@ bool gcard_set_mode(DisplayCharacteristics &mode)
 	}
 }
 
+/*
+ *	The framebuffer, current mode and palette are part of the
+ *	snapshot, the host display is switched to the saved mode.
+ */
+void PCI_GCard::saveState(Stream &st)
+{
+	PCI_Device::saveState(st);
+	DisplayCharacteristics *chr = (DisplayCharacteristics *)(*gGraphicModes)[gCurrentGraphicMode];
+	int m[11] = {
+		chr->width, chr->height, chr->bytesPerPixel, chr->scanLineLength,
+		chr->vsyncFrequency, chr->redShift, chr->redSize, chr->greenShift,
+		chr->greenSize, chr->blueShift, chr->blueSize,
+	};
+	st.writex(m, sizeof m);
+	st.writex(&gVBLon, sizeof gVBLon);
+	for (int i=0; i<256; i++) {
+		RGB c = gDisplay->getColor(i);
+		st.writex(&c, sizeof c);
+	}
+	st.writex(gFrameBuffer, chr->height * chr->scanLineLength);
+}
+
+void PCI_GCard::loadState(Stream &st)
+{
+	PCI_Device::loadState(st);
+	int m[11];
+	st.readx(m, sizeof m);
+	DisplayCharacteristics chr;
+	chr.width = m[0];
+	chr.height = m[1];
+	chr.bytesPerPixel = m[2];
+	chr.scanLineLength = m[3];
+	chr.vsyncFrequency = m[4];
+	chr.redShift = m[5];
+	chr.redSize = m[6];
+	chr.greenShift = m[7];
+	chr.greenSize = m[8];
+	chr.blueShift = m[9];
+	chr.blueSize = m[10];
+	st.readx(&gVBLon, sizeof gVBLon);
+	for (int i=0; i<256; i++) {
+		RGB c;
+		st.readx(&c, sizeof c);
+		gDisplay->setColor(i, c);
+	}
+	if (!gcard_supports_characteristic(chr) || !gDisplay->changeResolution(chr)) {
+		throw MsgfException("can't switch to the snapshot's display mode %dx%dx%d", chr.width, chr.height, chr.bytesPerPixel*8);
+	}
+	gcard_set_mode(chr);
+	st.readx(gFrameBuffer, chr.height * chr.scanLineLength);
+	damageFrameBufferAll();
+}
+
 void gcard_init_modes()
 {
 	gGraphicModes = new Array(true);
@@ -38,6 +38,8 @@ public:
 			PCI_GCard();
 	virtual bool	readDeviceMem(uint r, uint32 address, uint32 &data, uint size);
 	virtual bool	writeDeviceMem(uint r, uint32 address, uint32 data, uint size);
+	virtual void	saveState(Stream &st);
+	virtual void	loadState(Stream &st);
 };
 
 
@@ -120,6 +122,20 @@ static inline void gcard_read128_native(uint32 addr, uint128 *data)
 
 void gcard_raise_interrupt();
 
+/*
+ *	2D acceleration, PearPC specific OSI calls (selector in r5).
+ *	Positions are passed as (x << 16) | y, sizes as (w << 16) | h,
+ *	pixels as framebuffer values of the current mode. r3 returns
+ *	0, or 1 if a rectangle isn't completely on the screen.
+ *
+ *	The pattern is 8x8 pixels, one bit per pixel (set = fg),
+ *	rows 0-3 in r10 and 4-7 in r11, each row's leftmost pixel in
+ *	its most significant bit. It is aligned to the screen origin.
+ */
+#define OSI_GCARD_BLIT		0x1000	// r6: src, r7: dest, r8: size
+#define OSI_GCARD_FILL		0x1001	// r6: pos, r7: size, r8: pixel
+#define OSI_GCARD_PATTERN_FILL	0x1002	// r6: pos, r7: size, r8: fg, r9: bg, r10/r11: pattern
+
 void gcard_osi(int cpu);
 bool gcard_set_mode(DisplayCharacteristics &mode);
 
@@ -21,12 +21,14 @@
 #include "stdafx.h"
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <errno.h>
 
 #include "debug/tracers.h"
 #include "ata.h"
 
+#include "tools/except.h"
 #include "tools/snprintf.h"
 
 ATADevice::ATADevice(const char *name)
@@ -87,10 +89,14 @@ ATADeviceFile::~ATADeviceFile()
 {
 }
 
+ObjectID ATADeviceFile::getObjectID() const
+{
+	return ATOM_IDE_ATA_FILE;
+}
+
 bool ATADeviceFile::seek(uint64 blockno)
 {
-	sys_fseek(mFile, 512 * (uint64)blockno);
-	return true;
+	return sys_fseek(mFile, 512 * (uint64)blockno) == 0;
 }
 
 void ATADeviceFile::flush()
@@ -100,7 +106,7 @@ void ATADeviceFile::flush()
 
 int ATADeviceFile::readBlock(byte *buf)
 {
-	sys_fread(mFile, buf, 512);
+	if (sys_fread(mFile, buf, 512) != 512) return -1;
 	if (mMode & ATA_DEVICE_MODE_ECC) {
 		// add ECC bytes..
 		IO_IDE_ERR("ATADeviceFile: ECC not implemented\n");
@@ -110,8 +116,7 @@ int ATADeviceFile::readBlock(byte *buf)
 
 int ATADeviceFile::writeBlock(byte *buf)
 {
-	sys_fwrite(mFile, buf, 512);
-	return 0;
+	return (sys_fwrite(mFile, buf, 512) == 512) ? 0 : -1;
 }
 
 bool ATADeviceFile::promSeek(FileOfs pos)
@@ -124,3 +129,252 @@ uint ATADeviceFile::promRead(byte *buf, uint size)
 	return sys_fread(mFile, buf, size);
 }
 
+void ATADeviceFile::saveState(Stream &st)
+{
+	ATADevice::saveState(st);
+	FileOfs pos = sys_ftell(mFile);
+	st.writex(&pos, sizeof pos);
+}
+
+void ATADeviceFile::loadState(Stream &st)
+{
+	ATADevice::loadState(st);
+	FileOfs pos;
+	st.readx(&pos, sizeof pos);
+	if (sys_fseek(mFile, pos)) throw MsgfException("%s: can't restore the file position", mName);
+}
+
+/*
+ *
+ */
+#define ATA_OVERLAY_MAGIC	0x4c564f50
+#define ATA_OVERLAY_VERSION	1
+#define ATA_OVERLAY_HDR_SIZE	16
+// data blocks start at a multiple of this
+#define ATA_OVERLAY_ALIGN	4096
+
+ATADeviceOverlayFile::ATADeviceOverlayFile(const char *name, const char *filename, const char *overlay, bool recreate, const char *templ)
+	: ATADevice(name)
+{
+	mOverlay = NULL;
+	mOverlayName = strdup(overlay);
+	mBitmap = NULL;
+	mBlock = 0;
+	mPromPos = 0;
+	mBase = sys_fopen(filename, SYS_OPEN_READ);
+	if (!mBase) {
+		char buf[256];
+		ht_snprintf(buf, sizeof buf, "%s: could not open file (%s)", filename, strerror(errno));
+		setError(buf);
+		return;
+	}
+	sys_fseek(mBase, 0, SYS_SEEK_END);
+	uint64 size = sys_ftell(mBase);
+	uint64 cyl = size / 516096ULL;
+	blocks = size / 512;
+	if ((size % 516096) || cyl > 65535) {
+		// we only support disk images with 16 heads and 63 spt
+		setError("invalid format (filesize isn't a multiple of 516096)");
+		return;
+	}
+	init(16, cyl, 63);
+	mBitmapSize = (blocks + 7) / 8;
+	mDataOfs = (ATA_OVERLAY_HDR_SIZE + mBitmapSize + ATA_OVERLAY_ALIGN - 1) & ~(FileOfs)(ATA_OVERLAY_ALIGN - 1);
+	mBitmap = (byte*)malloc(mBitmapSize);
+	if (!openOverlay(recreate, templ)) {
+		char buf[256];
+		ht_snprintf(buf, sizeof buf, "%s: invalid overlay file for %s", overlay, filename);
+		setError(buf);
+	}
+}
+
+ATADeviceOverlayFile::~ATADeviceOverlayFile()
+{
+	if (mOverlay) sys_fclose(mOverlay);
+	if (mBase) sys_fclose(mBase);
+	free(mOverlayName);
+	free(mBitmap);
+}
+
+ObjectID ATADeviceOverlayFile::getObjectID() const
+{
+	return ATOM_IDE_ATA_OVERLAY_FILE;
+}
+
+static bool readOverlayHeader(SYS_FILE *f, uint64 blocks, byte *bitmap, uint bitmapSize)
+{
+	uint32 hdr[4];
+	sys_fseek(f, 0);
+	if (sys_fread(f, (byte*)hdr, sizeof hdr) != sizeof hdr
+	 || hdr[0] != ATA_OVERLAY_MAGIC || hdr[1] != ATA_OVERLAY_VERSION
+	 || hdr[2] != (uint32)blocks || hdr[3] != (uint32)(blocks >> 32)) return false;
+	return sys_fread(f, bitmap, bitmapSize) == (int)bitmapSize;
+}
+
+/*
+ *	Creates (or truncates) the overlay and writes the header
+ *	with the current bitmap, the data blocks are up to the caller.
+ */
+bool ATADeviceOverlayFile::createOverlay()
+{
+	if (mOverlay) sys_fclose(mOverlay);
+	mOverlay = sys_fopen(mOverlayName, SYS_OPEN_CREATE | SYS_OPEN_WRITE);
+	if (!mOverlay) return false;
+	uint32 hdr[4];
+	hdr[0] = ATA_OVERLAY_MAGIC;
+	hdr[1] = ATA_OVERLAY_VERSION;
+	hdr[2] = blocks;
+	hdr[3] = (uint64)blocks >> 32;
+	return sys_fwrite(mOverlay, (byte*)hdr, sizeof hdr) == sizeof hdr
+	    && sys_fwrite(mOverlay, mBitmap, mBitmapSize) == (int)mBitmapSize;
+}
+
+/*
+ *	Opens an existing overlay or creates a new one.
+ */
+bool ATADeviceOverlayFile::openOverlay(bool recreate, const char *templ)
+{
+	if (!recreate) {
+		mOverlay = sys_fopen(mOverlayName, SYS_OPEN_READ | SYS_OPEN_WRITE);
+		if (mOverlay) return readOverlayHeader(mOverlay, blocks, mBitmap, mBitmapSize);
+	}
+
+	SYS_FILE *t = templ ? sys_fopen(templ, SYS_OPEN_READ) : NULL;
+	if (templ && !t) return false;
+	if (t && !readOverlayHeader(t, blocks, mBitmap, mBitmapSize)) {
+		sys_fclose(t);
+		return false;
+	}
+	if (!t) memset(mBitmap, 0, mBitmapSize);
+
+	bool ok = createOverlay();
+	if (t) {
+		// only copy the blocks the template has, keeps it sparse
+		byte buf[512];
+		for (uint64 b = 0; ok && b < blocks; b++) {
+			if (!(mBitmap[b >> 3] & (1 << (b & 7)))) continue;
+			ok = sys_fseek(t, mDataOfs + 512 * b) == 0
+			  && sys_fseek(mOverlay, mDataOfs + 512 * b) == 0
+			  && sys_fread(t, buf, 512) == 512 && sys_fwrite(mOverlay, buf, 512) == 512;
+		}
+		sys_fclose(t);
+	}
+	if (mOverlay) sys_flush(mOverlay);
+	return ok;
+}
+
+bool ATADeviceOverlayFile::readBlockAt(uint64 block, byte *buf)
+{
+	if (block >= blocks) return false;
+	if (mBitmap[block >> 3] & (1 << (block & 7))) {
+		return sys_fseek(mOverlay, mDataOfs + 512 * block) == 0
+		    && sys_fread(mOverlay, buf, 512) == 512;
+	} else {
+		return sys_fseek(mBase, 512 * block) == 0
+		    && sys_fread(mBase, buf, 512) == 512;
+	}
+}
+
+bool ATADeviceOverlayFile::seek(uint64 blockno)
+{
+	mBlock = blockno;
+	return true;
+}
+
+void ATADeviceOverlayFile::flush()
+{
+	sys_flush(mOverlay);
+}
+
+int ATADeviceOverlayFile::readBlock(byte *buf)
+{
+	if (!readBlockAt(mBlock, buf)) return -1;
+	mBlock++;
+	if (mMode & ATA_DEVICE_MODE_ECC) {
+		// add ECC bytes..
+		IO_IDE_ERR("ATADeviceOverlayFile: ECC not implemented\n");
+	}
+	return 0;
+}
+
+int ATADeviceOverlayFile::writeBlock(byte *buf)
+{
+	if (mBlock >= blocks) return -1;
+	// data first, so a crash can't expose a stale block
+	if (sys_fseek(mOverlay, mDataOfs + 512 * mBlock)
+	 || sys_fwrite(mOverlay, buf, 512) != 512) return -1;
+	byte mask = 1 << (mBlock & 7);
+	byte b = mBitmap[mBlock >> 3];
+	if (!(b & mask)) {
+		b |= mask;
+		if (sys_fseek(mOverlay, ATA_OVERLAY_HDR_SIZE + (mBlock >> 3))
+		 || sys_fwrite(mOverlay, &b, 1) != 1) return -1;
+		mBitmap[mBlock >> 3] = b;
+	}
+	mBlock++;
+	return 0;
+}
+
+bool ATADeviceOverlayFile::promSeek(FileOfs pos)
+{
+	if (pos > 512 * (FileOfs)blocks) return false;
+	mPromPos = pos;
+	return true;
+}
+
+uint ATADeviceOverlayFile::promRead(byte *buf, uint size)
+{
+	byte block[512];
+	uint r = 0;
+	while (r < size) {
+		uint ofs = mPromPos % 512;
+		if (!readBlockAt(mPromPos / 512, block)) break;
+		uint n = MIN(512 - ofs, size - r);
+		memcpy(buf + r, block + ofs, n);
+		mPromPos += n;
+		r += n;
+	}
+	return r;
+}
+
+/*
+ *	The overlay keeps changing after the snapshot was taken
+ *	(and clones copy it), so its blocks are frozen into
+ *	the snapshot.
+ */
+void ATADeviceOverlayFile::saveState(Stream &st)
+{
+	ATADevice::saveState(st);
+	st.writex(&mBlock, sizeof mBlock);
+	st.writex(&mPromPos, sizeof mPromPos);
+	uint64 b = blocks;
+	st.writex(&b, sizeof b);
+	st.writex(mBitmap, mBitmapSize);
+	byte buf[512];
+	for (b = 0; b < blocks; b++) {
+		if (!(mBitmap[b >> 3] & (1 << (b & 7)))) continue;
+		if (!readBlockAt(b, buf)) throw MsgfException("%s: can't read block %qd", mOverlayName, b);
+		st.writex(buf, 512);
+	}
+}
+
+void ATADeviceOverlayFile::loadState(Stream &st)
+{
+	ATADevice::loadState(st);
+	st.readx(&mBlock, sizeof mBlock);
+	st.readx(&mPromPos, sizeof mPromPos);
+	uint64 b;
+	st.readx(&b, sizeof b);
+	if (b != blocks) throw MsgfException("%s: snapshot was taken with a different disk image", mName);
+	st.readx(mBitmap, mBitmapSize);
+	bool ok = createOverlay();
+	byte buf[512];
+	for (b = 0; ok && b < blocks; b++) {
+		if (!(mBitmap[b >> 3] & (1 << (b & 7)))) continue;
+		st.readx(buf, 512);
+		ok = sys_fseek(mOverlay, mDataOfs + 512 * b) == 0
+		  && sys_fwrite(mOverlay, buf, 512) == 512;
+	}
+	if (!ok) throw MsgfException("%s: can't recreate the overlay", mOverlayName);
+	sys_flush(mOverlay);
+}
@@ -48,6 +48,49 @@ public:
 		ATADeviceFile(const char *name, const char *filename);
 	virtual ~ATADeviceFile();
 
+	virtual	ObjectID	getObjectID() const;
+
+	virtual bool	seek(uint64 blockno);
+	virtual void	flush();
+	virtual int	readBlock(byte *buf);
+	virtual int	writeBlock(byte *buf);
+
+	virtual bool	promSeek(uint64 pos);
+	virtual uint	promRead(byte *buf, uint size);
+
+	virtual void	saveState(Stream &st);
+	virtual void	loadState(Stream &st);
+};
+
+/*
+ *	A read-only base image with a copy-on-write overlay file.
+ *	The overlay holds a bitmap of written blocks followed by
+ *	a (host-sparse) copy of the disk, so many guests can share
+ *	one base image. An existing overlay is reused unless
+ *	recreate is set, a new one starts as a copy of templ
+ *	(another overlay of the same image) if given.
+ *	Snapshots contain a copy of the overlay, loading one
+ *	recreates the overlay file from it.
+ */
+class ATADeviceOverlayFile: public ATADevice {
+	SYS_FILE *mBase;
+	SYS_FILE *mOverlay;
+	char	*mOverlayName;
+	byte	*mBitmap;
+	uint	mBitmapSize;
+	FileOfs	mDataOfs;
+	uint64	mBlock;
+	FileOfs	mPromPos;
+
+		bool	openOverlay(bool recreate, const char *templ);
+		bool	createOverlay();
+		bool	readBlockAt(uint64 block, byte *buf);
+public:
+		ATADeviceOverlayFile(const char *name, const char *filename, const char *overlay, bool recreate = false, const char *templ = NULL);
+	virtual ~ATADeviceOverlayFile();
+
+	virtual	ObjectID	getObjectID() const;
+
 	virtual bool	seek(uint64 blockno);
 	virtual void	flush();
 	virtual int	readBlock(byte *buf);
@@ -55,6 +98,9 @@ public:
 
 	virtual bool	promSeek(uint64 pos);
 	virtual uint	promRead(byte *buf, uint size);
+
+	virtual void	saveState(Stream &st);
+	virtual void	loadState(Stream &st);
 };
 
 #endif
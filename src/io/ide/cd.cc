@@ -373,6 +373,26 @@ bool CDROMDevice::isDVD(void)
 	return is_dvd;
 }
 
+void CDROMDevice::saveState(Stream &st)
+{
+	IDEDevice::saveState(st);
+	st.writex(&mLocked, sizeof mLocked);
+	st.writex(&mReady, sizeof mReady);
+	st.writex(&curProfile, sizeof curProfile);
+	st.writex(&is_dvd, sizeof is_dvd);
+}
+
+void CDROMDevice::loadState(Stream &st)
+{
+	IDEDevice::loadState(st);
+	st.readx(&mLocked, sizeof mLocked);
+	st.readx(&mReady, sizeof mReady);
+	st.readx(&curProfile, sizeof curProfile);
+	bool dvd;
+	st.readx(&dvd, sizeof dvd);
+	activateDVD(dvd);
+}
+
 // ----------------------------- File based CDROM device ------------------------------------
 
 /*
@@ -389,6 +409,11 @@ CDROMDeviceFile::~CDROMDeviceFile()
 	if (mFile) sys_fclose(mFile);
 }
 
+ObjectID CDROMDeviceFile::getObjectID() const
+{
+	return ATOM_IDE_CDROM_FILE;
+}
+
 uint32 CDROMDeviceFile::getCapacity()
 {
 	return mCapacity;
@@ -446,6 +471,19 @@ uint CDROMDeviceFile::promRead(byte *buf, uint size)
 	return sys_fread(mFile, buf, size);
 }
 
+void CDROMDeviceFile::saveState(Stream &st)
+{
+	CDROMDevice::saveState(st);
+	st.writex(&curLBA, sizeof curLBA);
+}
+
+void CDROMDeviceFile::loadState(Stream &st)
+{
+	CDROMDevice::loadState(st);
+	st.readx(&curLBA, sizeof curLBA);
+	if (mFile) seek(curLBA);
+}
+
 bool CDROMDeviceFile::changeDataSource(const char *file)
 {
 	if (mFile) sys_fclose(mFile);
@@ -643,6 +681,11 @@ CDROMDeviceSCSI::~CDROMDeviceSCSI()
 	delete[]data_buffer;
 }
 
+ObjectID CDROMDeviceSCSI::getObjectID() const
+{
+	return ATOM_IDE_CDROM_SCSI;
+}
+
 /// @author Alexander Stockinger
 /// @date 07/17/2004
 /// @return true if drive is ready, else false
@@ -86,6 +86,9 @@ public:
 	virtual void	activateDVD(bool onoff);
 	virtual bool	isDVD(void);
 
+	virtual void	saveState(Stream &st);
+	virtual void	loadState(Stream &st);
+
 protected:
 		void	addFeature(int feature);
 		void	addProfile(int profile);
@@ -103,6 +106,8 @@ public:
 			CDROMDeviceFile(const char *name);
 	virtual		~CDROMDeviceFile();
 
+	virtual	ObjectID	getObjectID() const;
+
 	virtual	uint32	getCapacity();
 		bool	changeDataSource(const char *file);
 	virtual	bool	seek(uint64 blockno);
@@ -114,6 +119,9 @@ public:
 
 	virtual	bool	promSeek(uint64 pos);
 	virtual	uint	promRead(byte *buf, uint size);
+
+	virtual void	saveState(Stream &st);
+	virtual void	loadState(Stream &st);
 };
 
 /// Generic interface for SCSI based implementations of a CD drive
@@ -213,6 +221,9 @@ protected:
 
 	/// Destructor
 	virtual ~CDROMDeviceSCSI();
+public:
+	/// Tags the snapshot state
+	virtual	ObjectID	getObjectID() const;
 };
 
 #endif
@@ -27,6 +27,7 @@
 #include <cstring>
 
 #include "tools/data.h"
+#include "tools/except.h"
 #include "tools/snprintf.h"
 #include "system/arch/sysendian.h"
 #include "cpu/cpu.h"
@@ -371,6 +372,52 @@ public:
 		mConfig[0x3e] = 0x02;	// min grand
 		mConfig[0x3f] = 0x04;	// max latency
 	}
+
+	virtual void saveState(Stream &st)
+	{
+		PCI_HWTD_Device::saveState(st);
+		st.writex(&mpIDEState->drive, sizeof mpIDEState->drive);
+		st.writex(&mpIDEState->drive_head, sizeof mpIDEState->drive_head);
+		st.writex(&mpIDEState->one_time_shit, sizeof mpIDEState->one_time_shit);
+		st.writex(mpIDEState->state, sizeof mpIDEState->state);
+		for (int i=0; i < IDE_DISK_MAX; i++) {
+			IDEConfig &cfg = mpIDEState->config[i];
+			st.writex(&cfg, sizeof cfg);
+			if (cfg.installed) {
+				uint32 id = cfg.device->getObjectID();
+				st.writex(&id, sizeof id);
+				cfg.device->saveState(st);
+			}
+		}
+	}
+
+	virtual void loadState(Stream &st)
+	{
+		PCI_HWTD_Device::loadState(st);
+		st.readx(&mpIDEState->drive, sizeof mpIDEState->drive);
+		st.readx(&mpIDEState->drive_head, sizeof mpIDEState->drive_head);
+		st.readx(&mpIDEState->one_time_shit, sizeof mpIDEState->one_time_shit);
+		st.readx(mpIDEState->state, sizeof mpIDEState->state);
+		for (int i=0; i < IDE_DISK_MAX; i++) {
+			IDEConfig &cfg = mpIDEState->config[i];
+			IDEConfig saved;
+			st.readx(&saved, sizeof saved);
+			if (saved.installed != cfg.installed || saved.protocol != cfg.protocol) {
+				throw MsgfException("snapshot was taken with different ide devices (channel %d, disk %d)", mChannel, i);
+			}
+			// keep our device, the pointer in the snapshot is stale
+			saved.device = cfg.device;
+			cfg = saved;
+			if (cfg.installed) {
+				uint32 id;
+				st.readx(&id, sizeof id);
+				if (id != (uint32)cfg.device->getObjectID()) {
+					throw MsgfException("snapshot was taken with a different kind of ide device (channel %d, disk %d)", mChannel, i);
+				}
+				cfg.device->loadState(st);
+			}
+		}
+	}
 	
 /*******************************************************************************
  *	IDE - Controller Core
@@ -1420,10 +1467,14 @@ void receive_atapi_packet()
 				IDEDevice *dev = mpIDEState->config[mpIDEState->drive].device;
 				dev->acquire();
 				dev->setMode(ATA_DEVICE_MODE_PLAIN, 512);
-				dev->seek(pos);
-				dev->writeBlock(mpIDEState->state[mpIDEState->drive].sector);
+				bool ok = dev->seek(pos) && !dev->writeBlock(mpIDEState->state[mpIDEState->drive].sector);
 				dev->release();
-				if (mpIDEState->state[mpIDEState->drive].sector_count) {
+				if (!ok) {
+					IO_IDE_WARN("write failed!\n");
+					mpIDEState->state[mpIDEState->drive].mode = IDE_TRANSFER_MODE_NONE;
+					mpIDEState->state[mpIDEState->drive].status = IDE_STATUS_RDY | IDE_STATUS_ERR;
+					mpIDEState->state[mpIDEState->drive].error = 0x4; // abort command
+				} else if (mpIDEState->state[mpIDEState->drive].sector_count) {
 					mpIDEState->state[mpIDEState->drive].status = IDE_STATUS_RDY | IDE_STATUS_DRQ | IDE_STATUS_SKC;
 				} else {
 					mpIDEState->state[mpIDEState->drive].mode = IDE_TRANSFER_MODE_NONE;
@@ -1446,11 +1497,17 @@ void receive_atapi_packet()
 					IDEDevice *dev = mpIDEState->config[mpIDEState->drive].device;
 					dev->acquire();
 					dev->setMode(ATA_DEVICE_MODE_PLAIN, 512);
-					dev->seek(pos);
-					dev->readBlock(mpIDEState->state[mpIDEState->drive].sector);
+					bool ok = dev->seek(pos) && !dev->readBlock(mpIDEState->state[mpIDEState->drive].sector);
 					dev->release();
 					mpIDEState->state[mpIDEState->drive].sectorpos = 0;
-					mpIDEState->state[mpIDEState->drive].error = 0;
+					if (ok) {
+						mpIDEState->state[mpIDEState->drive].error = 0;
+					} else {
+						IO_IDE_WARN("read failed!\n");
+						mpIDEState->state[mpIDEState->drive].mode = IDE_TRANSFER_MODE_NONE;
+						mpIDEState->state[mpIDEState->drive].status = IDE_STATUS_RDY | IDE_STATUS_ERR;
+						mpIDEState->state[mpIDEState->drive].error = 0x40; // uncorrectable data
+					}
 					raiseInterrupt(0);
 					return;
 				}
@@ -2225,8 +2282,10 @@ IDEConfig *ide_get_config(int disk)
 #define IDE_KEY_IDEX_Y_INSTALLED	"pci_ide%d_%s_installed"
 #define IDE_KEY_IDEX_Y_TYPE		"pci_ide%d_%s_type"
 #define IDE_KEY_IDEX_Y_IMG		"pci_ide%d_%s_image"
+#define IDE_KEY_IDEX_Y_OVERLAY		"pci_ide%d_%s_overlay"
 
 #include "configparser.h"
+#include "snapshot.h"
 #include "tools/except.h"
 void ide_init()
 {
@@ -2240,10 +2299,12 @@ void ide_init()
 			char instkey[255];
 			char typekey[255];
 			char imgkey[255];
+			char overlaykey[255];
 
 			sprintf(instkey, IDE_KEY_IDEX_Y_INSTALLED, CHANNEL, masterslave[DISK]);
 			sprintf(typekey, IDE_KEY_IDEX_Y_TYPE, CHANNEL, masterslave[DISK]);
 			sprintf(imgkey, IDE_KEY_IDEX_Y_IMG, CHANNEL, masterslave[DISK]);
+			sprintf(overlaykey, IDE_KEY_IDEX_Y_OVERLAY, CHANNEL, masterslave[DISK]);
 
 			if (gConfig->getConfigInt(instkey)) {
 				if (!gConfig->haveKey(imgkey)) throw MsgfException("no disk image specified for ide%d %s.", 0, masterslave[DISK]);
@@ -2273,9 +2334,28 @@ void ide_init()
 				}
 				String name;
 				name.assignFormat("IDE%d%c", CHANNEL, DISK? 'S': 'M');
+				if (snapshot_clone_index() >= 0 && (ext == "sparsehd" || (ext == "img" && !gConfig->haveKey(overlaykey)))) {
+					IO_IDE_ERR("cloned guests need an 'hd' image with '%s'\n", overlaykey);
+				}
 				if (ext == "img") {
 					gIDEState[CHANNEL].config[DISK].protocol = IDE_ATA;
-					gIDEState[CHANNEL].config[DISK].device = new ATADeviceFile(name.contentChar(), img.contentChar());
+					if (gConfig->haveKey(overlaykey)) {
+						/*
+						 *	Clones never reuse an old overlay, they
+						 *	start with a copy of the configured one.
+						 *	When a snapshot is loaded its frozen copy
+						 *	replaces the overlay anyway.
+						 */
+						String overlay, cloneoverlay;
+						gConfig->getConfigString(overlaykey, overlay);
+						snapshot_clone_filename(cloneoverlay, overlay);
+						bool clone = snapshot_clone_index() >= 0;
+						bool copy = clone && !gConfig->getConfigInt("snapshot_load");
+						gIDEState[CHANNEL].config[DISK].device = new ATADeviceOverlayFile(name.contentChar(), img.contentChar(),
+							cloneoverlay.contentChar(), clone, copy ? overlay.contentChar() : NULL);
+					} else {
+						gIDEState[CHANNEL].config[DISK].device = new ATADeviceFile(name.contentChar(), img.contentChar());
+					}
 					const char *error;
 					if ((error = gIDEState[CHANNEL].config[DISK].device->getError())) IO_IDE_ERR("%s\n", error);
 					gIDEState[CHANNEL].config[DISK].hd.cyl = ((ATADevice*)gIDEState[CHANNEL].config[DISK].device)->mCyl;
@@ -2363,14 +2443,17 @@ void ide_init_config()
 			char instkey[255];
 			char typekey[255];
 			char imgkey[255];
+			char overlaykey[255];
 
 			sprintf(instkey, IDE_KEY_IDEX_Y_INSTALLED, CHANNEL, masterslave[DISK]);
 			sprintf(typekey, IDE_KEY_IDEX_Y_TYPE, CHANNEL, masterslave[DISK]);
 			sprintf(imgkey, IDE_KEY_IDEX_Y_IMG, CHANNEL, masterslave[DISK]);
+			sprintf(overlaykey, IDE_KEY_IDEX_Y_OVERLAY, CHANNEL, masterslave[DISK]);
 
 			gConfig->acceptConfigEntryIntDef(instkey, 0);
 			gConfig->acceptConfigEntryString(typekey, false);
 			gConfig->acceptConfigEntryString(imgkey, false);
+			gConfig->acceptConfigEntryString(overlaykey, false);
 		}
 	}
 }
@@ -115,6 +115,26 @@ bool IDEDevice::release()
 	}
 }
 
+/*
+ *	Saves the deblocking state, derived devices
+ *	add their position within the image.
+ */
+void IDEDevice::saveState(Stream &st)
+{
+	st.writex(&mMode, sizeof mMode);
+	st.writex(&mSectorFirst, sizeof mSectorFirst);
+	st.writex(&mSectorSize, sizeof mSectorSize);
+	st.writex(mSector, sizeof mSector);
+}
+
+void IDEDevice::loadState(Stream &st)
+{
+	st.readx(&mMode, sizeof mMode);
+	st.readx(&mSectorFirst, sizeof mSectorFirst);
+	st.readx(&mSectorSize, sizeof mSectorSize);
+	st.readx(mSector, sizeof mSector);
+}
+
 void IDEDevice::setMode(int aMode, int aSectorSize)
 {
 	mMode = aMode;
@@ -144,12 +164,12 @@ int IDEDevice::read(byte *buf, int size)
 	}
 	if (size > 0) {
 		while (size >= mSectorSize) {
-			readBlock(buf);
+			if (readBlock(buf)) return buf-oldbuf;
 			size -= mSectorSize;
 			buf += mSectorSize;
 		}
 		if (size > 0) {
-			readBlock(mSector);
+			if (readBlock(mSector)) return buf-oldbuf;
 			memcpy(buf, mSector, size);
 			mSectorFirst = size;
 			buf += size;
@@ -168,12 +188,12 @@ int IDEDevice::write(byte *buf, int size)
 		buf += copy;
 		mSectorFirst += copy;
 		if (mSectorFirst >= mSectorSize) {
-			writeBlock(mSector);
+			if (writeBlock(mSector)) return buf-oldbuf-copy;
 		}
 	}
 	if (size > 0) {
 		while (size >= mSectorSize) {
-			writeBlock(buf);
+			if (writeBlock(buf)) return buf-oldbuf;
 			size -= mSectorSize;
 			buf += mSectorSize;
 		}
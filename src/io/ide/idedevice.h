@@ -28,6 +28,13 @@
 // The maximum size of a CD sector
 #define IDE_MAX_BLOCK_SIZE 2352
 
+// ObjectIDs of the devices, snapshots use them to tag the device state
+#define ATOM_IDE_ATA_FILE		MAGIC32("IDE\x01")
+#define ATOM_IDE_ATA_OVERLAY_FILE	MAGIC32("IDE\x02")
+#define ATOM_IDE_SPARSE_FILE		MAGIC32("IDE\x03")
+#define ATOM_IDE_CDROM_FILE		MAGIC32("IDE\x04")
+#define ATOM_IDE_CDROM_SCSI		MAGIC32("IDE\x05")
+
 class IDEDevice: public Object {
 protected:
 	int	mMode; // this is implementation specific
@@ -57,7 +64,7 @@ public:
 	/* these are deblocking read/writes */
 	virtual int	read(byte *buf, int size);
 	virtual int	write(byte *buf, int size);
-	/* these will always fetch a whole sector */
+	/* these will always fetch a whole sector, non-zero on errors */
 	virtual int	readBlock(byte *buf) = 0;
 	virtual int	writeBlock(byte *buf) = 0;
 	/* only for prom */
@@ -66,6 +73,9 @@ public:
 	virtual uint	promRead(byte *buf, uint size) = 0;
 	
 	virtual	int	toString(char *buf, int buflen) const;
+	/* snapshots, the ObjectID tells which layout the state has */
+	virtual void	saveState(Stream &st);
+	virtual void	loadState(Stream &st);
 };
 
 #endif
@@ -341,6 +341,11 @@ SparseDeviceFile::~SparseDeviceFile()
 	}
 }
 
+ObjectID SparseDeviceFile::getObjectID() const
+{
+	return ATOM_IDE_SPARSE_FILE;
+}
+
 
 bool SparseDeviceFile::seek(uint64 blockno)
 {
@@ -104,6 +104,8 @@ public:
 	SparseDeviceFile(const char *name, const char *filename);
 	virtual ~SparseDeviceFile();
 
+	virtual	ObjectID	getObjectID() const;
+
 	virtual bool	seek(uint64 blockno);
 	virtual void	flush();
 	virtual int		readBlock(byte *buf);
@@ -31,6 +31,74 @@
 #include "io/cuda/cuda.h"
 #include "io/nvram/nvram.h"
 
+IO_MemHandler *gIOMemMap[IO_MEM_MAP_CHUNKS];
+
+// marks a page which is only partially covered by a device
+#define IO_MEM_MAP_MIXED	0xffffffff
+
+static void io_mem_map_clear()
+{
+	for (int i=0; i < IO_MEM_MAP_CHUNKS; i++) {
+		if (gIOMemMap[i]) memset(gIOMemMap[i], 0, IO_MEM_MAP_PAGES * sizeof (IO_MemHandler));
+	}
+}
+
+/*
+ *	Ranges have to be entered in the order the range checks in
+ *	io.h are done, a page which already has an owner is left alone.
+ */
+void io_mem_map_range(uint32 start, uint32 end, IO_MemReadFunc read, IO_MemWriteFunc write, PCI_Device *dev, uint r)
+{
+	if (end <= start) return;
+	for (uint32 pn = start >> 12; pn <= (end-1) >> 12; pn++) {
+		IO_MemHandler *&chunk = gIOMemMap[pn >> 12];
+		if (!chunk) {
+			chunk = (IO_MemHandler*)calloc(IO_MEM_MAP_PAGES, sizeof (IO_MemHandler));
+		}
+		IO_MemHandler &h = chunk[pn & (IO_MEM_MAP_PAGES-1)];
+		if (h.read || h.dev || h.r == IO_MEM_MAP_MIXED) continue;
+		uint32 page = pn << 12;
+		if (page >= start && page + 0xfff <= end - 1) {
+			h.read = read;
+			h.write = write;
+			h.dev = dev;
+			h.r = r;
+		} else {
+			h.r = IO_MEM_MAP_MIXED;
+		}
+	}
+}
+
+static void io_isa_read(uint32 addr, uint32 &data, int size)
+{
+	isa_read(addr, data, size);
+}
+
+static void io_isa_write(uint32 addr, uint32 data, int size)
+{
+	isa_write(addr, data, size);
+}
+
+void io_mem_map_rebuild()
+{
+	io_mem_map_clear();
+	io_mem_map_range(IO_GCARD_FRAMEBUFFER_PA_START, IO_GCARD_FRAMEBUFFER_PA_END, gcard_read, gcard_write);
+	io_mem_map_range(IO_PCI_PA_START, IO_PCI_PA_END, pci_read, pci_write);
+	io_mem_map_range(IO_PIC_PA_START, IO_PIC_PA_END, pic_read, pic_write);
+	io_mem_map_range(IO_CUDA_PA_START, IO_CUDA_PA_END, cuda_read, cuda_write);
+	io_mem_map_range(IO_NVRAM_PA_START, IO_NVRAM_PA_END, nvram_read, nvram_write);
+	pci_map_devices();
+	io_mem_map_range(IO_ISA_PA_START, IO_ISA_PA_END, io_isa_read, io_isa_write);
+}
+
+static void io_mem_map_done()
+{
+	for (int i=0; i < IO_MEM_MAP_CHUNKS; i++) {
+		free(gIOMemMap[i]);
+		gIOMemMap[i] = NULL;
+	}
+}
+
 
 /*
  *	The xx_glue functions are needed for the jitc
@@ -93,6 +161,7 @@ void io_init()
 	cuda_init();
 	pic_init();
 	nvram_init();
+	io_mem_map_rebuild();
 }
 
 void io_done()
@@ -101,6 +170,7 @@ void io_done()
 	cuda_done();
 	pic_done();
 	nvram_done();
+	io_mem_map_done();
 }
 
 void io_init_config()
@@ -110,3 +180,20 @@ void io_init_config()
 	pic_init_config();
 	nvram_init_config();
 }
+
+void io_save_state(Stream &st)
+{
+	pci_save_state(st);
+	pic_save_state(st);
+	cuda_save_state(st);
+	nvram_save_state(st);
+}
+
+void io_load_state(Stream &st)
+{
+	pci_load_state(st);
+	pic_load_state(st);
+	cuda_load_state(st);
+	nvram_load_state(st);
+	io_mem_map_rebuild();
+}
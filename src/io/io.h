@@ -39,8 +39,52 @@
 #define IO_MEM_ACCESS_EXC	1
 #define IO_MEM_ACCESS_FATAL	2
 
+/*
+ *	Page granular dispatch table, two levels of 16 MB chunks
+ *	with 4096 pages each. A page is mapped only if a single
+ *	device is responsible for all of it, everything else (pages
+ *	shared by several devices, unassigned addresses) takes the
+ *	slow path through the range checks below.
+ *	Has to be rebuilt by io_mem_map_rebuild() whenever the
+ *	layout changes (e.g. BARs are assigned).
+ */
+typedef void (*IO_MemReadFunc)(uint32 addr, uint32 &data, int size);
+typedef void (*IO_MemWriteFunc)(uint32 addr, uint32 data, int size);
+
+struct IO_MemHandler {
+	IO_MemReadFunc	read;
+	IO_MemWriteFunc	write;
+	PCI_Device	*dev;	// if set, dispatched to BAR r of dev
+	uint		r;
+};
+
+#define IO_MEM_MAP_CHUNKS	256
+#define IO_MEM_MAP_PAGES	4096
+
+extern IO_MemHandler *gIOMemMap[IO_MEM_MAP_CHUNKS];
+
+static inline IO_MemHandler *io_mem_lookup(uint32 addr)
+{
+	IO_MemHandler *chunk = gIOMemMap[addr >> 24];
+	if (!chunk) return NULL;
+	IO_MemHandler *h = &chunk[(addr >> 12) & (IO_MEM_MAP_PAGES-1)];
+	return (h->read || h->dev) ? h : NULL;
+}
+
+void io_mem_map_range(uint32 start, uint32 end, IO_MemReadFunc read, IO_MemWriteFunc write, PCI_Device *dev = NULL, uint r = 0);
+void io_mem_map_rebuild();
+
 static inline int io_mem_write(uint32 addr, uint32 data, int size)
 {
+	IO_MemHandler *h = io_mem_lookup(addr);
+	if (h) {
+		if (h->dev) {
+			pci_write_device_bar(h->dev, h->r, addr, data, size);
+		} else {
+			h->write(addr, data, size);
+		}
+		return IO_MEM_ACCESS_OK;
+	}
 	if (addr >= IO_GCARD_FRAMEBUFFER_PA_START && addr < IO_GCARD_FRAMEBUFFER_PA_END) {
 		gcard_write(addr, data, size);
 		return IO_MEM_ACCESS_OK;
@@ -88,6 +132,15 @@ static inline int io_mem_write(uint32 addr, uint32 data, int size)
 
 static inline int io_mem_read(uint32 addr, uint32 &data, int size)
 {
+	IO_MemHandler *h = io_mem_lookup(addr);
+	if (h) {
+		if (h->dev) {
+			pci_read_device_bar(h->dev, h->r, addr, data, size);
+		} else {
+			h->read(addr, data, size);
+		}
+		return IO_MEM_ACCESS_OK;
+	}
 	if (addr >= IO_GCARD_FRAMEBUFFER_PA_START && addr < IO_GCARD_FRAMEBUFFER_PA_END) {
 		gcard_read(addr, data, size);
 		return IO_MEM_ACCESS_OK;
@@ -202,4 +255,7 @@ void io_init();
 void io_done();
 void io_init_config();
 
+void io_save_state(Stream &st);
+void io_load_state(Stream &st);
+
 #endif
@@ -24,6 +24,8 @@
 #include <cstring>
 
 #include "debug/tracers.h"
+#include "tools/except.h"
+#include "tools/stream.h"
 #include "nvram.h"
 
 #define NVRAM_IMAGE_SIZE 0x2000
@@ -87,11 +89,13 @@ static uint8 calcChksum(byte *buf)
 
 #define NRAM_KEY_FILE	"nvram_file"
 #include "configparser.h"
+#include "snapshot.h"
 
 void nvram_init()
 {
-	String filename;
-	gConfig->getConfigString(NRAM_KEY_FILE, filename);
+	String name, filename;
+	gConfig->getConfigString(NRAM_KEY_FILE, name);
+	snapshot_clone_filename(filename, name);
 	
 	gNVRAM.f = fopen(filename.contentChar(), "rb+");
 	if (!gNVRAM.f) {
@@ -123,3 +127,20 @@ void nvram_done()
 	fclose(gNVRAM.f);
 }
 
+void nvram_save_state(Stream &st)
+{
+	byte buf[NVRAM_IMAGE_SIZE];
+	memset(buf, 0, sizeof buf);
+	fseek(gNVRAM.f, 0, SEEK_SET);
+	fread(buf, 1, sizeof buf, gNVRAM.f);
+	st.writex(buf, sizeof buf);
+}
+
+void nvram_load_state(Stream &st)
+{
+	byte buf[NVRAM_IMAGE_SIZE];
+	st.readx(buf, sizeof buf);
+	fseek(gNVRAM.f, 0, SEEK_SET);
+	if (fwrite(buf, sizeof buf, 1, gNVRAM.f) != 1) throw MsgException("can't write nvram file");
+	fflush(gNVRAM.f);
+}
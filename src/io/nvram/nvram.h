@@ -33,5 +33,9 @@ void nvram_init();
 void nvram_init_config();
 void nvram_done();
 
+class Stream;
+void nvram_save_state(Stream &st);
+void nvram_load_state(Stream &st);
+
 #endif
 
@@ -24,11 +24,13 @@
 #include <cstring>
 
 #include "tools/data.h"
+#include "tools/except.h"
 #include "system/arch/sysendian.h"
 #include "cpu/cpu.h"
 #include "cpu/debug.h"
 #include "cpu/mem.h"
 #include "debug/tracers.h"
+#include "io/io.h"
 #include "pci.h"
 
 #define PCI_ADDRESS_ECD(v) ((v) & 0x80000000)
@@ -43,6 +45,18 @@ uint32 gPCI_Data;
 static uint32 gPCI_Data_LE;
 Container *gPCI_Devices;
 
+/*
+ *	Port table for isa_read/write, one entry per 4 ports
+ *	(the smallest io BAR). Ports above PCI_PORT_MAP_SIZE or
+ *	shared entries fall back to asking every device.
+ */
+#define PCI_PORT_MAP_SIZE	0x10000
+#define PCI_PORT_MAP_SHIFT	2
+#define PCI_PORT_MAP_MIXED	((PCI_Device*)1)
+
+static PCI_Device *gPCI_PortMap[PCI_PORT_MAP_SIZE >> PCI_PORT_MAP_SHIFT];
+static uint8 gPCI_PortMapReg[PCI_PORT_MAP_SIZE >> PCI_PORT_MAP_SHIFT];
+
 class PCI_Bridge: public PCI_Device {
 public:
 	PCI_Bridge(const char *aName, uint8 aBus, uint8 aUnit)
@@ -100,6 +114,7 @@ void PCI_Device::assignMemAddress(uint r, uint32 aAddress)
 	mConfig[0x11+4*r] = aAddress>>8;
 	mConfig[0x12+4*r] = aAddress>>16;
 	mConfig[0x13+4*r] = aAddress>>24;
+	io_mem_map_rebuild();
 }
 
 void PCI_Device::assignIOPort(uint r, uint32 aPort)
@@ -111,6 +126,7 @@ void PCI_Device::assignIOPort(uint r, uint32 aPort)
 	mConfig[0x11+4*r] = aPort>>8;
 	mConfig[0x12+4*r] = aPort>>16;
 	mConfig[0x13+4*r] = aPort>>24;
+	io_mem_map_rebuild();
 }
 
 bool PCI_Device::readMem(uint32 aAddress, uint32 &data, uint size)
@@ -237,6 +253,20 @@ void PCI_Device::setStatus(uint16 status)
 {
 }
 
+void PCI_Device::saveState(Stream &st)
+{
+	st.writex(mConfig, sizeof mConfig);
+	st.writex(mAddress, sizeof mAddress);
+	st.writex(mPort, sizeof mPort);
+}
+
+void PCI_Device::loadState(Stream &st)
+{
+	st.readx(mConfig, sizeof mConfig);
+	st.readx(mAddress, sizeof mAddress);
+	st.readx(mPort, sizeof mPort);
+}
+
 PCI_BridgeP2P::PCI_BridgeP2P()
 	:PCI_Bridge("pci-bridge-p2p", 0x00, 0x0d)
 {
@@ -485,6 +515,16 @@ bool isa_read(uint32 addr, uint32 &data, int size)
 {
 	// Translate address into port
 	addr -= IO_ISA_PA_START;
+	if (addr < PCI_PORT_MAP_SIZE) {
+		PCI_Device *pd = gPCI_PortMap[addr >> PCI_PORT_MAP_SHIFT];
+		if (pd && pd != PCI_PORT_MAP_MIXED) {
+			uint r = gPCI_PortMapReg[addr >> PCI_PORT_MAP_SHIFT];
+			if (!pd->readDeviceIO(r, addr-pd->mPort[r], data, size)) {
+				IO_PCI_ERR("%s: reg: %d: %08x read(%d) unimpl.\n", pd->mName, r, addr-pd->mPort[r], size);
+			}
+			return true;
+		}
+	}
 	ObjHandle oh = gPCI_Devices->findFirst();
 	while (oh != InvObjHandle) {
 		PCI_Device *pd = (PCI_Device*)gPCI_Devices->get(oh);
@@ -503,6 +543,16 @@ bool isa_write(uint32 addr, uint32 data, int size)
 {
 	// Translate address into port
 	addr -= IO_ISA_PA_START;
+	if (addr < PCI_PORT_MAP_SIZE) {
+		PCI_Device *pd = gPCI_PortMap[addr >> PCI_PORT_MAP_SHIFT];
+		if (pd && pd != PCI_PORT_MAP_MIXED) {
+			uint r = gPCI_PortMapReg[addr >> PCI_PORT_MAP_SHIFT];
+			if (!pd->writeDeviceIO(r, addr-pd->mPort[r], data, size)) {
+				IO_PCI_ERR("%s: reg: %d: %08x write(%d) unimpl.\n", pd->mName, r, addr-pd->mPort[r], size);
+			}
+			return true;
+		}
+	}
 	ObjHandle oh = gPCI_Devices->findFirst();
 	while (oh != InvObjHandle) {
 		PCI_Device *pd = (PCI_Device*)gPCI_Devices->get(oh);
@@ -546,6 +596,61 @@ bool pci_read_device(uint32 addr, uint32 &data, int size)
 	return false;
 }
 
+void pci_write_device_bar(PCI_Device *pd, uint r, uint32 addr, uint32 data, int size)
+{
+	IO_PCI_TRACE("write DEVICE (%d) @%08x %08x (from %08x, lr: %08x)\n", size, addr, data, gCPU.pc, gCPU.lr);
+	if (!pd->writeDeviceMem(r, addr-pd->mAddress[r], data, size)) {
+		IO_PCI_ERR("%s: reg: %d: %08x write unimpl.\n", pd->mName, r, addr-pd->mAddress[r]);
+	}
+}
+
+void pci_read_device_bar(PCI_Device *pd, uint r, uint32 addr, uint32 &data, int size)
+{
+	IO_PCI_TRACE("read DEVICE (%d) @%08x (from %08x, lr: %08x)\n", size, addr, gCPU.pc, gCPU.lr);
+	if (!pd->readDeviceMem(r, addr-pd->mAddress[r], data, size)) {
+		IO_PCI_ERR("%s: reg: %d: %08x read unimpl.\n", pd->mName, r, addr-pd->mAddress[r]);
+	}
+	IO_PCI_TRACE("->%08x\n", data);
+}
+
+static void pci_map_ports(PCI_Device *pd, uint r)
+{
+	uint32 start = pd->mPort[r];
+	uint32 end = start + pd->mIORegSize[r];
+	if (end > PCI_PORT_MAP_SIZE) end = PCI_PORT_MAP_SIZE;
+	if (end <= start) return;
+	uint32 gran = 1 << PCI_PORT_MAP_SHIFT;
+	for (uint32 i = start >> PCI_PORT_MAP_SHIFT; i <= (end-1) >> PCI_PORT_MAP_SHIFT; i++) {
+		if (gPCI_PortMap[i]) continue;
+		uint32 port = i << PCI_PORT_MAP_SHIFT;
+		if (port >= start && port + gran <= end) {
+			gPCI_PortMap[i] = pd;
+			gPCI_PortMapReg[i] = r;
+		} else {
+			gPCI_PortMap[i] = PCI_PORT_MAP_MIXED;
+		}
+	}
+}
+
+void pci_map_devices()
+{
+	memset(gPCI_PortMap, 0, sizeof gPCI_PortMap);
+	if (!gPCI_Devices) return;
+	// same order as pci_read_device()/isa_read()
+	foreach(PCI_Device, pd, *gPCI_Devices, {
+		for (uint i=0; i < pd->mIORegsCount; i++) {
+			if (!pd->mIORegSize[i]) continue;
+			if ((pd->mIORegType[i] & 1) == PCI_ADDRESS_SPACE_MEM) {
+				uint32 start = MAX(pd->mAddress[i], IO_PCI_DEVICE_PA_START);
+				uint32 end = MIN(pd->mAddress[i] + pd->mIORegSize[i], IO_PCI_DEVICE_PA_END);
+				io_mem_map_range(start, end, NULL, NULL, pd, i);
+			} else if (pd->mIORegType[i] == PCI_ADDRESS_SPACE_IO) {
+				pci_map_ports(pd, i);
+			}
+		}
+	});
+}
+
 // PCI devices
 #include "io/graphic/gcard.h"
 #include "io/ide/ide.h"
@@ -583,6 +688,45 @@ void pci_done()
 	delete gPCI_Devices;
 }
 
+/*
+ *	The devices are saved in bus/unit order, the same
+ *	devices have to be configured when the state is loaded.
+ */
+void pci_save_state(Stream &st)
+{
+	st.writex(&gPCI_Address, sizeof gPCI_Address);
+	st.writex(&gPCI_Data, sizeof gPCI_Data);
+	st.writex(&gPCI_Data_LE, sizeof gPCI_Data_LE);
+	uint32 count = gPCI_Devices->count();
+	st.writex(&count, sizeof count);
+	foreach(PCI_Device, d, *gPCI_Devices, {
+		st.writex(&d->mBus, sizeof d->mBus);
+		st.writex(&d->mUnit, sizeof d->mUnit);
+		d->saveState(st);
+	});
+}
+
+void pci_load_state(Stream &st)
+{
+	st.readx(&gPCI_Address, sizeof gPCI_Address);
+	st.readx(&gPCI_Data, sizeof gPCI_Data);
+	st.readx(&gPCI_Data_LE, sizeof gPCI_Data_LE);
+	uint32 count;
+	st.readx(&count, sizeof count);
+	if (count != gPCI_Devices->count()) {
+		throw MsgException("snapshot was taken with different pci devices");
+	}
+	for (uint32 i=0; i < count; i++) {
+		uint8 bus, unit;
+		st.readx(&bus, sizeof bus);
+		st.readx(&unit, sizeof unit);
+		PCI_Device empty("", bus, unit);
+		PCI_Device *p = (PCI_Device*)gPCI_Devices->get(gPCI_Devices->find(&empty));
+		if (!p) throw MsgfException("snapshot contains unknown pci device %02x:%02x", bus, unit);
+		p->loadState(st);
+	}
+}
+
 void pci_init_config()
 {
 	gcard_init_config();
@@ -61,6 +61,7 @@
  */
 
 #include "tools/data.h"
+#include "tools/stream.h"
 #include "system/types.h"
 #include "system/display.h"
 
@@ -112,6 +113,13 @@ public:
 	virtual bool	writeDeviceIO(uint r, uint32 port, uint32 data, uint size);
 	virtual	void	setCommand(uint16 command);
 	virtual void	setStatus(uint16 status);
+
+	/*
+	 *	Snapshot support, derived devices have to
+	 *	save/load their own state after calling these.
+	 */
+	virtual void	saveState(Stream &st);
+	virtual void	loadState(Stream &st);
 };
 
 void pci_write(uint32 addr, uint32 data, int size);
@@ -120,10 +128,22 @@ bool isa_write(uint32 addr, uint32 data, int size);
 bool isa_read(uint32 addr, uint32 &data, int size);
 bool pci_write_device(uint32 addr, uint32 data, int size);
 bool pci_read_device(uint32 addr, uint32 &data, int size);
+void pci_write_device_bar(PCI_Device *pd, uint r, uint32 addr, uint32 data, int size);
+void pci_read_device_bar(PCI_Device *pd, uint r, uint32 addr, uint32 &data, int size);
+
+/*
+ *	Enters the memory BARs of all devices into the io dispatch
+ *	table and rebuilds the port table used by isa_read/write.
+ *	Called by io_mem_map_rebuild().
+ */
+void pci_map_devices();
 
 void pci_init();
 void pci_done();
 void pci_init_config();
 
+void pci_save_state(Stream &st);
+void pci_load_state(Stream &st);
+
 #endif
 
@@ -24,6 +24,7 @@
 #include <cstring>
 
 #include "tools/snprintf.h"
+#include "tools/stream.h"
 #include "system/arch/sysendian.h"
 #include "cpu/cpu.h"
 #include "io/cuda/cuda.h"
@@ -42,9 +43,9 @@ sys_mutex PIC_mutex;
 void pic_renew_interrupts()
 {
 	if (((PIC_pending_low | PIC_pending_level) & PIC_enable_low) || (PIC_pending_high & PIC_enable_high)) {
-		ppc_cpu_raise_ext_exception();	
+		ppc_cpu_raise_ext_exception(IO_PIC_CPU);	
 	} else {
-		ppc_cpu_cancel_ext_exception();
+		ppc_cpu_cancel_ext_exception(IO_PIC_CPU);
 	}
 }
 
@@ -175,7 +176,7 @@ void pic_raise_interrupt(int intr)
 	if ((mask & ibit) && 
 	    (level || !(pending & ibit))) {
 		IO_PIC_TRACE("*signal int: %d\n", intr);
-		ppc_cpu_raise_ext_exception();
+		ppc_cpu_raise_ext_exception(IO_PIC_CPU);
 	} else {
 		IO_PIC_TRACE("/signal int: %d\n", intr);
 	}
@@ -193,9 +194,9 @@ void pic_cancel_interrupt(int intr)
 		PIC_pending_level &= ~(1<<intr);
 	}
 	if (((PIC_pending_low | PIC_pending_level) & PIC_enable_low) || (PIC_pending_high & PIC_enable_high)) {
-		ppc_cpu_raise_ext_exception();	
+		ppc_cpu_raise_ext_exception(IO_PIC_CPU);	
 	} else {
-		ppc_cpu_cancel_ext_exception();
+		ppc_cpu_cancel_ext_exception(IO_PIC_CPU);
 	}
 	sys_unlock_mutex(PIC_mutex);
 }
@@ -214,6 +215,29 @@ void pic_done()
 	sys_destroy_mutex(PIC_mutex);
 }
 
+void pic_save_state(Stream &st)
+{
+	sys_lock_mutex(PIC_mutex);
+	st.writex(&PIC_enable_low, sizeof PIC_enable_low);
+	st.writex(&PIC_enable_high, sizeof PIC_enable_high);
+	st.writex(&PIC_pending_low, sizeof PIC_pending_low);
+	st.writex(&PIC_pending_high, sizeof PIC_pending_high);
+	st.writex(&PIC_pending_level, sizeof PIC_pending_level);
+	sys_unlock_mutex(PIC_mutex);
+}
+
+void pic_load_state(Stream &st)
+{
+	sys_lock_mutex(PIC_mutex);
+	st.readx(&PIC_enable_low, sizeof PIC_enable_low);
+	st.readx(&PIC_enable_high, sizeof PIC_enable_high);
+	st.readx(&PIC_pending_low, sizeof PIC_pending_low);
+	st.readx(&PIC_pending_high, sizeof PIC_pending_high);
+	st.readx(&PIC_pending_level, sizeof PIC_pending_level);
+	pic_renew_interrupts();
+	sys_unlock_mutex(PIC_mutex);
+}
+
 void pic_init_config()
 {
 }
@@ -33,6 +33,11 @@
  */
 #define IO_PIC_LEVEL_TYPE 0x1ff00000
 
+/*
+ *	the controller has a single output, it's wired to the boot cpu
+ */
+#define IO_PIC_CPU 0
+
 #define IO_PIC_IRQ_ETHERNET0	5
 #define IO_PIC_IRQ_ETHERNET1	7
 #define IO_PIC_IRQ_CUDA		18
@@ -51,6 +56,10 @@ void pic_init();
 void pic_done();
 void pic_init_config();
 
+class Stream;
+void pic_save_state(Stream &st);
+void pic_load_state(Stream &st);
+
 
 #endif
 
@@ -24,6 +24,7 @@
 #include <cstdlib>
 #include "debug/tracers.h"
 #include "tools/debug.h"
+#include "tools/snprintf.h"
 #include "cpu/cpu.h"
 #include "cpu/mem.h"
 #include "io/graphic/gcard.h"
@@ -1113,40 +1114,48 @@ void prom_init_device_tree()
 	gPromRoot->addNode(cpus);
 	gPromRoot->addNode(kbd);
 
-	PromNode *cpu = new PromNode("PowerPC,G4");
-	cpus->addNode(cpu);
 	cpus->addProp(new PromPropInt("#size-cells", 0));
-	cpu->addProp(new PromPropString("device_type", "cpu"));
-	cpu->addProp(new PromPropInt("reg", 0));
-	cpu->addProp(new PromPropInt("cpu-version", ppc_cpu_get_pvr(0)));
-	cpu->addProp(new PromPropString("state", "running"));
-	cpu->addProp(new PromPropInt("clock-frequency", ppc_get_clock_frequency(0)));
-	cpu->addProp(new PromPropInt("timebase-frequency", ppc_get_timebase_frequency(0)));
-	cpu->addProp(new PromPropInt("bus-frequency", ppc_get_bus_frequency(0)));
-	cpu->addProp(new PromPropInt("reservation-granule-size", 0x20));
-	cpu->addProp(new PromPropInt("tlb-sets", 0x40));
-	cpu->addProp(new PromPropInt("tlb-size", 0x80));
-	cpu->addProp(new PromPropInt("d-cache-size", 0x8000));
-	cpu->addProp(new PromPropInt("i-cache-size", 0x8000));
-	cpu->addProp(new PromPropInt("d-cache-sets", 0x80));
-	cpu->addProp(new PromPropInt("i-cache-sets", 0x80));
-	cpu->addProp(new PromPropInt("i-cache-block-size", 0x20));
-	cpu->addProp(new PromPropInt("d-cache-block-size", 0x20));
-	cpu->addProp(new PromPropString("graphics", ""));
-	cpu->addProp(new PromPropString("performance-monitor", ""));
-	cpu->addProp(new PromPropString("data-streams", ""));
+	for (int i=0; i < ppc_cpu_count(); i++) {
+		char name[32];
+		if (i) {
+			ht_snprintf(name, sizeof name, "PowerPC,G4@%d", i);
+		} else {
+			ht_snprintf(name, sizeof name, "PowerPC,G4");
+		}
+		PromNode *cpu = new PromNode(name);
+		cpus->addNode(cpu);
+		cpu->addProp(new PromPropString("device_type", "cpu"));
+		cpu->addProp(new PromPropInt("reg", i));
+		cpu->addProp(new PromPropInt("cpu-version", ppc_cpu_get_pvr(i)));
+		cpu->addProp(new PromPropString("state", i ? "stopped" : "running"));
+		cpu->addProp(new PromPropInt("clock-frequency", ppc_get_clock_frequency(i)));
+		cpu->addProp(new PromPropInt("timebase-frequency", ppc_get_timebase_frequency(i)));
+		cpu->addProp(new PromPropInt("bus-frequency", ppc_get_bus_frequency(i)));
+		cpu->addProp(new PromPropInt("reservation-granule-size", 0x20));
+		cpu->addProp(new PromPropInt("tlb-sets", 0x40));
+		cpu->addProp(new PromPropInt("tlb-size", 0x80));
+		cpu->addProp(new PromPropInt("d-cache-size", 0x8000));
+		cpu->addProp(new PromPropInt("i-cache-size", 0x8000));
+		cpu->addProp(new PromPropInt("d-cache-sets", 0x80));
+		cpu->addProp(new PromPropInt("i-cache-sets", 0x80));
+		cpu->addProp(new PromPropInt("i-cache-block-size", 0x20));
+		cpu->addProp(new PromPropInt("d-cache-block-size", 0x20));
+		cpu->addProp(new PromPropString("graphics", ""));
+		cpu->addProp(new PromPropString("performance-monitor", ""));
+		cpu->addProp(new PromPropString("data-streams", ""));
 	
-	PromNode *cache = new PromNode("cache");
-	cpu->addProp(new PromPropInt("l2-cache", cache->getPHandle()));
-	cache->addProp(new PromPropString("device_type", "cache"));
-	cache->addProp(new PromPropInt("i-cache-size", 0x100000));
-	cache->addProp(new PromPropInt("d-cache-size", 0x100000));
-	cache->addProp(new PromPropInt("i-cache-sets", 0x2000));
-	cache->addProp(new PromPropInt("d-cache-sets", 0x2000));
-	cache->addProp(new PromPropInt("i-cache-line-size", 0x40));
-	cache->addProp(new PromPropInt("d-cache-line-size", 0x40));
-//	cache->addProp(new PromPropString("cache-unified", ""));
-	cpu->addNode(cache);
+		PromNode *cache = new PromNode("cache");
+		cpu->addProp(new PromPropInt("l2-cache", cache->getPHandle()));
+		cache->addProp(new PromPropString("device_type", "cache"));
+		cache->addProp(new PromPropInt("i-cache-size", 0x100000));
+		cache->addProp(new PromPropInt("d-cache-size", 0x100000));
+		cache->addProp(new PromPropInt("i-cache-sets", 0x2000));
+		cache->addProp(new PromPropInt("d-cache-sets", 0x2000));
+		cache->addProp(new PromPropInt("i-cache-line-size", 0x40));
+		cache->addProp(new PromPropInt("d-cache-line-size", 0x40));
+//		cache->addProp(new PromPropString("cache-unified", ""));
+		cpu->addNode(cache);
+	}
     	
 	gPromRoot->addNode(memory);
 	gPromRoot->addNode(openprom);
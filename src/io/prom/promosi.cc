@@ -36,7 +36,16 @@ uint32 gPromOSIEntry;
 
 void prom_service_start_cpu(prom_args *pa)
 {
-	IO_PROM_ERR("start_cpu()\n");
+	//; of_start_cpu(int phandle, void *pc, int arg)
+	uint32 phandle = pa->args[0];
+	uint32 pc = pa->args[1];
+	uint32 arg = pa->args[2];
+	IO_PROM_TRACE("start_cpu(%08x, %08x, %08x)\n", phandle, pc, arg);
+	PromNode *p = handleToPackage(phandle);
+	PromPropInt *reg = p ? dynamic_cast<PromPropInt*>(p->findProp("reg")) : NULL;
+	if (!reg || !ppc_cpu_start(reg->value, pc, arg)) {
+		IO_PROM_WARN("start_cpu(%08x): no such cpu or already running\n", phandle);
+	}
 }
 
 void prom_service_quiesce(prom_args *pa)
@@ -468,6 +468,48 @@ void writeConfig(uint reg, int offset, int size)
 	sys_unlock_mutex(mLock);
 }
 
+void saveState(Stream &st)
+{
+	sys_lock_mutex(mLock);
+	PCI_Device::saveState(st);
+	st.writex(mEEPROM, sizeof mEEPROM);
+	st.writex(&mEEPROMWritable, sizeof mEEPROMWritable);
+	st.writex(&mRegisters, sizeof mRegisters);
+	st.writex(&mIntStatus, sizeof mIntStatus);
+	st.writex(&mRingBufferSize, sizeof mRingBufferSize);
+	st.writex(&mGoodBSA, sizeof mGoodBSA);
+	st.writex(&mHead, sizeof mHead);
+	st.writex(&mTail, sizeof mTail);
+	st.writex(&mActive, sizeof mActive);
+	st.writex(&mWatermark, sizeof mWatermark);
+	st.writex(&mLast, sizeof mLast);
+	st.writex(mLastPackets, sizeof mLastPackets);
+	st.writex(&mPid, sizeof mPid);
+	st.writex(mPackets, sizeof mPackets);
+	sys_unlock_mutex(mLock);
+}
+
+void loadState(Stream &st)
+{
+	sys_lock_mutex(mLock);
+	PCI_Device::loadState(st);
+	st.readx(mEEPROM, sizeof mEEPROM);
+	st.readx(&mEEPROMWritable, sizeof mEEPROMWritable);
+	st.readx(&mRegisters, sizeof mRegisters);
+	st.readx(&mIntStatus, sizeof mIntStatus);
+	st.readx(&mRingBufferSize, sizeof mRingBufferSize);
+	st.readx(&mGoodBSA, sizeof mGoodBSA);
+	st.readx(&mHead, sizeof mHead);
+	st.readx(&mTail, sizeof mTail);
+	st.readx(&mActive, sizeof mActive);
+	st.readx(&mWatermark, sizeof mWatermark);
+	st.readx(&mLast, sizeof mLast);
+	st.readx(mLastPackets, sizeof mLastPackets);
+	st.readx(&mPid, sizeof mPid);
+	st.readx(mPackets, sizeof mPackets);
+	sys_unlock_mutex(mLock);
+}
+
 bool readDeviceIO(uint r, uint32 port, uint32 &data, uint size)
 {
 	if (r != 0) return false;
@@ -27,6 +27,7 @@
 
 #include "info.h"
 #include "cpu/cpu.h"
+#include "cpu/cputrace.h"
 //#include "cpu_generic/ppc_tools.h"
 #include "debug/debugger.h"
 #include "io/io.h"
@@ -45,9 +46,12 @@
 #include "system/keyboard.h"
 #include "system/sys.h"
 #include "configparser.h"
+#include "snapshot.h"
 
 #include "system/gif.h"
 #include "system/ui/gui.h"
+#include "system/ui/headless/sysheadless.h"
+#include "system/ui/vnc/sysvnc.h"
 
 #include "ppc_font.h"
 #include "ppc_img.h"
@@ -229,11 +233,18 @@ int main(int argc, char *argv[])
 	if (!initAtom()) return 3;
 	if (!initData()) return 4;
 	if (!initOSAPI()) return 5;
+	bool headless = false;
+	bool vnc = false;
 	try {
 		gConfig = new ConfigParser();
 		gConfig->acceptConfigEntryStringDef("ppc_start_resolution", "800x600x15");
 		gConfig->acceptConfigEntryIntDef("ppc_start_full_screen", 0);
+		gConfig->acceptConfigEntryIntDef("ppc_headless", 0);
+		gConfig->acceptConfigEntryIntDef("ppc_vnc", 0);
 		gConfig->acceptConfigEntryIntDef("memory_size", 128*1024*1024);
+		gConfig->acceptConfigEntryIntDef("memory_hugepages", 0);
+		gConfig->acceptConfigEntryIntDef("memory_mergeable", 0);
+		gConfig->acceptConfigEntryIntDef("memory_prefault", 0);
 		gConfig->acceptConfigEntryIntDef("page_table_pa", 0x00300000);
 		gConfig->acceptConfigEntryIntDef("redraw_interval_msec", 20);
 		gConfig->acceptConfigEntryStringDef("key_compose_dialog", "F11");
@@ -241,10 +252,17 @@ int main(int argc, char *argv[])
 		gConfig->acceptConfigEntryStringDef("key_change_cd_1", "none");
 		gConfig->acceptConfigEntryStringDef("key_toggle_mouse_grab", "F12");
 		gConfig->acceptConfigEntryStringDef("key_toggle_full_screen", "Ctrl+Alt+Return");
+		gConfig->acceptConfigEntryStringDef("key_save_snapshot", "none");
+		gConfig->acceptConfigEntryStringDef("snapshot_file", "snapshot");
+		gConfig->acceptConfigEntryIntDef("snapshot_load", 0);
+		gConfig->acceptConfigEntryIntDef("clone_count", 0);
 
 		prom_init_config();
+		headless_init_config();
+		vnc_init_config();
 		io_init_config();
 		ppc_cpu_init_config();
+		ppc_trace_init_config();
 		debugger_init_config();
 
 		try {
@@ -287,10 +305,12 @@ int main(int argc, char *argv[])
 		String key_compose_dialog_string;
 		String key_toggle_mouse_grab_string;
 		String key_toggle_full_screen_string;
+		String key_save_snapshot_string;
 		KeyboardCharacteristics keyConfig;
 		gConfig->getConfigString("key_compose_dialog", key_compose_dialog_string);		
 		gConfig->getConfigString("key_toggle_mouse_grab", key_toggle_mouse_grab_string);
 		gConfig->getConfigString("key_toggle_full_screen", key_toggle_full_screen_string);
+		gConfig->getConfigString("key_save_snapshot", key_save_snapshot_string);
 		if (!SystemKeyboard::convertStringToKeycode(keyConfig.key_compose_dialog, key_compose_dialog_string)) {
 			ht_printf("%s: invalid '%s'\n", argv[1], "key_compose_dialog");
 			exit(1);
@@ -303,6 +323,10 @@ int main(int argc, char *argv[])
 			ht_printf("%s: invalid '%s'\n", argv[1], "key_toggle_full_screen");
 			exit(1);
 		}
+		if (!SystemKeyboard::convertStringToKeycode(keyConfig.key_save_snapshot, key_save_snapshot_string)) {
+			ht_printf("%s: invalid '%s'\n", argv[1], "key_save_snapshot");
+			exit(1);
+		}
 		
 		
 		gcard_init_modes();
@@ -321,6 +345,9 @@ int main(int argc, char *argv[])
 		 *	Are we confusing bytesPerPixel with bitsPerPixel?
 		 *	Yes! And I am proud of it!
 		 */
+		case 8:
+			gm.bytesPerPixel = 1;
+			break;
 		case 15:
 			gm.bytesPerPixel = 2;
 			break;
@@ -337,12 +364,24 @@ int main(int argc, char *argv[])
 		}
 		gcard_add_characteristic(gm);
 
+		/*
+		 *	Clone before anything (threads, timers, RAM) is set up,
+		 *	only the clones return.
+		 */
+		int clones = gConfig->getConfigInt("clone_count");
+		if (clones > 0) {
+			snapshot_clone(clones);
+		}
 
 		/*
 		 *	begin hardware init
 		 */
 
-		if (!ppc_init_physical_memory(gConfig->getConfigInt("memory_size"))) {
+		int memflags = 0;
+		if (gConfig->getConfigInt("memory_hugepages")) memflags |= SYS_ALLOC_HUGEPAGES;
+		if (gConfig->getConfigInt("memory_mergeable")) memflags |= SYS_ALLOC_MERGEABLE;
+		if (gConfig->getConfigInt("memory_prefault")) memflags |= SYS_ALLOC_PREFAULT;
+		if (!ppc_init_physical_memory(gConfig->getConfigInt("memory_size"), memflags)) {
 			ht_printf("cannot initialize memory.\n");
 			exit(1);
 		}
@@ -350,8 +389,19 @@ int main(int argc, char *argv[])
 			ht_printf("cpu_init failed! Out of memory?\n");
 			exit(1);
 		}
-
-		initUI(APPNAME" "APPVERSION, gm, msec, keyConfig, fullscreen);
+		ppc_trace_init();
+
+		headless = gConfig->getConfigInt("ppc_headless");
+		vnc = gConfig->getConfigInt("ppc_vnc");
+		if (vnc) {
+			initVNCUI(APPNAME" "APPVERSION, gm, msec, keyConfig);
+			fullscreen = false;
+		} else if (headless) {
+			initHeadlessUI(APPNAME" "APPVERSION, gm, msec, keyConfig);
+			fullscreen = false;
+		} else {
+			initUI(APPNAME" "APPVERSION, gm, msec, keyConfig, fullscreen);
+		}
 
 		io_init();
 
@@ -414,7 +464,14 @@ int main(int argc, char *argv[])
 
 		testforth();
 
-		if (!prom_load_boot_file()) {
+		String snapshot_file, snapshot_save_file;
+		gConfig->getConfigString("snapshot_file", snapshot_file);
+		snapshot_clone_filename(snapshot_save_file, snapshot_file);
+
+		if (gConfig->getConfigInt("snapshot_load")) {
+			gDisplay->printf("Loading snapshot '%y'...\n", &snapshot_file);
+			snapshot_load(snapshot_file.contentChar());
+		} else if (!prom_load_boot_file()) {
 			ht_printf("cannot find boot file.\n");
 			return 1;
 		}
@@ -427,7 +484,19 @@ int main(int argc, char *argv[])
 		gDisplay->print("Starting client...");
 
 		ppc_cpu_run();
+		while (snapshot_save_requested()) {
+			try {
+				snapshot_save(snapshot_save_file.contentChar());
+				ht_printf("snapshot saved to '%y'.\n", &snapshot_save_file);
+			} catch (const Exception &e) {
+				String res;
+				e.reason(res);
+				ht_printf("cannot save snapshot: %y\n", &res);
+			}
+			ppc_cpu_run();
+		}
 
+		ppc_trace_done();
 		io_done();
 
 	} catch (const std::exception &e) {
@@ -440,7 +509,13 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	doneUI();
+	if (vnc) {
+		doneVNCUI();
+	} else if (headless) {
+		doneHeadlessUI();
+	} else {
+		doneUI();
+	}
 	doneOSAPI();
 	doneData();
 	doneAtom();
@@ -0,0 +1,174 @@
+/*
+ *	PearPC
+ *	snapshot.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "cpu/cpu.h"
+#include "cpu/mem.h"
+#include "io/io.h"
+#include "system/sys.h"
+#include "tools/except.h"
+#include "tools/snprintf.h"
+#include "tools/stream.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC		0x50415053
+#define SNAPSHOT_VERSION	1
+// RAM starts at a multiple of this, so it can be mapped
+#define SNAPSHOT_RAM_ALIGN	0x10000
+#define SNAPSHOT_CHUNK_SIZE	0x10000
+
+struct SnapshotHeader {
+	uint32	magic;
+	uint32	version;
+	uint32	header_size;
+	uint32	memory_size;
+	uint64	memory_offset;
+};
+
+static volatile bool gSnapshotSaveRequested = false;
+static int gCloneIndex = -1;
+
+void snapshot_request_save()
+{
+	gSnapshotSaveRequested = true;
+	ppc_cpu_stop();
+}
+
+bool snapshot_save_requested()
+{
+	bool r = gSnapshotSaveRequested;
+	gSnapshotSaveRequested = false;
+	return r;
+}
+
+static void writeSnapshot(const char *filename)
+{
+	LocalFile f(filename, IOAM_WRITE, FOM_CREATE);
+	SnapshotHeader h;
+	memset(&h, 0, sizeof h);
+	h.magic = SNAPSHOT_MAGIC;
+	h.version = SNAPSHOT_VERSION;
+	h.header_size = sizeof h;
+	h.memory_size = ppc_get_memory_size();
+	f.writex(&h, sizeof h);
+
+	ppc_cpu_save_state(f);
+	io_save_state(f);
+
+	byte *buf = new byte[SNAPSHOT_CHUNK_SIZE];
+	try {
+		FileOfs ofs = f.tell();
+		h.memory_offset = (ofs + SNAPSHOT_RAM_ALIGN - 1) & ~(FileOfs)(SNAPSHOT_RAM_ALIGN - 1);
+		memset(buf, 0, SNAPSHOT_CHUNK_SIZE);
+		f.writex(buf, h.memory_offset - ofs);
+		for (uint32 pa = 0; pa < h.memory_size; pa += SNAPSHOT_CHUNK_SIZE) {
+			uint32 size = MIN(h.memory_size - pa, SNAPSHOT_CHUNK_SIZE);
+			if (!ppc_dma_read(buf, pa, size)) throw MsgException("can't read guest memory");
+			f.writex(buf, size);
+		}
+	} catch (...) {
+		delete[] buf;
+		throw;
+	}
+	delete[] buf;
+
+	f.seek(0);
+	f.writex(&h, sizeof h);
+}
+
+/*
+ *	The snapshot is written to a new file which replaces the
+ *	old one when complete. RAM of running guests may still be
+ *	mapped from the old one.
+ */
+void snapshot_save(const char *filename)
+{
+	String tmpname;
+	tmpname.assignFormat("%s.tmp", filename);
+	writeSnapshot(tmpname.contentChar());
+	if (rename(tmpname.contentChar(), filename)) {
+		throw MsgfException("can't rename '%y' to '%s'", &tmpname, filename);
+	}
+}
+
+void snapshot_load(const char *filename)
+{
+	LocalFile f(filename);
+	SnapshotHeader h;
+	f.readx(&h, sizeof h);
+	if (h.magic != SNAPSHOT_MAGIC || h.header_size != sizeof h) {
+		throw MsgfException("%s: not a snapshot", filename);
+	}
+	if (h.version != SNAPSHOT_VERSION) {
+		throw MsgfException("%s: unsupported snapshot version %d", filename, h.version);
+	}
+	if (h.memory_size != ppc_get_memory_size()) {
+		throw MsgfException("%s: snapshot was taken with memory_size = %d", filename, h.memory_size);
+	}
+
+	/*
+	 *	Map RAM first, the cpu state has to be
+	 *	loaded afterwards to flush the tlb.
+	 */
+	if (!ppc_map_physical_memory(filename, h.memory_offset)) {
+		byte *buf = new byte[SNAPSHOT_CHUNK_SIZE];
+		try {
+			f.seek(h.memory_offset);
+			for (uint32 pa = 0; pa < h.memory_size; pa += SNAPSHOT_CHUNK_SIZE) {
+				uint32 size = MIN(h.memory_size - pa, SNAPSHOT_CHUNK_SIZE);
+				f.readx(buf, size);
+				ppc_dma_write(pa, buf, size);
+			}
+		} catch (...) {
+			delete[] buf;
+			throw;
+		}
+		delete[] buf;
+		f.seek(sizeof h);
+	}
+
+	ppc_cpu_load_state(f);
+	io_load_state(f);
+}
+
+void snapshot_clone(int count)
+{
+	gCloneIndex = sys_fork_instances(count);
+	if (gCloneIndex < 0) throw MsgException("cloning isn't supported on this host");
+}
+
+int snapshot_clone_index()
+{
+	return gCloneIndex;
+}
+
+String &snapshot_clone_filename(String &result, const String &filename)
+{
+	if (gCloneIndex < 0) {
+		result = filename;
+	} else {
+		result.assignFormat("%y.%d", &filename, gCloneIndex);
+	}
+	return result;
+}
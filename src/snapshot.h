@@ -0,0 +1,59 @@
+/*
+ *	PearPC
+ *	snapshot.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "tools/str.h"
+
+/*
+ *	A snapshot contains the state of the boot cpu, of all
+ *	devices and the guest RAM. It can only be loaded into
+ *	the same binary with the same configuration.
+ *
+ *	Both functions have to be called while the cpu is stopped
+ *	and throw an exception on error.
+ */
+void	snapshot_save(const char *filename);
+void	snapshot_load(const char *filename);
+
+/*
+ *	Stops the cpu, ppc_cpu_run() returns and the caller
+ *	saves the snapshot (may be called from any thread).
+ */
+void	snapshot_request_save();
+bool	snapshot_save_requested();
+
+/*
+ *	Clones the (not yet started) machine into count processes.
+ *	Only returns in the clones. Guest RAM is shared copy-on-write
+ *	if all of them load the same snapshot.
+ */
+void	snapshot_clone(int count);
+
+/*
+ *	Index of this clone or -1. Files written by the guest
+ *	(disk overlays, nvram, snapshots) are per clone, their
+ *	names get ".<index>" appended.
+ */
+int	snapshot_clone_index();
+String &snapshot_clone_filename(String &result, const String &filename);
+
+#endif
@@ -22,6 +22,7 @@
 
 #if !defined(TARGET_CPU_X86) || !defined(TARGET_COMPILER_GCC)
 
+#include "system/pixconv.h"
 #include "system/sysvaccel.h"
 
 #include "tools/snprintf.h"
@@ -35,18 +36,17 @@ static void convertBaseColor(uint &b, uint fromBits, uint toBits)
 	}
 }
 
-void sys_convert_display(
+static void genericConvertRect(
 	const DisplayCharacteristics &aSrcChar,
 	const DisplayCharacteristics &aDestChar,
 	const void *aSrcBuf,
 	void *aDestBuf,
-	int firstLine,
-	int lastLine)
+	int x, int y, int w, int h)
 {
-	byte *src = (byte*)aSrcBuf + aSrcChar.bytesPerPixel * aSrcChar.width * firstLine;
-	byte *dest = (byte*)aDestBuf + aDestChar.bytesPerPixel * aDestChar.width * firstLine;
-	for (int y=firstLine; y <= lastLine; y++) {
-		for (int x=0; x < aSrcChar.width; x++) {
+	for (int line=y; line < y+h; line++) {
+		byte *src = (byte*)aSrcBuf + aSrcChar.scanLineLength * line + aSrcChar.bytesPerPixel * x;
+		byte *dest = (byte*)aDestBuf + aDestChar.scanLineLength * line + aDestChar.bytesPerPixel * x;
+		for (int i=0; i < w; i++) {
 			uint r, g, b;
 			uint p;
 			switch (aSrcChar.bytesPerPixel) {
@@ -86,10 +86,53 @@ void sys_convert_display(
 			dest += aDestChar.bytesPerPixel;
 			src += aSrcChar.bytesPerPixel;
 		}
-		dest += aDestChar.scanLineLength - aDestChar.width*aDestChar.bytesPerPixel;
-		src += aSrcChar.scanLineLength - aSrcChar.width*aSrcChar.bytesPerPixel;
 	}
 }
 
+void sys_convert_display_rect(
+	const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar,
+	const void *aSrcBuf,
+	void *aDestBuf,
+	int x, int y, int w, int h)
+{
+	if (aSrcChar.bytesPerPixel == 1) {
+		pixconv_convert_indexed_rect(aSrcChar, aDestChar, gDisplay->paletteLUT(aDestChar),
+			aSrcBuf, aDestBuf, x, y, w, h);
+		return;
+	}
+	PixConvLine convert = pixconv_get(aSrcChar, aDestChar);
+	if (!convert) {
+		genericConvertRect(aSrcChar, aDestChar, aSrcBuf, aDestBuf, x, y, w, h);
+		return;
+	}
+	const byte *src = (const byte*)aSrcBuf + aSrcChar.scanLineLength * y + aSrcChar.bytesPerPixel * x;
+	byte *dest = (byte*)aDestBuf + aDestChar.scanLineLength * y + aDestChar.bytesPerPixel * x;
+	if (x == 0 && w == aSrcChar.width
+	 && aSrcChar.scanLineLength == w * aSrcChar.bytesPerPixel
+	 && aDestChar.scanLineLength == w * aDestChar.bytesPerPixel) {
+		// whole lines, convert them in one go
+		convert(w * h, src, dest);
+		return;
+	}
+	for (int line=0; line < h; line++) {
+		convert(w, src, dest);
+		src += aSrcChar.scanLineLength;
+		dest += aDestChar.scanLineLength;
+	}
+}
+
+void sys_convert_display(
+	const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar,
+	const void *aSrcBuf,
+	void *aDestBuf,
+	int firstLine,
+	int lastLine)
+{
+	sys_convert_display_rect(aSrcChar, aDestChar, aSrcBuf, aDestBuf,
+		0, firstLine, aSrcChar.width, lastLine-firstLine+1);
+}
+
 #endif
 
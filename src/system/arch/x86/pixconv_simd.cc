@@ -0,0 +1,396 @@
+/*
+ *	PearPC
+ *	pixconv_simd.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include "system/pixconv.h"
+
+#ifdef PIXCONV_X86_SIMD
+
+#include <immintrin.h>
+
+/*
+ *	SSE2, SSSE3 and AVX2 kernels for x86 and x86-64.
+ *	Every function is compiled for its instruction set only,
+ *	pixconv.cc picks them by cpuid at runtime. The pixels which
+ *	don't fill a whole vector are left to the scalar kernels.
+ */
+#define TARGET(isa) __attribute__((target(isa)))
+
+static inline void tail(PixConvSrcFormat s, PixConvDestFormat d, uint32 pixel, const byte *src, byte *dest)
+{
+	if (pixel) pixconv_get_kernel(PIXCONV_SCALAR, s, d)(pixel, src, dest);
+}
+
+#define LOAD128(p)	_mm_loadu_si128((const __m128i*)(p))
+#define STORE128(p, x)	_mm_storeu_si128((__m128i*)(p), x)
+#define LOAD256(p)	_mm256_loadu_si256((const __m256i*)(p))
+#define STORE256(p, x)	_mm256_storeu_si256((__m256i*)(p), x)
+
+/*
+ *	SSE2
+ */
+static TARGET("sse2") inline __m128i sse2_swap16(__m128i x)
+{
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static TARGET("sse2") inline __m128i sse2_555_to_565(__m128i x)
+{
+	return _mm_or_si128(
+		_mm_slli_epi16(_mm_and_si128(x, _mm_set1_epi16(0x7fe0)), 1),
+		_mm_and_si128(x, _mm_set1_epi16(0x1f)));
+}
+
+// x: 4 pixels 555 zero extended to 32 bit
+static TARGET("sse2") inline __m128i sse2_555_to_888(__m128i x)
+{
+	return _mm_or_si128(_mm_or_si128(
+		_mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7c00)), 9),
+		_mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x3e0)), 6)),
+		_mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x1f)), 3));
+}
+
+// x: 4 guest pixels loaded as little-endian words
+static TARGET("sse2") inline __m128i sse2_be888_to_555(__m128i x)
+{
+	return _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(_mm_srli_epi32(x, 1), _mm_set1_epi32(0x7c00)),
+		_mm_and_si128(_mm_srli_epi32(x, 14), _mm_set1_epi32(0x3e0))),
+		_mm_srli_epi32(x, 27));
+}
+
+// result sign extended to 32 bit, so that packs doesn't saturate
+static TARGET("sse2") inline __m128i sse2_be888_to_565(__m128i x)
+{
+	x = _mm_or_si128(_mm_or_si128(
+		_mm_and_si128(x, _mm_set1_epi32(0xf800)),
+		_mm_and_si128(_mm_srli_epi32(x, 13), _mm_set1_epi32(0x7e0))),
+		_mm_srli_epi32(x, 27));
+	return _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+}
+
+static TARGET("sse2") void sse2_2be555_to_2_555(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		STORE128(dest + i*2, sse2_swap16(LOAD128(src + i*2)));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_2_555, pixel - n, src + n*2, dest + n*2);
+}
+
+static TARGET("sse2") void sse2_2be555_to_2_565(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		STORE128(dest + i*2, sse2_555_to_565(sse2_swap16(LOAD128(src + i*2))));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_2_565, pixel - n, src + n*2, dest + n*2);
+}
+
+static TARGET("sse2") void sse2_2be555_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	__m128i zero = _mm_setzero_si128();
+	for (uint32 i=0; i < n; i += 8) {
+		__m128i x = sse2_swap16(LOAD128(src + i*2));
+		STORE128(dest + i*4, sse2_555_to_888(_mm_unpacklo_epi16(x, zero)));
+		STORE128(dest + i*4 + 16, sse2_555_to_888(_mm_unpackhi_epi16(x, zero)));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_4_888, pixel - n, src + n*2, dest + n*4);
+}
+
+static TARGET("sse2") void sse2_4be888_to_2_555(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		__m128i a = sse2_be888_to_555(LOAD128(src + i*4));
+		__m128i b = sse2_be888_to_555(LOAD128(src + i*4 + 16));
+		STORE128(dest + i*2, _mm_packs_epi32(a, b));
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_2_555, pixel - n, src + n*4, dest + n*2);
+}
+
+static TARGET("sse2") void sse2_4be888_to_2_565(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		__m128i a = sse2_be888_to_565(LOAD128(src + i*4));
+		__m128i b = sse2_be888_to_565(LOAD128(src + i*4 + 16));
+		STORE128(dest + i*2, _mm_packs_epi32(a, b));
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_2_565, pixel - n, src + n*4, dest + n*2);
+}
+
+static TARGET("sse2") void sse2_4be888_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~3;
+	for (uint32 i=0; i < n; i += 4) {
+		__m128i x = LOAD128(src + i*4);
+		x = _mm_or_si128(_mm_or_si128(
+			_mm_srli_epi32(x, 24),
+			_mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0xff00))),
+			_mm_and_si128(_mm_slli_epi32(x, 8), _mm_set1_epi32(0xff0000)));
+		STORE128(dest + i*4, x);
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_4_888, pixel - n, src + n*4, dest + n*4);
+}
+
+/*
+ *	SSSE3, byte shuffles with pshufb
+ */
+static TARGET("ssse3") inline __m128i ssse3_swap16(__m128i x)
+{
+	return _mm_shuffle_epi8(x, _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+}
+
+static TARGET("ssse3") void ssse3_2be555_to_2_555(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		STORE128(dest + i*2, ssse3_swap16(LOAD128(src + i*2)));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_2_555, pixel - n, src + n*2, dest + n*2);
+}
+
+static TARGET("ssse3") void ssse3_2be555_to_2_565(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		STORE128(dest + i*2, sse2_555_to_565(ssse3_swap16(LOAD128(src + i*2))));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_2_565, pixel - n, src + n*2, dest + n*2);
+}
+
+static TARGET("ssse3") void ssse3_2be555_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	__m128i zero = _mm_setzero_si128();
+	for (uint32 i=0; i < n; i += 8) {
+		__m128i x = ssse3_swap16(LOAD128(src + i*2));
+		STORE128(dest + i*4, sse2_555_to_888(_mm_unpacklo_epi16(x, zero)));
+		STORE128(dest + i*4 + 16, sse2_555_to_888(_mm_unpackhi_epi16(x, zero)));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_4_888, pixel - n, src + n*2, dest + n*4);
+}
+
+static TARGET("ssse3") void ssse3_4be888_to_3_888(uint32 pixel, const byte *src, byte *dest)
+{
+	// 4 pixels give 12 bytes, but 16 are stored. The last
+	// 4 pixels (at least) are done by the scalar kernel.
+	uint32 n = pixel >= 8 ? (pixel - 4) & ~3 : 0;
+	__m128i shuf = _mm_setr_epi8(3, 2, 1, 7, 6, 5, 11, 10, 9, 15, 14, 13, -1, -1, -1, -1);
+	for (uint32 i=0; i < n; i += 4) {
+		STORE128(dest + i*3, _mm_shuffle_epi8(LOAD128(src + i*4), shuf));
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_3_888, pixel - n, src + n*4, dest + n*3);
+}
+
+static TARGET("ssse3") void ssse3_4be888_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~3;
+	__m128i shuf = _mm_setr_epi8(3, 2, 1, -1, 7, 6, 5, -1, 11, 10, 9, -1, 15, 14, 13, -1);
+	for (uint32 i=0; i < n; i += 4) {
+		STORE128(dest + i*4, _mm_shuffle_epi8(LOAD128(src + i*4), shuf));
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_4_888, pixel - n, src + n*4, dest + n*4);
+}
+
+/*
+ *	AVX2, shuffles work within 128 bit lanes,
+ *	which is all we need per pixel.
+ */
+static TARGET("avx2") inline __m256i avx2_swap16(__m256i x)
+{
+	return _mm256_shuffle_epi8(x, _mm256_setr_epi8(
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14));
+}
+
+static TARGET("avx2") inline __m256i avx2_555_to_565(__m256i x)
+{
+	return _mm256_or_si256(
+		_mm256_slli_epi16(_mm256_and_si256(x, _mm256_set1_epi16(0x7fe0)), 1),
+		_mm256_and_si256(x, _mm256_set1_epi16(0x1f)));
+}
+
+static TARGET("avx2") void avx2_2be555_to_2_555(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~15;
+	for (uint32 i=0; i < n; i += 16) {
+		STORE256(dest + i*2, avx2_swap16(LOAD256(src + i*2)));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_2_555, pixel - n, src + n*2, dest + n*2);
+}
+
+static TARGET("avx2") void avx2_2be555_to_2_565(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~15;
+	for (uint32 i=0; i < n; i += 16) {
+		STORE256(dest + i*2, avx2_555_to_565(avx2_swap16(LOAD256(src + i*2))));
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_2_565, pixel - n, src + n*2, dest + n*2);
+}
+
+static TARGET("avx2") void avx2_2be555_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		__m256i x = _mm256_cvtepu16_epi32(ssse3_swap16(LOAD128(src + i*2)));
+		x = _mm256_or_si256(_mm256_or_si256(
+			_mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x7c00)), 9),
+			_mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x3e0)), 6)),
+			_mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x1f)), 3));
+		STORE256(dest + i*4, x);
+	}
+	tail(PIXCONV_SRC_2BE555, PIXCONV_DEST_4_888, pixel - n, src + n*2, dest + n*4);
+}
+
+static TARGET("avx2") inline __m256i avx2_be888_to_555(__m256i x)
+{
+	return _mm256_or_si256(_mm256_or_si256(
+		_mm256_and_si256(_mm256_srli_epi32(x, 1), _mm256_set1_epi32(0x7c00)),
+		_mm256_and_si256(_mm256_srli_epi32(x, 14), _mm256_set1_epi32(0x3e0))),
+		_mm256_srli_epi32(x, 27));
+}
+
+static TARGET("avx2") inline __m256i avx2_be888_to_565(__m256i x)
+{
+	x = _mm256_or_si256(_mm256_or_si256(
+		_mm256_and_si256(x, _mm256_set1_epi32(0xf800)),
+		_mm256_and_si256(_mm256_srli_epi32(x, 13), _mm256_set1_epi32(0x7e0))),
+		_mm256_srli_epi32(x, 27));
+	return _mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16);
+}
+
+// packs works per lane, 0xd8 puts the quadwords back in order
+#define AVX2_PACK(a, b)	_mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8)
+
+static TARGET("avx2") void avx2_4be888_to_2_555(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~15;
+	for (uint32 i=0; i < n; i += 16) {
+		__m256i a = avx2_be888_to_555(LOAD256(src + i*4));
+		__m256i b = avx2_be888_to_555(LOAD256(src + i*4 + 32));
+		STORE256(dest + i*2, AVX2_PACK(a, b));
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_2_555, pixel - n, src + n*4, dest + n*2);
+}
+
+static TARGET("avx2") void avx2_4be888_to_2_565(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~15;
+	for (uint32 i=0; i < n; i += 16) {
+		__m256i a = avx2_be888_to_565(LOAD256(src + i*4));
+		__m256i b = avx2_be888_to_565(LOAD256(src + i*4 + 32));
+		STORE256(dest + i*2, AVX2_PACK(a, b));
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_2_565, pixel - n, src + n*4, dest + n*2);
+}
+
+static TARGET("avx2") void avx2_4be888_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	uint32 n = pixel & ~7;
+	__m256i shuf = _mm256_setr_epi8(
+		3, 2, 1, -1, 7, 6, 5, -1, 11, 10, 9, -1, 15, 14, 13, -1,
+		3, 2, 1, -1, 7, 6, 5, -1, 11, 10, 9, -1, 15, 14, 13, -1);
+	for (uint32 i=0; i < n; i += 8) {
+		STORE256(dest + i*4, _mm256_shuffle_epi8(LOAD256(src + i*4), shuf));
+	}
+	tail(PIXCONV_SRC_4BE888, PIXCONV_DEST_4_888, pixel - n, src + n*4, dest + n*4);
+}
+
+/*
+ *	The palette lookups gather eight table entries at a time.
+ *	There is no gather before AVX2, the older levels keep
+ *	the scalar lookups.
+ */
+static inline void lut_tail(int bpp, uint32 pixel, const byte *src, byte *dest, const uint32 *lut)
+{
+	if (pixel) pixconv_get_lut_kernel(PIXCONV_SCALAR, bpp)(pixel, src, dest, lut);
+}
+
+static TARGET("avx2") inline __m256i avx2_lookup(const byte *src, const uint32 *lut)
+{
+	__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src));
+	return _mm256_i32gather_epi32((const int*)lut, idx, 4);
+}
+
+static TARGET("avx2") void avx2_lut_to_2(uint32 pixel, const byte *src, byte *dest, const uint32 *lut)
+{
+	uint32 n = pixel & ~15;
+	for (uint32 i=0; i < n; i += 16) {
+		__m256i a = avx2_lookup(src + i, lut);
+		__m256i b = avx2_lookup(src + i + 8, lut);
+		// the entries are 16 bit, so the unsigned saturation keeps them
+		STORE256(dest + i*2, _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8));
+	}
+	lut_tail(2, pixel - n, src + n, dest + n*2, lut);
+}
+
+static TARGET("avx2") void avx2_lut_to_4(uint32 pixel, const byte *src, byte *dest, const uint32 *lut)
+{
+	uint32 n = pixel & ~7;
+	for (uint32 i=0; i < n; i += 8) {
+		STORE256(dest + i*4, avx2_lookup(src + i, lut));
+	}
+	lut_tail(4, pixel - n, src + n, dest + n*4, lut);
+}
+
+void pixconv_x86_lut_kernels(PixConvLevel level, PixConvLUTLine k[5])
+{
+	if (level == PIXCONV_AVX2) {
+		k[2] = avx2_lut_to_2;
+		k[4] = avx2_lut_to_4;
+	}
+}
+
+void pixconv_x86_kernels(PixConvLevel level, PixConvLine k[PIXCONV_SRC_FORMATS][PIXCONV_DEST_FORMATS])
+{
+	switch (level) {
+	case PIXCONV_SSE2:
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_555] = sse2_2be555_to_2_555;
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_565] = sse2_2be555_to_2_565;
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_4_888] = sse2_2be555_to_4_888;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_2_555] = sse2_4be888_to_2_555;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_2_565] = sse2_4be888_to_2_565;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_4_888] = sse2_4be888_to_4_888;
+		break;
+	case PIXCONV_SSSE3:
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_555] = ssse3_2be555_to_2_555;
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_565] = ssse3_2be555_to_2_565;
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_4_888] = ssse3_2be555_to_4_888;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_3_888] = ssse3_4be888_to_3_888;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_4_888] = ssse3_4be888_to_4_888;
+		break;
+	case PIXCONV_AVX2:
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_555] = avx2_2be555_to_2_555;
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_565] = avx2_2be555_to_2_565;
+		k[PIXCONV_SRC_2BE555][PIXCONV_DEST_4_888] = avx2_2be555_to_4_888;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_2_555] = avx2_4be888_to_2_555;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_2_565] = avx2_4be888_to_2_565;
+		k[PIXCONV_SRC_4BE888][PIXCONV_DEST_4_888] = avx2_4be888_to_4_888;
+		break;
+	default:
+		break;
+	}
+}
+
+#endif
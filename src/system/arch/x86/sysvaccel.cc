@@ -22,6 +22,7 @@
 
 #if defined(TARGET_CPU_X86) && defined(TARGET_COMPILER_GCC)
 
+#include "system/pixconv.h"
 #include "system/sysvaccel.h"
 
 #include "tools/snprintf.h"
@@ -45,18 +46,17 @@ static void convertBaseColor(uint &b, uint fromBits, uint toBits)
 	}
 }
 
-static void genericConvertDisplay(
+static void genericConvertRect(
 	const DisplayCharacteristics &aSrcChar,
 	const DisplayCharacteristics &aDestChar,
 	const void *aSrcBuf,
 	void *aDestBuf,
-	int firstLine,
-	int lastLine)
+	int x, int y, int w, int h)
 {
-	byte *src = (byte*)aSrcBuf + aSrcChar.bytesPerPixel * aSrcChar.width * firstLine;
-	byte *dest = (byte*)aDestBuf + aDestChar.bytesPerPixel * aDestChar.width * firstLine;
-	for (int y=firstLine; y <= lastLine; y++) {
-		for (int x=0; x < aSrcChar.width; x++) {
+	for (int line=y; line < y+h; line++) {
+		byte *src = (byte*)aSrcBuf + aSrcChar.scanLineLength * line + aSrcChar.bytesPerPixel * x;
+		byte *dest = (byte*)aDestBuf + aDestChar.scanLineLength * line + aDestChar.bytesPerPixel * x;
+		for (int i=0; i < w; i++) {
 			uint r, g, b;
 			uint p;
 			switch (aSrcChar.bytesPerPixel) {
@@ -96,11 +96,21 @@ static void genericConvertDisplay(
 			dest += aDestChar.bytesPerPixel;
 			src += aSrcChar.bytesPerPixel;
 		}
-		dest += aDestChar.scanLineLength - aDestChar.width*aDestChar.bytesPerPixel;
-		src += aSrcChar.scanLineLength - aSrcChar.width*aSrcChar.bytesPerPixel;
 	}
 }
 
+static void genericConvertDisplay(
+	const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar,
+	const void *aSrcBuf,
+	void *aDestBuf,
+	int firstLine,
+	int lastLine)
+{
+	genericConvertRect(aSrcChar, aDestChar, aSrcBuf, aDestBuf,
+		0, firstLine, aSrcChar.width, lastLine-firstLine+1);
+}
+
 void sys_convert_display(
 	const DisplayCharacteristics &aSrcChar,
 	const DisplayCharacteristics &aDestChar,
@@ -109,6 +119,12 @@ void sys_convert_display(
 	int firstLine,
 	int lastLine)
 {
+	if (aSrcChar.bytesPerPixel == 1
+	 || (pixconv_level() >= PIXCONV_SSE2 && pixconv_get(aSrcChar, aDestChar))) {
+		sys_convert_display_rect(aSrcChar, aDestChar, aSrcBuf, aDestBuf,
+			0, firstLine, aSrcChar.width, lastLine-firstLine+1);
+		return;
+	}
 	byte *src = (byte*)aSrcBuf + aSrcChar.bytesPerPixel * aSrcChar.width * firstLine;
 	byte *dest = (byte*)aDestBuf + aDestChar.bytesPerPixel * aDestChar.width * firstLine;
 	uint32 pixel = (lastLine-firstLine+1) * aSrcChar.width;
@@ -129,5 +145,66 @@ void sys_convert_display(
 	}
 }
 
+void sys_convert_display_rect(
+	const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar,
+	const void *aSrcBuf,
+	void *aDestBuf,
+	int x, int y, int w, int h)
+{
+	if (aSrcChar.bytesPerPixel == 1) {
+		pixconv_convert_indexed_rect(aSrcChar, aDestChar, gDisplay->paletteLUT(aDestChar),
+			aSrcBuf, aDestBuf, x, y, w, h);
+		return;
+	}
+	if (pixconv_level() >= PIXCONV_SSE2) {
+		// the SIMD kernels beat the MMX code below
+		PixConvLine convert = pixconv_get(aSrcChar, aDestChar);
+		if (convert) {
+			const byte *src = (const byte*)aSrcBuf + aSrcChar.scanLineLength * y + aSrcChar.bytesPerPixel * x;
+			byte *dest = (byte*)aDestBuf + aDestChar.scanLineLength * y + aDestChar.bytesPerPixel * x;
+			for (int line=0; line < h; line++) {
+				convert(w, src, dest);
+				src += aSrcChar.scanLineLength;
+				dest += aDestChar.scanLineLength;
+			}
+			return;
+		}
+	}
+	if (x == 0 && w == aSrcChar.width
+	 && aSrcChar.scanLineLength == aSrcChar.width * aSrcChar.bytesPerPixel
+	 && aDestChar.scanLineLength == aDestChar.width * aDestChar.bytesPerPixel) {
+		// whole lines, convert them in one go
+		sys_convert_display(aSrcChar, aDestChar, aSrcBuf, aDestBuf, y, y+h-1);
+		return;
+	}
+	void (FASTCALL *convert)(uint32 pixel, byte *input, byte *output) = NULL;
+	if (w % 8 == 0) {
+		// the converters handle up to 8 pixels at a time
+		if (aSrcChar.bytesPerPixel == 2 && aDestChar.bytesPerPixel == 2) {
+			if (aDestChar.redSize == 5 && aDestChar.greenSize == 6 && aDestChar.blueSize == 5) {
+				convert = x86_mmx_convert_2be555_to_2le565;
+			} else if (aDestChar.redSize == 5 && aDestChar.greenSize == 5 && aDestChar.blueSize == 5) {
+				convert = x86_mmx_convert_2be555_to_2le555;
+			}
+		} else if (aSrcChar.bytesPerPixel == 2 && aDestChar.bytesPerPixel == 4) {
+			convert = x86_mmx_convert_2be555_to_4le888;
+		} else if (aSrcChar.bytesPerPixel == 4 && aDestChar.bytesPerPixel == 4) {
+			convert = x86_convert_4be888_to_4le888;
+		}
+	}
+	if (!convert) {
+		genericConvertRect(aSrcChar, aDestChar, aSrcBuf, aDestBuf, x, y, w, h);
+		return;
+	}
+	byte *src = (byte*)aSrcBuf + aSrcChar.scanLineLength * y + aSrcChar.bytesPerPixel * x;
+	byte *dest = (byte*)aDestBuf + aDestChar.scanLineLength * y + aDestChar.bytesPerPixel * x;
+	for (int line=0; line < h; line++) {
+		convert(w, src, dest);
+		src += aSrcChar.scanLineLength;
+		dest += aDestChar.scanLineLength;
+	}
+}
+
 #endif
 
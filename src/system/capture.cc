@@ -0,0 +1,204 @@
+/*
+ *	PearPC
+ *	capture.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "tools/crc32.h"
+#include "tools/except.h"
+#include "tools/snprintf.h"
+#include "tools/stream.h"
+#include "system/capture.h"
+
+static inline uint expandColor(uint v, int size)
+{
+	if (size <= 0) return 0;
+	if (size >= 8) return v >> (size - 8);
+	return v * 255 / ((1 << size) - 1);
+}
+
+/*
+ *	Converts the framebuffer into rows of 24 bit RGB, indexed
+ *	modes through the palette of gDisplay. If pad is set, every
+ *	row starts with a zero byte (the PNG filter type).
+ */
+static void captureRGB(const DisplayCharacteristics &chr, const byte *fb, byte *rgb, bool pad)
+{
+	for (int y=0; y < chr.height; y++) {
+		const byte *src = fb + y * chr.scanLineLength;
+		if (pad) *rgb++ = 0;
+		for (int x=0; x < chr.width; x++) {
+			uint32 p;
+			if (chr.bytesPerPixel == 1) {
+				RGB c = gDisplay->getColor(*src++);
+				*rgb++ = RGB_R(c);
+				*rgb++ = RGB_G(c);
+				*rgb++ = RGB_B(c);
+				continue;
+			}
+			switch (chr.bytesPerPixel) {
+			case 2:
+				p = (src[0] << 8) | src[1];
+				break;
+			case 4:
+				p = (src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
+				break;
+			default:
+				p = 0;
+				break;
+			}
+			src += chr.bytesPerPixel;
+			*rgb++ = expandColor((p >> chr.redShift) & ((1 << chr.redSize) - 1), chr.redSize);
+			*rgb++ = expandColor((p >> chr.greenShift) & ((1 << chr.greenSize) - 1), chr.greenSize);
+			*rgb++ = expandColor((p >> chr.blueShift) & ((1 << chr.blueSize) - 1), chr.blueSize);
+		}
+	}
+}
+
+static void put32(byte *p, uint32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/*
+ *	chunk has room for length and type in front of the
+ *	len bytes of data and for the crc behind them.
+ */
+static void writePNGChunk(File &f, const char *type, byte *chunk, uint32 len)
+{
+	put32(chunk, len);
+	memcpy(chunk+4, type, 4);
+	put32(chunk+8+len, ether_crc(len+4, chunk+4));
+	f.writex(chunk, len+12);
+}
+
+static uint32 adler32(const byte *p, uint32 len)
+{
+	uint32 a = 1, b = 0;
+	while (len) {
+		// no overflow before the modulo for 5552 bytes
+		uint32 n = MIN(len, 5552);
+		len -= n;
+		while (n--) {
+			a += *p++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+/*
+ *	The image data is deflated with stored blocks only, so no
+ *	compression library is needed. Captures are meant for
+ *	comparing and archiving, not for size.
+ */
+static void writePNG(File &f, const DisplayCharacteristics &chr, const byte *fb)
+{
+	static const byte signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	f.writex(signature, sizeof signature);
+
+	byte ihdr[12 + 13];
+	put32(ihdr+8, chr.width);
+	put32(ihdr+12, chr.height);
+	ihdr[16] = 8;	// bits per sample
+	ihdr[17] = 2;	// truecolor
+	ihdr[18] = 0;	// deflate
+	ihdr[19] = 0;	// adaptive filtering
+	ihdr[20] = 0;	// no interlace
+	writePNGChunk(f, "IHDR", ihdr, 13);
+
+	uint32 raw = chr.height * (1 + chr.width * 3);
+	uint32 blocks = (raw + 0xfffe) / 0xffff;
+	uint32 len = 2 + raw + 5 * blocks + 4;
+	byte *chunk = (byte*)malloc(len + 12);
+	byte *rgb = (byte*)malloc(raw);
+	if (!chunk || !rgb) {
+		free(chunk);
+		free(rgb);
+		throw IOException(ENOMEM);
+	}
+	captureRGB(chr, fb, rgb, true);
+
+	byte *z = chunk + 8;
+	*z++ = 0x78;	// deflate, 32k window
+	*z++ = 0x01;	// no preset dictionary, check bits
+	for (uint32 ofs = 0; ofs < raw; ofs += 0xffff) {
+		uint32 n = MIN(raw - ofs, 0xffff);
+		*z++ = (ofs + n == raw);	// BFINAL, BTYPE stored
+		z[0] = n;
+		z[1] = n >> 8;
+		z[2] = ~n;
+		z[3] = ~n >> 8;
+		z += 4;
+		memcpy(z, rgb + ofs, n);
+		z += n;
+	}
+	put32(z, adler32(rgb, raw));
+	free(rgb);
+
+	try {
+		writePNGChunk(f, "IDAT", chunk, len);
+	} catch (...) {
+		free(chunk);
+		throw;
+	}
+	free(chunk);
+
+	byte iend[12];
+	writePNGChunk(f, "IEND", iend, 0);
+}
+
+static void writePPM(File &f, const DisplayCharacteristics &chr, const byte *fb)
+{
+	char header[64];
+	int l = ht_snprintf(header, sizeof header, "P6\n%d %d\n255\n", chr.width, chr.height);
+	f.writex(header, l);
+
+	uint32 size = chr.width * chr.height * 3;
+	byte *rgb = (byte*)malloc(size);
+	if (!rgb) throw IOException(ENOMEM);
+	captureRGB(chr, fb, rgb, false);
+	try {
+		f.writex(rgb, size);
+	} catch (...) {
+		free(rgb);
+		throw;
+	}
+	free(rgb);
+}
+
+void captureFrame(const DisplayCharacteristics &chr, const byte *fb, const char *filename)
+{
+	LocalFile f(filename, IOAM_WRITE, FOM_CREATE);
+	int l = strlen(filename);
+	if (l >= 4 && strcmp(filename + l - 4, ".png") == 0) {
+		writePNG(f, chr, fb);
+	} else {
+		writePPM(f, chr, fb);
+	}
+}
@@ -0,0 +1,33 @@
+/*
+ *	PearPC
+ *	capture.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SYSTEM_CAPTURE_H__
+#define __SYSTEM_CAPTURE_H__
+
+#include "system/display.h"
+
+/*
+ *	Writes the guest framebuffer fb (in format chr) to filename.
+ *	The format is PNG if the name ends in ".png", binary PPM
+ *	otherwise. Throws an IOException on failure.
+ */
+void	captureFrame(const DisplayCharacteristics &chr, const byte *fb, const char *filename);
+
+#endif
@@ -27,8 +27,12 @@
 #include <cstring>
 
 #include "display.h"
+#include "cpu/cpu.h"
+#include "io/graphic/gcard.h"
 #include "tools/snprintf.h"
 #include "gif.h"
+#include "pixconv.h"
+#include "sysclk.h"
 
 // For key support
 #include "io/cuda/cuda.h"
@@ -36,7 +40,199 @@
 #include "system/keyboard.h"
 
 byte *	gFrameBuffer = NULL;
-int 	gDamageAreaFirstAddr, gDamageAreaLastAddr;
+uint32	gDamageTiles[DAMAGE_TILES_Y][DAMAGE_TILE_WORDS];
+uint	gDamageLineLength = 4096;
+uint	gDamageTileBytes = DAMAGE_TILE_W * 4;
+uint8	gFrameBufferDirty[FRAMEBUFFER_PAGES];
+
+static void damageTiles(uint ty, uint tx0, uint tx1)
+{
+	if (ty >= DAMAGE_TILES_Y) return;
+	if (tx1 >= DAMAGE_TILES_X) tx1 = DAMAGE_TILES_X-1;
+	for (uint w = tx0 >> 5; w <= tx1 >> 5; w++) {
+		uint32 m = 0xffffffff;
+		if (w == tx0 >> 5) m &= 0xffffffff << (tx0 & 31);
+		if (w == tx1 >> 5) m &= 0xffffffff >> (31 - (tx1 & 31));
+		if ((gDamageTiles[ty][w] & m) != m) sys_atomic_or(&gDamageTiles[ty][w], m);
+	}
+}
+
+void damageFrameBufferRange(uint32 first, uint32 last)
+{
+	uint y0 = first / gDamageLineLength;
+	uint y1 = last / gDamageLineLength;
+	uint tx0 = (first % gDamageLineLength) / gDamageTileBytes;
+	uint tx1 = (last % gDamageLineLength) / gDamageTileBytes;
+	uint txEnd = (gDamageLineLength - 1) / gDamageTileBytes;
+	if (y0 == y1) {
+		damageTiles(y0 / DAMAGE_TILE_H, tx0, tx1);
+		return;
+	}
+	// the first and the last line are partial, the ones between are whole
+	damageTiles(y0 / DAMAGE_TILE_H, tx0, txEnd);
+	if (y1 > y0+1) {
+		for (uint ty = (y0+1) / DAMAGE_TILE_H; ty <= (y1-1) / DAMAGE_TILE_H && ty < DAMAGE_TILES_Y; ty++) {
+			damageTiles(ty, 0, txEnd);
+		}
+	}
+	damageTiles(y1 / DAMAGE_TILE_H, 0, tx1);
+}
+
+void damageFrameBufferRect(int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0) return;
+	for (uint ty = y / DAMAGE_TILE_H; ty <= (uint)(y+h-1) / DAMAGE_TILE_H; ty++) {
+		damageTiles(ty, x / DAMAGE_TILE_W, (x+w-1) / DAMAGE_TILE_W);
+	}
+}
+
+void damageFrameBufferAll()
+{
+	for (int ty=0; ty < DAMAGE_TILES_Y; ty++) {
+		damageTiles(ty, 0, DAMAGE_TILES_X-1);
+	}
+}
+
+/*
+ *	A page is marked with 2 and stays dirty for one more redraw
+ *	after it has been collected: a cpu may still store through
+ *	a cached mapping until it has handled ppc_cpu_protect_framebuffer().
+ */
+void damageFrameBufferCollect()
+{
+	bool protect = false;
+	uint32 *d = (uint32*)gFrameBufferDirty;
+	for (int i=0; i < FRAMEBUFFER_PAGES/4; i++) {
+		if (!d[i]) continue;
+		for (int j=i*4; j < i*4+4; j++) {
+			uint8 m = gFrameBufferDirty[j];
+			if (!m) continue;
+			if (m > 1) protect = true;
+			gFrameBufferDirty[j] = m-1;
+			damageFrameBufferRange(j << FRAMEBUFFER_PAGE_SHIFT, ((j+1) << FRAMEBUFFER_PAGE_SHIFT) - 1);
+		}
+	}
+	if (protect) ppc_cpu_protect_framebuffer();
+}
+
+/*
+ *	Runs of dirty tiles in a tile row become one rectangle, which
+ *	is extended downwards as long as the rows below have the same run.
+ *	If there are too many rectangles, their bounding box is returned.
+ */
+int takeDamage(const DisplayCharacteristics &chr, DamageRect *rects)
+{
+	uint tileBytes = DAMAGE_TILE_W * chr.bytesPerPixel;
+	if ((uint)chr.scanLineLength != gDamageLineLength || tileBytes != gDamageTileBytes) {
+		// damage recorded for another mode is meaningless
+		gDamageLineLength = chr.scanLineLength;
+		gDamageTileBytes = tileBytes;
+		damageFrameBufferAll();
+	}
+	damageFrameBufferCollect();
+
+	int tilesX = MIN((chr.width + DAMAGE_TILE_W-1) / DAMAGE_TILE_W, DAMAGE_TILES_X);
+	int tilesY = MIN((chr.height + DAMAGE_TILE_H-1) / DAMAGE_TILE_H, DAMAGE_TILES_Y);
+	int count = 0;
+	bool overflow = false;
+	int x0 = chr.width, y0 = chr.height, x1 = 0, y1 = 0;
+	for (int ty=0; ty < DAMAGE_TILES_Y; ty++) {
+		uint32 row[DAMAGE_TILE_WORDS];
+		bool any = false;
+		for (int w=0; w < DAMAGE_TILE_WORDS; w++) {
+			row[w] = gDamageTiles[ty][w] ? sys_atomic_take(&gDamageTiles[ty][w]) : 0;
+			any |= row[w];
+		}
+		if (!any || ty >= tilesY) continue;
+		int y = ty * DAMAGE_TILE_H;
+		int h = MIN(y + DAMAGE_TILE_H, chr.height) - y;
+		int tx = 0;
+		while (tx < tilesX) {
+			if (!(row[tx >> 5] & (1 << (tx & 31)))) {
+				tx++;
+				continue;
+			}
+			int start = tx;
+			while (tx < tilesX && (row[tx >> 5] & (1 << (tx & 31)))) tx++;
+			int x = start * DAMAGE_TILE_W;
+			int w = MIN(tx * DAMAGE_TILE_W, chr.width) - x;
+			x0 = MIN(x0, x);
+			y0 = MIN(y0, y);
+			x1 = MAX(x1, x + w);
+			y1 = MAX(y1, y + h);
+			int i;
+			for (i=0; i < count; i++) {
+				if (rects[i].x == x && rects[i].w == w && rects[i].y + rects[i].h == y) {
+					rects[i].h += h;
+					break;
+				}
+			}
+			if (i < count) continue;
+			if (count < DAMAGE_RECTS_MAX) {
+				rects[count].x = x;
+				rects[count].y = y;
+				rects[count].w = w;
+				rects[count].h = h;
+				count++;
+			} else {
+				overflow = true;
+			}
+		}
+	}
+	if (overflow) {
+		rects[0].x = x0;
+		rects[0].y = y0;
+		rects[0].w = x1 - x0;
+		rects[0].h = y1 - y0;
+		return 1;
+	}
+	return count;
+}
+
+static inline uint popCount(uint32 v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+/*
+ *	Number of damaged tiles and dirty pages, without taking them.
+ *	Only used to see whether the damage is still growing.
+ */
+static uint damageCount()
+{
+	uint n = 0;
+	for (int ty=0; ty < DAMAGE_TILES_Y; ty++) {
+		for (int w=0; w < DAMAGE_TILE_WORDS; w++) {
+			if (gDamageTiles[ty][w]) n += popCount(gDamageTiles[ty][w]);
+		}
+	}
+	uint32 *d = (uint32*)gFrameBufferDirty;
+	for (int i=0; i < FRAMEBUFFER_PAGES/4; i++) {
+		if (!d[i]) continue;
+		for (int j=i*4; j < i*4+4; j++) {
+			if (gFrameBufferDirty[j]) n++;
+		}
+	}
+	return n;
+}
+
+byte *allocFrameBuffer()
+{
+	if (!gFrameBuffer) {
+		gFrameBuffer = (byte*)malloc(FRAMEBUFFER_MAX_SIZE);
+		if (!gFrameBuffer) throw std::bad_alloc();
+		memset(gFrameBuffer, 0, FRAMEBUFFER_MAX_SIZE);
+	}
+	return gFrameBuffer;
+}
+
+void freeFrameBuffer()
+{
+	free(gFrameBuffer);
+	gFrameBuffer = NULL;
+}
 
 #define IS_FGTRANS(c) (VC_GET_BASECOLOR(VCP_FOREGROUND((c)))==VC_TRANSPARENT)
 #define IS_BGTRANS(c) (VC_GET_BASECOLOR(VCP_BACKGROUND((c)))==VC_TRANSPARENT)
@@ -142,6 +338,52 @@ SystemDisplay::SystemDisplay(const DisplayCharacteristics &aClientChr, int redra
 	mFullscreen = false;
 
 	mExposed = false;
+
+	mNextFrameClk = 0;
+	mNextCheckClk = 0;
+	mDamageClk = 0;
+	mDamageCount = 0;
+
+	// a gray ramp until the guest sets its colors
+	for (int i=0; i < 256; i++) palette[i] = MK_RGB(i, i, i);
+	mPaletteGen = 1;
+	mPaletteLUTGen = 0;
+}
+
+bool SystemDisplay::frameTick(uint64 clk, uint64 &next)
+{
+	uint64 freq = sys_get_hiresclk_ticks_per_second();
+	int hz = mClientChar.vsyncFrequency > 0 ? mClientChar.vsyncFrequency : 60;
+	uint64 frame = freq / hz;
+	if (clk >= mNextFrameClk) {
+		// one VBL, even if frames were missed
+		gcard_raise_interrupt();
+		mNextFrameClk = clk + frame - (clk - mNextFrameClk) % frame;
+	}
+	bool show = false;
+	if (clk >= mNextCheckClk) {
+		uint n = damageCount();
+		if (!n) {
+			mDamageClk = 0;
+		} else {
+			if (!mDamageClk) mDamageClk = clk;
+			// settled, or drawing for too long
+			if (n == mDamageCount || clk - mDamageClk >= mRedraw_ms * freq / 1000) {
+				show = true;
+				mDamageClk = 0;
+			}
+		}
+		if (show) {
+			// the ui takes the damage, count what comes after it
+			mDamageCount = 0;
+			mNextCheckClk = clk + frame;
+		} else {
+			mDamageCount = n;
+			mNextCheckClk = clk + MAX(frame / 4, freq / 1000);
+		}
+	}
+	next = MIN(mNextFrameClk, mNextCheckClk);
+	return show;
 }
 
 SystemDisplay::~SystemDisplay()
@@ -323,7 +565,12 @@ void SystemDisplay::fillRGB(int x, int y, int w, int h, RGB rgb)
 
 void SystemDisplay::setColor(int idx, RGB color)
 {
-	if (idx >= 0 && idx < 256) palette[idx] = color;
+	if (idx >= 0 && idx < 256) {
+		palette[idx] = color;
+		mPaletteGen++;
+		// the pixels stay the same but show another color
+		if (mClientChar.bytesPerPixel == 1) damageFrameBufferAll();
+	}
 }
 
 RGB  SystemDisplay::getColor(int idx)
@@ -332,6 +579,39 @@ RGB  SystemDisplay::getColor(int idx)
 	return 0;
 }
 
+const uint32 *SystemDisplay::paletteLUT(const DisplayCharacteristics &aHostChar)
+{
+	uint gen = mPaletteGen;
+	if (gen != mPaletteLUTGen || mPaletteLUTChar.compareTo(&aHostChar) != 0) {
+		pixconv_build_lut(aHostChar, palette, mPaletteLUT);
+		mPaletteLUTChar = aHostChar;
+		mPaletteLUTGen = gen;
+	}
+	return mPaletteLUT;
+}
+
+/*
+ *	The palette index closest to rgb, for drawing
+ *	into indexed modes.
+ */
+byte SystemDisplay::findColor(RGB rgb)
+{
+	int best = 0;
+	uint bestDist = (uint)-1;
+	for (int i=0; i < 256; i++) {
+		int dr = RGB_R(palette[i]) - RGB_R(rgb);
+		int dg = RGB_G(palette[i]) - RGB_G(rgb);
+		int db = RGB_B(palette[i]) - RGB_B(rgb);
+		uint dist = dr*dr + dg*dg + db*db;
+		if (dist < bestDist) {
+			bestDist = dist;
+			best = i;
+			if (!dist) break;
+		}
+	}
+	return best;
+}
+
 void SystemDisplay::fillRGBA(int x, int y, int w, int h, RGBA rgba)
 {
 	while (h--) {
@@ -526,7 +806,7 @@ void SystemDisplay::mixRGB(byte *pixel, RGB rgb)
 		| (b << mClientChar.blueShift);
 	switch (mClientChar.bytesPerPixel) {
 	case 1:
-		pixel[0] = rgb;
+		pixel[0] = findColor(rgb);
 		break;
 	case 2:
 		pixel[0] = p>>8;
@@ -547,6 +827,12 @@ void SystemDisplay::mixRGBA(byte *pixel, RGBA rgba)
 	uint g = RGBA_G(rgba);
 	uint b = RGBA_B(rgba);
 	uint a = RGBA_A(rgba);
+	if (mClientChar.bytesPerPixel == 1) {
+		RGB c = palette[pixel[0]];
+		pixel[0] = findColor(MK_RGB((r*a + RGB_R(c)*(255-a))/255,
+			(g*a + RGB_G(c)*(255-a))/255, (b*a + RGB_B(c)*(255-a))/255));
+		return;
+	}
 	convertBaseColor(r, 8, mClientChar.redSize);
 	convertBaseColor(g, 8, mClientChar.greenSize);
 	convertBaseColor(b, 8, mClientChar.blueSize);
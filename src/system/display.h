@@ -25,6 +25,7 @@
 #include "tools/stream.h"
 #include "types.h"
 #include "keyboard.h"
+#include "sysatomic.h"
 
 /* codepages */
 
@@ -37,31 +38,82 @@
 #define	GC_TRANSPARENT		'0'		// transparent
 
 extern byte *	gFrameBuffer;
-extern int 	gDamageAreaFirstAddr, gDamageAreaLastAddr;
+
+/*
+ *	Damage is tracked in tiles of DAMAGE_TILE_W x DAMAGE_TILE_H
+ *	pixels, one bit per tile. Bits are set with atomic or's from
+ *	any thread and taken by the redraw thread with an atomic
+ *	exchange (see takeDamage()), so no damage is lost.
+ */
+#define DAMAGE_TILE_W		64
+#define DAMAGE_TILE_H		16
+#define DAMAGE_TILES_X		64	// 4096 pixels
+#define DAMAGE_TILES_Y		256	// 4096 lines
+#define DAMAGE_TILE_WORDS	(DAMAGE_TILES_X / 32)
+
+extern uint32	gDamageTiles[DAMAGE_TILES_Y][DAMAGE_TILE_WORDS];
+extern uint	gDamageLineLength;	// scanLineLength of the client mode
+extern uint	gDamageTileBytes;	// DAMAGE_TILE_W * bytesPerPixel
 
 inline void damageFrameBuffer(int addr)
 {
-	if (addr < gDamageAreaFirstAddr) {
-		gDamageAreaFirstAddr = addr;
-	}
-
-	if (addr > gDamageAreaLastAddr) {
-		gDamageAreaLastAddr = addr;
+	uint ty = ((uint)addr / gDamageLineLength) / DAMAGE_TILE_H;
+	uint tx = ((uint)addr % gDamageLineLength) / gDamageTileBytes;
+	if (ty < DAMAGE_TILES_Y && tx < DAMAGE_TILES_X) {
+		uint32 *w = &gDamageTiles[ty][tx >> 5];
+		uint32 m = 1 << (tx & 31);
+		if (!(*w & m)) sys_atomic_or(w, m);
 	}
 }
 
-inline void damageFrameBufferAll()
-{
-	gDamageAreaFirstAddr = 0;
-	gDamageAreaLastAddr = 0xffffff0;
-}
+// damages all tiles touched by the bytes first..last
+void damageFrameBufferRange(uint32 first, uint32 last);
+// damages all tiles touched by the rectangle (in pixels)
+void damageFrameBufferRect(int x, int y, int w, int h);
+void damageFrameBufferAll();
+
+struct DamageRect {
+	int x, y, w, h;
+};
+
+#define DAMAGE_RECTS_MAX	64
+
+/*
+ *	The cpu accesses the framebuffer like RAM, so stores
+ *	don't pass damageFrameBuffer(). Instead they mark their page
+ *	in gFrameBufferDirty, damageFrameBufferCollect() turns these
+ *	marks into the damage area and has to be called before
+ *	each redraw.
+ */
+#define FRAMEBUFFER_MAX_SIZE	0x1000000
+#define FRAMEBUFFER_PAGE_SHIFT	12
+#define FRAMEBUFFER_PAGES	(FRAMEBUFFER_MAX_SIZE >> FRAMEBUFFER_PAGE_SHIFT)
+
+extern uint8	gFrameBufferDirty[FRAMEBUFFER_PAGES];
 
-inline void healFrameBuffer()
+inline void damageFrameBufferPage(uint32 addr)
 {
-	gDamageAreaFirstAddr = 0xffffff0;
-	gDamageAreaLastAddr = 0;
+	gFrameBufferDirty[addr >> FRAMEBUFFER_PAGE_SHIFT] = 2;
 }
 
+void damageFrameBufferCollect();
+
+class DisplayCharacteristics;
+/*
+ *	Collects and clears the damage and merges the damaged tiles
+ *	into at most DAMAGE_RECTS_MAX rectangles, clipped to chr.
+ *	Returns the number of rectangles (0 if nothing has changed).
+ */
+int takeDamage(const DisplayCharacteristics &chr, DamageRect *rects);
+
+/*
+ *	gFrameBuffer is allocated once with FRAMEBUFFER_MAX_SIZE
+ *	so it doesn't move when the resolution changes (the cpu may
+ *	have cached host pointers into it).
+ */
+byte *allocFrameBuffer();
+void freeFrameBuffer();
+
 /* virtual colors */
 
 typedef int vc;
@@ -181,6 +233,12 @@ protected:
 	int		mVTDY;
 	bool		mExposed;
 	RGB		palette[256]; // only used in indexed modes
+	volatile uint	mPaletteGen;	// incremented by setColor()
+	uint		mPaletteLUTGen;
+	DisplayCharacteristics	mPaletteLUTChar;
+	uint32		mPaletteLUT[256];
+
+		byte	findColor(RGB rgb);
 
 	/* hw cursor */
 	int		mHWCursorX, mHWCursorY;
@@ -210,6 +268,12 @@ public: // until we know better
 	}
 
 	void	mixRGB();
+
+	/* frame pacing */
+	uint64		mNextFrameClk;
+	uint64		mNextCheckClk;
+	uint64		mDamageClk;
+	uint		mDamageCount;
 public:
 	DisplayCharacteristics	mClientChar;
 	BufferedChar	*buf;
@@ -219,6 +283,17 @@ public:
 
 	virtual void	displayShow() = 0;
 
+	/*
+	 *	Frame pacing, called by the ui's redraw loop at clk (hires
+	 *	clock) and again at next. The guest's VBL interrupt is raised
+	 *	once per frame of the client mode's vsyncFrequency. Returns
+	 *	true if displayShow() should be called: when there is damage
+	 *	that hasn't grown since the last check (a burst of drawing
+	 *	has settled) or that is mRedraw_ms old (continuous drawing),
+	 *	at most once per frame. Without damage nothing is presented.
+	 */
+	bool	frameTick(uint64 clk, uint64 &next);
+
 	/*
 	 *	Note: this function might do different things when in / not in fullscreen
 	 *	mode.
@@ -251,6 +326,13 @@ public:
 		void setHWCursor(int x, int y, bool visible, byte *data);
 		void setColor(int idx, RGB color);
 		RGB  getColor(int idx);
+		uint paletteGeneration() const { return mPaletteGen; }
+	/*
+	 *	The palette as pixels of aHostChar (host byte order), to
+	 *	convert an indexed client mode with. Rebuilt if the palette
+	 *	or aHostChar changed since the last call.
+	 */
+		const uint32 *paletteLUT(const DisplayCharacteristics &aHostChar);
 		void fillRGB(int x, int y, int w, int h, RGB rgb);
 		void fillRGBA(int x, int y, int w, int h, RGBA rgba);
 		void mixRGB(byte *pixel, RGB rgb);
@@ -24,6 +24,7 @@
 #include "tools/snprintf.h"
 #include "keyboard.h"
 #include "display.h"
+#include "snapshot.h"
 
 SystemKeyboard *gKeyboard = NULL;
 
@@ -93,6 +94,9 @@ bool SystemKeyboard::handleEvent(const SystemEvent &ev)
 	} else if (keycode == keyConfig.key_compose_dialog) {
 		if (ev.key.pressed) gDisplay->composeKeyDialog();
 		return true;
+	} else if (keycode == keyConfig.key_save_snapshot) {
+		if (ev.key.pressed) snapshot_request_save();
+		return true;
 	} else {
 		return SystemDevice::handleEvent(ev);
 	}
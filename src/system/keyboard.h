@@ -164,6 +164,7 @@ struct KeyboardCharacteristics
 	int key_compose_dialog;
 	int key_toggle_mouse_grab;
 	int key_toggle_full_screen;
+	int key_save_snapshot;
 };
 
 #include "tools/str.h"
@@ -40,6 +40,7 @@
 #endif
 
 #include "system/file.h"
+#include "system/sys.h"
 
 #include <dirent.h>
 
@@ -280,21 +281,65 @@ FileOfs	sys_ftell(SYS_FILE *file)
 
 void *sys_alloc_read_write_execute(int size)
 {
-	void *p = malloc(size+PAGESIZE-1);
-	if (!p) return NULL;
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+	return p;
+}
 
-	void *ret = (void *)(((ptrdiff_t)p + PAGESIZE-1) & ~(PAGESIZE-1));
+void sys_free_read_write_execute(void *p)
+{
+	// do nothing :(
+}
 
-	if (mprotect(ret, size, PROT_READ | PROT_WRITE | PROT_EXEC)) {
-		free(p);
-		return NULL;
+void *sys_alloc_memory(uint size, int flags)
+{
+	int mflags = MAP_PRIVATE | MAP_ANONYMOUS;
+	if (flags & SYS_ALLOC_PREFAULT) {
+#ifdef MAP_POPULATE
+		mflags |= MAP_POPULATE;
+#endif
+	} else {
+#ifdef MAP_NORESERVE
+		mflags |= MAP_NORESERVE;
+#endif
 	}
-	return ret;
+	void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if (flags & SYS_ALLOC_HUGEPAGES) {
+		// only works if the admin has reserved huge pages
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, mflags | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	if (p == MAP_FAILED) {
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE, mflags, -1, 0);
+		if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+		// transparent huge pages
+		if (flags & SYS_ALLOC_HUGEPAGES) madvise(p, size, MADV_HUGEPAGE);
+#endif
+	}
+#ifdef MADV_MERGEABLE
+	if (flags & SYS_ALLOC_MERGEABLE) madvise(p, size, MADV_MERGEABLE);
+#endif
+	return p;
 }
 
-void sys_free_read_write_execute(void *p)
+void sys_free_memory(void *p, uint size)
 {
-	// do nothing :(
+	if (p) munmap(p, size);
+}
+
+void *sys_map_file_memory(const char *filename, FileOfs ofs, uint size)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return NULL;
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, ofs);
+	// the mapping keeps its own reference to the file
+	close(fd);
+	return (p == MAP_FAILED) ? NULL : p;
 }
 
 #endif
@@ -22,9 +22,11 @@
 
 #ifndef TARGET_COMPILER_VC
 
+#include <cstdlib>
 #include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 
 #include "system/sys.h"
 
@@ -38,4 +40,19 @@ void doneOSAPI()
 {
 }
 
+int sys_fork_instances(int count)
+{
+	int failed = 0;
+	for (int i=0; i < count; i++) {
+		pid_t pid = fork();
+		if (pid == 0) return i;
+		if (pid < 0) failed++;
+	}
+	int status;
+	while (wait(&status) > 0) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) failed++;
+	}
+	exit(failed ? 1 : 0);
+}
+
 #endif
@@ -446,4 +446,21 @@ void sys_free_read_write_execute(void *p)
 	VirtualFree(p, 0, MEM_DECOMMIT | MEM_RELEASE);
 }
 
+void *sys_alloc_memory(uint size, int flags)
+{
+	// committed pages are demand-zero, large pages need a privilege
+	return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void sys_free_memory(void *p, uint size)
+{
+	if (p) VirtualFree(p, 0, MEM_RELEASE);
+}
+
+void *sys_map_file_memory(const char *filename, FileOfs ofs, uint size)
+{
+	// callers fall back to reading the file
+	return NULL;
+}
+
 #endif
@@ -42,5 +42,10 @@ void doneOSAPI()
 {
 }
 
+int sys_fork_instances(int count)
+{
+	return -1;
+}
+
 #endif
 
@@ -0,0 +1,313 @@
+/*
+ *	PearPC
+ *	pixconv.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include "system/display.h"
+#include "system/pixconv.h"
+#include "tools/snprintf.h"
+
+/*
+ *	Scalar kernels. Like the generic converter, color
+ *	components are widened by shifting only.
+ */
+static void scalar_2be555_to_2_555(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		((uint16*)dest)[i] = (src[0] << 8) | src[1];
+		src += 2;
+	}
+}
+
+static void scalar_2be555_to_2_565(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		uint p = (src[0] << 8) | src[1];
+		((uint16*)dest)[i] = ((p & 0x7fe0) << 1) | (p & 0x1f);
+		src += 2;
+	}
+}
+
+static inline uint32 scalar_555_to_888(uint p)
+{
+	return ((p & 0x7c00) << 9) | ((p & 0x3e0) << 6) | ((p & 0x1f) << 3);
+}
+
+static void scalar_2be555_to_3_888(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		uint32 p = scalar_555_to_888((src[0] << 8) | src[1]);
+		dest[0] = p; dest[1] = p>>8; dest[2] = p>>16;
+		src += 2;
+		dest += 3;
+	}
+}
+
+static void scalar_2be555_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		((uint32*)dest)[i] = scalar_555_to_888((src[0] << 8) | src[1]);
+		src += 2;
+	}
+}
+
+static void scalar_4be888_to_2_555(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		((uint16*)dest)[i] = ((src[1] & 0xf8) << 7) | ((src[2] & 0xf8) << 2) | (src[3] >> 3);
+		src += 4;
+	}
+}
+
+static void scalar_4be888_to_2_565(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		((uint16*)dest)[i] = ((src[1] & 0xf8) << 8) | ((src[2] & 0xfc) << 3) | (src[3] >> 3);
+		src += 4;
+	}
+}
+
+static void scalar_4be888_to_3_888(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		dest[0] = src[3]; dest[1] = src[2]; dest[2] = src[1];
+		src += 4;
+		dest += 3;
+	}
+}
+
+static void scalar_4be888_to_4_888(uint32 pixel, const byte *src, byte *dest)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		((uint32*)dest)[i] = (src[1] << 16) | (src[2] << 8) | src[3];
+		src += 4;
+	}
+}
+
+static void scalar_lut_to_1(uint32 pixel, const byte *src, byte *dest, const uint32 *lut)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		dest[i] = lut[src[i]];
+	}
+}
+
+static void scalar_lut_to_2(uint32 pixel, const byte *src, byte *dest, const uint32 *lut)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		((uint16*)dest)[i] = lut[src[i]];
+	}
+}
+
+static void scalar_lut_to_3(uint32 pixel, const byte *src, byte *dest, const uint32 *lut)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		uint32 p = lut[src[i]];
+		dest[0] = p; dest[1] = p>>8; dest[2] = p>>16;
+		dest += 3;
+	}
+}
+
+static void scalar_lut_to_4(uint32 pixel, const byte *src, byte *dest, const uint32 *lut)
+{
+	for (uint32 i=0; i < pixel; i++) {
+		((uint32*)dest)[i] = lut[src[i]];
+	}
+}
+
+static PixConvLine gKernels[PIXCONV_LEVELS][PIXCONV_SRC_FORMATS][PIXCONV_DEST_FORMATS];
+static PixConvLUTLine gLUTKernels[PIXCONV_LEVELS][5];
+static PixConvLevel gHostLevel;
+static PixConvLevel gLevel;
+static bool gInitialized = false;
+
+static void pixconv_init()
+{
+	PixConvLine (*k)[PIXCONV_DEST_FORMATS] = gKernels[PIXCONV_SCALAR];
+	k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_555] = scalar_2be555_to_2_555;
+	k[PIXCONV_SRC_2BE555][PIXCONV_DEST_2_565] = scalar_2be555_to_2_565;
+	k[PIXCONV_SRC_2BE555][PIXCONV_DEST_3_888] = scalar_2be555_to_3_888;
+	k[PIXCONV_SRC_2BE555][PIXCONV_DEST_4_888] = scalar_2be555_to_4_888;
+	k[PIXCONV_SRC_4BE888][PIXCONV_DEST_2_555] = scalar_4be888_to_2_555;
+	k[PIXCONV_SRC_4BE888][PIXCONV_DEST_2_565] = scalar_4be888_to_2_565;
+	k[PIXCONV_SRC_4BE888][PIXCONV_DEST_3_888] = scalar_4be888_to_3_888;
+	k[PIXCONV_SRC_4BE888][PIXCONV_DEST_4_888] = scalar_4be888_to_4_888;
+	gLUTKernels[PIXCONV_SCALAR][1] = scalar_lut_to_1;
+	gLUTKernels[PIXCONV_SCALAR][2] = scalar_lut_to_2;
+	gLUTKernels[PIXCONV_SCALAR][3] = scalar_lut_to_3;
+	gLUTKernels[PIXCONV_SCALAR][4] = scalar_lut_to_4;
+
+	gHostLevel = PIXCONV_SCALAR;
+#ifdef PIXCONV_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) gHostLevel = PIXCONV_SSE2;
+	if (gHostLevel == PIXCONV_SSE2 && __builtin_cpu_supports("ssse3")) gHostLevel = PIXCONV_SSSE3;
+	if (gHostLevel == PIXCONV_SSSE3 && __builtin_cpu_supports("avx2")) gHostLevel = PIXCONV_AVX2;
+	for (int l=PIXCONV_SSE2; l <= gHostLevel; l++) {
+		pixconv_x86_kernels((PixConvLevel)l, gKernels[l]);
+		pixconv_x86_lut_kernels((PixConvLevel)l, gLUTKernels[l]);
+	}
+#endif
+	// a level inherits the kernels it doesn't have from the one below
+	for (int l=PIXCONV_SCALAR+1; l <= gHostLevel; l++) {
+		for (int s=0; s < PIXCONV_SRC_FORMATS; s++) {
+			for (int d=0; d < PIXCONV_DEST_FORMATS; d++) {
+				if (!gKernels[l][s][d]) gKernels[l][s][d] = gKernels[l-1][s][d];
+			}
+		}
+		for (int b=1; b <= 4; b++) {
+			if (!gLUTKernels[l][b]) gLUTKernels[l][b] = gLUTKernels[l-1][b];
+		}
+	}
+	gLevel = gHostLevel;
+	gInitialized = true;
+}
+
+static bool isFormat(const DisplayCharacteristics &c, int bpp,
+	int rs, int rz, int gs, int gz, int bs, int bz)
+{
+	return c.bytesPerPixel == bpp
+		&& c.redShift == rs && c.redSize == rz
+		&& c.greenShift == gs && c.greenSize == gz
+		&& c.blueShift == bs && c.blueSize == bz;
+}
+
+PixConvLine pixconv_get(const DisplayCharacteristics &aSrcChar, const DisplayCharacteristics &aDestChar)
+{
+	PixConvSrcFormat s;
+	PixConvDestFormat d;
+	if (isFormat(aSrcChar, 2, 10, 5, 5, 5, 0, 5)) {
+		s = PIXCONV_SRC_2BE555;
+	} else if (isFormat(aSrcChar, 4, 16, 8, 8, 8, 0, 8)) {
+		s = PIXCONV_SRC_4BE888;
+	} else {
+		return NULL;
+	}
+	if (isFormat(aDestChar, 2, 10, 5, 5, 5, 0, 5)) {
+		d = PIXCONV_DEST_2_555;
+	} else if (isFormat(aDestChar, 2, 11, 5, 5, 6, 0, 5)) {
+		d = PIXCONV_DEST_2_565;
+	} else if (isFormat(aDestChar, 3, 16, 8, 8, 8, 0, 8)) {
+		d = PIXCONV_DEST_3_888;
+	} else if (isFormat(aDestChar, 4, 16, 8, 8, 8, 0, 8)) {
+		d = PIXCONV_DEST_4_888;
+	} else {
+		return NULL;
+	}
+	return pixconv_get_kernel(pixconv_level(), s, d);
+}
+
+PixConvLine pixconv_get_kernel(PixConvLevel level, PixConvSrcFormat src, PixConvDestFormat dest)
+{
+	if (!gInitialized) pixconv_init();
+	if (level > gHostLevel) return NULL;
+	return gKernels[level][src][dest];
+}
+
+void pixconv_build_lut(const DisplayCharacteristics &aDestChar, const RGB *palette, uint32 *lut)
+{
+	for (int i=0; i < 256; i++) {
+		uint r = RGB_R(palette[i]);
+		uint g = RGB_G(palette[i]);
+		uint b = RGB_B(palette[i]);
+		SystemDisplay::convertBaseColor(r, 8, aDestChar.redSize);
+		SystemDisplay::convertBaseColor(g, 8, aDestChar.greenSize);
+		SystemDisplay::convertBaseColor(b, 8, aDestChar.blueSize);
+		lut[i] = (r << aDestChar.redShift) | (g << aDestChar.greenShift)
+			| (b << aDestChar.blueShift);
+	}
+}
+
+PixConvLUTLine pixconv_get_lut(int destBytesPerPixel)
+{
+	return pixconv_get_lut_kernel(pixconv_level(), destBytesPerPixel);
+}
+
+PixConvLUTLine pixconv_get_lut_kernel(PixConvLevel level, int destBytesPerPixel)
+{
+	if (!gInitialized) pixconv_init();
+	if (level > gHostLevel) return NULL;
+	if (destBytesPerPixel < 1 || destBytesPerPixel > 4) return NULL;
+	return gLUTKernels[level][destBytesPerPixel];
+}
+
+void pixconv_convert_indexed_rect(
+	const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar,
+	const uint32 *lut,
+	const void *aSrcBuf,
+	void *aDestBuf,
+	int x, int y, int w, int h)
+{
+	PixConvLUTLine convert = pixconv_get_lut(aDestChar.bytesPerPixel);
+	if (!convert) {
+		ht_printf("internal error in %s:%d\n", __FILE__, __LINE__);
+		exit(1);
+	}
+	const byte *src = (const byte*)aSrcBuf + aSrcChar.scanLineLength * y + x;
+	byte *dest = (byte*)aDestBuf + aDestChar.scanLineLength * y + aDestChar.bytesPerPixel * x;
+	if (x == 0 && w == aSrcChar.width
+	 && aSrcChar.scanLineLength == w
+	 && aDestChar.scanLineLength == w * aDestChar.bytesPerPixel) {
+		// whole lines, convert them in one go
+		convert(w * h, src, dest, lut);
+		return;
+	}
+	for (int line=0; line < h; line++) {
+		convert(w, src, dest, lut);
+		src += aSrcChar.scanLineLength;
+		dest += aDestChar.scanLineLength;
+	}
+}
+
+PixConvLevel pixconv_host_level()
+{
+	if (!gInitialized) pixconv_init();
+	return gHostLevel;
+}
+
+PixConvLevel pixconv_level()
+{
+	if (!gInitialized) pixconv_init();
+	return gLevel;
+}
+
+void pixconv_set_level(PixConvLevel level)
+{
+	if (!gInitialized) pixconv_init();
+	gLevel = MIN(level, gHostLevel);
+}
+
+const char *pixconv_level_name(PixConvLevel level)
+{
+	static const char *names[PIXCONV_LEVELS] = {"scalar", "sse2", "ssse3", "avx2"};
+	return names[level];
+}
+
+const char *pixconv_src_name(PixConvSrcFormat src)
+{
+	static const char *names[PIXCONV_SRC_FORMATS] = {"be555", "be888"};
+	return names[src];
+}
+
+const char *pixconv_dest_name(PixConvDestFormat dest)
+{
+	static const char *names[PIXCONV_DEST_FORMATS] = {"555", "565", "888/24", "888/32"};
+	return names[dest];
+}
@@ -0,0 +1,116 @@
+/*
+ *	PearPC
+ *	pixconv.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SYSTEM_PIXCONV_H__
+#define __SYSTEM_PIXCONV_H__
+
+#include "system/types.h"
+#include "system/display.h"
+
+/*
+ *	Specialized pixel conversion kernels for the common
+ *	guest -> host formats, used by sys_convert_display().
+ *
+ *	Guest pixels are big-endian, host pixels are stored in
+ *	host byte order (24 bit pixels least significant byte first).
+ */
+enum PixConvSrcFormat {
+	PIXCONV_SRC_2BE555,
+	PIXCONV_SRC_4BE888,
+	PIXCONV_SRC_FORMATS,
+};
+
+enum PixConvDestFormat {
+	PIXCONV_DEST_2_555,
+	PIXCONV_DEST_2_565,
+	PIXCONV_DEST_3_888,
+	PIXCONV_DEST_4_888,
+	PIXCONV_DEST_FORMATS,
+};
+
+enum PixConvLevel {
+	PIXCONV_SCALAR,
+	PIXCONV_SSE2,
+	PIXCONV_SSSE3,
+	PIXCONV_AVX2,
+	PIXCONV_LEVELS,
+};
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#	define PIXCONV_X86_SIMD
+#endif
+
+/*
+ *	Converts pixel pixels from src to dest.
+ *	Any count and any alignment is allowed.
+ */
+typedef void (*PixConvLine)(uint32 pixel, const byte *src, byte *dest);
+
+/*
+ *	Returns the kernel of the best level the host supports
+ *	(or the one set by pixconv_set_level()) for this pair of
+ *	formats, NULL if there is no specialized kernel.
+ */
+PixConvLine	pixconv_get(const DisplayCharacteristics &aSrcChar, const DisplayCharacteristics &aDestChar);
+
+/*
+ *	Returns the kernel of exactly this level or NULL.
+ *	For benchmarks.
+ */
+PixConvLine	pixconv_get_kernel(PixConvLevel level, PixConvSrcFormat src, PixConvDestFormat dest);
+
+/*
+ *	8 bit indexed guest pixels are converted by looking them up
+ *	in a table of the 256 palette colors as destination pixels
+ *	(host byte order), made by pixconv_build_lut(). So the kernels
+ *	only depend on the size of the destination pixels (1 to 4 bytes).
+ */
+typedef void (*PixConvLUTLine)(uint32 pixel, const byte *src, byte *dest, const uint32 *lut);
+
+void		pixconv_build_lut(const DisplayCharacteristics &aDestChar, const RGB *palette, uint32 *lut);
+PixConvLUTLine	pixconv_get_lut(int destBytesPerPixel);
+PixConvLUTLine	pixconv_get_lut_kernel(PixConvLevel level, int destBytesPerPixel);
+void		pixconv_convert_indexed_rect(
+	const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar,
+	const uint32 *lut,
+	const void *aSrcBuf,
+	void *aDestBuf,
+	int x, int y, int w, int h);
+
+PixConvLevel	pixconv_host_level();
+PixConvLevel	pixconv_level();
+// restricts the kernels used to level (at most the host level)
+void		pixconv_set_level(PixConvLevel level);
+const char *	pixconv_level_name(PixConvLevel level);
+const char *	pixconv_src_name(PixConvSrcFormat src);
+const char *	pixconv_dest_name(PixConvDestFormat dest);
+
+#ifdef PIXCONV_X86_SIMD
+/*
+ *	Provided by system/arch/x86/pixconv_simd.cc.
+ *	Fills in the kernels it has for level (NULL otherwise).
+ */
+void	pixconv_x86_kernels(PixConvLevel level, PixConvLine k[PIXCONV_SRC_FORMATS][PIXCONV_DEST_FORMATS]);
+// k is indexed by the destination bytes per pixel
+void	pixconv_x86_lut_kernels(PixConvLevel level, PixConvLUTLine k[5]);
+#endif
+
+#endif
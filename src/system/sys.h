@@ -21,6 +21,9 @@
 #ifndef __SYS_H__
 #define __SYS_H__
 
+#include "system/types.h"
+#include "system/fileofs.h"
+
 extern char gAppFilename[260];
 
 /* system-dependent (implementation in $MYSYSTEM/ *.cc) */
@@ -45,6 +48,31 @@ int		sys_native_clipboard_get_size();
 void *		sys_alloc_read_write_execute(int size);
 void		sys_free_read_write_execute(void *p);
 
+/*
+ *	Allocates size bytes of zeroed, page aligned memory.
+ *	Pages are committed on first touch unless SYS_ALLOC_PREFAULT
+ *	is given, the other flags are hints and may be ignored.
+ */
+#define SYS_ALLOC_HUGEPAGES		1
+#define SYS_ALLOC_MERGEABLE		2
+#define SYS_ALLOC_PREFAULT		4
+void *		sys_alloc_memory(uint size, int flags);
+void		sys_free_memory(void *p, uint size);
+
+/*
+ *	Maps size bytes of filename at ofs copy-on-write, writes
+ *	don't go to the file. ofs must be page aligned.
+ *	Returns NULL if not supported. Free with sys_free_memory().
+ */
+void *		sys_map_file_memory(const char *filename, FileOfs ofs, uint size);
+
+/*
+ *	Forks count copies of the process and waits for them,
+ *	the parent exits afterwards. Returns the copy's index
+ *	(0..count-1) in the copies or -1 if not supported.
+ */
+int		sys_fork_instances(int count);
+
 bool initOSAPI();
 void doneOSAPI();
 
@@ -0,0 +1,70 @@
+/*
+ *	PearPC
+ *	sysatomic.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SYSATOMIC_H__
+#define __SYSATOMIC_H__
+
+#include "types.h"
+
+#ifdef TARGET_COMPILER_VC
+#	include <intrin.h>
+#endif
+
+/*
+ *	Thread-local storage and the few atomic operations shared
+ *	between threads, for every compiler PearPC is built with.
+ */
+#ifdef TARGET_COMPILER_VC
+#	define SYS_THREAD_LOCAL	__declspec(thread)
+#else
+#	define SYS_THREAD_LOCAL	__thread
+#endif
+
+// *p |= v
+static inline void sys_atomic_or(volatile uint32 *p, uint32 v)
+{
+#ifdef TARGET_COMPILER_VC
+	_InterlockedOr((volatile long *)p, v);
+#else
+	__sync_fetch_and_or(p, v);
+#endif
+}
+
+// sets *p to 0 and returns the old value
+static inline uint32 sys_atomic_take(volatile uint32 *p)
+{
+#ifdef TARGET_COMPILER_VC
+	return _InterlockedExchange((volatile long *)p, 0);
+#else
+	return __sync_lock_test_and_set(p, 0);
+#endif
+}
+
+// stores v if *p is old, returns whether it did
+static inline bool sys_atomic_cas(volatile uint32 *p, uint32 old, uint32 v)
+{
+#ifdef TARGET_COMPILER_VC
+	return (uint32)_InterlockedCompareExchange((volatile long *)p, v, old) == old;
+#else
+	return __sync_bool_compare_and_swap(p, old, v);
+#endif
+}
+
+#endif
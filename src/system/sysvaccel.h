@@ -33,4 +33,15 @@ void sys_convert_display(
 	int firstLine,
 	int lastLine);
 
+/*
+ *	Converts the rectangle x, y, w, h only. Both buffers are
+ *	addressed by their scanLineLength.
+ */
+void sys_convert_display_rect(
+	const DisplayCharacteristics &aSrcChar,
+	const DisplayCharacteristics &aDestChar,
+	const void *aSrcBuf,
+	void *aDestBuf,
+	int x, int y, int w, int h);
+
 #endif
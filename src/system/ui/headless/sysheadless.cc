@@ -0,0 +1,225 @@
+/*
+ *	PearPC
+ *	sysheadless.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <csignal>
+#include <cstring>
+
+#include "system/capture.h"
+#include "system/sysclk.h"
+#include "system/systhread.h"
+#include "tools/except.h"
+#include "tools/snprintf.h"
+#include "configparser.h"
+#include "sysheadless.h"
+
+#define HEADLESS_KEY_CAPTURE_FILE	"headless_capture_file"
+#define HEADLESS_KEY_CAPTURE_SETTLE	"headless_capture_settle_msec"
+
+static String		gCaptureFile;
+static int		gCaptureSettle;
+static int		gCaptureCount;
+static volatile bool	gCaptureRequested;
+static volatile bool	gHeadlessQuit;
+static bool		gHeadlessThreadRunning;
+static sys_thread	gHeadlessThread;
+static sys_semaphore	gHeadlessSem;
+
+HeadlessSystemDisplay::HeadlessSystemDisplay(const DisplayCharacteristics &aClientChar, int redraw_ms)
+	:SystemDisplay(aClientChar, redraw_ms)
+{
+	mMenuHeight = 0;
+	allocFrameBuffer();
+	memset(gFrameBuffer, 0, mClientChar.height * mClientChar.scanLineLength);
+	damageFrameBufferAll();
+}
+
+HeadlessSystemDisplay::~HeadlessSystemDisplay()
+{
+	freeFrameBuffer();
+}
+
+/*
+ *	Nobody looks, the backend's thread takes the damage itself.
+ */
+void HeadlessSystemDisplay::displayShow()
+{
+}
+
+void HeadlessSystemDisplay::convertCharacteristicsToHost(DisplayCharacteristics &aHostChar, const DisplayCharacteristics &aClientChar)
+{
+	aHostChar = aClientChar;
+}
+
+bool HeadlessSystemDisplay::changeResolution(const DisplayCharacteristics &aClientChar)
+{
+	// the framebuffer has the maximum size already
+	mClientChar = aClientChar;
+	damageFrameBufferAll();
+	return true;
+}
+
+void HeadlessSystemDisplay::getHostCharacteristics(Container &modes)
+{
+}
+
+void HeadlessSystemDisplay::updateTitle()
+{
+}
+
+void HeadlessSystemDisplay::finishMenu()
+{
+}
+
+int HeadlessSystemDisplay::toString(char *buf, int buflen) const
+{
+	return ht_snprintf(buf, buflen, "headless");
+}
+
+int HeadlessSystemKeyboard::getKeybLEDs()
+{
+	return 0;
+}
+
+void HeadlessSystemKeyboard::setKeybLEDs(int leds)
+{
+}
+
+static void headlessCapture()
+{
+	// the name isn't a format string, only "%d" means something
+	String name(gCaptureFile), count;
+	count.assignFormat("%d", gCaptureCount++);
+	name.replace("%d", count, 0, 1);
+	try {
+		captureFrame(gDisplay->mClientChar, gFrameBuffer, name.contentChar());
+		ht_printf("headless: captured %y\n", &name);
+	} catch (const Exception &e) {
+		String res;
+		e.reason(res);
+		ht_printf("headless: can't write %y: %y\n", &name, &res);
+	}
+}
+
+/*
+ *	Paces the frames for the guest's VBL. The damage is only
+ *	taken when captures are wanted, otherwise the framebuffer
+ *	stays writable and nothing is done with it.
+ */
+static void *headlessLoop(void *p)
+{
+	uint64 clk_per_ms = sys_get_hiresclk_ticks_per_second() / 1000;
+	uint64 last_damage = 0;
+	uint64 next = 0;
+	bool unsettled = false;
+	while (!gHeadlessQuit) {
+		uint64 clk = sys_get_hiresclk_ticks();
+		bool show = false;
+		if (clk >= next) show = gDisplay->frameTick(clk, next);
+
+		if (!gCaptureFile.isEmpty()) {
+			DamageRect rects[DAMAGE_RECTS_MAX];
+			if (show && takeDamage(gDisplay->mClientChar, rects)) {
+				last_damage = clk;
+				unsettled = true;
+			}
+			if (gCaptureRequested) {
+				gCaptureRequested = false;
+				headlessCapture();
+			} else if (gCaptureSettle && unsettled
+			 && clk - last_damage >= gCaptureSettle * clk_per_ms) {
+				unsettled = false;
+				headlessCapture();
+			}
+		}
+
+		clk = sys_get_hiresclk_ticks();
+		if (clk < next) {
+			sys_lock_semaphore(gHeadlessSem);
+			sys_wait_semaphore_bounded(gHeadlessSem, MAX(1, (next - clk) / clk_per_ms));
+			sys_unlock_semaphore(gHeadlessSem);
+		}
+	}
+	return NULL;
+}
+
+#ifdef SIGUSR1
+static void headlessSignal(int sig)
+{
+	gCaptureRequested = true;
+}
+#endif
+
+void headless_request_capture()
+{
+	gCaptureRequested = true;
+	if (gHeadlessThreadRunning) sys_signal_semaphore(gHeadlessSem);
+}
+
+void headless_init_config()
+{
+	gConfig->acceptConfigEntryStringDef(HEADLESS_KEY_CAPTURE_FILE, "");
+	gConfig->acceptConfigEntryIntDef(HEADLESS_KEY_CAPTURE_SETTLE, 0);
+}
+
+void initHeadlessUI(const char *title, const DisplayCharacteristics &aCharacteristics, int redraw_ms, const KeyboardCharacteristics &keyConfig)
+{
+	gDisplay = new HeadlessSystemDisplay(aCharacteristics, redraw_ms);
+	gMouse = new HeadlessSystemMouse();
+	gKeyboard = new HeadlessSystemKeyboard();
+	if (!gKeyboard->setKeyConfig(keyConfig)) {
+		ht_printf("no keyConfig, or is empty");
+		exit(1);
+	}
+
+	gConfig->getConfigString(HEADLESS_KEY_CAPTURE_FILE, gCaptureFile);
+	gCaptureSettle = gConfig->getConfigInt(HEADLESS_KEY_CAPTURE_SETTLE);
+	gCaptureCount = 0;
+	gCaptureRequested = false;
+	gHeadlessQuit = false;
+	gHeadlessThreadRunning = false;
+	if (sys_create_semaphore(&gHeadlessSem)
+	 || sys_create_thread(&gHeadlessThread, 0, headlessLoop, NULL)) {
+		ht_printf("can't create headless thread!\n");
+		exit(1);
+	}
+	gHeadlessThreadRunning = true;
+	if (gCaptureFile.isEmpty()) {
+		if (gCaptureSettle) ht_printf("headless: '%s' not set, no captures\n", HEADLESS_KEY_CAPTURE_FILE);
+		return;
+	}
+#ifdef SIGUSR1
+	signal(SIGUSR1, headlessSignal);
+#endif
+}
+
+void doneHeadlessUI()
+{
+	if (!gHeadlessThreadRunning) return;
+#ifdef SIGUSR1
+	if (!gCaptureFile.isEmpty()) signal(SIGUSR1, SIG_DFL);
+#endif
+	gHeadlessQuit = true;
+	sys_signal_semaphore(gHeadlessSem);
+	sys_join_thread(gHeadlessThread);
+	sys_destroy_semaphore(gHeadlessSem);
+	gHeadlessThreadRunning = false;
+}
@@ -0,0 +1,76 @@
+/*
+ *	PearPC
+ *	sysheadless.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SYSHEADLESS_H__
+#define __SYSHEADLESS_H__
+
+#include "system/display.h"
+#include "system/keyboard.h"
+#include "system/mouse.h"
+
+/*
+ *	A display without a window ("ppc_headless = 1"), used instead
+ *	of initUI()/doneUI(). Nothing is converted or presented, the
+ *	guest framebuffer can only be captured to a file:
+ *
+ *	headless_capture_file		name of the capture, ".png" or PPM.
+ *					the first "%d" is replaced by a counter.
+ *	headless_capture_settle_msec	capture when the screen hasn't
+ *					changed for that long after a change
+ *					(0 = never)
+ *
+ *	A capture is also written on SIGUSR1 or headless_request_capture().
+ */
+void	headless_init_config();
+void	initHeadlessUI(const char *title, const DisplayCharacteristics &aCharacteristics, int redraw_ms, const KeyboardCharacteristics &keyConfig);
+void	doneHeadlessUI();
+
+void	headless_request_capture();
+
+/*
+ *	A display, keyboard and mouse with nothing attached. The
+ *	framebuffer is kept at the maximum size, the backend (this
+ *	one or the vnc server) takes the damage from its own thread.
+ */
+class HeadlessSystemDisplay: public SystemDisplay
+{
+public:
+			HeadlessSystemDisplay(const DisplayCharacteristics &aClientChar, int redraw_ms);
+	virtual		~HeadlessSystemDisplay();
+
+	virtual void	displayShow();
+	virtual void	convertCharacteristicsToHost(DisplayCharacteristics &aHostChar, const DisplayCharacteristics &aClientChar);
+	virtual bool	changeResolution(const DisplayCharacteristics &aClientChar);
+	virtual void	getHostCharacteristics(Container &modes);
+	virtual void	updateTitle();
+	virtual void	finishMenu();
+	virtual	int	toString(char *buf, int buflen) const;
+};
+
+class HeadlessSystemKeyboard: public SystemKeyboard {
+public:
+	virtual int	getKeybLEDs();
+	virtual void	setKeybLEDs(int leds);
+};
+
+class HeadlessSystemMouse: public SystemMouse {
+};
+
+#endif
@@ -92,8 +92,7 @@ SDLSystemDisplay::SDLSystemDisplay(const char *title, const DisplayCharacteristi
 {
 	mTitle = strdup(title);
 
-	gFrameBuffer = (byte*)malloc(mClientChar.width *
-		mClientChar.height * mClientChar.bytesPerPixel);
+	allocFrameBuffer();
 	memset(gFrameBuffer, 0, mClientChar.width *
 		mClientChar.height * mClientChar.bytesPerPixel);
 	damageFrameBufferAll();
@@ -128,40 +127,27 @@ void SDLSystemDisplay::displayShow()
 {
 	if (!isExposed()) return;
 
-	int firstDamagedLine, lastDamagedLine;
-	// We've got problems with races here because gcard_write1/2/4
-	// might set gDamageAreaFirstAddr, gDamageAreaLastAddr.
-	// We can't use mutexes in gcard for speed reasons. So we'll
-	// try to minimize the probability of loosing the race.
-	if (gDamageAreaFirstAddr > gDamageAreaLastAddr+3) {
-	        return;
-	}
-	int damageAreaFirstAddr = gDamageAreaFirstAddr;
-	int damageAreaLastAddr = gDamageAreaLastAddr;
-	healFrameBuffer();
-	// end of race
-	damageAreaLastAddr += 3;	// this is a hack. For speed reasons we
-					// inaccurately set gDamageAreaLastAddr
-					// to the first (not last) byte accessed
-					// accesses are up to 4 bytes "long".
-	firstDamagedLine = damageAreaFirstAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	lastDamagedLine = damageAreaLastAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	// Overflow may happen, because of the hack used above
-	// and others, that set lastAddr = 0xfffffff0 (damageFrameBufferAll())
-	if (lastDamagedLine >= mClientChar.height) {
-		lastDamagedLine = mClientChar.height-1;
-	}
+	DamageRect rects[DAMAGE_RECTS_MAX];
+	int n = takeDamage(mClientChar, rects);
+	if (!n) return;
 
 	sys_lock_mutex(mRedrawMutex);
 
 	if (SDL_MUSTLOCK(gSDLScreen)) SDL_LockSurface(gSDLScreen);
 
-	sys_convert_display(mClientChar, mSDLChar, gFrameBuffer,
-		(byte*)gSDLScreen->pixels, firstDamagedLine, lastDamagedLine);
+	SDL_Rect sdlRects[DAMAGE_RECTS_MAX];
+	for (int i=0; i < n; i++) {
+		sys_convert_display_rect(mClientChar, mSDLChar, gFrameBuffer,
+			(byte*)gSDLScreen->pixels, rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+		sdlRects[i].x = rects[i].x;
+		sdlRects[i].y = rects[i].y;
+		sdlRects[i].w = rects[i].w;
+		sdlRects[i].h = rects[i].h;
+	}
 
 	if (SDL_MUSTLOCK(gSDLScreen)) SDL_UnlockSurface(gSDLScreen);
 
-	SDL_UpdateRect(gSDLScreen, 0, firstDamagedLine, mClientChar.width, lastDamagedLine-firstDamagedLine+1);
+	SDL_UpdateRects(gSDLScreen, n, sdlRects);
 
 #if 0
 	if (mSDLFrameBuffer) { // using software-mode?
@@ -196,6 +182,11 @@ void SDLSystemDisplay::displayShow()
 void SDLSystemDisplay::convertCharacteristicsToHost(DisplayCharacteristics &aHostChar, const DisplayCharacteristics &aClientChar)
 {
 	aHostChar = aClientChar;
+	if (aClientChar.bytesPerPixel == 1) {
+		// the palette is applied when converting
+		aHostChar.bytesPerPixel = 4;
+		aHostChar.scanLineLength = aHostChar.width * 4;
+	}
 }
 
 bool SDLSystemDisplay::changeResolution(const DisplayCharacteristics &aCharacteristics)
@@ -336,14 +327,13 @@ bool SDLSystemDisplay::changeResolutionREAL(const DisplayCharacteristics &aChara
 #endif
 
 	mFullscreenChanged = videoFlags & SDL_FULLSCREEN;
-	if (gSDLScreen->pitch != aCharacteristics.width * aCharacteristics.bytesPerPixel) {
+	if (gSDLScreen->pitch != chr.width * chr.bytesPerPixel) {
 		// FIXME: this is really bad.
 		ht_printf("SDL: FATAL: new mode has scanline gap. Trying to revert to old mode.\n");
 		exit(1);
 	}	
 
-	gFrameBuffer = (byte*)realloc(gFrameBuffer, mClientChar.width *
-		mClientChar.height * mClientChar.bytesPerPixel);
+	allocFrameBuffer();
 #if 0
 	if (mSDLClientScreen) {
 		// if this is a modechange, free the old surface first.
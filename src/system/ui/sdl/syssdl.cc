@@ -346,8 +346,13 @@ static bool handleSDLEvent(const SDL_Event &event)
 static Uint32 SDL_redrawCallback(Uint32 interval, void *param)
 {
 	SDL_Event event;
+	uint64 clk = sys_get_hiresclk_ticks();
+	uint64 next;
+	bool show = gDisplay->frameTick(clk, next);
+	// the timer restarts with the returned interval
+	interval = MAX(1, (next - clk) * 1000 / sys_get_hiresclk_ticks_per_second());
 
-	if (!gSDLVideoExposePending) {
+	if (show && !gSDLVideoExposePending) {
 		event.type = SDL_VIDEOEXPOSE;
 		// according to the docs, "You may always call SDL_PushEvent" in an SDL
 		// timer callback function
@@ -0,0 +1,1150 @@
+/*
+ *	PearPC
+ *	sysvnc.cc
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "stdafx.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "system/display.h"
+#include "system/keyboard.h"
+#include "system/mouse.h"
+#include "tools/snprintf.h"
+#include "configparser.h"
+#include "sysvnc.h"
+
+#define VNC_KEY_PORT	"vnc_port"
+#define VNC_KEY_SOCKET	"vnc_socket"
+
+void vnc_init_config()
+{
+	gConfig->acceptConfigEntryIntDef(VNC_KEY_PORT, 5900);
+	gConfig->acceptConfigEntryStringDef(VNC_KEY_SOCKET, "");
+}
+
+#ifdef TARGET_COMPILER_VC
+
+void initVNCUI(const char *title, const DisplayCharacteristics &aCharacteristics, int redraw_ms, const KeyboardCharacteristics &keyConfig)
+{
+	ht_printf("vnc: not supported on this platform\n");
+	exit(1);
+}
+
+void doneVNCUI()
+{
+}
+
+#else
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "system/pixconv.h"
+#include "system/sysclk.h"
+#include "system/systhread.h"
+#include "system/ui/headless/sysheadless.h"
+#include "tools/except.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* RFB protocol */
+#define RFB_SET_PIXEL_FORMAT		0
+#define RFB_SET_ENCODINGS		2
+#define RFB_UPDATE_REQUEST		3
+#define RFB_KEY_EVENT			4
+#define RFB_POINTER_EVENT		5
+#define RFB_CLIENT_CUT_TEXT		6
+
+#define RFB_FRAMEBUFFER_UPDATE		0
+
+#define RFB_ENCODING_RAW		0
+#define RFB_ENCODING_HEXTILE		5
+#define RFB_ENCODING_DESKTOP_SIZE	-223
+
+#define HEXTILE_RAW			1
+#define HEXTILE_BACKGROUND		2
+#define HEXTILE_FOREGROUND		4
+#define HEXTILE_ANY_SUBRECTS		8
+#define HEXTILE_SUBRECTS_COLOURED	16
+
+#define VNC_OUT_CHUNK			65536
+
+struct VNCPixelFormat {
+	int bitsPerPixel;
+	int depth;
+	bool bigEndian;
+	bool trueColour;
+	int redMax, greenMax, blueMax;
+	int redShift, greenShift, blueShift;
+};
+
+static String		gVNCTitle;
+static int		gVNCListen = -1;
+static int		gVNCClient = -1;
+static String		gVNCSocketPath;
+static volatile bool	gVNCQuit;
+static bool		gVNCThreadRunning;
+static sys_thread	gVNCThread;
+
+/* state of the connected client */
+static VNCPixelFormat	gVNCFormat;
+static int		gVNCBpp;		// bytes per pixel of gVNCFormat
+static bool		gVNCHextile;
+static bool		gVNCDesktopSize;
+static bool		gVNCUpdateRequested;
+static bool		gVNCFullUpdate;
+static int		gVNCWidth, gVNCHeight;	// as the client knows it
+
+/* conversion from the guest to the client format */
+static bool		gVNCConvValid;
+static DisplayCharacteristics gVNCConvChar;
+static PixConvLine	gVNCKernel;
+static bool		gVNCIdentity;
+static uint32		gVNCRed[256], gVNCGreen[256], gVNCBlue[256];
+/* indexed guest modes: the palette as client pixels */
+static PixConvLUTLine	gVNCLUTKernel;
+static uint32		gVNCPalette[256];
+static uint		gVNCPaletteGen;
+
+/* hextile state, valid until the next raw tile */
+static bool		gVNCBgValid, gVNCFgValid;
+static uint32		gVNCBg, gVNCFg;
+
+/* buttons as the guest knows them */
+static bool		gVNCMouseButton[3];
+
+static byte *		gVNCOut;
+static uint		gVNCOutLen;
+static uint		gVNCOutSize;
+
+class VNCSystemDisplay: public HeadlessSystemDisplay
+{
+public:
+	VNCSystemDisplay(const DisplayCharacteristics &aClientChar, int redraw_ms)
+		:HeadlessSystemDisplay(aClientChar, redraw_ms)
+	{
+		mMouseGrabbed = true;
+	}
+
+	/*
+	 *	The pointer always belongs to the guest, the client
+	 *	decides where it is.
+	 */
+	virtual void setMouseGrab(bool mouseGrab)
+	{
+		SystemDisplay::setMouseGrab(true);
+	}
+
+	virtual	int toString(char *buf, int buflen) const
+	{
+		return ht_snprintf(buf, buflen, "vnc");
+	}
+};
+
+/*
+ *	Keysyms (X11 values) to ADB keycodes, for a US layout.
+ *	Shifted characters map to their unshifted key, the client
+ *	sends the shift key itself.
+ */
+static const byte vnc_letter_to_adb_key[26] = {
+	KEY_a, KEY_b, KEY_c, KEY_d, KEY_e, KEY_f, KEY_g, KEY_h, KEY_i,
+	KEY_j, KEY_k, KEY_l, KEY_m, KEY_n, KEY_o, KEY_p, KEY_q, KEY_r,
+	KEY_s, KEY_t, KEY_u, KEY_v, KEY_w, KEY_x, KEY_y, KEY_z,
+};
+
+static const struct {
+	uint32 keysym;
+	byte keycode;
+} vnc_keysym_to_adb_key[] = {
+	{' ', KEY_SPACE},
+	{'1', KEY_1}, {'!', KEY_1}, {'2', KEY_2}, {'@', KEY_2},
+	{'3', KEY_3}, {'#', KEY_3}, {'4', KEY_4}, {'$', KEY_4},
+	{'5', KEY_5}, {'%', KEY_5}, {'6', KEY_6}, {'^', KEY_6},
+	{'7', KEY_7}, {'&', KEY_7}, {'8', KEY_8}, {'*', KEY_8},
+	{'9', KEY_9}, {'(', KEY_9}, {'0', KEY_0}, {')', KEY_0},
+	{'-', KEY_MINUS}, {'_', KEY_MINUS}, {'=', KEY_EQ}, {'+', KEY_EQ},
+	{'[', KEY_BRACKET_L}, {'{', KEY_BRACKET_L},
+	{']', KEY_BRACKET_R}, {'}', KEY_BRACKET_R},
+	{'\\', KEY_BACKSLASH}, {'|', KEY_BACKSLASH},
+	{';', KEY_SEMICOLON}, {':', KEY_SEMICOLON},
+	{'\'', KEY_APOSTROPHE}, {'"', KEY_APOSTROPHE},
+	{'`', KEY_GRAVE}, {'~', KEY_GRAVE},
+	{',', KEY_COMMA}, {'<', KEY_COMMA}, {'.', KEY_PERIOD}, {'>', KEY_PERIOD},
+	{'/', KEY_SLASH}, {'?', KEY_SLASH},
+
+	{0xff08, KEY_DELETE},		// BackSpace
+	{0xff09, KEY_TAB},
+	{0xff0d, KEY_RETURN},
+	{0xff13, KEY_PAUSE},
+	{0xff14, KEY_SCROLL_LOCK},
+	{0xff1b, KEY_ESCAPE},
+	{0xff50, KEY_HOME},
+	{0xff51, KEY_LEFT},
+	{0xff52, KEY_UP},
+	{0xff53, KEY_RIGHT},
+	{0xff54, KEY_DOWN},
+	{0xff55, KEY_PRIOR},
+	{0xff56, KEY_NEXT},
+	{0xff57, KEY_END},
+	{0xff63, KEY_INSERT},
+	{0xffff, KEY_REMOVE},		// Delete
+	{0xff7f, KEY_NUM_LOCK},
+
+	{0xff8d, KEY_KP_ENTER},
+	{0xff95, KEY_KP_7},		// KP_Home
+	{0xff96, KEY_KP_4},		// KP_Left
+	{0xff97, KEY_KP_8},		// KP_Up
+	{0xff98, KEY_KP_6},		// KP_Right
+	{0xff99, KEY_KP_2},		// KP_Down
+	{0xff9a, KEY_KP_9},		// KP_Prior
+	{0xff9b, KEY_KP_3},		// KP_Next
+	{0xff9c, KEY_KP_1},		// KP_End
+	{0xff9d, KEY_KP_5},		// KP_Begin
+	{0xff9e, KEY_KP_0},		// KP_Insert
+	{0xff9f, KEY_KP_PERIOD},	// KP_Delete
+	{0xffaa, KEY_KP_MULTIPLY},
+	{0xffab, KEY_KP_ADD},
+	{0xffad, KEY_KP_SUBTRACT},
+	{0xffae, KEY_KP_PERIOD},
+	{0xffaf, KEY_KP_DIVIDE},
+	{0xffb0, KEY_KP_0}, {0xffb1, KEY_KP_1}, {0xffb2, KEY_KP_2},
+	{0xffb3, KEY_KP_3}, {0xffb4, KEY_KP_4}, {0xffb5, KEY_KP_5},
+	{0xffb6, KEY_KP_6}, {0xffb7, KEY_KP_7}, {0xffb8, KEY_KP_8},
+	{0xffb9, KEY_KP_9},
+
+	{0xffbe, KEY_F1}, {0xffbf, KEY_F2}, {0xffc0, KEY_F3},
+	{0xffc1, KEY_F4}, {0xffc2, KEY_F5}, {0xffc3, KEY_F6},
+	{0xffc4, KEY_F7}, {0xffc5, KEY_F8}, {0xffc6, KEY_F9},
+	{0xffc7, KEY_F10}, {0xffc8, KEY_F11}, {0xffc9, KEY_F12},
+	{0xffca, KEY_F13},
+
+	// like the X11 ui: left alt is command, right alt is option
+	{0xffe1, KEY_SHIFT},		// Shift_L
+	{0xffe2, KEY_SHIFT},		// Shift_R
+	{0xffe3, KEY_CONTROL},		// Control_L
+	{0xffe4, KEY_CONTROL},		// Control_R
+	{0xffe5, KEY_CAPS_LOCK},
+	{0xffe7, KEY_ALT},		// Meta_L
+	{0xffe8, KEY_ALT},		// Meta_R
+	{0xffe9, KEY_ALT},		// Alt_L
+	{0xffea, KEY_ALTGR},		// Alt_R
+	{0xffeb, KEY_ALT},		// Super_L
+	{0xffec, KEY_ALT},		// Super_R
+	{0xfe03, KEY_ALTGR},		// ISO_Level3_Shift
+};
+
+static int vncKeysymToADB(uint32 keysym)
+{
+	if (keysym >= 'a' && keysym <= 'z') return vnc_letter_to_adb_key[keysym - 'a'];
+	if (keysym >= 'A' && keysym <= 'Z') return vnc_letter_to_adb_key[keysym - 'A'];
+	for (uint i=0; i < sizeof vnc_keysym_to_adb_key / sizeof vnc_keysym_to_adb_key[0]; i++) {
+		if (vnc_keysym_to_adb_key[i].keysym == keysym) return vnc_keysym_to_adb_key[i].keycode;
+	}
+	return KEY_NONE;
+}
+
+/*
+ *	Socket I/O. Errors and disconnects throw, the server
+ *	loop drops the client then. The client socket is non-
+ *	blocking, waiting is done with a short poll() so that
+ *	doneVNCUI() isn't held up by a client that stalls.
+ */
+static void vncWait(int events)
+{
+	struct pollfd pfd;
+	pfd.fd = gVNCClient;
+	pfd.events = events;
+	while (1) {
+		int r = poll(&pfd, 1, 100);
+		if (gVNCQuit) throw MsgException("quit");
+		if (r > 0) return;
+		if (r < 0 && errno != EINTR) throw IOException(errno);
+	}
+}
+
+static void vncSend(const void *buf, uint len)
+{
+	const byte *p = (const byte *)buf;
+	while (len) {
+		ssize_t r = send(gVNCClient, p, len, MSG_NOSIGNAL);
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				vncWait(POLLOUT);
+				continue;
+			}
+			throw IOException(errno);
+		}
+		p += r;
+		len -= r;
+	}
+}
+
+static void vncRecv(void *buf, uint len)
+{
+	byte *p = (byte *)buf;
+	while (len) {
+		ssize_t r = recv(gVNCClient, p, len, 0);
+		if (r == 0) throw MsgException("client disconnected");
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				vncWait(POLLIN);
+				continue;
+			}
+			throw IOException(errno);
+		}
+		p += r;
+		len -= r;
+	}
+}
+
+static inline uint get16(const byte *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static inline uint32 get32(const byte *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void put16(byte *p, uint v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static inline void put32(byte *p, uint32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void vncFlush()
+{
+	if (gVNCOutLen) vncSend(gVNCOut, gVNCOutLen);
+	gVNCOutLen = 0;
+}
+
+/*
+ *	Returns room for len bytes at the end of the output
+ *	buffer, sending what's in it when it's full.
+ */
+static byte *vncReserve(uint len)
+{
+	if (gVNCOutLen + len > gVNCOutSize) {
+		vncFlush();
+		if (len > gVNCOutSize) {
+			gVNCOutSize = MAX(len, VNC_OUT_CHUNK);
+			gVNCOut = (byte*)realloc(gVNCOut, gVNCOutSize);
+			if (!gVNCOut) throw IOException(ENOMEM);
+		}
+	}
+	byte *r = gVNCOut + gVNCOutLen;
+	gVNCOutLen += len;
+	return r;
+}
+
+static void vncFormatFromChar(VNCPixelFormat &f, const DisplayCharacteristics &chr)
+{
+	if (chr.bytesPerPixel == 1) {
+		// there is no colour map, indexed modes are offered as 32 bit
+		DisplayCharacteristics tc = chr;
+		tc.bytesPerPixel = 4;
+		tc.redShift = 16;
+		tc.greenShift = 8;
+		tc.blueShift = 0;
+		tc.redSize = tc.greenSize = tc.blueSize = 8;
+		vncFormatFromChar(f, tc);
+		return;
+	}
+	f.bitsPerPixel = chr.bytesPerPixel * 8;
+	f.depth = chr.redSize + chr.greenSize + chr.blueSize;
+	f.bigEndian = true;
+	f.trueColour = true;
+	f.redMax = (1 << chr.redSize) - 1;
+	f.greenMax = (1 << chr.greenSize) - 1;
+	f.blueMax = (1 << chr.blueSize) - 1;
+	f.redShift = chr.redShift;
+	f.greenShift = chr.greenShift;
+	f.blueShift = chr.blueShift;
+}
+
+static void vncPutFormat(byte *p, const VNCPixelFormat &f)
+{
+	p[0] = f.bitsPerPixel;
+	p[1] = f.depth;
+	p[2] = f.bigEndian;
+	p[3] = f.trueColour;
+	put16(p+4, f.redMax);
+	put16(p+6, f.greenMax);
+	put16(p+8, f.blueMax);
+	p[10] = f.redShift;
+	p[11] = f.greenShift;
+	p[12] = f.blueShift;
+	p[13] = p[14] = p[15] = 0;
+}
+
+static void vncGetFormat(VNCPixelFormat &f, const byte *p)
+{
+	f.bitsPerPixel = p[0];
+	f.depth = p[1];
+	f.bigEndian = p[2];
+	f.trueColour = p[3];
+	f.redMax = get16(p+4);
+	f.greenMax = get16(p+6);
+	f.blueMax = get16(p+8);
+	f.redShift = p[10];
+	f.greenShift = p[11];
+	f.blueShift = p[12];
+}
+
+static bool vncHostBigEndian()
+{
+	uint16 one = 1;
+	return *(byte*)&one == 0;
+}
+
+// size in bits of max, if max is 2^n-1
+static int vncMaxToSize(int max)
+{
+	int s = 0;
+	while (max & 1) {
+		max >>= 1;
+		s++;
+	}
+	return max ? -1 : s;
+}
+
+static void vncBuildLUT(uint32 *lut, int size, int max, int shift)
+{
+	int vmax = (1 << size) - 1;
+	for (int v=0; v <= vmax; v++) {
+		lut[v] = (uint32)((v * max + vmax / 2) / vmax) << shift;
+	}
+}
+
+/*
+ *	Picks the conversion from the guest mode chr to the format
+ *	of the client: a copy if they are the same, a pixconv kernel
+ *	if there is one, else the lookup tables. Indexed modes always
+ *	go through the palette, converted to client pixels in gVNCPalette.
+ */
+static void vncSetupConversion(const DisplayCharacteristics &chr)
+{
+	const VNCPixelFormat &f = gVNCFormat;
+	VNCPixelFormat g;
+	vncFormatFromChar(g, chr);
+	gVNCIdentity = chr.bytesPerPixel != 1
+		&& f.bitsPerPixel == g.bitsPerPixel
+		&& (f.bigEndian || f.bitsPerPixel == 8)
+		&& f.redMax == g.redMax && f.greenMax == g.greenMax && f.blueMax == g.blueMax
+		&& f.redShift == g.redShift && f.greenShift == g.greenShift && f.blueShift == g.blueShift;
+
+	gVNCKernel = NULL;
+	gVNCLUTKernel = NULL;
+	int rs = vncMaxToSize(f.redMax);
+	int gs = vncMaxToSize(f.greenMax);
+	int bs = vncMaxToSize(f.blueMax);
+	if (!gVNCIdentity && chr.bytesPerPixel != 1
+	 && f.bigEndian == vncHostBigEndian() && rs > 0 && gs > 0 && bs > 0) {
+		DisplayCharacteristics dc;
+		dc.bytesPerPixel = gVNCBpp;
+		dc.redShift = f.redShift;
+		dc.redSize = rs;
+		dc.greenShift = f.greenShift;
+		dc.greenSize = gs;
+		dc.blueShift = f.blueShift;
+		dc.blueSize = bs;
+		gVNCKernel = pixconv_get(chr, dc);
+	}
+
+	vncBuildLUT(gVNCRed, chr.redSize, f.redMax, f.redShift);
+	vncBuildLUT(gVNCGreen, chr.greenSize, f.greenMax, f.greenShift);
+	vncBuildLUT(gVNCBlue, chr.blueSize, f.blueMax, f.blueShift);
+	if (chr.bytesPerPixel == 1) {
+		gVNCPaletteGen = gDisplay->paletteGeneration();
+		bool swap = f.bigEndian != vncHostBigEndian();
+		for (int i=0; i < 256; i++) {
+			RGB c = gDisplay->getColor(i);
+			uint32 v = gVNCRed[RGB_R(c)] | gVNCGreen[RGB_G(c)] | gVNCBlue[RGB_B(c)];
+			// the kernels store host order
+			if (swap && gVNCBpp == 2) v = ((v & 0xff) << 8) | ((v >> 8) & 0xff);
+			if (swap && gVNCBpp == 4) v = (v << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+			gVNCPalette[i] = v;
+		}
+		gVNCLUTKernel = pixconv_get_lut(gVNCBpp);
+	}
+	gVNCConvChar = chr;
+	gVNCConvValid = true;
+}
+
+static void vncConvertLine(const DisplayCharacteristics &chr, const byte *src, byte *dest, int w)
+{
+	if (gVNCIdentity) {
+		memcpy(dest, src, w * gVNCBpp);
+		return;
+	}
+	if (gVNCLUTKernel) {
+		gVNCLUTKernel(w, src, dest, gVNCPalette);
+		return;
+	}
+	if (gVNCKernel) {
+		gVNCKernel(w, src, dest);
+		return;
+	}
+	uint rm = (1 << chr.redSize) - 1;
+	uint gm = (1 << chr.greenSize) - 1;
+	uint bm = (1 << chr.blueSize) - 1;
+	for (int x=0; x < w; x++) {
+		uint32 p;
+		if (chr.bytesPerPixel == 2) {
+			p = get16(src);
+		} else {
+			p = get32(src);
+		}
+		src += chr.bytesPerPixel;
+		uint32 v = gVNCRed[(p >> chr.redShift) & rm]
+			| gVNCGreen[(p >> chr.greenShift) & gm]
+			| gVNCBlue[(p >> chr.blueShift) & bm];
+		switch (gVNCBpp) {
+		case 1:
+			*dest = v;
+			break;
+		case 2:
+			if (gVNCFormat.bigEndian) {
+				dest[0] = v >> 8; dest[1] = v;
+			} else {
+				dest[0] = v; dest[1] = v >> 8;
+			}
+			break;
+		case 4:
+			if (gVNCFormat.bigEndian) {
+				put32(dest, v);
+			} else {
+				dest[0] = v; dest[1] = v >> 8; dest[2] = v >> 16; dest[3] = v >> 24;
+			}
+			break;
+		}
+		dest += gVNCBpp;
+	}
+}
+
+static void vncPutRectHeader(int x, int y, int w, int h, int encoding)
+{
+	byte *p = vncReserve(12);
+	put16(p, x);
+	put16(p+2, y);
+	put16(p+4, w);
+	put16(p+6, h);
+	put32(p+8, encoding);
+}
+
+static void vncSendRaw(const DisplayCharacteristics &chr, const DamageRect &r)
+{
+	vncPutRectHeader(r.x, r.y, r.w, r.h, RFB_ENCODING_RAW);
+	const byte *src = gFrameBuffer + r.y * chr.scanLineLength + r.x * chr.bytesPerPixel;
+	for (int y=0; y < r.h; y++) {
+		vncConvertLine(chr, src, vncReserve(r.w * gVNCBpp), r.w);
+		src += chr.scanLineLength;
+	}
+}
+
+// client pixels are compared and stored as their bytes
+static inline uint32 vncTilePixel(const byte *p)
+{
+	uint32 v = 0;
+	memcpy(&v, p, gVNCBpp);
+	return v;
+}
+
+/*
+ *	Encodes one hextile tile: solid tiles as their background,
+ *	others as subrectangles, found greedily, unless that is
+ *	bigger than the raw tile.
+ */
+static void vncSendHextileTile(const byte *tile, int w, int h)
+{
+	int n = w * h;
+	uint32 bg = vncTilePixel(tile);
+	uint32 fg = bg;
+	int bgCount = 0;
+	bool mono = true;
+	for (int i=0; i < n; i++) {
+		uint32 p = vncTilePixel(tile + i * gVNCBpp);
+		if (p == bg) {
+			bgCount++;
+		} else if (fg == bg) {
+			fg = p;
+		} else if (p != fg) {
+			mono = false;
+		}
+	}
+
+	if (bgCount == n) {
+		byte *o = vncReserve(1 + gVNCBpp);
+		if (gVNCBgValid && gVNCBg == bg) {
+			*o = 0;
+			gVNCOutLen -= gVNCBpp;
+		} else {
+			*o = HEXTILE_BACKGROUND;
+			memcpy(o+1, &bg, gVNCBpp);
+		}
+		gVNCBg = bg;
+		gVNCBgValid = true;
+		return;
+	}
+	// two colors: the more frequent one is the background
+	if (mono && bgCount * 2 < n) {
+		uint32 t = bg;
+		bg = fg;
+		fg = t;
+	}
+
+	byte subrects[16*16*(4+2)];
+	int subLen = 0, subCount = 0;
+	int subSize = mono ? 2 : gVNCBpp + 2;
+	int rawSize = n * gVNCBpp;
+	bool done[16*16];
+	memset(done, 0, sizeof done);
+	for (int y=0; y < h && subLen <= rawSize; y++) {
+		for (int x=0; x < w; x++) {
+			if (done[y*16+x]) continue;
+			uint32 c = vncTilePixel(tile + (y*w+x) * gVNCBpp);
+			if (c == bg) continue;
+			int sw = 1;
+			while (x+sw < w && !done[y*16+x+sw]
+			 && vncTilePixel(tile + (y*w+x+sw) * gVNCBpp) == c) sw++;
+			int sh = 1;
+			while (y+sh < h) {
+				int i;
+				for (i=0; i < sw; i++) {
+					if (done[(y+sh)*16+x+i]
+					 || vncTilePixel(tile + ((y+sh)*w+x+i) * gVNCBpp) != c) break;
+				}
+				if (i < sw) break;
+				sh++;
+			}
+			for (int j=0; j < sh; j++) {
+				memset(done + (y+j)*16 + x, 1, sw);
+			}
+			if (subLen + subSize > rawSize) {
+				subLen = rawSize + 1;
+				break;
+			}
+			if (!mono) {
+				memcpy(subrects + subLen, &c, gVNCBpp);
+				subLen += gVNCBpp;
+			}
+			subrects[subLen++] = (x << 4) | y;
+			subrects[subLen++] = ((sw-1) << 4) | (sh-1);
+			subCount++;
+		}
+	}
+
+	if (subLen > rawSize) {
+		byte *o = vncReserve(1 + rawSize);
+		*o = HEXTILE_RAW;
+		memcpy(o+1, tile, rawSize);
+		gVNCBgValid = gVNCFgValid = false;
+		return;
+	}
+
+	byte *o = vncReserve(1 + 2*gVNCBpp + 1 + subLen);
+	byte *s = o++;
+	*s = HEXTILE_ANY_SUBRECTS;
+	if (!gVNCBgValid || gVNCBg != bg) {
+		*s |= HEXTILE_BACKGROUND;
+		memcpy(o, &bg, gVNCBpp);
+		o += gVNCBpp;
+	}
+	if (!mono) {
+		// the foreground doesn't survive coloured subrects
+		*s |= HEXTILE_SUBRECTS_COLOURED;
+		gVNCFgValid = false;
+	} else if (!gVNCFgValid || gVNCFg != fg) {
+		*s |= HEXTILE_FOREGROUND;
+		memcpy(o, &fg, gVNCBpp);
+		o += gVNCBpp;
+		gVNCFg = fg;
+		gVNCFgValid = true;
+	}
+	*o++ = subCount;
+	memcpy(o, subrects, subLen);
+	o += subLen;
+	gVNCOutLen = o - gVNCOut;
+	gVNCBg = bg;
+	gVNCBgValid = true;
+}
+
+static void vncSendHextile(const DisplayCharacteristics &chr, const DamageRect &r)
+{
+	vncPutRectHeader(r.x, r.y, r.w, r.h, RFB_ENCODING_HEXTILE);
+	gVNCBgValid = gVNCFgValid = false;
+	byte tile[16*16*4];
+	for (int ty=0; ty < r.h; ty += 16) {
+		int th = MIN(16, r.h - ty);
+		for (int tx=0; tx < r.w; tx += 16) {
+			int tw = MIN(16, r.w - tx);
+			const byte *src = gFrameBuffer + (r.y + ty) * chr.scanLineLength
+				+ (r.x + tx) * chr.bytesPerPixel;
+			for (int y=0; y < th; y++) {
+				vncConvertLine(chr, src, tile + y * tw * gVNCBpp, tw);
+				src += chr.scanLineLength;
+			}
+			vncSendHextileTile(tile, tw, th);
+		}
+	}
+}
+
+/*
+ *	Sends the damage (or everything, for a full update)
+ *	as one FramebufferUpdate.
+ */
+static void vncSendUpdate()
+{
+	DisplayCharacteristics chr = gDisplay->mClientChar;
+	DamageRect rects[DAMAGE_RECTS_MAX];
+	int count = takeDamage(chr, rects);
+
+	bool resize = chr.width != gVNCWidth || chr.height != gVNCHeight;
+	if (resize && gVNCDesktopSize) {
+		gVNCWidth = chr.width;
+		gVNCHeight = chr.height;
+		gVNCFullUpdate = true;
+	}
+	if (gVNCFullUpdate) {
+		rects[0].x = 0;
+		rects[0].y = 0;
+		rects[0].w = chr.width;
+		rects[0].h = chr.height;
+		count = 1;
+	}
+	// without DesktopSize the client only gets what fits
+	int n = 0;
+	for (int i=0; i < count; i++) {
+		DamageRect r = rects[i];
+		if (r.x >= gVNCWidth || r.y >= gVNCHeight) continue;
+		r.w = MIN(r.w, gVNCWidth - r.x);
+		r.h = MIN(r.h, gVNCHeight - r.y);
+		rects[n++] = r;
+	}
+	if (!n && !(resize && gVNCDesktopSize)) return;
+
+	if (!gVNCConvValid || gVNCConvChar.compareTo(&chr) != 0
+	 || (chr.bytesPerPixel == 1 && gVNCPaletteGen != gDisplay->paletteGeneration())) {
+		vncSetupConversion(chr);
+	}
+
+	byte *p = vncReserve(4);
+	p[0] = RFB_FRAMEBUFFER_UPDATE;
+	p[1] = 0;
+	put16(p+2, n + (resize && gVNCDesktopSize));
+	if (resize && gVNCDesktopSize) {
+		vncPutRectHeader(0, 0, chr.width, chr.height, RFB_ENCODING_DESKTOP_SIZE);
+	}
+	for (int i=0; i < n; i++) {
+		if (gVNCHextile) {
+			vncSendHextile(chr, rects[i]);
+		} else {
+			vncSendRaw(chr, rects[i]);
+		}
+	}
+	vncFlush();
+	gVNCUpdateRequested = false;
+	gVNCFullUpdate = false;
+}
+
+static void vncKeyEvent(bool down, uint32 keysym)
+{
+	int keycode = vncKeysymToADB(keysym);
+	if (keycode == KEY_NONE) return;
+	SystemEvent ev;
+	ev.type = sysevKey;
+	ev.key.keycode = keycode;
+	ev.key.pressed = down;
+	if (keysym < 0x80) {
+		ev.key.chr = keysym;
+	} else if ((keysym & 0xff00) == 0xff00 && (keysym & 0xff) < 0x20) {
+		// BackSpace, Tab, Return, Escape
+		ev.key.chr = keysym & 0xff;
+	} else {
+		ev.key.chr = 0;
+	}
+	gKeyboard->handleEvent(ev);
+}
+
+/*
+ *	The client reports absolute positions, the guest mouse
+ *	moves relative.
+ */
+static void vncPointerEvent(int mask, int x, int y)
+{
+	SystemEvent ev;
+	ev.type = sysevMouse;
+	if (x != gDisplay->mCurMouseX || y != gDisplay->mCurMouseY) {
+		ev.mouse.type = sme_motionNotify;
+		ev.mouse.button1 = gVNCMouseButton[0];
+		ev.mouse.button2 = gVNCMouseButton[1];
+		ev.mouse.button3 = gVNCMouseButton[2];
+		ev.mouse.dbutton = 0;
+		ev.mouse.x = x;
+		ev.mouse.y = y;
+		ev.mouse.relx = x - gDisplay->mCurMouseX;
+		ev.mouse.rely = y - gDisplay->mCurMouseY;
+		gDisplay->mCurMouseX = x;
+		gDisplay->mCurMouseY = y;
+		gMouse->handleEvent(ev);
+	}
+	// left, right, middle like the X11 ui; RFB has left, middle, right
+	bool b[3];
+	b[0] = mask & 1;
+	b[1] = mask & 4;
+	b[2] = mask & 2;
+	for (int i=0; i < 3; i++) {
+		if (b[i] == gVNCMouseButton[i]) continue;
+		gVNCMouseButton[i] = b[i];
+		ev.mouse.type = b[i] ? sme_buttonPressed : sme_buttonReleased;
+		ev.mouse.button1 = gVNCMouseButton[0];
+		ev.mouse.button2 = gVNCMouseButton[1];
+		ev.mouse.button3 = gVNCMouseButton[2];
+		ev.mouse.dbutton = i+1;
+		ev.mouse.x = x;
+		ev.mouse.y = y;
+		ev.mouse.relx = 0;
+		ev.mouse.rely = 0;
+		gMouse->handleEvent(ev);
+	}
+}
+
+static void vncHandleMessage()
+{
+	byte type;
+	vncRecv(&type, 1);
+	switch (type) {
+	case RFB_SET_PIXEL_FORMAT: {
+		byte m[19];
+		vncRecv(m, sizeof m);
+		VNCPixelFormat f;
+		vncGetFormat(f, m+3);
+		if (!f.trueColour) throw MsgException("colour map formats are not supported");
+		if (f.bitsPerPixel != 8 && f.bitsPerPixel != 16 && f.bitsPerPixel != 32) {
+			throw MsgfException("%d bits per pixel are not supported", f.bitsPerPixel);
+		}
+		gVNCFormat = f;
+		gVNCBpp = f.bitsPerPixel / 8;
+		gVNCConvValid = false;
+		break;
+	}
+	case RFB_SET_ENCODINGS: {
+		byte m[3];
+		vncRecv(m, sizeof m);
+		int n = get16(m+1);
+		gVNCHextile = false;
+		gVNCDesktopSize = false;
+		for (int i=0; i < n; i++) {
+			byte e[4];
+			vncRecv(e, sizeof e);
+			switch ((sint32)get32(e)) {
+			case RFB_ENCODING_HEXTILE:
+				gVNCHextile = true;
+				break;
+			case RFB_ENCODING_DESKTOP_SIZE:
+				gVNCDesktopSize = true;
+				break;
+			}
+		}
+		break;
+	}
+	case RFB_UPDATE_REQUEST: {
+		byte m[9];
+		vncRecv(m, sizeof m);
+		gVNCUpdateRequested = true;
+		// the region is ignored, we always send all damage
+		if (!m[0]) gVNCFullUpdate = true;
+		break;
+	}
+	case RFB_KEY_EVENT: {
+		byte m[7];
+		vncRecv(m, sizeof m);
+		vncKeyEvent(m[0], get32(m+3));
+		break;
+	}
+	case RFB_POINTER_EVENT: {
+		byte m[5];
+		vncRecv(m, sizeof m);
+		vncPointerEvent(m[0], get16(m+1), get16(m+3));
+		break;
+	}
+	case RFB_CLIENT_CUT_TEXT: {
+		byte m[7];
+		vncRecv(m, sizeof m);
+		uint32 len = get32(m+3);
+		while (len) {
+			byte buf[256];
+			uint32 l = MIN(len, sizeof buf);
+			vncRecv(buf, l);
+			len -= l;
+		}
+		break;
+	}
+	default:
+		throw MsgfException("unknown message type %d", type);
+	}
+}
+
+/*
+ *	Protocol versions 3.3, 3.7 and 3.8, without authentication.
+ */
+static void vncHandshake()
+{
+	vncSend("RFB 003.008\n", 12);
+	char version[13];
+	vncRecv(version, 12);
+	version[12] = 0;
+	int major, minor;
+	if (sscanf(version, "RFB %03d.%03d\n", &major, &minor) != 2 || major != 3) {
+		throw MsgException("unknown protocol version");
+	}
+	if (minor < 7) {
+		byte sec[4];
+		put32(sec, 1);
+		vncSend(sec, 4);
+	} else {
+		byte sec[2] = {1, 1};
+		vncSend(sec, 2);
+		byte type;
+		vncRecv(&type, 1);
+		if (type != 1) throw MsgfException("unknown security type %d", type);
+		if (minor >= 8) {
+			byte result[4];
+			put32(result, 0);
+			vncSend(result, 4);
+		}
+	}
+	byte shared;
+	vncRecv(&shared, 1);
+
+	DisplayCharacteristics chr = gDisplay->mClientChar;
+	vncFormatFromChar(gVNCFormat, chr);
+	gVNCBpp = gVNCFormat.bitsPerPixel / 8;
+	gVNCWidth = chr.width;
+	gVNCHeight = chr.height;
+	gVNCHextile = false;
+	gVNCDesktopSize = false;
+	gVNCUpdateRequested = false;
+	gVNCFullUpdate = true;
+	gVNCConvValid = false;
+
+	uint nameLen = gVNCTitle.length();
+	byte init[24];
+	put16(init, chr.width);
+	put16(init+2, chr.height);
+	vncPutFormat(init+4, gVNCFormat);
+	put32(init+20, nameLen);
+	vncSend(init, sizeof init);
+	vncSend(gVNCTitle.contentChar(), nameLen);
+}
+
+static void vncAccept()
+{
+	int fd = accept(gVNCListen, NULL, NULL);
+	if (fd < 0) return;
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+	gVNCClient = fd;
+	// release what the last client left pressed
+	vncPointerEvent(0, gDisplay->mCurMouseX, gDisplay->mCurMouseY);
+	try {
+		vncHandshake();
+		ht_printf("vnc: client connected\n");
+	} catch (const Exception &e) {
+		String res;
+		e.reason(res);
+		ht_printf("vnc: handshake failed: %y\n", &res);
+		close(gVNCClient);
+		gVNCClient = -1;
+	}
+}
+
+/*
+ *	One client at a time, others wait in the backlog. The frames
+ *	are paced here like in the other uis, but instead of showing
+ *	the damage an update is sent once the client has asked for
+ *	one. Until then, the damage accumulates.
+ */
+static void *vncLoop(void *p)
+{
+	uint64 clk_per_ms = sys_get_hiresclk_ticks_per_second() / 1000;
+	uint64 next = 0;
+	bool due = false;
+	while (!gVNCQuit) {
+		uint64 clk = sys_get_hiresclk_ticks();
+		if (clk >= next && gDisplay->frameTick(clk, next)) due = true;
+
+		struct pollfd pfd;
+		pfd.fd = gVNCClient < 0 ? gVNCListen : gVNCClient;
+		pfd.events = POLLIN;
+		clk = sys_get_hiresclk_ticks();
+		int timeout = clk >= next ? 0 : (next - clk) / clk_per_ms;
+		int r = poll(&pfd, 1, timeout);
+		if (r < 0 && errno != EINTR) break;
+		if (gVNCClient < 0) {
+			if (r > 0) vncAccept();
+			continue;
+		}
+		try {
+			if (r > 0) {
+				// everything the client has sent so far
+				do {
+					vncHandleMessage();
+				} while (poll(&pfd, 1, 0) > 0);
+			}
+			if (gVNCUpdateRequested && (gVNCFullUpdate || due)) {
+				vncSendUpdate();
+				due = false;
+			}
+		} catch (const Exception &e) {
+			if (!gVNCQuit) {
+				String res;
+				e.reason(res);
+				ht_printf("vnc: client dropped: %y\n", &res);
+			}
+			close(gVNCClient);
+			gVNCClient = -1;
+			gVNCOutLen = 0;
+		}
+	}
+	return NULL;
+}
+
+static int vncListenTCP(int port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(fd, 1) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return -1;
+	}
+	return fd;
+}
+
+static int vncListenUnix(const char *path)
+{
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof addr.sun_path) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(fd, 1) < 0) {
+		int e = errno;
+		close(fd);
+		errno = e;
+		return -1;
+	}
+	return fd;
+}
+
+void initVNCUI(const char *title, const DisplayCharacteristics &aCharacteristics, int redraw_ms, const KeyboardCharacteristics &keyConfig)
+{
+	gDisplay = new VNCSystemDisplay(aCharacteristics, redraw_ms);
+	gMouse = new HeadlessSystemMouse();
+	gKeyboard = new HeadlessSystemKeyboard();
+	if (!gKeyboard->setKeyConfig(keyConfig)) {
+		ht_printf("no keyConfig, or is empty");
+		exit(1);
+	}
+
+	gVNCTitle = title;
+	gConfig->getConfigString(VNC_KEY_SOCKET, gVNCSocketPath);
+	int port = gConfig->getConfigInt(VNC_KEY_PORT);
+	if (gVNCSocketPath.isEmpty()) {
+		gVNCListen = vncListenTCP(port);
+	} else {
+		gVNCListen = vncListenUnix(gVNCSocketPath.contentChar());
+	}
+	if (gVNCListen < 0) {
+		ht_printf("vnc: can't listen: %s\n", strerror(errno));
+		exit(1);
+	}
+	fcntl(gVNCListen, F_SETFL, fcntl(gVNCListen, F_GETFL) | O_NONBLOCK);
+	if (gVNCSocketPath.isEmpty()) {
+		ht_printf("vnc: listening on localhost:%d\n", port);
+	} else {
+		ht_printf("vnc: listening on %y\n", &gVNCSocketPath);
+	}
+
+	gVNCQuit = false;
+	gVNCClient = -1;
+	if (sys_create_thread(&gVNCThread, 0, vncLoop, NULL)) {
+		ht_printf("can't create vnc server thread!\n");
+		exit(1);
+	}
+	gVNCThreadRunning = true;
+}
+
+void doneVNCUI()
+{
+	if (!gVNCThreadRunning) return;
+	gVNCQuit = true;
+	sys_join_thread(gVNCThread);
+	gVNCThreadRunning = false;
+	if (gVNCClient >= 0) close(gVNCClient);
+	gVNCClient = -1;
+	close(gVNCListen);
+	gVNCListen = -1;
+	if (!gVNCSocketPath.isEmpty()) unlink(gVNCSocketPath.contentChar());
+	free(gVNCOut);
+	gVNCOut = NULL;
+	gVNCOutLen = gVNCOutSize = 0;
+}
+
+#endif
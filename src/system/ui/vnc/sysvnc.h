@@ -0,0 +1,43 @@
+/*
+ *	PearPC
+ *	sysvnc.h
+ *
+ *	Copyright (C) 2005 Sebastian Biallas (sb@biallas.net)
+ *
+ *	This program is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License version 2 as
+ *	published by the Free Software Foundation.
+ *
+ *	This program is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with this program; if not, write to the Free Software
+ *	Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef __SYSVNC_H__
+#define __SYSVNC_H__
+
+#include "system/display.h"
+
+/*
+ *	A display without a window that serves the guest framebuffer
+ *	to one RFB (VNC) client at a time ("ppc_vnc = 1"), used instead
+ *	of initUI()/doneUI():
+ *
+ *	vnc_port	TCP port, only bound to localhost (default 5900)
+ *	vnc_socket	if set, listen on this Unix socket instead
+ *
+ *	Only the damaged parts of the screen are sent, raw or hextile
+ *	encoded. Keyboard and mouse events of the client go to gKeyboard
+ *	and gMouse like those of a window would. The server runs on its
+ *	own thread, so a slow client only delays its own updates.
+ */
+void	vnc_init_config();
+void	initVNCUI(const char *title, const DisplayCharacteristics &aCharacteristics, int redraw_ms, const KeyboardCharacteristics &keyConfig);
+void	doneVNCUI();
+
+#endif
@@ -57,8 +57,7 @@ Win32Display::Win32Display(const char *name, const DisplayCharacteristics &chr,
 	mMenuHeight = 0; //28;
 	gMenuHeight = mMenuHeight;
 
-	gFrameBuffer = (byte*)realloc(gFrameBuffer, mClientChar.width 
-		* mClientChar.height * mClientChar.bytesPerPixel);
+	allocFrameBuffer();
 	winframebuffer = (byte*)realloc(winframebuffer, mWinChar.width 
 		* mWinChar.height * mWinChar.bytesPerPixel);
 	memset(gFrameBuffer, 0, mClientChar.width 
@@ -78,7 +77,7 @@ Win32Display::~Win32Display()
 
 	DeleteCriticalSection(&gDrawCS);
 
-	free(gFrameBuffer);
+	freeFrameBuffer();
 	free(winframebuffer);
 
 	if (mInvisibleCursor) DestroyCursor(mInvisibleCursor);
@@ -125,6 +124,10 @@ void Win32Display::convertCharacteristicsToHost(DisplayCharacteristics &aHostCha
 		aHostChar.bytesPerPixel = (GetDeviceCaps(ddc, BITSPIXEL)+7)/8;
 		aHostChar.scanLineLength = aHostChar.bytesPerPixel * aHostChar.width;
 		ReleaseDC(dw, ddc);
+	} else if (aClientChar.bytesPerPixel == 1) {
+		// the palette is applied when converting
+		aHostChar.bytesPerPixel = 4;
+		aHostChar.scanLineLength = aHostChar.width * 4;
 	}
 	switch (aHostChar.bytesPerPixel) {
 	case 2: 
@@ -189,8 +192,7 @@ bool Win32Display::changeResolution(const DisplayCharacteristics &aClientChar)
 		}
 		ChangeDisplaySettings(&dm, CDS_FULLSCREEN);
 		gMenuHeight = 0;
-		gFrameBuffer = (byte*)realloc(gFrameBuffer, mClientChar.width 
-			* mClientChar.height * mClientChar.bytesPerPixel);
+		allocFrameBuffer();
 		winframebuffer = (byte*)realloc(winframebuffer, mWinChar.width 
 			* mWinChar.height * mWinChar.bytesPerPixel);
 		createBitmap();
@@ -236,8 +238,7 @@ bool Win32Display::changeResolution(const DisplayCharacteristics &aClientChar)
 		mFullscreenChanged = false;
 		mClientChar = aClientChar;
 		convertCharacteristicsToHost(mWinChar, mClientChar);
-		gFrameBuffer = (byte*)realloc(gFrameBuffer, mClientChar.width 
-			* mClientChar.height * mClientChar.bytesPerPixel);
+		allocFrameBuffer();
 		winframebuffer = (byte*)realloc(winframebuffer, mWinChar.width 
 			* mWinChar.height * mWinChar.bytesPerPixel);
 
@@ -344,51 +345,34 @@ void Win32Display::displayShow()
 {
 	if (!isExposed()) return;
 
-	uint firstDamagedLine, lastDamagedLine;
-	// We've got problems with races here because gcard_write1/2/4
-	// might set gDamageAreaFirstAddr, gDamageAreaLastAddr.
-	// We can't use mutexes in gcard for speed reasons. So we'll
-	// try to minimize the probability of loosing the race.
-	if (gDamageAreaFirstAddr > gDamageAreaLastAddr+3) {
-	        return;
-	}
-	uint damageAreaFirstAddr = gDamageAreaFirstAddr;
-	uint damageAreaLastAddr = gDamageAreaLastAddr;
-	healFrameBuffer();
-	// end of race
-
 	// we enter the critical section early, so that
 	// changeResolution can't conflict here
 	EnterCriticalSection(&gDrawCS);
 
-	damageAreaLastAddr += 3;	// this is a hack. For speed reasons we
-					// inaccurately set gDamageAreaLastAddr
-					// to the first (not last) byte accessed
-					// accesses are up to 4 bytes "long".
-
-	firstDamagedLine = damageAreaFirstAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	lastDamagedLine = damageAreaLastAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-	// Overflow may happen, because of the hack used above
-	// and others, that set lastAddr = 0xfffffff0
-	if (lastDamagedLine >= (uint)mClientChar.height) {
-		lastDamagedLine = mClientChar.height-1;
+	DamageRect rects[DAMAGE_RECTS_MAX];
+	int n = takeDamage(mClientChar, rects);
+	if (!n) {
+		LeaveCriticalSection(&gDrawCS);
+		return;
 	}
 
-	sys_convert_display(mClientChar, mWinChar, gFrameBuffer, winframebuffer, firstDamagedLine, lastDamagedLine);
-
 	HDC hdc = GetDC(gHWNDMain);
 
-	SetDIBitsToDevice(
-		hdc,
-		0,
-		gMenuHeight+firstDamagedLine,
-		mWinChar.width,
-		lastDamagedLine-firstDamagedLine+1,  // number of lines to draw
-		0,
-		mWinChar.height-lastDamagedLine-1, // line src-position (0,0 = lower left)
-		0,
-       		mWinChar.height,
-		winframebuffer, &gBitmapInfo, DIB_RGB_COLORS);
+	for (int i=0; i < n; i++) {
+		sys_convert_display_rect(mClientChar, mWinChar, gFrameBuffer, winframebuffer,
+			rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+		SetDIBitsToDevice(
+			hdc,
+			rects[i].x,
+			gMenuHeight+rects[i].y,
+			rects[i].w,
+			rects[i].h,
+			rects[i].x,
+			mWinChar.height-rects[i].y-rects[i].h, // src-position (0,0 = lower left)
+			0,
+			mWinChar.height,
+			winframebuffer, &gBitmapInfo, DIB_RGB_COLORS);
+	}
 
 	ReleaseDC(gHWNDMain, hdc);
 
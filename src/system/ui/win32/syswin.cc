@@ -41,6 +41,7 @@
 
 #undef FASTCALL
 
+#include "system/sysclk.h"
 #include "system/display.h"
 #include "system/keyboard.h"
 #include "system/mouse.h"
@@ -134,7 +135,12 @@ static bool needUpdateDisplay()
 
 static VOID CALLBACK TimerProc(HWND hwnd, UINT uMsg, UINT idEvent, DWORD dwTime)
 {
-	if (needUpdateDisplay()) gDisplay->displayShow();
+	uint64 clk = sys_get_hiresclk_ticks();
+	uint64 next;
+	if (gDisplay->frameTick(clk, next) && needUpdateDisplay()) gDisplay->displayShow();
+	// re-arming replaces the timer
+	UINT ms = MAX(1, (next - clk) * 1000 / sys_get_hiresclk_ticks_per_second());
+	SetTimer(hwnd, idEvent, ms, TimerProc);
 }
 
 static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
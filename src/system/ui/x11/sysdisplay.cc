@@ -28,7 +28,11 @@
 #include <unistd.h>
 #include <cstring>
 
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
 
 #include "system/display.h"
 #include "system/types.h"
@@ -63,11 +67,39 @@ static void findMaskShiftAndSize(int &shift, int &size, uint bitmask)
 	}
 }
 
+static bool gX11ShmError;
+
+static int x11ShmErrorHandler(Display *display, XErrorEvent *event)
+{
+	gX11ShmError = true;
+	return 0;
+}
+
+/*
+ *	With MIT-SHM the display is double buffered: XShmPutImage()
+ *	returns before the server has read the image, so the next
+ *	frame is converted into the other buffer meanwhile. A buffer
+ *	is busy until its ShmCompletion event has arrived.
+ *	Without MIT-SHM a single buffer is sent with XPutImage().
+ */
+struct X11Buffer {
+	XImage *	image;
+	byte *		data;
+	XShmSegmentInfo	shm;
+	bool		busy;
+};
+
 class X11SystemDisplay: public SystemDisplay
 {
-	byte *		mXFrameBuffer;
+	X11Buffer	mBuf[2];
+	int		mBufCount;
+	int		mBackBuf;
+	bool		mUseShm;
+	int		mShmCompletion;
+	// damage of the previous frame, which the back buffer lacks
+	DamageRect	mLastRects[DAMAGE_RECTS_MAX];
+	int		mLastRectCount;
 	GC		mXGC;
-	XImage *	mXImage;
 	XImage *	mMenuXImage;
 	XImage *	mMouseXImage;
 	Colormap	mDefaultColormap;
@@ -106,7 +138,12 @@ public:
 		mMenuHeight = 0;
 		menuData = NULL;
 
-		mXImage = NULL;
+		memset(mBuf, 0, sizeof mBuf);
+		mBufCount = 0;
+		mBackBuf = 0;
+		mLastRectCount = 0;
+		mUseShm = XShmQueryExtension(gX11Display);
+		mShmCompletion = mUseShm ? XShmGetEventBase(gX11Display) + ShmCompletion : -1;
 
 		mClientChar = aClientChar;
 		convertCharacteristicsToHost(mXChar, mClientChar);
@@ -168,10 +205,11 @@ public:
 
 	virtual ~X11SystemDisplay()
 	{
+		destroyBuffers();
 		gX11Display = NULL;
 		free(mTitle);
 		free(mouseData);
-		free(gFrameBuffer);
+		freeFrameBuffer();
 		if (menuData) free(menuData);
 	}
 
@@ -188,14 +226,10 @@ public:
 		fillRGB(0, 0, mClientChar.width, mClientChar.height, MK_RGB(0xff, 0xff, 0xff));
 		drawMenu();
 //		convertDisplayClientToServer(0, mClientChar.height-1);
-		if (mXFrameBuffer) {
-			sys_convert_display(mClientChar, mXChar, gFrameBuffer, mXFrameBuffer, 0, mClientChar.height-1);
-			memmove(menuData, mXFrameBuffer, mXChar.width * mMenuHeight
-				* mXChar.bytesPerPixel);
-		} else {
-			memmove(menuData, gFrameBuffer, mXChar.width * mMenuHeight
-				* mXChar.bytesPerPixel);
-		}
+		byte *buf = mBuf[mBackBuf].data;
+		sys_convert_display(mClientChar, mXChar, gFrameBuffer, buf, 0, mClientChar.height-1);
+		memmove(menuData, buf, mXChar.width * mMenuHeight
+			* mXChar.bytesPerPixel);
 	}
 
 	/*
@@ -203,40 +237,147 @@ public:
 	 */
 	void reinitChar()
 	{
-		gFrameBuffer = (byte*)realloc(gFrameBuffer, mClientChar.width *
-			mClientChar.height * mClientChar.bytesPerPixel);
+		allocFrameBuffer();
 		damageFrameBufferAll();
 
 		mHomeMouseX = mClientChar.width / 2;
 		mHomeMouseY = mClientChar.height / 2;
 
+		destroyBuffers();
+		if (mUseShm) {
+			if (createShmBuffer(mBuf[0]) && createShmBuffer(mBuf[1])) {
+				mBufCount = 2;
+			} else {
+				// e.g. a remote display, don't try again
+				ht_printf("X11: MIT-SHM not usable, using XPutImage\n");
+				destroyBuffers();
+				mUseShm = false;
+			}
+		}
+		if (!mUseShm) {
+			createBuffer(mBuf[0]);
+			mBufCount = 1;
+		}
+		mBackBuf = 0;
+		mLastRectCount = 0;
+	}
+
+	/*
+	 *	must be called with gX11Mutex locked
+	 */
+	void createBuffer(X11Buffer &b)
+	{
 		uint XDepth = mXChar.redSize + mXChar.greenSize + mXChar.blueSize;
 		int screen_num = DefaultScreen(gX11Display);
 
-		if (mXImage) XDestroyImage(mXImage);	// no need to free gXFrameBuffer. XDeleteImage does this.
+		b.data = (byte*)malloc(mXChar.width
+			* mXChar.height * mXChar.bytesPerPixel);
 
-		// Maybe client and (X-)server display characteristics match
-		if (0 && memcmp(&mClientChar, &mXChar, sizeof (mClientChar)) == 0) {
-//			fprintf(stderr, "client and server display characteristics match!!\n");
-			mXFrameBuffer = NULL;
+		b.image = XCreateImage(gX11Display, DefaultVisual(gX11Display, screen_num),
+			XDepth, ZPixmap, 0, (char*)b.data,
+			mXChar.width, mXChar.height,
+			mXChar.bytesPerPixel*8, 0);
+		b.busy = false;
+	}
 
-			mXImage = XCreateImage(gX11Display, DefaultVisual(gX11Display, screen_num),
-				XDepth, ZPixmap, 0, (char*)gFrameBuffer,
-				mXChar.width, mXChar.height,
-				mXChar.bytesPerPixel*8, 0);
-		} else {
-			// Otherwise we need a second framebuffer
-//			fprintf(stderr, "client and server display characteristics DONT match :-(\n");
-			mXFrameBuffer = (byte*)malloc(mXChar.width
-				* mXChar.height * mXChar.bytesPerPixel);
-
-			mXImage = XCreateImage(gX11Display, DefaultVisual(gX11Display, screen_num),
-				XDepth, ZPixmap, 0, (char*)mXFrameBuffer,
-				mXChar.width, mXChar.height,
-				mXChar.bytesPerPixel*8, 0);
+	/*
+	 *	must be called with gX11Mutex locked
+	 */
+	bool createShmBuffer(X11Buffer &b)
+	{
+		uint XDepth = mXChar.redSize + mXChar.greenSize + mXChar.blueSize;
+		int screen_num = DefaultScreen(gX11Display);
+
+		b.busy = false;
+		b.image = XShmCreateImage(gX11Display, DefaultVisual(gX11Display, screen_num),
+			XDepth, ZPixmap, NULL, &b.shm,
+			mXChar.width, mXChar.height);
+		if (!b.image) return false;
+		b.shm.shmid = shmget(IPC_PRIVATE, b.image->bytes_per_line * b.image->height, IPC_CREAT | 0600);
+		if (b.shm.shmid == -1) {
+			XDestroyImage(b.image);
+			b.image = NULL;
+			return false;
+		}
+		b.shm.shmaddr = b.image->data = (char*)shmat(b.shm.shmid, NULL, 0);
+		b.shm.readOnly = False;
+		b.data = (byte*)b.shm.shmaddr;
+
+		// XShmAttach() fails asynchronously, e.g. for remote servers
+		gX11ShmError = false;
+		XErrorHandler old = XSetErrorHandler(x11ShmErrorHandler);
+		bool ok = b.shm.shmaddr != (char*)-1 && XShmAttach(gX11Display, &b.shm);
+		XSync(gX11Display, False);
+		XSetErrorHandler(old);
+		// the segment goes away with the last detach, even if we crash
+		shmctl(b.shm.shmid, IPC_RMID, NULL);
+		if (!ok || gX11ShmError) {
+			if (ok) XShmDetach(gX11Display, &b.shm);
+			if (b.shm.shmaddr != (char*)-1) shmdt(b.shm.shmaddr);
+			b.image->data = NULL;
+			XDestroyImage(b.image);
+			b.image = NULL;
+			b.data = NULL;
+			return false;
+		}
+		return true;
+	}
+
+	/*
+	 *	must be called with gX11Mutex locked
+	 */
+	void destroyBuffers()
+	{
+		bool shm = false;
+		for (int i=0; i<2; i++) shm |= mBuf[i].image && mBuf[i].busy;
+		// the server must be done with the images
+		if (shm) XSync(gX11Display, False);
+		for (int i=0; i<2; i++) {
+			X11Buffer &b = mBuf[i];
+			if (!b.image) continue;
+			if (mUseShm) {
+				XShmDetach(gX11Display, &b.shm);
+				shmdt(b.shm.shmaddr);
+				b.image->data = NULL;
+			}
+			XDestroyImage(b.image);	// frees b.data if not shm
+			b.image = NULL;
+			b.data = NULL;
+			b.busy = false;
+		}
+		mBufCount = 0;
+	}
+
+	/*
+	 *	Waits until the server has read b.
+	 *	must be called with gX11Mutex locked
+	 */
+	void waitBuffer(X11Buffer &b)
+	{
+		XEvent event;
+		// other events stay in the queue for the event loop
+		while (XCheckTypedEvent(gX11Display, mShmCompletion, &event)) {
+			shmCompleted(event);
+		}
+		while (b.busy) {
+			XIfEvent(gX11Display, &event, isShmCompletion, (XPointer)this);
+			shmCompleted(event);
 		}
 	}
 
+	void shmCompleted(XEvent &event)
+	{
+		XShmCompletionEvent *e = (XShmCompletionEvent*)&event;
+		for (int i=0; i < mBufCount; i++) {
+			if (mBuf[i].shm.shmseg == e->shmseg) mBuf[i].busy = false;
+		}
+	}
+
+	static Bool isShmCompletion(Display *display, XEvent *event, XPointer arg)
+	{
+		return event->type == ((X11SystemDisplay*)arg)->mShmCompletion;
+	}
+
 	virtual void convertCharacteristicsToHost(DisplayCharacteristics &aHostChar, const DisplayCharacteristics &aClientChar)
 	{
 		sys_lock_mutex(gX11Mutex);
@@ -412,33 +553,27 @@ public:
 	{
 		if (!isExposed()) return;
 
-		int firstDamagedLine, lastDamagedLine;
-		// We've got problems with races here because gcard_write1/2/4
-		// might set gDamageAreaFirstAddr, gDamageAreaLastAddr.
-		// We can't use mutexes in gcard for speed reasons. So we'll
-		// try to minimize the probability of loosing the race.
-		if (gDamageAreaFirstAddr > gDamageAreaLastAddr+3) {
-		        return;
-		}
-		uint damageAreaFirstAddr = gDamageAreaFirstAddr;
-		uint damageAreaLastAddr = gDamageAreaLastAddr;
-		healFrameBuffer();
-		// end of race
-		damageAreaLastAddr += 3;	// this is a hack. For speed reasons we
-						// inaccurately set gDamageAreaLastAddr
-						// to the first (not last) byte accessed
-						// accesses are up to 4 bytes "long".
-
-		firstDamagedLine = damageAreaFirstAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-		lastDamagedLine = damageAreaLastAddr / (mClientChar.width * mClientChar.bytesPerPixel);
-		// Overflow may happen, because of the hack used above
-		// and others, that set lastAddr = 0xfffffff0 (damageFrameBufferAll())
-		if (lastDamagedLine >= mClientChar.height) {
-			lastDamagedLine = mClientChar.height-1;
-		}
+		DamageRect rects[DAMAGE_RECTS_MAX];
+		int n = takeDamage(mClientChar, rects);
+		if (!n) return;
 
-		if (mXFrameBuffer) {
-			sys_convert_display(mClientChar, mXChar, gFrameBuffer, mXFrameBuffer, firstDamagedLine, lastDamagedLine);
+		sys_lock_mutex(gX11Mutex);
+		X11Buffer &b = mBuf[mBackBuf];
+		if (mUseShm) waitBuffer(b);
+		sys_unlock_mutex(gX11Mutex);
+
+		// the server may still read the other buffer meanwhile
+		for (int i=0; i < n; i++) {
+			sys_convert_display_rect(mClientChar, mXChar, gFrameBuffer, b.data,
+				rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+		}
+		if (mBufCount > 1) {
+			for (int i=0; i < mLastRectCount; i++) {
+				sys_convert_display_rect(mClientChar, mXChar, gFrameBuffer, b.data,
+					mLastRects[i].x, mLastRects[i].y, mLastRects[i].w, mLastRects[i].h);
+			}
+			memcpy(mLastRects, rects, n * sizeof rects[0]);
+			mLastRectCount = n;
 		}
 
 		sys_lock_mutex(gX11Mutex);
@@ -447,13 +582,32 @@ public:
 			mClientChar.width,
 			mMenuHeight);*/
 
-		XPutImage(gX11Display, gX11Window, mXGC, mXImage,
-			0,
-			firstDamagedLine,
-			0,
-			mMenuHeight+firstDamagedLine,
-			mClientChar.width,
-			lastDamagedLine-firstDamagedLine+1);
+		for (int i=0; i < n; i++) {
+			if (mUseShm) {
+				// requests are processed in order, one event is enough
+				XShmPutImage(gX11Display, gX11Window, mXGC, b.image,
+					rects[i].x,
+					rects[i].y,
+					rects[i].x,
+					mMenuHeight+rects[i].y,
+					rects[i].w,
+					rects[i].h,
+					i == n-1);
+			} else {
+				XPutImage(gX11Display, gX11Window, mXGC, b.image,
+					rects[i].x,
+					rects[i].y,
+					rects[i].x,
+					mMenuHeight+rects[i].y,
+					rects[i].w,
+					rects[i].h);
+			}
+		}
+		if (mUseShm) {
+			b.busy = true;
+			XFlush(gX11Display);
+			mBackBuf = (mBackBuf + 1) % mBufCount;
+		}
 
 /*		if (mHWCursorVisible) {
 			XPutImage(gX11Display, gX11Window, mXGC, mMouseXImage, 0, 0, 
@@ -262,8 +262,6 @@ static void *X11eventLoop(void *p)
 {
 	int fd = ConnectionNumber(gX11Display);
 
-	int redraw_interval_msec = gDisplay->mRedraw_ms;
-	uint64 redraw_interval_clk = redraw_interval_msec*sys_get_hiresclk_ticks_per_second()/1000;
 	uint64 clk_per_sec = sys_get_hiresclk_ticks_per_second();
 	uint64 next_redraw_clk = sys_get_hiresclk_ticks();
 
@@ -272,13 +270,7 @@ static void *X11eventLoop(void *p)
 			uint64 clk = sys_get_hiresclk_ticks();
 
 			if (clk >= next_redraw_clk) {
-				uint64 d = clk - next_redraw_clk;
-				// We may have missed some scheduled display
-				// redraws. We'll just ignore this and
-				// keep drawing every 'redraw_interval_msec' msecs
-				d %= redraw_interval_clk;
-				next_redraw_clk = clk + redraw_interval_clk - d;
-				gDisplay->displayShow();
+				if (gDisplay->frameTick(clk, next_redraw_clk)) gDisplay->displayShow();
 			}
 			struct timeval tm;
 			fd_set zerofds;